@@ -0,0 +1,545 @@
+#ifndef ATOMIC_H
+#define ATOMIC_H
+
+#include <Python.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * All types are heap types created from a PyType_Spec by the module's exec
+ * slot. They are immutable where the running Python supports it so that they
+ * behave like the static types they replaced.
+ */
+#ifdef Py_TPFLAGS_IMMUTABLETYPE
+#define ATOMIC_TPFLAGS_DEFAULT (Py_TPFLAGS_DEFAULT | Py_TPFLAGS_IMMUTABLETYPE)
+#else
+#define ATOMIC_TPFLAGS_DEFAULT Py_TPFLAGS_DEFAULT
+#endif
+
+#define ATOMIC_CACHE_LINE 64
+
+/*
+ * Helpers shared by the METH_FASTCALL methods. These replace
+ * PyArg_ParseTuple() on the hot paths: no argument tuple is built and no
+ * format string is interpreted on each call.
+ */
+
+static inline int atomic_check_nargs(const char *name, Py_ssize_t nargs,
+				     Py_ssize_t expected)
+{
+	if (nargs == expected)
+		return 1;
+
+	PyErr_Format(PyExc_TypeError, "%s() takes exactly %zd argument%s (%zd given)",
+		     name, expected, expected == 1 ? "" : "s", nargs);
+	return 0;
+}
+
+static inline int atomic_long_arg(PyObject *arg, long *value)
+{
+	*value = PyLong_AsLong(arg);
+	return *value != -1 || !PyErr_Occurred();
+}
+
+/*
+ * Parse keyword arguments of a METH_FASTCALL | METH_KEYWORDS method. names is
+ * a NULL-terminated list of accepted keywords; values[i] is set to the
+ * argument passed for names[i] and left alone otherwise.
+ */
+static inline int atomic_parse_kwargs(const char *name, PyObject *const *args,
+				      Py_ssize_t nargs, PyObject *kwnames,
+				      const char *const *names,
+				      PyObject **values)
+{
+	Py_ssize_t i;
+	int j;
+
+	if (kwnames == NULL)
+		return 1;
+
+	for (i = 0; i < PyTuple_GET_SIZE(kwnames); i++) {
+		PyObject *key = PyTuple_GET_ITEM(kwnames, i);
+
+		for (j = 0; names[j]; j++) {
+			if (PyUnicode_CompareWithASCIIString(key, names[j]) == 0)
+				break;
+		}
+		if (names[j] == NULL) {
+			PyErr_Format(PyExc_TypeError,
+				     "%s() got an unexpected keyword argument '%U'",
+				     name, key);
+			return 0;
+		}
+		values[j] = args[nargs + i];
+	}
+	return 1;
+}
+
+/*
+ * Memory orders. The Python-visible values are the __ATOMIC_* constants,
+ * exported by the module as atomic.RELAXED, atomic.ACQUIRE, ...
+ *
+ * GCC only honors a memory order that is a compile-time constant and treats
+ * anything else as __ATOMIC_SEQ_CST, so an order chosen at run time has to be
+ * dispatched to one instantiation of the operation per order. BODY is a
+ * function-like macro taking the constant order.
+ */
+#define ATOMIC_ORDER_LOAD	1
+#define ATOMIC_ORDER_STORE	2
+#define ATOMIC_ORDER_RMW	3
+
+static inline int atomic_order_arg(PyObject *arg, int kind, int *order)
+{
+	long value;
+
+	if (arg == NULL)
+		return 1;
+
+	value = PyLong_AsLong(arg);
+	if (value == -1 && PyErr_Occurred())
+		return 0;
+
+	switch (value) {
+	case __ATOMIC_RELAXED:
+	case __ATOMIC_SEQ_CST:
+		break;
+	case __ATOMIC_ACQUIRE:
+		if (kind == ATOMIC_ORDER_STORE)
+			goto invalid;
+		break;
+	case __ATOMIC_RELEASE:
+		if (kind == ATOMIC_ORDER_LOAD)
+			goto invalid;
+		break;
+	case __ATOMIC_ACQ_REL:
+		if (kind != ATOMIC_ORDER_RMW)
+			goto invalid;
+		break;
+	default:
+		goto invalid;
+	}
+
+	*order = value;
+	return 1;
+
+invalid:
+	PyErr_Format(PyExc_ValueError, "invalid memory order %ld for %s", value,
+		     kind == ATOMIC_ORDER_LOAD ? "a load" :
+		     kind == ATOMIC_ORDER_STORE ? "a store" :
+		     "a read-modify-write");
+	return 0;
+}
+
+#define ATOMIC_WITH_LOAD_ORDER(order, BODY)		\
+	do {						\
+		switch (order) {			\
+		case __ATOMIC_RELAXED:			\
+			BODY(__ATOMIC_RELAXED);		\
+			break;				\
+		case __ATOMIC_ACQUIRE:			\
+			BODY(__ATOMIC_ACQUIRE);		\
+			break;				\
+		default:				\
+			BODY(__ATOMIC_SEQ_CST);		\
+			break;				\
+		}					\
+	} while (0)
+
+#define ATOMIC_WITH_STORE_ORDER(order, BODY)		\
+	do {						\
+		switch (order) {			\
+		case __ATOMIC_RELAXED:			\
+			BODY(__ATOMIC_RELAXED);		\
+			break;				\
+		case __ATOMIC_RELEASE:			\
+			BODY(__ATOMIC_RELEASE);		\
+			break;				\
+		default:				\
+			BODY(__ATOMIC_SEQ_CST);		\
+			break;				\
+		}					\
+	} while (0)
+
+#define ATOMIC_WITH_ORDER(order, BODY)			\
+	do {						\
+		switch (order) {			\
+		case __ATOMIC_RELAXED:			\
+			BODY(__ATOMIC_RELAXED);		\
+			break;				\
+		case __ATOMIC_ACQUIRE:			\
+			BODY(__ATOMIC_ACQUIRE);		\
+			break;				\
+		case __ATOMIC_RELEASE:			\
+			BODY(__ATOMIC_RELEASE);		\
+			break;				\
+		case __ATOMIC_ACQ_REL:			\
+			BODY(__ATOMIC_ACQ_REL);		\
+			break;				\
+		default:				\
+			BODY(__ATOMIC_SEQ_CST);		\
+			break;				\
+		}					\
+	} while (0)
+
+/* Parse the order= keyword of a single load, store or read-modify-write. */
+static inline int atomic_parse_order(const char *name, PyObject *const *args,
+				     Py_ssize_t nargs, PyObject *kwnames,
+				     int kind, int *order)
+{
+	static const char *const kwlist[] = {"order", NULL};
+	PyObject *kwargs[] = {NULL};
+
+	if (kwnames == NULL)
+		return 1;
+
+	return atomic_parse_kwargs(name, args, nargs, kwnames, kwlist, kwargs) &&
+	       atomic_order_arg(kwargs[0], kind, order);
+}
+
+/* The C++ default failure order: the success order minus its release part. */
+static inline int atomic_failure_order(int success)
+{
+	return success == __ATOMIC_ACQ_REL ? __ATOMIC_ACQUIRE :
+	       success == __ATOMIC_RELEASE ? __ATOMIC_RELAXED : success;
+}
+
+/*
+ * Parse the order= and failure_order= keywords of a compare-and-exchange. As
+ * in C++, the failure order defaults to the success order minus its release
+ * part, and it may not be stronger than the success order.
+ */
+static inline int atomic_parse_cas_orders(const char *name,
+					  PyObject *const *args,
+					  Py_ssize_t nargs, PyObject *kwnames,
+					  int *success, int *failure)
+{
+	static const char *const kwlist[] = {"order", "failure_order", NULL};
+	PyObject *kwargs[] = {NULL, NULL};
+
+	if (kwnames == NULL)
+		return 1;
+
+	if (!atomic_parse_kwargs(name, args, nargs, kwnames, kwlist, kwargs) ||
+	    !atomic_order_arg(kwargs[0], ATOMIC_ORDER_RMW, success))
+		return 0;
+
+	if (kwargs[1] == NULL) {
+		*failure = atomic_failure_order(*success);
+		return 1;
+	}
+
+	if (!atomic_order_arg(kwargs[1], ATOMIC_ORDER_LOAD, failure))
+		return 0;
+
+	if ((*failure == __ATOMIC_SEQ_CST && *success != __ATOMIC_SEQ_CST) ||
+	    (*failure == __ATOMIC_ACQUIRE && (*success == __ATOMIC_RELAXED ||
+					      *success == __ATOMIC_RELEASE))) {
+		PyErr_SetString(PyExc_ValueError,
+				"failure_order cannot be stronger than order");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Single operations with a run-time order, as expressions. Each expands to a
+ * switch over the valid orders so that every builtin sees a constant.
+ */
+#define ATOMIC_LOAD_N(ptr, order)						\
+	__extension__ ({							\
+		__typeof__(*(ptr)) _atomic_v;					\
+		switch (order) {						\
+		case __ATOMIC_RELAXED:						\
+			_atomic_v = __atomic_load_n(ptr, __ATOMIC_RELAXED);	\
+			break;							\
+		case __ATOMIC_ACQUIRE:						\
+			_atomic_v = __atomic_load_n(ptr, __ATOMIC_ACQUIRE);	\
+			break;							\
+		default:							\
+			_atomic_v = __atomic_load_n(ptr, __ATOMIC_SEQ_CST);	\
+			break;							\
+		}								\
+		_atomic_v;							\
+	})
+
+#define ATOMIC_STORE_N(ptr, value, order)					\
+	do {									\
+		switch (order) {						\
+		case __ATOMIC_RELAXED:						\
+			__atomic_store_n(ptr, value, __ATOMIC_RELAXED);		\
+			break;							\
+		case __ATOMIC_RELEASE:						\
+			__atomic_store_n(ptr, value, __ATOMIC_RELEASE);		\
+			break;							\
+		default:							\
+			__atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);		\
+			break;							\
+		}								\
+	} while (0)
+
+/* fn is one of the __atomic_*_n or __atomic_fetch_* builtins. */
+#define ATOMIC_RMW_N(fn, ptr, value, order)					\
+	__extension__ ({							\
+		__typeof__(*(ptr)) _atomic_v;					\
+		switch (order) {						\
+		case __ATOMIC_RELAXED:						\
+			_atomic_v = fn(ptr, value, __ATOMIC_RELAXED);		\
+			break;							\
+		case __ATOMIC_ACQUIRE:						\
+			_atomic_v = fn(ptr, value, __ATOMIC_ACQUIRE);		\
+			break;							\
+		case __ATOMIC_RELEASE:						\
+			_atomic_v = fn(ptr, value, __ATOMIC_RELEASE);		\
+			break;							\
+		case __ATOMIC_ACQ_REL:						\
+			_atomic_v = fn(ptr, value, __ATOMIC_ACQ_REL);		\
+			break;							\
+		default:							\
+			_atomic_v = fn(ptr, value, __ATOMIC_SEQ_CST);		\
+			break;							\
+		}								\
+		_atomic_v;							\
+	})
+
+#define _ATOMIC_CAS_CASE(ptr, expect, desired, weak, s, f)			\
+	case (s) * 8 + (f):							\
+		_atomic_ok = __atomic_compare_exchange_n(ptr, expect, desired,	\
+							 weak, s, f);		\
+		break;
+
+/* Only the (success, failure) pairs accepted by atomic_parse_cas_orders(). */
+#define ATOMIC_CAS_N(ptr, expect, desired, weak, success, failure)		\
+	__extension__ ({							\
+		int _atomic_ok;							\
+		switch ((success) * 8 + (failure)) {				\
+		_ATOMIC_CAS_CASE(ptr, expect, desired, weak,			\
+				 __ATOMIC_RELAXED, __ATOMIC_RELAXED)		\
+		_ATOMIC_CAS_CASE(ptr, expect, desired, weak,			\
+				 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)		\
+		_ATOMIC_CAS_CASE(ptr, expect, desired, weak,			\
+				 __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)		\
+		_ATOMIC_CAS_CASE(ptr, expect, desired, weak,			\
+				 __ATOMIC_RELEASE, __ATOMIC_RELAXED)		\
+		_ATOMIC_CAS_CASE(ptr, expect, desired, weak,			\
+				 __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)		\
+		_ATOMIC_CAS_CASE(ptr, expect, desired, weak,			\
+				 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)		\
+		_ATOMIC_CAS_CASE(ptr, expect, desired, weak,			\
+				 __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)		\
+		_ATOMIC_CAS_CASE(ptr, expect, desired, weak,			\
+				 __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE)		\
+		default:							\
+			_atomic_ok = __atomic_compare_exchange_n(ptr, expect,	\
+					desired, weak, __ATOMIC_SEQ_CST,	\
+					__ATOMIC_SEQ_CST);			\
+			break;							\
+		}								\
+		_atomic_ok;							\
+	})
+
+/*
+ * Double-width words: two 64-bit halves updated together, for values that
+ * need more than one word to be consistent (a pointer and a version stamp,
+ * a sum and its compensation term). On x86-64 (built with -mcx16) and
+ * AArch64 these are single cmpxchg16b/casp-style instructions; elsewhere
+ * libatomic provides them, possibly with a lock, which
+ * atomic_pair_is_lock_free() reports.
+ */
+typedef struct {
+	uint64_t lo;
+	uint64_t hi;
+} __attribute__((aligned(16))) atomic_pair;
+
+#if defined(__GCC_HAVE_SYNC_COMPARE_AND_SWAP_16) && defined(__SIZEOF_INT128__)
+#define ATOMIC_PAIR_NATIVE 1
+#endif
+
+static inline int atomic_pair_is_lock_free(atomic_pair *ptr)
+{
+#ifdef ATOMIC_PAIR_NATIVE
+	return 1;
+#else
+	return __atomic_is_lock_free(sizeof(*ptr), ptr);
+#endif
+}
+
+/* Sequentially consistent; like __atomic_compare_exchange(), updates *expect. */
+static inline int atomic_pair_cas(atomic_pair *ptr, atomic_pair *expect,
+				  atomic_pair desired)
+{
+#ifdef ATOMIC_PAIR_NATIVE
+	unsigned __int128 old, new, prev;
+
+	memcpy(&old, expect, sizeof(old));
+	memcpy(&new, &desired, sizeof(new));
+	prev = __sync_val_compare_and_swap((unsigned __int128 *)ptr, old, new);
+	if (prev == old)
+		return 1;
+	memcpy(expect, &prev, sizeof(prev));
+	return 0;
+#else
+	return __atomic_compare_exchange(ptr, expect, &desired, 0,
+					 __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/*
+ * Sequentially consistent load of both halves. The native version is a
+ * compare-and-swap that never changes the value, so the pair must be in
+ * writable memory.
+ */
+static inline atomic_pair atomic_pair_load(atomic_pair *ptr)
+{
+	atomic_pair ret;
+#ifdef ATOMIC_PAIR_NATIVE
+	unsigned __int128 word;
+
+	word = __sync_val_compare_and_swap((unsigned __int128 *)ptr, 0, 0);
+	memcpy(&ret, &word, sizeof(ret));
+#else
+	__atomic_load(ptr, &ret, __ATOMIC_SEQ_CST);
+#endif
+	return ret;
+}
+
+/*
+ * Attach to size bytes at offset inside a caller-supplied buffer (an mmap,
+ * multiprocessing.shared_memory, a bytearray, ...), so that atomics can live
+ * in memory shared with other processes. The buffer must be writable and
+ * C-contiguous, and the region must fit and be aligned to align bytes, which
+ * the __atomic builtins need to be single lock-free instructions.
+ *
+ * Returns a new reference to a memoryview that keeps the export alive, and
+ * stores the address of the region in *ptr; returns NULL with an exception
+ * set on failure. The owner releases the export by dropping the memoryview.
+ */
+static inline PyObject *atomic_buffer_attach(const char *name, PyObject *obj,
+					     Py_ssize_t offset,
+					     Py_ssize_t size, size_t align,
+					     void **ptr)
+{
+	PyObject *memory;
+	Py_buffer *view;
+	char *addr;
+
+	if (offset < 0) {
+		PyErr_Format(PyExc_ValueError, "%s: offset must be non-negative",
+			     name);
+		return NULL;
+	}
+
+	memory = PyMemoryView_FromObject(obj);
+	if (memory == NULL)
+		return NULL;
+	view = PyMemoryView_GET_BUFFER(memory);
+
+	if (view->readonly) {
+		PyErr_Format(PyExc_TypeError, "%s: buffer is read-only", name);
+		goto error;
+	}
+	if (!PyBuffer_IsContiguous(view, 'C')) {
+		PyErr_Format(PyExc_ValueError, "%s: buffer is not contiguous",
+			     name);
+		goto error;
+	}
+	if (offset > view->len || size > view->len - offset) {
+		PyErr_Format(PyExc_ValueError,
+			     "%s: %zd bytes at offset %zd do not fit in a "
+			     "buffer of %zd bytes", name, size, offset,
+			     view->len);
+		goto error;
+	}
+
+	addr = (char *)view->buf + offset;
+	if ((uintptr_t)addr % align) {
+		PyErr_Format(PyExc_ValueError,
+			     "%s: address at offset %zd is not %zu-byte aligned",
+			     name, offset, align);
+		goto error;
+	}
+
+	*ptr = addr;
+	return memory;
+
+error:
+	Py_DECREF(memory);
+	return NULL;
+}
+
+/*
+ * Whether long and pointer-sized atomics on naturally aligned objects are
+ * lock free. The answer cannot change while the process runs, so the module's
+ * exec slot asks __atomic_is_lock_free() once and constructors only read
+ * these.
+ */
+extern int atomic_long_is_lock_free;
+extern int atomic_pointer_is_lock_free;
+
+/*
+ * Per-module state, for types that are created by the exec slot but not
+ * added to the module. Reach it from one of the module's own types with
+ * PyType_GetModuleState(), which stays valid for as long as the type does.
+ */
+struct atomic_state {
+	PyTypeObject *ObjectPoolLease_type;
+};
+
+/*
+ * Free list of deallocated objects of one exact type, whose memory its tp_new
+ * reuses instead of going back to the allocator. The GIL is all that
+ * protects it, so on free-threaded builds nothing is ever kept and every
+ * object is allocated normally.
+ */
+#define ATOMIC_FREELIST_SIZE 256
+
+typedef struct {
+	int count;
+	PyObject *objects[ATOMIC_FREELIST_SIZE];
+} atomic_freelist;
+
+/*
+ * Return an object of type with its fields zeroed, as from tp_alloc but not
+ * yet tracked by the GC, or NULL if the list is empty.
+ */
+static inline PyObject *atomic_freelist_pop(atomic_freelist *list,
+					    PyTypeObject *type)
+{
+#ifdef Py_GIL_DISABLED
+	return NULL;
+#else
+	PyObject *op;
+
+	if (list->count == 0)
+		return NULL;
+	op = list->objects[--list->count];
+	memset((char *)op + sizeof(PyObject), 0,
+	       type->tp_basicsize - sizeof(PyObject));
+	return PyObject_Init(op, type);
+#endif
+}
+
+/*
+ * Keep op, which is untracked and has released everything it owned, for
+ * reuse. Returns 0 if the list is full and op must be freed instead.
+ */
+static inline int atomic_freelist_push(atomic_freelist *list, PyObject *op)
+{
+#ifdef Py_GIL_DISABLED
+	return 0;
+#else
+	if (list->count == ATOMIC_FREELIST_SIZE)
+		return 0;
+	list->objects[list->count++] = op;
+	return 1;
+#endif
+}
+
+/* Free everything on the list with the type's tp_free. */
+static inline void atomic_freelist_clear(atomic_freelist *list,
+					 freefunc free)
+{
+	while (list->count)
+		free(list->objects[--list->count]);
+}
+
+#endif /* ATOMIC_H */
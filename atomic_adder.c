@@ -0,0 +1,332 @@
+#include <Python.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "atomic.h"
+#include "atomic_stats.h"
+
+/*
+ * Striped counter in the style of Java's LongAdder. Updates go to a base word
+ * until two threads collide on it; from then on each thread adds into one of
+ * an array of cache-line-sized cells picked by a per-thread probe, and the
+ * number of cells in use doubles (up to the number of CPUs) whenever threads
+ * keep colliding. Reads sum the base and every cell, so they are cheap for
+ * counters that are written constantly and read rarely, but they are not an
+ * atomic snapshot of concurrent updates.
+ */
+
+typedef struct {
+	long value;
+} __attribute__((aligned(ATOMIC_CACHE_LINE))) AdderCell;
+
+typedef struct {
+	PyObject_HEAD
+	long base;
+	AdderCell *cells;
+	unsigned int ncells;
+	ATOMIC_STATS_MEMBER
+} Adder;
+
+static __thread unsigned int Adder_probe;
+
+/* Seeds handed out so far, times the 32-bit golden ratio. */
+static unsigned int Adder_seeder;
+
+#define ADDER_PROBE_INCREMENT 0x9e3779b9U
+
+static unsigned int Adder_thread_probe(void)
+{
+	unsigned int probe = Adder_probe;
+
+	if (probe == 0) {
+		/*
+		 * Successive multiples of an odd constant differ in their low
+		 * bits, so the first threads to contend start on distinct
+		 * cells. Zero means unseeded, so skip it when the counter wraps.
+		 */
+		probe = __atomic_add_fetch(&Adder_seeder, ADDER_PROBE_INCREMENT,
+					   __ATOMIC_RELAXED);
+		if (probe == 0)
+			probe = 1;
+		Adder_probe = probe;
+	}
+	return probe;
+}
+
+/* Move the calling thread to a different cell after a collision. */
+static unsigned int Adder_rehash_probe(unsigned int probe)
+{
+	probe ^= probe << 13;
+	probe ^= probe >> 17;
+	probe ^= probe << 5;
+	Adder_probe = probe;
+	return probe;
+}
+
+static unsigned int Adder_max_cells(void)
+{
+	static unsigned int max_cells;
+	unsigned int n;
+	long ncpus;
+
+	n = __atomic_load_n(&max_cells, __ATOMIC_RELAXED);
+	if (n)
+		return n;
+
+	ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpus < 2)
+		ncpus = 2;
+	if (ncpus > 256)
+		ncpus = 256;
+	for (n = 1; n < (unsigned int)ncpus; n <<= 1)
+		;
+
+	__atomic_store_n(&max_cells, n, __ATOMIC_RELAXED);
+	return n;
+}
+
+static int Adder_init(Adder *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = {"x", NULL};
+	long value = 0;
+
+	if (!atomic_long_is_lock_free) {
+		if (PyErr_WarnEx(PyExc_RuntimeWarning,
+				 "atomic.Adder is not lock free", 1) < 0)
+			return -1;
+	}
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|l", kwlist, &value))
+		return -1;
+
+	__atomic_store(&self->base, &value, __ATOMIC_SEQ_CST);
+
+	return 0;
+}
+
+static void Adder_dealloc(Adder *self)
+{
+	PyTypeObject *tp = Py_TYPE(self);
+
+	free(self->cells);
+	tp->tp_free((PyObject *)self);
+	Py_DECREF(tp);
+}
+
+/*
+ * Allocate the cell array on first contention. The array is sized for the
+ * maximum number of cells up front and never replaced, so readers and writers
+ * never need to worry about it being freed under them; growing only bumps
+ * ncells.
+ */
+static AdderCell *Adder_create_cells(Adder *self)
+{
+	AdderCell *cells, *expect = NULL;
+	unsigned int max_cells = Adder_max_cells();
+
+	if (posix_memalign((void **)&cells, ATOMIC_CACHE_LINE,
+			   max_cells * sizeof(*cells))) {
+		PyErr_NoMemory();
+		return NULL;
+	}
+	memset(cells, 0, max_cells * sizeof(*cells));
+
+	if (!__atomic_compare_exchange_n(&self->cells, &expect, cells, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		free(cells);
+		return expect;
+	}
+
+	__atomic_store_n(&self->ncells, 2, __ATOMIC_RELEASE);
+	return cells;
+}
+
+/*
+ * Try once to add x to *ptr, which holds value. A failure is a collision
+ * and is counted as one; the caller moves elsewhere rather than retrying.
+ */
+static inline int Adder_try_add(Adder *self, long *ptr, long value, long x)
+{
+	ATOMIC_STATS_ONLY(long expected = value;)
+	int ret = __atomic_compare_exchange_n(ptr, &value, value + x, 1,
+					      __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED);
+
+	ATOMIC_STATS_CAS(ATOMIC_STATS_PTR(self), ATOMIC_STATS_ADDER, ret,
+			 value == expected);
+	return ret;
+}
+
+static int Adder_add_value(Adder *self, long x)
+{
+	AdderCell *cells, *cell;
+	unsigned int ncells, probe;
+	long value;
+
+	cells = __atomic_load_n(&self->cells, __ATOMIC_ACQUIRE);
+	if (cells == NULL) {
+		value = __atomic_load_n(&self->base, __ATOMIC_RELAXED);
+		if (Adder_try_add(self, &self->base, value, x))
+			return 0;
+
+		cells = Adder_create_cells(self);
+		if (cells == NULL)
+			return -1;
+	}
+
+	ncells = __atomic_load_n(&self->ncells, __ATOMIC_ACQUIRE);
+	if (ncells == 0) {
+		/* Another thread installed the cells but not ncells yet. */
+		__atomic_fetch_add(&self->base, x, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	probe = Adder_thread_probe();
+	cell = &cells[probe & (ncells - 1)];
+	value = __atomic_load_n(&cell->value, __ATOMIC_RELAXED);
+	if (Adder_try_add(self, &cell->value, value, x))
+		return 0;
+
+	/*
+	 * Collision: spread the cells out if there is room, move to another
+	 * cell and finish with an unconditional add so an update never loops.
+	 */
+	if (ncells < Adder_max_cells())
+		__atomic_compare_exchange_n(&self->ncells, &ncells, ncells * 2,
+					    0, __ATOMIC_RELEASE,
+					    __ATOMIC_RELAXED);
+	ncells = __atomic_load_n(&self->ncells, __ATOMIC_ACQUIRE);
+	probe = Adder_rehash_probe(probe);
+	__atomic_fetch_add(&cells[probe & (ncells - 1)].value, x,
+			   __ATOMIC_RELAXED);
+	return 0;
+}
+
+static PyObject *Adder_add(Adder *self, PyObject *arg)
+{
+	long x;
+
+	if (!atomic_long_arg(arg, &x) || Adder_add_value(self, x) < 0)
+		return NULL;
+
+	Py_RETURN_NONE;
+}
+
+static PyObject *Adder_increment(Adder *self)
+{
+	if (Adder_add_value(self, 1) < 0)
+		return NULL;
+
+	Py_RETURN_NONE;
+}
+
+static long Adder_sum_value(Adder *self)
+{
+	AdderCell *cells;
+	unsigned int i;
+	long sum;
+
+	sum = __atomic_load_n(&self->base, __ATOMIC_RELAXED);
+	cells = __atomic_load_n(&self->cells, __ATOMIC_ACQUIRE);
+	if (cells) {
+		for (i = 0; i < Adder_max_cells(); i++)
+			sum += __atomic_load_n(&cells[i].value,
+					       __ATOMIC_RELAXED);
+	}
+	return sum;
+}
+
+static PyObject *Adder_sum(Adder *self)
+{
+	return PyLong_FromLong(Adder_sum_value(self));
+}
+
+static PyObject *Adder_sum_then_reset(Adder *self)
+{
+	AdderCell *cells;
+	unsigned int i;
+	long sum;
+
+	sum = __atomic_exchange_n(&self->base, 0, __ATOMIC_ACQ_REL);
+	cells = __atomic_load_n(&self->cells, __ATOMIC_ACQUIRE);
+	if (cells) {
+		for (i = 0; i < Adder_max_cells(); i++)
+			sum += __atomic_exchange_n(&cells[i].value, 0,
+						   __ATOMIC_ACQ_REL);
+	}
+	return PyLong_FromLong(sum);
+}
+
+static PyObject *Adder_reset(Adder *self)
+{
+	AdderCell *cells;
+	unsigned int i;
+
+	__atomic_store_n(&self->base, 0, __ATOMIC_RELEASE);
+	cells = __atomic_load_n(&self->cells, __ATOMIC_ACQUIRE);
+	if (cells) {
+		for (i = 0; i < Adder_max_cells(); i++)
+			__atomic_store_n(&cells[i].value, 0, __ATOMIC_RELEASE);
+	}
+	Py_RETURN_NONE;
+}
+
+static PyObject *Adder_repr(Adder *self)
+{
+	return PyUnicode_FromFormat("atomic.Adder(%ld)", Adder_sum_value(self));
+}
+
+ATOMIC_STATS_GETTER(Adder_stats, Adder)
+
+static PyMethodDef Adder_methods[] = {
+	{"add", (PyCFunction)Adder_add, METH_O,
+	 "add(x)\n\n"
+	 "Add the given value to the counter."},
+	{"increment", (PyCFunction)Adder_increment, METH_NOARGS,
+	 "increment()\n\n"
+	 "Add one to the counter."},
+	{"sum", (PyCFunction)Adder_sum, METH_NOARGS,
+	 "sum() -> int\n\n"
+	 "Return the current total. Updates made concurrently with the call may or\n"
+	 "may not be included."},
+	{"sum_then_reset", (PyCFunction)Adder_sum_then_reset, METH_NOARGS,
+	 "sum_then_reset() -> int\n\n"
+	 "Return the current total and reset the counter to zero. Each update is\n"
+	 "counted either in the returned total or in the counter afterwards, never\n"
+	 "lost or counted twice."},
+	{"reset", (PyCFunction)Adder_reset, METH_NOARGS,
+	 "reset()\n\n"
+	 "Reset the counter to zero. Only exact when there are no concurrent\n"
+	 "updates."},
+
+	ATOMIC_STATS_METHOD_DEF(Adder_stats),
+
+	{NULL, NULL, 0, NULL}
+};
+
+#define ATOMIC_ADDER_DOCSTRING \
+	"atomic.Adder(x=0) -> new striped counter\n\n" \
+	"Counter with the range of a C long optimized for many threads updating\n" \
+	"it at once. Uncontended updates go to a single word; once threads\n" \
+	"collide, updates are spread over cache-line-padded cells, one per CPU\n" \
+	"at most, so writers stop fighting over one cache line.\n\n" \
+	"Use it for statistics that are written often and read rarely: sum()\n" \
+	"walks every cell and is not an atomic snapshot. Use atomic.Integer when\n" \
+	"each update needs the resulting value."
+
+static PyType_Slot Adder_slots[] = {
+	{Py_tp_dealloc, Adder_dealloc},
+	{Py_tp_repr, Adder_repr},
+	{Py_tp_doc, ATOMIC_ADDER_DOCSTRING},
+	{Py_tp_methods, Adder_methods},
+	{Py_tp_init, Adder_init},
+	{Py_tp_new, PyType_GenericNew},
+	{0, NULL}
+};
+
+PyType_Spec Adder_spec = {
+	.name = "atomic.Adder",
+	.basicsize = sizeof(Adder),
+	.flags = ATOMIC_TPFLAGS_DEFAULT,
+	.slots = Adder_slots,
+};
@@ -0,0 +1,548 @@
+#include <Python.h>
+#include <stdint.h>
+
+#include "atomic.h"
+#include "atomic_stats.h"
+
+/*
+ * Bits are packed 64 to a word, bit i in words[i / 64] at position i % 64.
+ * Lookups scan words with relaxed loads, and only the final claim of a bit is
+ * an atomic read-modify-write, so scanning past busy words never writes to
+ * (or steals the cache line from) another thread. The unused high bits of
+ * the last word are treated as permanently set and are never written.
+ *
+ * As with IntegerArray, words is either owned (PyMem_Calloc) or, for
+ * Bitset.from_buffer(), points into a caller's buffer whose export the
+ * memoryview buffer holds.
+ */
+typedef struct {
+	PyObject_HEAD
+	Py_ssize_t nbits;
+	Py_ssize_t nwords;
+	uint64_t *words;
+	PyObject *buffer;
+	ATOMIC_STATS_MEMBER
+} Bitset;
+
+#define Bitset_WORD_BITS 64
+#define Bitset_FULL (~(uint64_t)0)
+
+static inline Py_ssize_t Bitset_nwords(Py_ssize_t nbits)
+{
+	return (nbits + Bitset_WORD_BITS - 1) / Bitset_WORD_BITS;
+}
+
+/* The bits of word i past the end of the set. */
+static inline uint64_t Bitset_pad(Bitset *self, Py_ssize_t i)
+{
+	unsigned int used = self->nbits % Bitset_WORD_BITS;
+
+	if (i != self->nwords - 1 || used == 0)
+		return 0;
+	return Bitset_FULL << used;
+}
+
+static inline uint64_t Bitset_load_relaxed(Bitset *self, Py_ssize_t i)
+{
+	return __atomic_load_n(&self->words[i], __ATOMIC_RELAXED) |
+	       Bitset_pad(self, i);
+}
+
+static int Bitset_init(Bitset *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = {"nbits", NULL};
+	Py_ssize_t nbits;
+	uint64_t *words;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "n", kwlist, &nbits))
+		return -1;
+
+	if (nbits < 0) {
+		PyErr_SetString(PyExc_ValueError,
+				"atomic.Bitset size must be non-negative");
+		return -1;
+	}
+
+	if (self->words || self->buffer) {
+		PyErr_SetString(PyExc_RuntimeError,
+				"atomic.Bitset is already initialized");
+		return -1;
+	}
+
+	words = PyMem_Calloc(nbits ? Bitset_nwords(nbits) : 1, sizeof(*words));
+	if (words == NULL) {
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	self->nbits = nbits;
+	self->nwords = Bitset_nwords(nbits);
+	self->words = words;
+
+	return 0;
+}
+
+static void Bitset_dealloc(Bitset *self)
+{
+	PyTypeObject *tp = Py_TYPE(self);
+
+	if (self->buffer)
+		Py_DECREF(self->buffer);
+	else
+		PyMem_Free(self->words);
+	tp->tp_free((PyObject *)self);
+	Py_DECREF(tp);
+}
+
+static PyObject *Bitset_from_buffer(PyTypeObject *type, PyObject *args,
+				    PyObject *kwds)
+{
+	static char *kwlist[] = {"buffer", "nbits", "offset", NULL};
+	PyObject *obj;
+	Py_ssize_t nbits, offset = 0;
+	Bitset *self;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "On|n", kwlist, &obj,
+					 &nbits, &offset))
+		return NULL;
+
+	if (!__atomic_always_lock_free(sizeof(uint64_t), 0)) {
+		PyErr_SetString(PyExc_RuntimeError,
+				"atomic.Bitset cannot live in shared memory: "
+				"64-bit words are not lock free on this "
+				"platform");
+		return NULL;
+	}
+
+	if (nbits < 0) {
+		PyErr_SetString(PyExc_ValueError,
+				"atomic.Bitset size must be non-negative");
+		return NULL;
+	}
+
+	self = (Bitset *)type->tp_alloc(type, 0);
+	if (self == NULL)
+		return NULL;
+
+	self->buffer = atomic_buffer_attach("Bitset.from_buffer", obj, offset,
+					    Bitset_nwords(nbits) *
+					    (Py_ssize_t)sizeof(uint64_t),
+					    __alignof__(uint64_t),
+					    (void **)&self->words);
+	if (self->buffer == NULL) {
+		Py_DECREF(self);
+		return NULL;
+	}
+	self->nbits = nbits;
+	self->nwords = Bitset_nwords(nbits);
+
+	return (PyObject *)self;
+}
+
+/*
+ * Resolve a Python index (negative indices count from the end) to its word
+ * and mask, or return 0 with IndexError set.
+ */
+static int Bitset_bit(Bitset *self, PyObject *arg, Py_ssize_t *word,
+		      uint64_t *mask)
+{
+	Py_ssize_t i;
+
+	i = PyNumber_AsSsize_t(arg, PyExc_IndexError);
+	if (i == -1 && PyErr_Occurred())
+		return 0;
+
+	if (i < 0)
+		i += self->nbits;
+	if (i < 0 || i >= self->nbits) {
+		PyErr_SetString(PyExc_IndexError,
+				"atomic.Bitset index out of range");
+		return 0;
+	}
+
+	*word = i / Bitset_WORD_BITS;
+	*mask = (uint64_t)1 << (i % Bitset_WORD_BITS);
+	return 1;
+}
+
+/* Clamp start and stop like slice bounds; stop may be NULL or None. */
+static int Bitset_range(Bitset *self, PyObject *start_obj, PyObject *stop_obj,
+			Py_ssize_t *start, Py_ssize_t *stop)
+{
+	*start = 0;
+	*stop = self->nbits;
+
+	if (start_obj) {
+		*start = PyNumber_AsSsize_t(start_obj, PyExc_OverflowError);
+		if (*start == -1 && PyErr_Occurred())
+			return 0;
+	}
+	if (stop_obj && stop_obj != Py_None) {
+		*stop = PyNumber_AsSsize_t(stop_obj, PyExc_OverflowError);
+		if (*stop == -1 && PyErr_Occurred())
+			return 0;
+	}
+
+	PySlice_AdjustIndices(self->nbits, start, stop, 1);
+	return 1;
+}
+
+/* The bits of word i inside [start, stop). */
+static inline uint64_t Bitset_range_mask(Py_ssize_t i, Py_ssize_t start,
+					 Py_ssize_t stop)
+{
+	Py_ssize_t lo = i * Bitset_WORD_BITS, hi = lo + Bitset_WORD_BITS;
+	uint64_t mask = Bitset_FULL;
+
+	if (start > lo)
+		mask &= Bitset_FULL << (start - lo);
+	if (stop < hi)
+		mask &= ~(Bitset_FULL << (stop - lo));
+	return mask;
+}
+
+static PyObject *Bitset_repr(Bitset *self)
+{
+	return PyUnicode_FromFormat("atomic.Bitset(%zd)", self->nbits);
+}
+
+static Py_ssize_t Bitset_length(Bitset *self)
+{
+	return self->nbits;
+}
+
+static PyObject *Bitset_item(Bitset *self, Py_ssize_t i)
+{
+	uint64_t word;
+
+	if (i < 0 || i >= self->nbits) {
+		PyErr_SetString(PyExc_IndexError,
+				"atomic.Bitset index out of range");
+		return NULL;
+	}
+
+	word = __atomic_load_n(&self->words[i / Bitset_WORD_BITS],
+			       __ATOMIC_SEQ_CST);
+
+	return PyBool_FromLong((word >> (i % Bitset_WORD_BITS)) & 1);
+}
+
+static PyObject *Bitset_test(Bitset *self, PyObject *const *args,
+			     Py_ssize_t nargs, PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	Py_ssize_t word;
+	uint64_t mask;
+
+	if (!atomic_check_nargs("test", nargs, 1) ||
+	    !atomic_parse_order("test", args, nargs, kwnames, ATOMIC_ORDER_LOAD,
+				&order) ||
+	    !Bitset_bit(self, args[0], &word, &mask))
+		return NULL;
+
+	return PyBool_FromLong(ATOMIC_LOAD_N(&self->words[word], order) & mask);
+}
+
+static PyObject *Bitset_test_and_set(Bitset *self, PyObject *const *args,
+				     Py_ssize_t nargs, PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	Py_ssize_t word;
+	uint64_t mask, old;
+
+	if (!atomic_check_nargs("test_and_set", nargs, 1) ||
+	    !atomic_parse_order("test_and_set", args, nargs, kwnames,
+				ATOMIC_ORDER_RMW, &order) ||
+	    !Bitset_bit(self, args[0], &word, &mask))
+		return NULL;
+
+	old = ATOMIC_RMW_N(__atomic_fetch_or, &self->words[word], mask, order);
+
+	return PyBool_FromLong(old & mask);
+}
+
+static PyObject *Bitset_test_and_clear(Bitset *self, PyObject *const *args,
+				       Py_ssize_t nargs, PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	Py_ssize_t word;
+	uint64_t mask, old;
+
+	if (!atomic_check_nargs("test_and_clear", nargs, 1) ||
+	    !atomic_parse_order("test_and_clear", args, nargs, kwnames,
+				ATOMIC_ORDER_RMW, &order) ||
+	    !Bitset_bit(self, args[0], &word, &mask))
+		return NULL;
+
+	old = ATOMIC_RMW_N(__atomic_fetch_and, &self->words[word], ~mask,
+			   order);
+
+	return PyBool_FromLong(old & mask);
+}
+
+/*
+ * Return the first word in [i, stop) with a clear bit, or stop. Full words
+ * are skipped four at a time by and-ing them together, which keeps the loop
+ * to one well-predicted branch per 256 bits.
+ */
+static Py_ssize_t Bitset_find_free_word(Bitset *self, Py_ssize_t i,
+					Py_ssize_t stop)
+{
+	/* The last word has padding, so leave it to the loop below. */
+	Py_ssize_t fast_stop = stop < self->nwords - 1 ? stop : self->nwords - 1;
+
+	for (; i + 4 <= fast_stop; i += 4) {
+		if ((__atomic_load_n(&self->words[i], __ATOMIC_RELAXED) &
+		     __atomic_load_n(&self->words[i + 1], __ATOMIC_RELAXED) &
+		     __atomic_load_n(&self->words[i + 2], __ATOMIC_RELAXED) &
+		     __atomic_load_n(&self->words[i + 3], __ATOMIC_RELAXED)) !=
+		    Bitset_FULL)
+			break;
+	}
+	for (; i < stop; i++) {
+		if (Bitset_load_relaxed(self, i) != Bitset_FULL)
+			return i;
+	}
+	return stop;
+}
+
+/*
+ * Claim the lowest clear bit of word i that is not in ignore, returning its
+ * index or -1 if there is none. A claim that loses a race retries with the
+ * word as the failed fetch-or saw it; the stats count each claim as a CAS.
+ */
+static Py_ssize_t Bitset_claim_in_word(Bitset *self, Py_ssize_t i,
+				       uint64_t ignore, int order)
+{
+	uint64_t word, bit, old;
+
+	word = Bitset_load_relaxed(self, i) | ignore;
+	while (word != Bitset_FULL) {
+		bit = ~word & (word + 1);
+		old = ATOMIC_RMW_N(__atomic_fetch_or, &self->words[i], bit,
+				   order);
+		ATOMIC_STATS_LOOP_CAS(ATOMIC_STATS_PTR(self),
+				      ATOMIC_STATS_BITSET, !(old & bit), 0);
+		if (!(old & bit))
+			return i * Bitset_WORD_BITS + __builtin_ctzll(bit);
+		word |= old;
+	}
+	return -1;
+}
+
+/* Claim a clear bit in words [i, stop), or return -1. */
+static Py_ssize_t Bitset_claim_in_range(Bitset *self, Py_ssize_t i,
+					Py_ssize_t stop, int order)
+{
+	Py_ssize_t ret;
+
+	for (;;) {
+		i = Bitset_find_free_word(self, i, stop);
+		if (i == stop)
+			return -1;
+		ret = Bitset_claim_in_word(self, i, 0, order);
+		if (ret >= 0)
+			return ret;
+		i++;
+	}
+}
+
+/*
+ * Claim the first clear bit at or after start, wrapping around to the bits
+ * before it, or return -1 if every bit is set.
+ */
+static Py_ssize_t Bitset_acquire(Bitset *self, Py_ssize_t start, int order)
+{
+	Py_ssize_t first = start / Bitset_WORD_BITS, ret;
+	uint64_t before = ((uint64_t)1 << (start % Bitset_WORD_BITS)) - 1;
+
+	ret = Bitset_claim_in_word(self, first, before, order);
+	if (ret < 0)
+		ret = Bitset_claim_in_range(self, first + 1, self->nwords, order);
+	if (ret < 0)
+		ret = Bitset_claim_in_range(self, 0, first, order);
+	if (ret < 0 && before)
+		ret = Bitset_claim_in_word(self, first, ~before, order);
+	return ret;
+}
+
+static PyObject *Bitset_acquire_free(Bitset *self, PyObject *const *args,
+				     Py_ssize_t nargs, PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	Py_ssize_t start = 0;
+
+	if (nargs > 1) {
+		PyErr_Format(PyExc_TypeError,
+			     "acquire_free() takes at most 1 argument (%zd given)",
+			     nargs);
+		return NULL;
+	}
+	if (!atomic_parse_order("acquire_free", args, nargs, kwnames,
+				ATOMIC_ORDER_RMW, &order))
+		return NULL;
+	if (nargs) {
+		start = PyNumber_AsSsize_t(args[0], PyExc_OverflowError);
+		if (start == -1 && PyErr_Occurred())
+			return NULL;
+	}
+
+	if (self->nbits == 0)
+		return PyLong_FromLong(-1);
+
+	/* start is only a hint of where to look first. */
+	start %= self->nbits;
+	if (start < 0)
+		start += self->nbits;
+
+	return PyLong_FromSsize_t(Bitset_acquire(self, start, order));
+}
+
+static PyObject *Bitset_popcount(Bitset *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = {"start", "stop", NULL};
+	PyObject *start_obj = NULL, *stop_obj = NULL;
+	Py_ssize_t start, stop, i, count = 0;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OO:popcount", kwlist,
+					 &start_obj, &stop_obj) ||
+	    !Bitset_range(self, start_obj, stop_obj, &start, &stop))
+		return NULL;
+
+	if (start >= stop)
+		return PyLong_FromLong(0);
+
+	for (i = start / Bitset_WORD_BITS; i <= (stop - 1) / Bitset_WORD_BITS;
+	     i++) {
+		count += __builtin_popcountll(
+			__atomic_load_n(&self->words[i], __ATOMIC_RELAXED) &
+			Bitset_range_mask(i, start, stop));
+	}
+
+	return PyLong_FromSsize_t(count);
+}
+
+/*
+ * Set or clear [start, stop) with one fetch-or or fetch-and per word,
+ * returning how many bits changed. Each word is updated atomically, but the
+ * range as a whole is not.
+ */
+static PyObject *Bitset_update_range(Bitset *self, const char *name,
+				     PyObject *const *args, Py_ssize_t nargs,
+				     PyObject *kwnames, int set)
+{
+	int order = __ATOMIC_SEQ_CST;
+	Py_ssize_t start, stop, i, count = 0;
+	uint64_t mask, old;
+
+	if (!atomic_check_nargs(name, nargs, 2) ||
+	    !atomic_parse_order(name, args, nargs, kwnames, ATOMIC_ORDER_RMW,
+				&order) ||
+	    !Bitset_range(self, args[0], args[1], &start, &stop))
+		return NULL;
+
+	if (start >= stop)
+		return PyLong_FromLong(0);
+
+	for (i = start / Bitset_WORD_BITS; i <= (stop - 1) / Bitset_WORD_BITS;
+	     i++) {
+		mask = Bitset_range_mask(i, start, stop);
+		if (set) {
+			old = ATOMIC_RMW_N(__atomic_fetch_or, &self->words[i],
+					   mask, order);
+			count += __builtin_popcountll(~old & mask);
+		} else {
+			old = ATOMIC_RMW_N(__atomic_fetch_and, &self->words[i],
+					   ~mask, order);
+			count += __builtin_popcountll(old & mask);
+		}
+	}
+
+	return PyLong_FromSsize_t(count);
+}
+
+static PyObject *Bitset_set_range(Bitset *self, PyObject *const *args,
+				  Py_ssize_t nargs, PyObject *kwnames)
+{
+	return Bitset_update_range(self, "set_range", args, nargs, kwnames, 1);
+}
+
+static PyObject *Bitset_clear_range(Bitset *self, PyObject *const *args,
+				    Py_ssize_t nargs, PyObject *kwnames)
+{
+	return Bitset_update_range(self, "clear_range", args, nargs, kwnames, 0);
+}
+
+ATOMIC_STATS_GETTER(Bitset_stats, Bitset)
+
+#define Bitset_METHOD(name) \
+	(PyCFunction)(void (*)(void))Bitset_##name, METH_FASTCALL | METH_KEYWORDS
+
+static PyMethodDef Bitset_methods[] = {
+	{"from_buffer", (PyCFunction)(void (*)(void))Bitset_from_buffer,
+	 METH_CLASS | METH_VARARGS | METH_KEYWORDS,
+	 "from_buffer(buffer, nbits, offset=0) -> Bitset\n\n"
+	 "Return an atomic.Bitset of nbits bits stored as 64-bit words starting\n"
+	 "at the given byte offset in a writable buffer, so that processes\n"
+	 "sharing the memory allocate from the same set. The offset must be\n"
+	 "8-byte aligned, and the buffer must hold (nbits + 63) // 64 words."},
+	{"test", Bitset_METHOD(test),
+	 "test(i, *, order=atomic.SEQ_CST) -> bool\n\n"
+	 "Atomically load and return bit i."},
+	{"test_and_set", Bitset_METHOD(test_and_set),
+	 "test_and_set(i, *, order=atomic.SEQ_CST) -> bool\n\n"
+	 "Atomically set bit i and return its previous value."},
+	{"test_and_clear", Bitset_METHOD(test_and_clear),
+	 "test_and_clear(i, *, order=atomic.SEQ_CST) -> bool\n\n"
+	 "Atomically clear bit i and return its previous value."},
+	{"acquire_free", Bitset_METHOD(acquire_free),
+	 "acquire_free(start=0, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Find a clear bit, set it, and return its index, or return -1 if every\n"
+	 "bit is set. The search begins at start and wraps around, so callers\n"
+	 "can spread allocations by starting at different points. Busy words\n"
+	 "are skipped with plain loads; only the claim itself is atomic."},
+	{"popcount", (PyCFunction)(void (*)(void))Bitset_popcount,
+	 METH_VARARGS | METH_KEYWORDS,
+	 "popcount(start=0, stop=None) -> int\n\n"
+	 "Return the number of set bits in range(start, stop). Each word is\n"
+	 "read atomically, but concurrent updates to other words may or may\n"
+	 "not be counted."},
+	{"set_range", Bitset_METHOD(set_range),
+	 "set_range(start, stop, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Set every bit in range(start, stop) and return how many were clear.\n"
+	 "Each 64-bit word is updated atomically, but the range is not."},
+	{"clear_range", Bitset_METHOD(clear_range),
+	 "clear_range(start, stop, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Clear every bit in range(start, stop) and return how many were set.\n"
+	 "Each 64-bit word is updated atomically, but the range is not."},
+
+	ATOMIC_STATS_METHOD_DEF(Bitset_stats),
+
+	{NULL, NULL, 0, NULL}
+};
+
+#define ATOMIC_BITSET_DOCSTRING \
+	"atomic.Bitset(nbits) -> new atomic bitset of nbits clear bits\n\n" \
+	"Fixed-size set of bits packed into 64-bit words, for lock-free slot\n" \
+	"allocation: acquire_free() claims a clear bit and returns its index,\n" \
+	"and test_and_clear() gives it back. len() is the number of bits, and\n" \
+	"indexing returns a bit as a bool.\n\n" \
+	"Single-bit operations take the order= keyword of the other types."
+
+static PyType_Slot Bitset_slots[] = {
+	{Py_tp_dealloc, Bitset_dealloc},
+	{Py_tp_repr, Bitset_repr},
+	{Py_tp_doc, ATOMIC_BITSET_DOCSTRING},
+	{Py_tp_methods, Bitset_methods},
+	{Py_tp_init, Bitset_init},
+	{Py_sq_length, Bitset_length},
+	{Py_sq_item, Bitset_item},
+	{0, NULL}
+};
+
+PyType_Spec Bitset_spec = {
+	.name = "atomic.Bitset",
+	.basicsize = sizeof(Bitset),
+	.flags = ATOMIC_TPFLAGS_DEFAULT,
+	.slots = Bitset_slots,
+};
@@ -0,0 +1,572 @@
+#include <Python.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <structmember.h>
+
+#include "atomic.h"
+#include "atomic_futex.h"
+#include "atomic_stats.h"
+
+/*
+ * Bounded multi-producer multi-consumer queue after Dmitry Vyukov's design.
+ * Each slot carries a sequence number that tells producers and consumers
+ * whose turn it is: slot i is free for the producer that claims position pos
+ * when its sequence is pos, and holds an item for the consumer of position
+ * pos when its sequence is pos + 1. Claiming a position is one CAS on the
+ * tail or head counter; no operation ever waits for another thread to finish
+ * unless the queue is full or empty.
+ *
+ * The blocking put() and get() park on a futex. A producer that fills a slot
+ * bumps the not_empty event word and wakes a consumer, but only if some
+ * consumer announced itself in get_waiters; consumers do the same for
+ * producers through not_full.
+ */
+
+typedef struct {
+	size_t seq;
+	PyObject *object;
+} BoundedQueueCell;
+
+struct BoundedQueueRing {
+	size_t tail __attribute__((aligned(ATOMIC_CACHE_LINE)));
+	size_t head __attribute__((aligned(ATOMIC_CACHE_LINE)));
+	uint32_t not_empty __attribute__((aligned(ATOMIC_CACHE_LINE)));
+	uint32_t not_full;
+	unsigned int get_waiters;
+	unsigned int put_waiters;
+	BoundedQueueCell cells[] __attribute__((aligned(ATOMIC_CACHE_LINE)));
+};
+
+typedef struct {
+	PyObject_HEAD
+	Py_ssize_t capacity;
+	size_t mask;
+	struct BoundedQueueRing *ring;
+	ATOMIC_STATS_MEMBER
+} BoundedQueue;
+
+static inline BoundedQueueCell *BoundedQueue_cell(BoundedQueue *self,
+						   size_t pos)
+{
+	/* Powers of two avoid the division. */
+	return &self->ring->cells[self->mask ? pos & self->mask :
+				  pos % (size_t)self->capacity];
+}
+
+/* Wake up to count threads parked on event if any are announced. */
+static void BoundedQueue_signal(uint32_t *event, unsigned int *waiters,
+				int count)
+{
+	/*
+	 * Pairs with the increment of the waiter count before a waiter's last
+	 * attempt: either it is counted here or that attempt sees our slot.
+	 */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(waiters, __ATOMIC_RELAXED) == 0)
+		return;
+
+	__atomic_fetch_add(event, 1, __ATOMIC_RELEASE);
+	atomic_futex_wake(event, count, 0);
+}
+
+/* Move *end (the head or the tail) on from *pos, or reload it into *pos. */
+static inline int BoundedQueue_advance(BoundedQueue *self, size_t *end,
+				       size_t *pos)
+{
+	ATOMIC_STATS_ONLY(size_t expected = *pos;)
+	int ret = __atomic_compare_exchange_n(end, pos, *pos + 1, 1,
+					      __ATOMIC_RELAXED,
+					      __ATOMIC_RELAXED);
+
+	ATOMIC_STATS_LOOP_CAS(ATOMIC_STATS_PTR(self), ATOMIC_STATS_BOUNDED_QUEUE,
+			      ret, *pos == expected);
+	return ret;
+}
+
+/* Append object, stealing a reference on success. Returns 0 if full. */
+static int BoundedQueue_push(BoundedQueue *self, PyObject *object)
+{
+	struct BoundedQueueRing *ring = self->ring;
+	BoundedQueueCell *cell;
+	size_t pos, seq;
+	intptr_t diff;
+
+	pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	for (;;) {
+		cell = BoundedQueue_cell(self, pos);
+		seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		diff = (intptr_t)seq - (intptr_t)pos;
+		if (diff == 0) {
+			if (BoundedQueue_advance(self, &ring->tail, &pos))
+				break;
+		} else if (diff < 0) {
+			return 0;
+		} else {
+			/* Another thread already took this cell. */
+			ATOMIC_STATS_RETRY(ATOMIC_STATS_PTR(self),
+					   ATOMIC_STATS_BOUNDED_QUEUE);
+			pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+		}
+	}
+
+	__atomic_store_n(&cell->object, object, __ATOMIC_RELAXED);
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+/* Remove and return the oldest object (a new reference), or NULL if empty. */
+static PyObject *BoundedQueue_pop(BoundedQueue *self)
+{
+	struct BoundedQueueRing *ring = self->ring;
+	BoundedQueueCell *cell;
+	PyObject *object;
+	size_t pos, seq;
+	intptr_t diff;
+
+	pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+	for (;;) {
+		cell = BoundedQueue_cell(self, pos);
+		seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		diff = (intptr_t)seq - (intptr_t)(pos + 1);
+		if (diff == 0) {
+			if (BoundedQueue_advance(self, &ring->head, &pos))
+				break;
+		} else if (diff < 0) {
+			return NULL;
+		} else {
+			/* Another thread already took this cell. */
+			ATOMIC_STATS_RETRY(ATOMIC_STATS_PTR(self),
+					   ATOMIC_STATS_BOUNDED_QUEUE);
+			pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	object = __atomic_load_n(&cell->object, __ATOMIC_RELAXED);
+	__atomic_store_n(&cell->object, NULL, __ATOMIC_RELAXED);
+	__atomic_store_n(&cell->seq, pos + self->capacity, __ATOMIC_RELEASE);
+	return object;
+}
+
+static int BoundedQueue_check_ready(BoundedQueue *self)
+{
+	if (self->ring == NULL) {
+		PyErr_SetString(PyExc_ValueError,
+				"atomic.BoundedQueue is not initialized");
+		return 0;
+	}
+	return 1;
+}
+
+static int BoundedQueue_init(BoundedQueue *self, PyObject *args,
+			     PyObject *kwds)
+{
+	static char *kwlist[] = {"capacity", NULL};
+	struct BoundedQueueRing *ring;
+	Py_ssize_t capacity, i;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "n", kwlist, &capacity))
+		return -1;
+
+	/*
+	 * With a single slot, the sequence number a consumer leaves behind
+	 * would already admit the next producer while the slot is still full.
+	 */
+	if (capacity < 2 ||
+	    (size_t)capacity > (SIZE_MAX - sizeof(*ring)) /
+			       sizeof(BoundedQueueCell)) {
+		PyErr_SetString(PyExc_ValueError,
+				"atomic.BoundedQueue capacity must be at least 2");
+		return -1;
+	}
+
+	if (self->ring) {
+		PyErr_SetString(PyExc_RuntimeError,
+				"atomic.BoundedQueue is already initialized");
+		return -1;
+	}
+
+	if (posix_memalign((void **)&ring, ATOMIC_CACHE_LINE,
+			   sizeof(*ring) + capacity * sizeof(BoundedQueueCell))) {
+		PyErr_NoMemory();
+		return -1;
+	}
+	memset(ring, 0, sizeof(*ring));
+	for (i = 0; i < capacity; i++) {
+		ring->cells[i].seq = i;
+		ring->cells[i].object = NULL;
+	}
+
+	if (!__atomic_is_lock_free(sizeof(ring->tail), &ring->tail)) {
+		if (PyErr_WarnEx(PyExc_RuntimeWarning,
+				 "atomic.BoundedQueue is not lock free",
+				 1) < 0) {
+			free(ring);
+			return -1;
+		}
+	}
+
+	self->capacity = capacity;
+	self->mask = (capacity & (capacity - 1)) == 0 ? capacity - 1 : 0;
+	/* Publish the ring only once it is fully set up. */
+	__atomic_store_n(&self->ring, ring, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+static int BoundedQueue_traverse(BoundedQueue *self, visitproc visit,
+				 void *arg)
+{
+	Py_ssize_t i;
+
+	if (self->ring) {
+		for (i = 0; i < self->capacity; i++)
+			Py_VISIT(__atomic_load_n(&self->ring->cells[i].object,
+						 __ATOMIC_RELAXED));
+	}
+	Py_VISIT(Py_TYPE(self));
+	return 0;
+}
+
+static int BoundedQueue_clear(BoundedQueue *self)
+{
+	PyObject *object;
+
+	if (self->ring) {
+		while ((object = BoundedQueue_pop(self)))
+			Py_DECREF(object);
+	}
+	return 0;
+}
+
+static void BoundedQueue_dealloc(BoundedQueue *self)
+{
+	PyTypeObject *tp = Py_TYPE(self);
+
+	PyObject_GC_UnTrack(self);
+	BoundedQueue_clear(self);
+	free(self->ring);
+	tp->tp_free((PyObject *)self);
+	Py_DECREF(tp);
+}
+
+static PyObject *BoundedQueue_try_put(BoundedQueue *self, PyObject *object)
+{
+	if (!BoundedQueue_check_ready(self))
+		return NULL;
+
+	Py_INCREF(object);
+	if (!BoundedQueue_push(self, object)) {
+		Py_DECREF(object);
+		Py_RETURN_FALSE;
+	}
+
+	BoundedQueue_signal(&self->ring->not_empty, &self->ring->get_waiters,
+			    1);
+	Py_RETURN_TRUE;
+}
+
+static PyObject *BoundedQueue_try_get(BoundedQueue *self,
+				      PyObject *const *args, Py_ssize_t nargs)
+{
+	PyObject *object;
+
+	if (nargs > 1) {
+		PyErr_Format(PyExc_TypeError,
+			     "try_get() takes at most 1 argument (%zd given)",
+			     nargs);
+		return NULL;
+	}
+	if (!BoundedQueue_check_ready(self))
+		return NULL;
+
+	object = BoundedQueue_pop(self);
+	if (object == NULL) {
+		object = nargs ? args[0] : Py_None;
+		Py_INCREF(object);
+		return object;
+	}
+
+	BoundedQueue_signal(&self->ring->not_full, &self->ring->put_waiters, 1);
+	return object;
+}
+
+static PyObject *BoundedQueue_put_many(BoundedQueue *self, PyObject *arg)
+{
+	PyObject *seq, **items;
+	Py_ssize_t n, i;
+
+	if (!BoundedQueue_check_ready(self))
+		return NULL;
+
+	seq = PySequence_Fast(arg, "put_many() argument must be iterable");
+	if (seq == NULL)
+		return NULL;
+	n = PySequence_Fast_GET_SIZE(seq);
+	items = PySequence_Fast_ITEMS(seq);
+
+	for (i = 0; i < n; i++) {
+		Py_INCREF(items[i]);
+		if (!BoundedQueue_push(self, items[i])) {
+			Py_DECREF(items[i]);
+			break;
+		}
+	}
+	Py_DECREF(seq);
+
+	if (i)
+		BoundedQueue_signal(&self->ring->not_empty,
+				    &self->ring->get_waiters,
+				    i > INT_MAX ? INT_MAX : (int)i);
+	return PyLong_FromSsize_t(i);
+}
+
+static PyObject *BoundedQueue_get_many(BoundedQueue *self, PyObject *arg)
+{
+	PyObject *list, *object;
+	Py_ssize_t n, i;
+
+	if (!BoundedQueue_check_ready(self))
+		return NULL;
+
+	n = PyNumber_AsSsize_t(arg, PyExc_OverflowError);
+	if (n == -1 && PyErr_Occurred())
+		return NULL;
+	if (n < 0) {
+		PyErr_SetString(PyExc_ValueError,
+				"get_many() count must be non-negative");
+		return NULL;
+	}
+	if (n > self->capacity)
+		n = self->capacity;
+
+	list = PyList_New(n);
+	if (list == NULL)
+		return NULL;
+
+	for (i = 0; i < n; i++) {
+		object = BoundedQueue_pop(self);
+		if (object == NULL)
+			break;
+		PyList_SET_ITEM(list, i, object);
+	}
+	/* Shrink to the number of items actually taken. */
+	Py_SET_SIZE(list, i);
+
+	if (i)
+		BoundedQueue_signal(&self->ring->not_full,
+				    &self->ring->put_waiters,
+				    i > INT_MAX ? INT_MAX : (int)i);
+	return list;
+}
+
+/*
+ * Park until event moves on from epoch or the deadline passes. Returns 0 to
+ * retry, 1 on timeout, or -1 with an exception set if a signal handler
+ * raised.
+ */
+static int BoundedQueue_park(uint32_t *event, uint32_t epoch,
+			     const struct timespec *deadline)
+{
+	int err;
+
+	Py_BEGIN_ALLOW_THREADS
+	err = atomic_futex_wait(event, epoch, deadline, 0);
+	Py_END_ALLOW_THREADS
+
+	if (err == ETIMEDOUT)
+		return 1;
+	if (err == EINTR && PyErr_CheckSignals() < 0)
+		return -1;
+	return 0;
+}
+
+static PyObject *BoundedQueue_put(BoundedQueue *self, PyObject *const *args,
+				  Py_ssize_t nargs, PyObject *kwnames)
+{
+	static const char *const kwlist[] = {"timeout", NULL};
+	PyObject *kwargs[] = {NULL};
+	struct BoundedQueueRing *ring;
+	struct timespec deadline, *deadlinep;
+	PyObject *object;
+	uint32_t epoch;
+	int ret;
+
+	if (!atomic_check_nargs("put", nargs, 1) ||
+	    !atomic_parse_kwargs("put", args, nargs, kwnames, kwlist, kwargs) ||
+	    !BoundedQueue_check_ready(self) ||
+	    atomic_futex_deadline(kwargs[0], &deadline, &deadlinep) < 0)
+		return NULL;
+	ring = self->ring;
+	object = args[0];
+
+	Py_INCREF(object);
+	while (!BoundedQueue_push(self, object)) {
+		/* Announce ourselves, then try once more before sleeping. */
+		epoch = __atomic_load_n(&ring->not_full, __ATOMIC_ACQUIRE);
+		__atomic_fetch_add(&ring->put_waiters, 1, __ATOMIC_SEQ_CST);
+		if (BoundedQueue_push(self, object)) {
+			__atomic_fetch_sub(&ring->put_waiters, 1,
+					   __ATOMIC_RELAXED);
+			break;
+		}
+		ret = BoundedQueue_park(&ring->not_full, epoch, deadlinep);
+		__atomic_fetch_sub(&ring->put_waiters, 1, __ATOMIC_RELAXED);
+
+		if (ret < 0 ||
+		    (ret > 0 && !BoundedQueue_push(self, object))) {
+			Py_DECREF(object);
+			if (ret < 0)
+				return NULL;
+			Py_RETURN_FALSE;
+		}
+		if (ret > 0)
+			break;
+	}
+
+	BoundedQueue_signal(&ring->not_empty, &ring->get_waiters, 1);
+	Py_RETURN_TRUE;
+}
+
+static PyObject *BoundedQueue_get(BoundedQueue *self, PyObject *const *args,
+				  Py_ssize_t nargs, PyObject *kwnames)
+{
+	static const char *const kwlist[] = {"timeout", "default", NULL};
+	PyObject *kwargs[] = {NULL, NULL};
+	struct BoundedQueueRing *ring;
+	struct timespec deadline, *deadlinep;
+	PyObject *object;
+	uint32_t epoch;
+	int ret;
+
+	if (!atomic_check_nargs("get", nargs, 0) ||
+	    !atomic_parse_kwargs("get", args, nargs, kwnames, kwlist, kwargs) ||
+	    !BoundedQueue_check_ready(self) ||
+	    atomic_futex_deadline(kwargs[0], &deadline, &deadlinep) < 0)
+		return NULL;
+	ring = self->ring;
+
+	while ((object = BoundedQueue_pop(self)) == NULL) {
+		epoch = __atomic_load_n(&ring->not_empty, __ATOMIC_ACQUIRE);
+		__atomic_fetch_add(&ring->get_waiters, 1, __ATOMIC_SEQ_CST);
+		object = BoundedQueue_pop(self);
+		if (object) {
+			__atomic_fetch_sub(&ring->get_waiters, 1,
+					   __ATOMIC_RELAXED);
+			break;
+		}
+		ret = BoundedQueue_park(&ring->not_empty, epoch, deadlinep);
+		__atomic_fetch_sub(&ring->get_waiters, 1, __ATOMIC_RELAXED);
+
+		if (ret < 0)
+			return NULL;
+		if (ret > 0) {
+			object = BoundedQueue_pop(self);
+			if (object)
+				break;
+			object = kwargs[1] ? kwargs[1] : Py_None;
+			Py_INCREF(object);
+			return object;
+		}
+	}
+
+	BoundedQueue_signal(&ring->not_full, &ring->put_waiters, 1);
+	return object;
+}
+
+static Py_ssize_t BoundedQueue_length(BoundedQueue *self)
+{
+	size_t head, tail;
+
+	if (self->ring == NULL)
+		return 0;
+
+	/* Only a snapshot: either end may move right after. */
+	head = __atomic_load_n(&self->ring->head, __ATOMIC_ACQUIRE);
+	tail = __atomic_load_n(&self->ring->tail, __ATOMIC_ACQUIRE);
+	if ((intptr_t)(tail - head) <= 0)
+		return 0;
+	if (tail - head > (size_t)self->capacity)
+		return self->capacity;
+	return tail - head;
+}
+
+static PyObject *BoundedQueue_repr(BoundedQueue *self)
+{
+	return PyUnicode_FromFormat("atomic.BoundedQueue(%zd)", self->capacity);
+}
+
+ATOMIC_STATS_GETTER(BoundedQueue_stats, BoundedQueue)
+
+static PyMethodDef BoundedQueue_methods[] = {
+	{"try_put", (PyCFunction)BoundedQueue_try_put, METH_O,
+	 "try_put(obj) -> bool\n\n"
+	 "Append obj unless the queue is full. Returns whether it was added.\n"
+	 "Never blocks."},
+	{"try_get", (PyCFunction)(void (*)(void))BoundedQueue_try_get,
+	 METH_FASTCALL,
+	 "try_get(default=None) -> object\n\n"
+	 "Remove and return the oldest item, or return default if the queue is\n"
+	 "empty. Never blocks."},
+	{"put_many", (PyCFunction)BoundedQueue_put_many, METH_O,
+	 "put_many(items) -> int\n\n"
+	 "Append items from the given iterable in order until the queue is full.\n"
+	 "Returns how many were added; the rest are left out. Never blocks."},
+	{"get_many", (PyCFunction)BoundedQueue_get_many, METH_O,
+	 "get_many(n) -> list\n\n"
+	 "Remove and return up to n of the oldest items, fewer if the queue runs\n"
+	 "empty. Never blocks."},
+	{"put", (PyCFunction)(void (*)(void))BoundedQueue_put,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "put(obj, *, timeout=None) -> bool\n\n"
+	 "Append obj, blocking without the GIL while the queue is full. Returns\n"
+	 "False if timeout seconds passed without room, True otherwise."},
+	{"get", (PyCFunction)(void (*)(void))BoundedQueue_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get(*, timeout=None, default=None) -> object\n\n"
+	 "Remove and return the oldest item, blocking without the GIL while the\n"
+	 "queue is empty. Returns default if timeout seconds pass first."},
+
+	ATOMIC_STATS_METHOD_DEF(BoundedQueue_stats),
+
+	{NULL, NULL, 0, NULL}
+};
+
+static PyMemberDef BoundedQueue_members[] = {
+	{"capacity", T_PYSSIZET, offsetof(BoundedQueue, capacity), READONLY,
+	 "Maximum number of items the queue holds."},
+	{NULL}
+};
+
+#define ATOMIC_BOUNDED_QUEUE_DOCSTRING \
+	"atomic.BoundedQueue(capacity) -> new empty FIFO queue\n\n" \
+	"Lock-free multi-producer multi-consumer queue of at most capacity\n" \
+	"objects, after Dmitry Vyukov's bounded queue. Adding or removing an\n" \
+	"item is a compare-and-swap on one of two counters in separate cache\n" \
+	"lines plus a store to the slot; no mutex is taken.\n\n" \
+	"try_put(), try_get(), put_many() and get_many() never block. put() and\n" \
+	"get() wait for room or an item on a futex with the GIL released, and\n" \
+	"only pay for waking a thread when one is actually waiting.\n\n" \
+	"len() is a snapshot of the number of items and may be stale as soon as\n" \
+	"it returns."
+
+static PyType_Slot BoundedQueue_slots[] = {
+	{Py_tp_dealloc, BoundedQueue_dealloc},
+	{Py_tp_repr, BoundedQueue_repr},
+	{Py_tp_doc, ATOMIC_BOUNDED_QUEUE_DOCSTRING},
+	{Py_tp_traverse, BoundedQueue_traverse},
+	{Py_tp_clear, BoundedQueue_clear},
+	{Py_tp_methods, BoundedQueue_methods},
+	{Py_tp_members, BoundedQueue_members},
+	{Py_tp_init, BoundedQueue_init},
+	{Py_tp_new, PyType_GenericNew},
+	{Py_sq_length, BoundedQueue_length},
+	{0, NULL}
+};
+
+PyType_Spec BoundedQueue_spec = {
+	.name = "atomic.BoundedQueue",
+	.basicsize = sizeof(BoundedQueue),
+	.flags = ATOMIC_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+	.slots = BoundedQueue_slots,
+};
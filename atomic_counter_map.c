@@ -0,0 +1,714 @@
+#include <Python.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "atomic.h"
+#include "atomic_stats.h"
+#include "atomic_update.h"
+
+/*
+ * Map from hashable keys to atomic counters: an open-addressing table with
+ * linear probing whose slots point to cells. A cell holds the key, its
+ * cached hash and the counter, is created once per key and never moves, so
+ * counting an existing key is a probe and one fetch-add on the cell. A new
+ * key is a compare-and-swap of an empty slot to its cell.
+ *
+ * Growing the table copies cell pointers, never counters, so increments can
+ * keep going during a resize. Once a table is half full, the thread that
+ * noticed links a table four times larger as its next. From then on every
+ * operation on the old table first migrates one chunk of it: it sets
+ * SLOT_FROZEN in each slot of the chunk, which stops new keys from being
+ * added there, and copies the cells to the next table. The thread that
+ * finishes the last chunk makes the next table current. An operation that
+ * meets an empty slot in a table being migrated freezes it before moving on,
+ * so no key is ever added to both tables.
+ *
+ * Comparing keys can run Python code, so nothing is reclaimed while the map
+ * is alive: old tables (which add up to less than the current one) and
+ * cells are freed by the deallocator. Every cell is also on the cells list,
+ * which items() and the garbage collector walk.
+ */
+struct CounterMap_cell {
+	PyObject *key;
+	Py_hash_t hash;
+	long value;
+	struct CounterMap_cell *next;	/* on CounterMap.cells, newest first */
+};
+
+#define SLOT_FROZEN ((uintptr_t)1)
+#define SLOT_CELL(word) ((struct CounterMap_cell *)((word) & ~SLOT_FROZEN))
+
+struct CounterMap_table {
+	Py_ssize_t capacity;		/* a power of two */
+	Py_ssize_t used;		/* slots holding a cell */
+	int filling;			/* still receiving the older table's cells */
+	struct CounterMap_table *next;	/* the table migrated into, if any */
+	struct CounterMap_table *older;	/* on CounterMap.tables */
+	Py_ssize_t next_chunk;
+	Py_ssize_t chunks_done;
+	uintptr_t slots[];
+};
+
+#define COUNTER_MAP_MIN_CAPACITY 16
+#define COUNTER_MAP_CHUNK 64
+
+typedef struct {
+	PyObject_HEAD
+	struct CounterMap_table *table;		/* oldest table still in use */
+	struct CounterMap_table *tables;	/* every table, newest first */
+	struct CounterMap_cell *cells;
+	Py_ssize_t size;
+	ATOMIC_STATS_MEMBER
+} CounterMap;
+
+static struct CounterMap_table *CounterMap_table_new(Py_ssize_t capacity)
+{
+	struct CounterMap_table *table;
+
+	if (capacity > (PY_SSIZE_T_MAX - (Py_ssize_t)sizeof(*table)) /
+		       (Py_ssize_t)sizeof(uintptr_t))
+		return NULL;
+	table = PyMem_RawCalloc(1, sizeof(*table) +
+				   capacity * sizeof(uintptr_t));
+	if (table == NULL)
+		return NULL;
+	table->capacity = capacity;
+	return table;
+}
+
+static PyObject *CounterMap_new(PyTypeObject *type, PyObject *args,
+				PyObject *kwds)
+{
+	struct CounterMap_table *table;
+	CounterMap *self;
+
+	table = CounterMap_table_new(COUNTER_MAP_MIN_CAPACITY);
+	if (table == NULL)
+		return PyErr_NoMemory();
+
+	self = (CounterMap *)type->tp_alloc(type, 0);
+	if (self == NULL) {
+		PyMem_RawFree(table);
+		return NULL;
+	}
+	self->table = self->tables = table;
+	return (PyObject *)self;
+}
+
+/* Start migrating t into a larger table, unless that already started. */
+static int CounterMap_grow(CounterMap *self, struct CounterMap_table *t)
+{
+	struct CounterMap_table *next, *expected = NULL, *head;
+
+	if (__atomic_load_n(&t->next, __ATOMIC_ACQUIRE))
+		return 1;
+
+	next = CounterMap_table_new(t->capacity * 4);
+	if (next == NULL)
+		return 0;
+	next->filling = 1;
+
+	if (!__atomic_compare_exchange_n(&t->next, &expected, next, 0,
+					 __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		PyMem_RawFree(next);
+		return 1;
+	}
+
+	head = __atomic_load_n(&self->tables, __ATOMIC_RELAXED);
+	do {
+		next->older = head;
+	} while (!__atomic_compare_exchange_n(&self->tables, &head, next, 1,
+					      __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+	return 1;
+}
+
+/*
+ * Copy a cell into a table that is filling. Such a table always has room:
+ * it is four times the size of the one being migrated, and new keys stop
+ * going into it at half full until the migration is done.
+ */
+static void CounterMap_place(CounterMap *self, struct CounterMap_table *t,
+			     struct CounterMap_cell *cell)
+{
+	Py_ssize_t mask = t->capacity - 1, i = cell->hash & mask;
+	uintptr_t expected;
+	int ret;
+
+	for (;; i = (i + 1) & mask) {
+		expected = 0;
+		if (__atomic_load_n(&t->slots[i], __ATOMIC_RELAXED))
+			continue;
+		ret = __atomic_compare_exchange_n(&t->slots[i], &expected,
+						  (uintptr_t)cell, 0,
+						  __ATOMIC_RELEASE,
+						  __ATOMIC_RELAXED);
+		ATOMIC_STATS_CAS(ATOMIC_STATS_PTR(self),
+				 ATOMIC_STATS_COUNTER_MAP, ret, 0);
+		if (ret) {
+			__atomic_fetch_add(&t->used, 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+}
+
+/*
+ * Claim the next unmigrated chunk of t, freeze its slots and copy their
+ * cells to t->next. Returns 0 if every chunk was already claimed.
+ */
+static int CounterMap_migrate(CounterMap *self, struct CounterMap_table *t)
+{
+	struct CounterMap_table *next = t->next;
+	Py_ssize_t nchunks, chunk, i, end;
+	uintptr_t word;
+	int ret;
+
+	nchunks = (t->capacity + COUNTER_MAP_CHUNK - 1) / COUNTER_MAP_CHUNK;
+	if (__atomic_load_n(&t->next_chunk, __ATOMIC_RELAXED) >= nchunks)
+		return 0;
+	chunk = __atomic_fetch_add(&t->next_chunk, 1, __ATOMIC_RELAXED);
+	if (chunk >= nchunks)
+		return 0;
+
+	end = (chunk + 1) * COUNTER_MAP_CHUNK;
+	if (end > t->capacity)
+		end = t->capacity;
+	for (i = chunk * COUNTER_MAP_CHUNK; i < end; i++) {
+		word = __atomic_load_n(&t->slots[i], __ATOMIC_ACQUIRE);
+		/* Only empty slots can have been frozen by someone else. */
+		while (!(word & SLOT_FROZEN)) {
+			ret = __atomic_compare_exchange_n(&t->slots[i], &word,
+							  word | SLOT_FROZEN, 0,
+							  __ATOMIC_ACQ_REL,
+							  __ATOMIC_ACQUIRE);
+			ATOMIC_STATS_LOOP_CAS(ATOMIC_STATS_PTR(self),
+					      ATOMIC_STATS_COUNTER_MAP, ret, 0);
+			if (ret)
+				break;
+		}
+		if (SLOT_CELL(word))
+			CounterMap_place(self, next, SLOT_CELL(word));
+	}
+
+	if (__atomic_add_fetch(&t->chunks_done, 1, __ATOMIC_ACQ_REL) ==
+	    nchunks) {
+		__atomic_store_n(&next->filling, 0, __ATOMIC_RELEASE);
+		__atomic_store_n(&self->table, next, __ATOMIC_RELEASE);
+	}
+	return 1;
+}
+
+static struct CounterMap_cell *CounterMap_cell_new(PyObject *key,
+						   Py_hash_t hash)
+{
+	struct CounterMap_cell *cell;
+
+	cell = PyMem_RawMalloc(sizeof(*cell));
+	if (cell == NULL) {
+		PyErr_NoMemory();
+		return NULL;
+	}
+	Py_INCREF(key);
+	cell->key = key;
+	cell->hash = hash;
+	cell->value = 0;
+	return cell;
+}
+
+static void CounterMap_cell_free(struct CounterMap_cell *cell)
+{
+	Py_XDECREF(cell->key);
+	PyMem_RawFree(cell);
+}
+
+/* Publish a cell that was just added to a table. */
+static void CounterMap_link_cell(CounterMap *self, struct CounterMap_cell *cell)
+{
+	struct CounterMap_cell *head;
+
+	head = __atomic_load_n(&self->cells, __ATOMIC_RELAXED);
+	do {
+		cell->next = head;
+	} while (!__atomic_compare_exchange_n(&self->cells, &head, cell, 1,
+					      __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+	__atomic_fetch_add(&self->size, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Return the cell for key, adding one with a count of 0 if create is set.
+ * Returns NULL if key is absent, or NULL with an exception set on error.
+ */
+static struct CounterMap_cell *CounterMap_lookup(CounterMap *self,
+						 PyObject *key, Py_hash_t hash,
+						 int create)
+{
+	struct CounterMap_cell *cell, *new = NULL;
+	struct CounterMap_table *t, *next;
+	struct atomic_backoff backoff;
+	Py_ssize_t mask, i, n, used;
+	uintptr_t word;
+	int ret;
+
+	atomic_backoff_init(&backoff, ATOMIC_DEFAULT_MAX_SPIN);
+restart:
+	t = __atomic_load_n(&self->table, __ATOMIC_ACQUIRE);
+	for (;;) {
+		next = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+		if (next)
+			CounterMap_migrate(self, t);
+
+		mask = t->capacity - 1;
+		for (n = 0, i = hash & mask; n < t->capacity;
+		     n++, i = (i + 1) & mask) {
+			word = __atomic_load_n(&t->slots[i], __ATOMIC_ACQUIRE);
+			if (word == 0) {
+				if (!create)
+					break;
+				next = __atomic_load_n(&t->next,
+						       __ATOMIC_ACQUIRE);
+				if (next) {
+					/* Close the chain before moving on. */
+					ret = __atomic_compare_exchange_n(
+						&t->slots[i], &word,
+						SLOT_FROZEN, 0,
+						__ATOMIC_ACQ_REL,
+						__ATOMIC_ACQUIRE);
+					ATOMIC_STATS_CAS(ATOMIC_STATS_PTR(self),
+							 ATOMIC_STATS_COUNTER_MAP,
+							 ret, 0);
+					if (ret)
+						break;
+				} else if (__atomic_load_n(&t->filling,
+							   __ATOMIC_ACQUIRE) &&
+					   __atomic_load_n(&t->used,
+							   __ATOMIC_RELAXED) * 2 >=
+					   t->capacity) {
+					/* Keep room for the cells still to come. */
+					ATOMIC_STATS_RETRY(ATOMIC_STATS_PTR(self),
+							   ATOMIC_STATS_COUNTER_MAP);
+					atomic_backoff_wait(&backoff);
+					goto restart;
+				} else {
+					if (new == NULL) {
+						new = CounterMap_cell_new(key,
+									  hash);
+						if (new == NULL)
+							return NULL;
+					}
+					ret = __atomic_compare_exchange_n(
+						&t->slots[i], &word,
+						(uintptr_t)new, 0,
+						__ATOMIC_ACQ_REL,
+						__ATOMIC_ACQUIRE);
+					ATOMIC_STATS_LOOP_CAS(ATOMIC_STATS_PTR(self),
+							      ATOMIC_STATS_COUNTER_MAP,
+							      ret, 0);
+					if (ret) {
+						used = __atomic_add_fetch(
+							&t->used, 1,
+							__ATOMIC_RELAXED);
+						CounterMap_link_cell(self, new);
+						if (used * 2 > t->capacity &&
+						    !__atomic_load_n(&t->filling,
+								     __ATOMIC_ACQUIRE) &&
+						    !CounterMap_grow(self, t))
+							PyErr_Clear();
+						return new;
+					}
+				}
+				/* Somebody else filled or froze the slot. */
+			}
+
+			if (word == SLOT_FROZEN)
+				break;
+
+			cell = SLOT_CELL(word);
+			if (cell->hash != hash)
+				continue;
+			if (cell->key != key) {
+				ret = PyObject_RichCompareBool(cell->key, key,
+							       Py_EQ);
+				if (ret < 0)
+					goto error;
+				if (!ret)
+					continue;
+			}
+			if (new)
+				CounterMap_cell_free(new);
+			return cell;
+		}
+
+		/* Not in this table; a newer one may have it. */
+		next = __atomic_load_n(&t->next, __ATOMIC_ACQUIRE);
+		if (next == NULL) {
+			if (!create)
+				return NULL;
+			/* Full, and growing it failed before. */
+			if (!CounterMap_grow(self, t)) {
+				PyErr_NoMemory();
+				goto error;
+			}
+			continue;
+		}
+		t = next;
+	}
+
+error:
+	if (new)
+		CounterMap_cell_free(new);
+	return NULL;
+}
+
+static int CounterMap_add(CounterMap *self, PyObject *key, long n,
+			  long *value)
+{
+	struct CounterMap_cell *cell;
+	Py_hash_t hash;
+
+	hash = PyObject_Hash(key);
+	if (hash == -1)
+		return 0;
+
+	cell = CounterMap_lookup(self, key, hash, 1);
+	if (cell == NULL)
+		return 0;
+
+	*value = __atomic_add_fetch(&cell->value, n, __ATOMIC_SEQ_CST);
+	return 1;
+}
+
+static int CounterMap_init(CounterMap *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = {"iterable", NULL};
+	PyObject *iterable = NULL, *iterator, *item;
+	long value;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &iterable))
+		return -1;
+
+	if (iterable == NULL)
+		return 0;
+
+	iterator = PyObject_GetIter(iterable);
+	if (iterator == NULL)
+		return -1;
+
+	while ((item = PyIter_Next(iterator))) {
+		if (!CounterMap_add(self, item, 1, &value)) {
+			Py_DECREF(item);
+			Py_DECREF(iterator);
+			return -1;
+		}
+		Py_DECREF(item);
+	}
+	Py_DECREF(iterator);
+
+	return PyErr_Occurred() ? -1 : 0;
+}
+
+static int CounterMap_traverse(CounterMap *self, visitproc visit, void *arg)
+{
+	struct CounterMap_cell *cell;
+
+	for (cell = __atomic_load_n(&self->cells, __ATOMIC_ACQUIRE); cell;
+	     cell = cell->next)
+		Py_VISIT(cell->key);
+	Py_VISIT(Py_TYPE(self));
+	return 0;
+}
+
+/* Only called on unreachable maps, which nobody looks keys up in. */
+static int CounterMap_clear(CounterMap *self)
+{
+	struct CounterMap_cell *cell;
+
+	for (cell = self->cells; cell; cell = cell->next)
+		Py_CLEAR(cell->key);
+	return 0;
+}
+
+static void CounterMap_dealloc(CounterMap *self)
+{
+	PyTypeObject *tp = Py_TYPE(self);
+	struct CounterMap_cell *cell, *next_cell;
+	struct CounterMap_table *table, *older;
+
+	PyObject_GC_UnTrack(self);
+	for (cell = self->cells; cell; cell = next_cell) {
+		next_cell = cell->next;
+		CounterMap_cell_free(cell);
+	}
+	for (table = self->tables; table; table = older) {
+		older = table->older;
+		PyMem_RawFree(table);
+	}
+	tp->tp_free((PyObject *)self);
+	Py_DECREF(tp);
+}
+
+static PyObject *CounterMap_increment(CounterMap *self, PyObject *const *args,
+				      Py_ssize_t nargs)
+{
+	long n = 1, value;
+
+	if (nargs < 1 || nargs > 2) {
+		PyErr_Format(PyExc_TypeError,
+			     "increment() takes 1 or 2 arguments (%zd given)",
+			     nargs);
+		return NULL;
+	}
+	if (nargs == 2 && !atomic_long_arg(args[1], &n))
+		return NULL;
+
+	if (!CounterMap_add(self, args[0], n, &value))
+		return NULL;
+	return PyLong_FromLong(value);
+}
+
+/* Look key up without adding it; *value is 0 if absent. */
+static int CounterMap_find(CounterMap *self, PyObject *key, long *value)
+{
+	struct CounterMap_cell *cell;
+	Py_hash_t hash;
+
+	hash = PyObject_Hash(key);
+	if (hash == -1)
+		return -1;
+
+	cell = CounterMap_lookup(self, key, hash, 0);
+	if (cell == NULL) {
+		*value = 0;
+		return PyErr_Occurred() ? -1 : 0;
+	}
+	*value = __atomic_load_n(&cell->value, __ATOMIC_SEQ_CST);
+	return 1;
+}
+
+static PyObject *CounterMap_get(CounterMap *self, PyObject *const *args,
+				Py_ssize_t nargs)
+{
+	long value;
+	int ret;
+
+	if (nargs < 1 || nargs > 2) {
+		PyErr_Format(PyExc_TypeError,
+			     "get() takes 1 or 2 arguments (%zd given)", nargs);
+		return NULL;
+	}
+
+	ret = CounterMap_find(self, args[0], &value);
+	if (ret < 0)
+		return NULL;
+	if (!ret && nargs == 2) {
+		Py_INCREF(args[1]);
+		return args[1];
+	}
+	return PyLong_FromLong(value);
+}
+
+static PyObject *CounterMap_subscript(CounterMap *self, PyObject *key)
+{
+	long value;
+
+	if (CounterMap_find(self, key, &value) < 0)
+		return NULL;
+	return PyLong_FromLong(value);
+}
+
+static int CounterMap_contains(CounterMap *self, PyObject *key)
+{
+	long value;
+
+	return CounterMap_find(self, key, &value);
+}
+
+struct CounterMap_entry {
+	struct CounterMap_cell *cell;
+	long value;
+	Py_ssize_t order;
+};
+
+/*
+ * Read every counter into a new array, in the order the keys were added.
+ * Each count is read atomically, but the counts are not one snapshot.
+ */
+static struct CounterMap_entry *CounterMap_snapshot(CounterMap *self,
+						    Py_ssize_t *count)
+{
+	struct CounterMap_cell *head, *cell;
+	struct CounterMap_entry *entries;
+	Py_ssize_t n = 0, i;
+
+	/* Cells are only ever added in front of head. */
+	head = __atomic_load_n(&self->cells, __ATOMIC_ACQUIRE);
+	for (cell = head; cell; cell = cell->next)
+		n++;
+
+	entries = PyMem_New(struct CounterMap_entry, n ? n : 1);
+	if (entries == NULL) {
+		PyErr_NoMemory();
+		return NULL;
+	}
+
+	for (cell = head, i = n - 1; cell; cell = cell->next, i--) {
+		entries[i].cell = cell;
+		entries[i].value = __atomic_load_n(&cell->value,
+						   __ATOMIC_SEQ_CST);
+		entries[i].order = i;
+	}
+	*count = n;
+	return entries;
+}
+
+static PyObject *CounterMap_entries_list(struct CounterMap_entry *entries,
+					 Py_ssize_t count)
+{
+	PyObject *list, *item;
+	Py_ssize_t i;
+
+	list = PyList_New(count);
+	for (i = 0; list && i < count; i++) {
+		item = Py_BuildValue("(Ol)", entries[i].cell->key,
+				     entries[i].value);
+		if (item == NULL)
+			Py_CLEAR(list);
+		else
+			PyList_SET_ITEM(list, i, item);
+	}
+	PyMem_Free(entries);
+	return list;
+}
+
+static PyObject *CounterMap_items(CounterMap *self,
+				  PyObject *Py_UNUSED(unused))
+{
+	struct CounterMap_entry *entries;
+	Py_ssize_t count;
+
+	entries = CounterMap_snapshot(self, &count);
+	if (entries == NULL)
+		return NULL;
+	return CounterMap_entries_list(entries, count);
+}
+
+/* Highest count first; ties in the order the keys were added. */
+static int CounterMap_entry_compare(const void *a, const void *b)
+{
+	const struct CounterMap_entry *x = a, *y = b;
+
+	if (x->value != y->value)
+		return x->value > y->value ? -1 : 1;
+	return x->order < y->order ? -1 : x->order > y->order;
+}
+
+static PyObject *CounterMap_most_common(CounterMap *self,
+					PyObject *const *args,
+					Py_ssize_t nargs)
+{
+	struct CounterMap_entry *entries;
+	Py_ssize_t count, k = PY_SSIZE_T_MAX;
+
+	if (nargs > 1) {
+		PyErr_Format(PyExc_TypeError,
+			     "most_common() takes at most 1 argument "
+			     "(%zd given)", nargs);
+		return NULL;
+	}
+	if (nargs && args[0] != Py_None) {
+		k = PyNumber_AsSsize_t(args[0], PyExc_OverflowError);
+		if (k == -1 && PyErr_Occurred())
+			return NULL;
+		if (k < 0)
+			k = 0;
+	}
+
+	entries = CounterMap_snapshot(self, &count);
+	if (entries == NULL)
+		return NULL;
+	qsort(entries, count, sizeof(*entries), CounterMap_entry_compare);
+	return CounterMap_entries_list(entries, count < k ? count : k);
+}
+
+static Py_ssize_t CounterMap_length(CounterMap *self)
+{
+	return __atomic_load_n(&self->size, __ATOMIC_RELAXED);
+}
+
+static PyObject *CounterMap_repr(CounterMap *self)
+{
+	PyObject *items, *dict, *ret;
+
+	items = CounterMap_items(self, NULL);
+	if (items == NULL)
+		return NULL;
+	dict = PyDict_New();
+	if (dict == NULL || PyDict_MergeFromSeq2(dict, items, 1) < 0) {
+		Py_XDECREF(dict);
+		Py_DECREF(items);
+		return NULL;
+	}
+	Py_DECREF(items);
+	ret = PyUnicode_FromFormat("atomic.CounterMap(%R)", dict);
+	Py_DECREF(dict);
+	return ret;
+}
+
+ATOMIC_STATS_GETTER(CounterMap_stats, CounterMap)
+
+static PyMethodDef CounterMap_methods[] = {
+	{"increment", (PyCFunction)(void (*)(void))CounterMap_increment,
+	 METH_FASTCALL,
+	 "increment(key, n=1) -> int\n\n"
+	 "Atomically add n to the count of key, adding the key with a count of\n"
+	 "0 first if it is new, and return the resulting count."},
+	{"get", (PyCFunction)(void (*)(void))CounterMap_get, METH_FASTCALL,
+	 "get(key, default=0) -> int\n\n"
+	 "Return the count of key, or default if the key was never added."},
+	{"items", (PyCFunction)CounterMap_items, METH_NOARGS,
+	 "items() -> list\n\n"
+	 "Return a list of (key, count) pairs in the order the keys were added.\n"
+	 "Each count is read atomically, but counts that change while the list\n"
+	 "is built are not one consistent snapshot."},
+	{"most_common", (PyCFunction)(void (*)(void))CounterMap_most_common,
+	 METH_FASTCALL,
+	 "most_common(k=None) -> list\n\n"
+	 "Return the k (key, count) pairs with the highest counts, or all of\n"
+	 "them, highest first, as collections.Counter.most_common() does."},
+
+	ATOMIC_STATS_METHOD_DEF(CounterMap_stats),
+
+	{NULL, NULL, 0, NULL}
+};
+
+#define ATOMIC_COUNTER_MAP_DOCSTRING \
+	"atomic.CounterMap(iterable=()) -> new counter map\n\n" \
+	"Map from hashable keys to counters with the range of a C long, which\n" \
+	"any number of threads can update without a lock, counting each element\n" \
+	"of iterable once. Counting a key already present is a lookup and one\n" \
+	"atomic add; adding a new key is one compare-and-swap, and the table\n" \
+	"grows while other threads keep counting.\n\n" \
+	"map[key] and get() return 0 for missing keys, like\n" \
+	"collections.Counter. Keys are never removed."
+
+static PyType_Slot CounterMap_slots[] = {
+	{Py_tp_dealloc, CounterMap_dealloc},
+	{Py_tp_repr, CounterMap_repr},
+	{Py_tp_doc, ATOMIC_COUNTER_MAP_DOCSTRING},
+	{Py_tp_traverse, CounterMap_traverse},
+	{Py_tp_clear, CounterMap_clear},
+	{Py_tp_methods, CounterMap_methods},
+	{Py_mp_length, CounterMap_length},
+	{Py_mp_subscript, CounterMap_subscript},
+	{Py_sq_contains, CounterMap_contains},
+	{Py_tp_init, CounterMap_init},
+	{Py_tp_new, CounterMap_new},
+	{0, NULL}
+};
+
+PyType_Spec CounterMap_spec = {
+	.name = "atomic.CounterMap",
+	.basicsize = sizeof(CounterMap),
+	.flags = ATOMIC_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+	.slots = CounterMap_slots,
+};
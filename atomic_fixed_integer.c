@@ -0,0 +1,336 @@
+#include <Python.h>
+#include <stdint.h>
+
+#include "atomic.h"
+#include "atomic_stats.h"
+
+/*
+ * atomic.Int8 ... atomic.UInt64 and, where a 16-byte compare-and-swap is
+ * lock free, atomic.Int128: one instantiation of atomic_fixed_integer.h per
+ * type. Arguments are reduced modulo 2**N on the way in, so every operation
+ * wraps around like unsigned C arithmetic whatever the type's signedness;
+ * results are read back in the type's signed or unsigned range.
+ */
+
+static int fixed_mask_arg(PyObject *arg, unsigned long long *value)
+{
+	if (!PyIndex_Check(arg)) {
+		PyErr_Format(PyExc_TypeError,
+			     "'%.200s' object cannot be interpreted as an integer",
+			     Py_TYPE(arg)->tp_name);
+		return 0;
+	}
+	*value = PyLong_AsUnsignedLongLongMask(arg);
+	return *value != (unsigned long long)-1 || !PyErr_Occurred();
+}
+
+#define FIXED_ARG(ctype)							\
+static inline int fixed_##ctype##_arg(PyObject *arg, ctype *value)		\
+{										\
+	unsigned long long v;							\
+										\
+	if (!fixed_mask_arg(arg, &v))						\
+		return 0;							\
+	*value = (ctype)v;							\
+	return 1;								\
+}
+
+FIXED_ARG(int8_t)
+FIXED_ARG(int16_t)
+FIXED_ARG(int32_t)
+FIXED_ARG(int64_t)
+FIXED_ARG(uint8_t)
+FIXED_ARG(uint16_t)
+FIXED_ARG(uint32_t)
+FIXED_ARG(uint64_t)
+
+/* Widths the __atomic builtins handle directly; they wrap on overflow. */
+#define FIXED_NATIVE_LOAD(ptr, order) ATOMIC_LOAD_N(ptr, order)
+#define FIXED_NATIVE_STORE(ptr, value, order, stats) \
+	ATOMIC_STORE_N(ptr, value, order)
+#define FIXED_NATIVE_EXCHANGE(ptr, value, order, stats) \
+	ATOMIC_RMW_N(__atomic_exchange_n, ptr, value, order)
+#define FIXED_NATIVE_CAS(ptr, expect, desired, weak, success, failure) \
+	ATOMIC_CAS_N(ptr, expect, desired, weak, success, failure)
+#define FIXED_NATIVE_FETCH_OP(op, ptr, value, order, stats) \
+	ATOMIC_RMW_N(__atomic_fetch_##op, ptr, value, order)
+#define FIXED_NATIVE_OP_FETCH(op, ptr, value, order, stats) \
+	ATOMIC_RMW_N(__atomic_##op##_fetch, ptr, value, order)
+#define FIXED_NATIVE_IS_LOCK_FREE(ptr) \
+	__atomic_always_lock_free(sizeof(*(ptr)), 0)
+
+#define FIXED_NAME Int8
+#define FIXED_NAME_STR "Int8"
+#define FIXED_STATS ATOMIC_STATS_INT8
+#define FIXED_TYPE int8_t
+#define FIXED_DESCRIPTION "signed 8-bit"
+#define FIXED_FROM_PY fixed_int8_t_arg
+#define FIXED_TO_PY PyLong_FromLong
+#define FIXED_OPS FIXED_NATIVE
+#include "atomic_fixed_integer.h"
+
+#define FIXED_NAME Int16
+#define FIXED_NAME_STR "Int16"
+#define FIXED_STATS ATOMIC_STATS_INT16
+#define FIXED_TYPE int16_t
+#define FIXED_DESCRIPTION "signed 16-bit"
+#define FIXED_FROM_PY fixed_int16_t_arg
+#define FIXED_TO_PY PyLong_FromLong
+#define FIXED_OPS FIXED_NATIVE
+#include "atomic_fixed_integer.h"
+
+#define FIXED_NAME Int32
+#define FIXED_NAME_STR "Int32"
+#define FIXED_STATS ATOMIC_STATS_INT32
+#define FIXED_TYPE int32_t
+#define FIXED_DESCRIPTION "signed 32-bit"
+#define FIXED_FROM_PY fixed_int32_t_arg
+#define FIXED_TO_PY PyLong_FromLong
+#define FIXED_OPS FIXED_NATIVE
+#include "atomic_fixed_integer.h"
+
+#define FIXED_NAME Int64
+#define FIXED_NAME_STR "Int64"
+#define FIXED_STATS ATOMIC_STATS_INT64
+#define FIXED_TYPE int64_t
+#define FIXED_DESCRIPTION "signed 64-bit"
+#define FIXED_FROM_PY fixed_int64_t_arg
+#define FIXED_TO_PY PyLong_FromLongLong
+#define FIXED_OPS FIXED_NATIVE
+#include "atomic_fixed_integer.h"
+
+#define FIXED_NAME UInt8
+#define FIXED_NAME_STR "UInt8"
+#define FIXED_STATS ATOMIC_STATS_UINT8
+#define FIXED_TYPE uint8_t
+#define FIXED_DESCRIPTION "unsigned 8-bit"
+#define FIXED_FROM_PY fixed_uint8_t_arg
+#define FIXED_TO_PY PyLong_FromUnsignedLong
+#define FIXED_OPS FIXED_NATIVE
+#include "atomic_fixed_integer.h"
+
+#define FIXED_NAME UInt16
+#define FIXED_NAME_STR "UInt16"
+#define FIXED_STATS ATOMIC_STATS_UINT16
+#define FIXED_TYPE uint16_t
+#define FIXED_DESCRIPTION "unsigned 16-bit"
+#define FIXED_FROM_PY fixed_uint16_t_arg
+#define FIXED_TO_PY PyLong_FromUnsignedLong
+#define FIXED_OPS FIXED_NATIVE
+#include "atomic_fixed_integer.h"
+
+#define FIXED_NAME UInt32
+#define FIXED_NAME_STR "UInt32"
+#define FIXED_STATS ATOMIC_STATS_UINT32
+#define FIXED_TYPE uint32_t
+#define FIXED_DESCRIPTION "unsigned 32-bit"
+#define FIXED_FROM_PY fixed_uint32_t_arg
+#define FIXED_TO_PY PyLong_FromUnsignedLong
+#define FIXED_OPS FIXED_NATIVE
+#include "atomic_fixed_integer.h"
+
+#define FIXED_NAME UInt64
+#define FIXED_NAME_STR "UInt64"
+#define FIXED_STATS ATOMIC_STATS_UINT64
+#define FIXED_TYPE uint64_t
+#define FIXED_DESCRIPTION "unsigned 64-bit"
+#define FIXED_FROM_PY fixed_uint64_t_arg
+#define FIXED_TO_PY PyLong_FromUnsignedLongLong
+#define FIXED_OPS FIXED_NATIVE
+#include "atomic_fixed_integer.h"
+
+#ifdef ATOMIC_PAIR_NATIVE
+/*
+ * 128 bits: the __atomic builtins would go through libatomic, so every
+ * operation is a cmpxchg16b-style __sync compare-and-swap, sequentially
+ * consistent whatever order was asked for. Arithmetic is done unsigned to
+ * keep overflow defined.
+ */
+typedef __int128 fixed_int128 __attribute__((aligned(16)));
+
+static int fixed_int128_arg(PyObject *arg, fixed_int128 *value)
+{
+	unsigned long long lo, hi;
+	PyObject *index, *bits, *shifted;
+
+	if (!fixed_mask_arg(arg, &lo))
+		return 0;
+
+	index = PyNumber_Index(arg);
+	if (index == NULL)
+		return 0;
+	bits = PyLong_FromLong(64);
+	if (bits == NULL) {
+		Py_DECREF(index);
+		return 0;
+	}
+	shifted = PyNumber_Rshift(index, bits);
+	Py_DECREF(bits);
+	Py_DECREF(index);
+	if (shifted == NULL)
+		return 0;
+	hi = PyLong_AsUnsignedLongLongMask(shifted);
+	Py_DECREF(shifted);
+	if (hi == (unsigned long long)-1 && PyErr_Occurred())
+		return 0;
+
+	*value = (fixed_int128)(((unsigned __int128)hi << 64) | lo);
+	return 1;
+}
+
+static PyObject *fixed_int128_to_py(fixed_int128 value)
+{
+	PyObject *hi, *lo, *bits, *shifted, *ret;
+
+	if (value == (int64_t)value)
+		return PyLong_FromLongLong((long long)value);
+
+	/* value == hi * 2**64 + lo, with hi signed and lo unsigned. */
+	hi = PyLong_FromLongLong((long long)(value >> 64));
+	if (hi == NULL)
+		return NULL;
+	bits = PyLong_FromLong(64);
+	if (bits == NULL) {
+		Py_DECREF(hi);
+		return NULL;
+	}
+	shifted = PyNumber_Lshift(hi, bits);
+	Py_DECREF(bits);
+	Py_DECREF(hi);
+	if (shifted == NULL)
+		return NULL;
+	lo = PyLong_FromUnsignedLongLong((unsigned long long)value);
+	if (lo == NULL) {
+		Py_DECREF(shifted);
+		return NULL;
+	}
+	ret = PyNumber_Add(shifted, lo);
+	Py_DECREF(shifted);
+	Py_DECREF(lo);
+	return ret;
+}
+
+static inline fixed_int128 fixed_int128_cas_val(fixed_int128 *ptr,
+						fixed_int128 expect,
+						fixed_int128 desired)
+{
+	return __sync_val_compare_and_swap(ptr, expect, desired);
+}
+
+static inline fixed_int128 fixed_int128_load(fixed_int128 *ptr)
+{
+	/* A compare-and-swap that never changes the value. */
+	return fixed_int128_cas_val(ptr, 0, 0);
+}
+
+static inline int fixed_int128_cas(fixed_int128 *ptr, fixed_int128 *expect,
+				   fixed_int128 desired)
+{
+	fixed_int128 prev;
+
+	prev = fixed_int128_cas_val(ptr, *expect, desired);
+	if (prev == *expect)
+		return 1;
+	*expect = prev;
+	return 0;
+}
+
+#define fixed_int128_apply_add(a, b) ((a) + (b))
+#define fixed_int128_apply_sub(a, b) ((a) - (b))
+#define fixed_int128_apply_and(a, b) ((a) & (b))
+#define fixed_int128_apply_xor(a, b) ((a) ^ (b))
+#define fixed_int128_apply_or(a, b) ((a) | (b))
+#define fixed_int128_apply_nand(a, b) (~((a) & (b)))
+
+/* fixed_int128_cas() as one step of an update loop. */
+static inline int fixed_int128_cas_loop(fixed_int128 *ptr,
+					fixed_int128 *expect,
+					fixed_int128 desired,
+					atomic_stats *stats)
+{
+	int ret = fixed_int128_cas(ptr, expect, desired);
+
+	ATOMIC_STATS_LOOP_CAS(stats, ATOMIC_STATS_INT128, ret, 0);
+	return ret;
+}
+
+/* Returns the old value in *old and the new one. */
+#define FIXED_INT128_RMW(op)							\
+static inline fixed_int128 fixed_int128_##op(fixed_int128 *ptr,		\
+					     fixed_int128 value,		\
+					     fixed_int128 *old,			\
+					     atomic_stats *stats)		\
+{										\
+	fixed_int128 expect = fixed_int128_load(ptr), desired;			\
+										\
+	do {									\
+		desired = (fixed_int128)fixed_int128_apply_##op(		\
+			(unsigned __int128)expect, (unsigned __int128)value);	\
+	} while (!fixed_int128_cas_loop(ptr, &expect, desired, stats));	\
+	*old = expect;								\
+	return desired;								\
+}
+
+FIXED_INT128_RMW(add)
+FIXED_INT128_RMW(sub)
+FIXED_INT128_RMW(and)
+FIXED_INT128_RMW(xor)
+FIXED_INT128_RMW(or)
+FIXED_INT128_RMW(nand)
+
+static inline fixed_int128 fixed_int128_exchange(fixed_int128 *ptr,
+						 fixed_int128 value,
+						 atomic_stats *stats)
+{
+	fixed_int128 expect = fixed_int128_load(ptr);
+
+	while (!fixed_int128_cas_loop(ptr, &expect, value, stats))
+		;
+	return expect;
+}
+
+#define FIXED_INT128_LOAD(ptr, order) fixed_int128_load(ptr)
+#define FIXED_INT128_STORE(ptr, value, order, stats) \
+	((void)fixed_int128_exchange(ptr, value, stats))
+#define FIXED_INT128_EXCHANGE(ptr, value, order, stats) \
+	fixed_int128_exchange(ptr, value, stats)
+#define FIXED_INT128_CAS(ptr, expect, desired, weak, success, failure) \
+	fixed_int128_cas(ptr, expect, desired)
+#define FIXED_INT128_FETCH_OP(op, ptr, value, order, stats)			\
+	__extension__ ({							\
+		fixed_int128 _fixed_old;					\
+		fixed_int128_##op(ptr, value, &_fixed_old, stats);		\
+		_fixed_old;							\
+	})
+#define FIXED_INT128_OP_FETCH(op, ptr, value, order, stats)			\
+	__extension__ ({							\
+		fixed_int128 _fixed_old;					\
+		fixed_int128_##op(ptr, value, &_fixed_old, stats);		\
+	})
+#define FIXED_INT128_IS_LOCK_FREE(ptr) 1
+
+#define FIXED_NAME Int128
+#define FIXED_NAME_STR "Int128"
+#define FIXED_STATS ATOMIC_STATS_INT128
+#define FIXED_TYPE fixed_int128
+#define FIXED_DESCRIPTION "signed 128-bit"
+#define FIXED_FROM_PY fixed_int128_arg
+#define FIXED_TO_PY fixed_int128_to_py
+#define FIXED_OPS FIXED_INT128
+#include "atomic_fixed_integer.h"
+#endif /* ATOMIC_PAIR_NATIVE */
+
+PyType_Spec *atomic_fixed_integer_specs[] = {
+	&Int8_spec,
+	&Int16_spec,
+	&Int32_spec,
+	&Int64_spec,
+	&UInt8_spec,
+	&UInt16_spec,
+	&UInt32_spec,
+	&UInt64_spec,
+#ifdef ATOMIC_PAIR_NATIVE
+	&Int128_spec,
+#endif
+	NULL
+};
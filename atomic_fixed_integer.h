@@ -0,0 +1,482 @@
+/*
+ * Template for the fixed-width integer types (atomic.Int8, atomic.UInt32,
+ * ...). atomic_fixed_integer.c includes this file once per type after
+ * defining:
+ *
+ *   FIXED_NAME		type name token, e.g. Int8
+ *   FIXED_NAME_STR	the same as a string, e.g. "Int8"
+ *   FIXED_TYPE		the C type of the value, e.g. int8_t
+ *   FIXED_DESCRIPTION	e.g. "signed 8-bit"
+ *   FIXED_FROM_PY(obj, ptr)	reduce a Python int modulo 2**N into *ptr;
+ *				returns 0 with an exception set on failure
+ *   FIXED_TO_PY(value)	convert a value to a Python int
+ *   FIXED_STATS		the type's counter slot in atomic_stats.h, e.g.
+ *			ATOMIC_STATS_INT8
+ *   FIXED_OPS		prefix of the atomic operation macros: PREFIX_LOAD(ptr,
+ *			order), _STORE(ptr, value, order, stats),
+ *			_EXCHANGE(ptr, value, order, stats), _CAS(ptr,
+ *			expect, desired, weak, success, failure),
+ *			_FETCH_OP(op, ptr, value, order, stats),
+ *			_OP_FETCH(op, ptr, value, order, stats) and
+ *			_IS_LOCK_FREE(ptr), with op one of add, sub, and, xor,
+ *			or and nand, and stats the object's atomic_stats for
+ *			operations that loop on a CAS to count retries in
+ *
+ * and undefines them all again at the end. The generated code mirrors
+ * atomic.Integer, including from_buffer() and the number protocol; the
+ * type's PyType_Spec is FIXED_NAME_spec.
+ */
+
+#define FIXED_CAT_(a, b) a##b
+#define FIXED_CAT(a, b) FIXED_CAT_(a, b)
+#define FIXED_FN(suffix) FIXED_CAT(FIXED_NAME, _##suffix)
+#define FIXED_SELF FIXED_NAME
+
+#define FIXED_LOAD FIXED_CAT(FIXED_OPS, _LOAD)
+#define FIXED_STORE FIXED_CAT(FIXED_OPS, _STORE)
+#define FIXED_EXCHANGE FIXED_CAT(FIXED_OPS, _EXCHANGE)
+#define FIXED_CAS FIXED_CAT(FIXED_OPS, _CAS)
+#define FIXED_FETCH_OP FIXED_CAT(FIXED_OPS, _FETCH_OP)
+#define FIXED_OP_FETCH FIXED_CAT(FIXED_OPS, _OP_FETCH)
+#define FIXED_IS_LOCK_FREE FIXED_CAT(FIXED_OPS, _IS_LOCK_FREE)
+
+typedef struct {
+	PyObject_HEAD
+	FIXED_TYPE *target;
+	PyObject *buffer;
+	FIXED_TYPE value;
+	ATOMIC_STATS_MEMBER
+} FIXED_SELF;
+
+static PyObject *FIXED_FN(new)(PyTypeObject *type, PyObject *args,
+			       PyObject *kwds)
+{
+	FIXED_SELF *self;
+
+	self = (FIXED_SELF *)type->tp_alloc(type, 0);
+	if (self == NULL)
+		return NULL;
+
+	self->target = &self->value;
+	return (PyObject *)self;
+}
+
+static int FIXED_FN(init)(FIXED_SELF *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = {"x", NULL};
+	PyObject *arg = NULL;
+	FIXED_TYPE value = 0;
+
+	if ((uintptr_t)self->target % __alignof__(FIXED_TYPE)) {
+		PyErr_SetString(PyExc_SystemError,
+				"atomic." FIXED_NAME_STR " is not aligned");
+		return -1;
+	}
+
+	if (!FIXED_IS_LOCK_FREE(self->target)) {
+		if (PyErr_WarnEx(PyExc_RuntimeWarning,
+				 "atomic." FIXED_NAME_STR " is not lock free",
+				 1) < 0)
+			return -1;
+	}
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &arg))
+		return -1;
+	if (arg && !FIXED_FROM_PY(arg, &value))
+		return -1;
+
+	/* __init__ may be called again on an object other threads can see. */
+	FIXED_STORE(self->target, value, __ATOMIC_SEQ_CST,
+		    ATOMIC_STATS_PTR(self));
+
+	return 0;
+}
+
+static void FIXED_FN(dealloc)(FIXED_SELF *self)
+{
+	PyTypeObject *tp = Py_TYPE(self);
+
+	Py_XDECREF(self->buffer);
+	tp->tp_free((PyObject *)self);
+	Py_DECREF(tp);
+}
+
+static PyObject *FIXED_FN(from_buffer)(PyTypeObject *type, PyObject *args,
+				       PyObject *kwds)
+{
+	static char *kwlist[] = {"buffer", "offset", NULL};
+	PyObject *obj;
+	Py_ssize_t offset = 0;
+	FIXED_SELF *self;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|n", kwlist, &obj,
+					 &offset))
+		return NULL;
+
+	/* A lock-based fallback would not be shared with other processes. */
+	if (!FIXED_IS_LOCK_FREE((FIXED_TYPE *)NULL)) {
+		PyErr_SetString(PyExc_RuntimeError,
+				"atomic." FIXED_NAME_STR " cannot live in "
+				"shared memory: it is not lock free on this "
+				"platform");
+		return NULL;
+	}
+
+	self = (FIXED_SELF *)type->tp_alloc(type, 0);
+	if (self == NULL)
+		return NULL;
+
+	self->buffer = atomic_buffer_attach(FIXED_NAME_STR ".from_buffer", obj,
+					    offset, sizeof(FIXED_TYPE),
+					    __alignof__(FIXED_TYPE),
+					    (void **)&self->target);
+	if (self->buffer == NULL) {
+		Py_DECREF(self);
+		return NULL;
+	}
+
+	return (PyObject *)self;
+}
+
+static PyObject *FIXED_FN(load_long)(FIXED_SELF *self)
+{
+	return FIXED_TO_PY(FIXED_LOAD(self->target, __ATOMIC_SEQ_CST));
+}
+
+static PyObject *FIXED_FN(repr)(FIXED_SELF *self)
+{
+	PyObject *value, *ret;
+
+	value = FIXED_FN(load_long)(self);
+	if (value == NULL)
+		return NULL;
+	ret = PyUnicode_FromFormat("atomic." FIXED_NAME_STR "(%S)", value);
+	Py_DECREF(value);
+	return ret;
+}
+
+static PyObject *FIXED_FN(str)(FIXED_SELF *self)
+{
+	PyObject *value, *ret;
+
+	value = FIXED_FN(load_long)(self);
+	if (value == NULL)
+		return NULL;
+	ret = PyObject_Str(value);
+	Py_DECREF(value);
+	return ret;
+}
+
+static PyObject *FIXED_FN(get)(FIXED_SELF *self, PyObject *const *args,
+			       Py_ssize_t nargs, PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	FIXED_TYPE x;
+
+	if (!atomic_check_nargs("get", nargs, 0) ||
+	    !atomic_parse_order("get", args, nargs, kwnames, ATOMIC_ORDER_LOAD,
+				&order))
+		return NULL;
+
+	x = FIXED_LOAD(self->target, order);
+
+	return FIXED_TO_PY(x);
+}
+
+static PyObject *FIXED_FN(set)(FIXED_SELF *self, PyObject *const *args,
+			       Py_ssize_t nargs, PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	FIXED_TYPE value;
+
+	if (!atomic_check_nargs("set", nargs, 1) ||
+	    !atomic_parse_order("set", args, nargs, kwnames, ATOMIC_ORDER_STORE,
+				&order) ||
+	    !FIXED_FROM_PY(args[0], &value))
+		return NULL;
+
+	FIXED_STORE(self->target, value, order, ATOMIC_STATS_PTR(self));
+
+	Py_RETURN_NONE;
+}
+
+static PyObject *FIXED_FN(get_and_set)(FIXED_SELF *self, PyObject *const *args,
+				       Py_ssize_t nargs, PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	FIXED_TYPE value, ret;
+
+	if (!atomic_check_nargs("get_and_set", nargs, 1) ||
+	    !atomic_parse_order("get_and_set", args, nargs, kwnames,
+				ATOMIC_ORDER_RMW, &order) ||
+	    !FIXED_FROM_PY(args[0], &value))
+		return NULL;
+
+	ret = FIXED_EXCHANGE(self->target, value, order,
+			     ATOMIC_STATS_PTR(self));
+
+	return FIXED_TO_PY(ret);
+}
+
+static PyObject *FIXED_FN(do_compare_and_set)(FIXED_SELF *self,
+					      const char *name,
+					      PyObject *const *args,
+					      Py_ssize_t nargs,
+					      PyObject *kwnames, int weak)
+{
+	int success = __ATOMIC_SEQ_CST, failure = __ATOMIC_SEQ_CST, ret;
+	FIXED_TYPE expect, update;
+	ATOMIC_STATS_ONLY(FIXED_TYPE expected;)
+
+	if (!atomic_check_nargs(name, nargs, 2) ||
+	    !atomic_parse_cas_orders(name, args, nargs, kwnames, &success,
+				     &failure) ||
+	    !FIXED_FROM_PY(args[0], &expect) ||
+	    !FIXED_FROM_PY(args[1], &update))
+		return NULL;
+
+	ATOMIC_STATS_ONLY(expected = expect;)
+	ret = FIXED_CAS(self->target, &expect, update, weak, success, failure);
+	ATOMIC_STATS_CAS(ATOMIC_STATS_PTR(self), FIXED_STATS, ret,
+			 weak && expect == expected);
+
+	return PyBool_FromLong(ret);
+}
+
+static PyObject *FIXED_FN(compare_and_set)(FIXED_SELF *self,
+					   PyObject *const *args,
+					   Py_ssize_t nargs, PyObject *kwnames)
+{
+	return FIXED_FN(do_compare_and_set)(self, "compare_and_set", args,
+					    nargs, kwnames, 0);
+}
+
+static PyObject *FIXED_FN(weak_compare_and_set)(FIXED_SELF *self,
+						PyObject *const *args,
+						Py_ssize_t nargs,
+						PyObject *kwnames)
+{
+	return FIXED_FN(do_compare_and_set)(self, "weak_compare_and_set", args,
+					    nargs, kwnames, 1);
+}
+
+#define FIXED_GET_AND(op)							\
+static PyObject *FIXED_FN(get_and_##op)(FIXED_SELF *self,			\
+					PyObject *const *args,			\
+					Py_ssize_t nargs, PyObject *kwnames)	\
+{										\
+	int order = __ATOMIC_SEQ_CST;						\
+	FIXED_TYPE value, ret;							\
+										\
+	if (!atomic_check_nargs("get_and_" #op, nargs, 1) ||			\
+	    !atomic_parse_order("get_and_" #op, args, nargs, kwnames,		\
+				ATOMIC_ORDER_RMW, &order) ||			\
+	    !FIXED_FROM_PY(args[0], &value))					\
+		return NULL;							\
+										\
+	ret = FIXED_FETCH_OP(op, self->target, value, order,			\
+			     ATOMIC_STATS_PTR(self));				\
+										\
+	return FIXED_TO_PY(ret);						\
+}
+
+#define FIXED_AND_GET(op)							\
+static PyObject *FIXED_FN(op##_and_get)(FIXED_SELF *self,			\
+					PyObject *const *args,			\
+					Py_ssize_t nargs, PyObject *kwnames)	\
+{										\
+	int order = __ATOMIC_SEQ_CST;						\
+	FIXED_TYPE value, ret;							\
+										\
+	if (!atomic_check_nargs(#op "_and_get", nargs, 1) ||			\
+	    !atomic_parse_order(#op "_and_get", args, nargs, kwnames,		\
+				ATOMIC_ORDER_RMW, &order) ||			\
+	    !FIXED_FROM_PY(args[0], &value))					\
+		return NULL;							\
+										\
+	ret = FIXED_OP_FETCH(op, self->target, value, order,			\
+			     ATOMIC_STATS_PTR(self));				\
+										\
+	return FIXED_TO_PY(ret);						\
+}
+
+#define FIXED_INPLACE(op)							\
+static PyObject *FIXED_FN(inplace_##op)(FIXED_SELF *self, PyObject *other)	\
+{										\
+	FIXED_TYPE value;							\
+										\
+	if (!PyIndex_Check(other))						\
+		Py_RETURN_NOTIMPLEMENTED;					\
+	if (!FIXED_FROM_PY(other, &value))					\
+		return NULL;							\
+										\
+	FIXED_FETCH_OP(op, self->target, value, __ATOMIC_SEQ_CST,		\
+		       ATOMIC_STATS_PTR(self));					\
+										\
+	Py_INCREF(self);							\
+	return (PyObject *)self;						\
+}
+
+ATOMIC_STATS_GETTER(FIXED_FN(stats), FIXED_SELF)
+
+FIXED_GET_AND(add)
+FIXED_GET_AND(sub)
+FIXED_GET_AND(and)
+FIXED_GET_AND(xor)
+FIXED_GET_AND(or)
+FIXED_GET_AND(nand)
+
+FIXED_AND_GET(add)
+FIXED_AND_GET(sub)
+FIXED_AND_GET(and)
+FIXED_AND_GET(xor)
+FIXED_AND_GET(or)
+FIXED_AND_GET(nand)
+
+FIXED_INPLACE(add)
+FIXED_INPLACE(sub)
+FIXED_INPLACE(and)
+FIXED_INPLACE(xor)
+FIXED_INPLACE(or)
+
+static PyObject *FIXED_FN(richcompare)(FIXED_SELF *self, PyObject *other,
+				       int op)
+{
+	PyObject *value, *ret;
+
+	value = FIXED_FN(load_long)(self);
+	if (value == NULL)
+		return NULL;
+	ret = PyObject_RichCompare(value, other, op);
+	Py_DECREF(value);
+	return ret;
+}
+
+#define FIXED_METHOD(name) \
+	(PyCFunction)(void (*)(void))FIXED_FN(name), METH_FASTCALL | METH_KEYWORDS
+
+static PyMethodDef FIXED_FN(methods)[] = {
+	{"from_buffer", (PyCFunction)(void (*)(void))FIXED_FN(from_buffer),
+	 METH_CLASS | METH_VARARGS | METH_KEYWORDS,
+	 "from_buffer(buffer, offset=0)\n\n"
+	 "Return an integer whose value lives at the given byte offset in a\n"
+	 "writable buffer, as Integer.from_buffer() does. Narrow types pack many\n"
+	 "counters into one cache line of a shared buffer."},
+	{"get", FIXED_METHOD(get),
+	 "get(*, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically load and return the value of this integer."},
+	{"set", FIXED_METHOD(set),
+	 "set(x, *, order=atomic.SEQ_CST)\n\n"
+	 "Atomically store the given value in this integer."},
+	{"get_and_set", FIXED_METHOD(get_and_set),
+	 "get_and_set(x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically store the given value and return the old value."},
+	{"compare_and_set", FIXED_METHOD(compare_and_set),
+	 "compare_and_set(expect, update, *, order=atomic.SEQ_CST,\n"
+	 "                failure_order=None) -> bool\n\n"
+	 "Atomically store update if the old value equals expect, returning\n"
+	 "whether it did."},
+	{"weak_compare_and_set", FIXED_METHOD(weak_compare_and_set),
+	 "weak_compare_and_set(expect, update, *, order=atomic.SEQ_CST,\n"
+	 "                     failure_order=None) -> bool\n\n"
+	 "compare_and_set, but can fail spuriously."},
+
+	{"get_and_add", FIXED_METHOD(get_and_add),
+	 "get_and_add(x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically add x and return the previously stored value."},
+	{"get_and_sub", FIXED_METHOD(get_and_sub),
+	 "get_and_sub(x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically subtract x and return the previously stored value."},
+	{"get_and_and", FIXED_METHOD(get_and_and),
+	 "get_and_and(x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically bitwise-and x and return the previously stored value."},
+	{"get_and_xor", FIXED_METHOD(get_and_xor),
+	 "get_and_xor(x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically bitwise-xor x and return the previously stored value."},
+	{"get_and_or", FIXED_METHOD(get_and_or),
+	 "get_and_or(x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically bitwise-or x and return the previously stored value."},
+	{"get_and_nand", FIXED_METHOD(get_and_nand),
+	 "get_and_nand(x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically bitwise-nand x and return the previously stored value."},
+
+	{"add_and_get", FIXED_METHOD(add_and_get),
+	 "add_and_get(x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically add x and return the resulting value."},
+	{"sub_and_get", FIXED_METHOD(sub_and_get),
+	 "sub_and_get(x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically subtract x and return the resulting value."},
+	{"and_and_get", FIXED_METHOD(and_and_get),
+	 "and_and_get(x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically bitwise-and x and return the resulting value."},
+	{"xor_and_get", FIXED_METHOD(xor_and_get),
+	 "xor_and_get(x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically bitwise-xor x and return the resulting value."},
+	{"or_and_get", FIXED_METHOD(or_and_get),
+	 "or_and_get(x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically bitwise-or x and return the resulting value."},
+	{"nand_and_get", FIXED_METHOD(nand_and_get),
+	 "nand_and_get(x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically bitwise-nand x and return the resulting value."},
+
+	ATOMIC_STATS_METHOD_DEF(FIXED_FN(stats)),
+
+	{NULL, NULL, 0, NULL}
+};
+
+static PyType_Slot FIXED_FN(slots)[] = {
+	{Py_tp_dealloc, FIXED_FN(dealloc)},
+	{Py_tp_repr, FIXED_FN(repr)},
+	{Py_tp_str, FIXED_FN(str)},
+	{Py_tp_richcompare, FIXED_FN(richcompare)},
+	{Py_nb_int, FIXED_FN(load_long)},
+	{Py_nb_index, FIXED_FN(load_long)},
+	{Py_nb_inplace_add, FIXED_FN(inplace_add)},
+	{Py_nb_inplace_subtract, FIXED_FN(inplace_sub)},
+	{Py_nb_inplace_and, FIXED_FN(inplace_and)},
+	{Py_nb_inplace_xor, FIXED_FN(inplace_xor)},
+	{Py_nb_inplace_or, FIXED_FN(inplace_or)},
+	{Py_tp_doc,
+	 "atomic." FIXED_NAME_STR "(x=0) -> new atomic " FIXED_DESCRIPTION
+	 " integer\n\n"
+	 "Fixed-width " FIXED_DESCRIPTION " integer with the same operations\n"
+	 "as atomic.Integer. Arithmetic is modular: results wrap around on\n"
+	 "overflow, and every int argument is first reduced to the type's width\n"
+	 "(so x.add_and_get(-1) decrements an unsigned type)."},
+	{Py_tp_methods, FIXED_FN(methods)},
+	{Py_tp_init, FIXED_FN(init)},
+	{Py_tp_new, FIXED_FN(new)},
+	{0, NULL}
+};
+
+PyType_Spec FIXED_FN(spec) = {
+	.name = "atomic." FIXED_NAME_STR,
+	.basicsize = sizeof(FIXED_SELF),
+	.flags = ATOMIC_TPFLAGS_DEFAULT,
+	.slots = FIXED_FN(slots),
+};
+
+#undef FIXED_GET_AND
+#undef FIXED_AND_GET
+#undef FIXED_INPLACE
+#undef FIXED_METHOD
+#undef FIXED_LOAD
+#undef FIXED_STORE
+#undef FIXED_EXCHANGE
+#undef FIXED_CAS
+#undef FIXED_FETCH_OP
+#undef FIXED_OP_FETCH
+#undef FIXED_IS_LOCK_FREE
+#undef FIXED_SELF
+#undef FIXED_FN
+#undef FIXED_CAT
+#undef FIXED_CAT_
+
+#undef FIXED_NAME
+#undef FIXED_NAME_STR
+#undef FIXED_TYPE
+#undef FIXED_DESCRIPTION
+#undef FIXED_FROM_PY
+#undef FIXED_TO_PY
+#undef FIXED_STATS
+#undef FIXED_OPS
@@ -0,0 +1,736 @@
+#include <Python.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "atomic.h"
+#include "atomic_stats.h"
+
+/*
+ * The __atomic builtins only do arithmetic on integers, so a double is kept
+ * as its 64-bit pattern: loads, stores, exchanges and compare-and-swaps act on
+ * the bits directly, and addition, max and min are compare-and-swap loops.
+ */
+
+static inline uint64_t Float_bits(double value)
+{
+	uint64_t bits;
+
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static inline double Float_value(uint64_t bits)
+{
+	double value;
+
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static inline int Float_arg(PyObject *arg, double *value)
+{
+	*value = PyFloat_AsDouble(arg);
+	return *value != -1.0 || !PyErr_Occurred();
+}
+
+typedef struct {
+	PyObject_HEAD
+	uint64_t *target;
+	PyObject *buffer;
+	uint64_t value;
+	ATOMIC_STATS_MEMBER
+} Float;
+
+static PyObject *Float_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+	Float *self;
+
+	self = (Float *)type->tp_alloc(type, 0);
+	if (self == NULL)
+		return NULL;
+
+	self->target = &self->value;
+	return (PyObject *)self;
+}
+
+static int Float_init(Float *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = {"x", NULL};
+	double value = 0.0;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|d", kwlist, &value))
+		return -1;
+
+	/* __init__ may be called again on an object other threads can see. */
+	__atomic_store_n(self->target, Float_bits(value), __ATOMIC_SEQ_CST);
+
+	return 0;
+}
+
+static void Float_dealloc(Float *self)
+{
+	PyTypeObject *tp = Py_TYPE(self);
+
+	Py_XDECREF(self->buffer);
+	tp->tp_free((PyObject *)self);
+	Py_DECREF(tp);
+}
+
+static PyObject *Float_from_buffer(PyTypeObject *type, PyObject *args,
+				   PyObject *kwds)
+{
+	static char *kwlist[] = {"buffer", "offset", NULL};
+	PyObject *obj;
+	Py_ssize_t offset = 0;
+	Float *self;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|n:from_buffer", kwlist,
+					 &obj, &offset))
+		return NULL;
+
+	/* A lock-based fallback would not be shared with other processes. */
+	if (!__atomic_always_lock_free(sizeof(uint64_t), 0)) {
+		PyErr_SetString(PyExc_RuntimeError,
+				"atomic.Float cannot live in shared memory: "
+				"64-bit words are not lock free on this platform");
+		return NULL;
+	}
+
+	self = (Float *)type->tp_alloc(type, 0);
+	if (self == NULL)
+		return NULL;
+
+	self->buffer = atomic_buffer_attach("Float.from_buffer", obj, offset,
+					    sizeof(uint64_t),
+					    __alignof__(uint64_t),
+					    (void **)&self->target);
+	if (self->buffer == NULL) {
+		Py_DECREF(self);
+		return NULL;
+	}
+
+	return (PyObject *)self;
+}
+
+static PyObject *Float_float(Float *self)
+{
+	return PyFloat_FromDouble(Float_value(__atomic_load_n(self->target,
+							      __ATOMIC_SEQ_CST)));
+}
+
+static PyObject *Float_repr(Float *self)
+{
+	PyObject *value, *ret;
+
+	value = Float_float(self);
+	if (value == NULL)
+		return NULL;
+	ret = PyUnicode_FromFormat("atomic.Float(%R)", value);
+	Py_DECREF(value);
+	return ret;
+}
+
+static PyObject *Float_str(Float *self)
+{
+	PyObject *value, *ret;
+
+	value = Float_float(self);
+	if (value == NULL)
+		return NULL;
+	ret = PyObject_Str(value);
+	Py_DECREF(value);
+	return ret;
+}
+
+static PyObject *Float_richcompare(Float *self, PyObject *other, int op)
+{
+	PyObject *value, *ret;
+
+	value = Float_float(self);
+	if (value == NULL)
+		return NULL;
+	ret = PyObject_RichCompare(value, other, op);
+	Py_DECREF(value);
+	return ret;
+}
+
+static PyObject *Float_get(Float *self, PyObject *const *args,
+			   Py_ssize_t nargs, PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	uint64_t bits;
+
+	if (!atomic_check_nargs("get", nargs, 0) ||
+	    !atomic_parse_order("get", args, nargs, kwnames, ATOMIC_ORDER_LOAD,
+				&order))
+		return NULL;
+
+	bits = ATOMIC_LOAD_N(self->target, order);
+
+	return PyFloat_FromDouble(Float_value(bits));
+}
+
+static PyObject *Float_set(Float *self, PyObject *const *args,
+			   Py_ssize_t nargs, PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	double value;
+
+	if (!atomic_check_nargs("set", nargs, 1) ||
+	    !atomic_parse_order("set", args, nargs, kwnames, ATOMIC_ORDER_STORE,
+				&order) ||
+	    !Float_arg(args[0], &value))
+		return NULL;
+
+	ATOMIC_STORE_N(self->target, Float_bits(value), order);
+
+	Py_RETURN_NONE;
+}
+
+static PyObject *Float_get_and_set(Float *self, PyObject *const *args,
+				   Py_ssize_t nargs, PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	double value;
+	uint64_t ret;
+
+	if (!atomic_check_nargs("get_and_set", nargs, 1) ||
+	    !atomic_parse_order("get_and_set", args, nargs, kwnames,
+				ATOMIC_ORDER_RMW, &order) ||
+	    !Float_arg(args[0], &value))
+		return NULL;
+
+	ret = ATOMIC_RMW_N(__atomic_exchange_n, self->target, Float_bits(value),
+			   order);
+
+	return PyFloat_FromDouble(Float_value(ret));
+}
+
+static PyObject *Float_do_compare_and_set(Float *self, const char *name,
+					  PyObject *const *args,
+					  Py_ssize_t nargs, PyObject *kwnames,
+					  int weak)
+{
+	int success = __ATOMIC_SEQ_CST, failure = __ATOMIC_SEQ_CST, ret;
+	double expect, update;
+	uint64_t bits;
+
+	if (!atomic_check_nargs(name, nargs, 2) ||
+	    !atomic_parse_cas_orders(name, args, nargs, kwnames, &success,
+				     &failure) ||
+	    !Float_arg(args[0], &expect) || !Float_arg(args[1], &update))
+		return NULL;
+
+	bits = Float_bits(expect);
+	ret = ATOMIC_CAS_N(self->target, &bits, Float_bits(update), weak,
+			   success, failure);
+	ATOMIC_STATS_CAS(ATOMIC_STATS_PTR(self), ATOMIC_STATS_FLOAT, ret,
+			 weak && bits == Float_bits(expect));
+
+	return PyBool_FromLong(ret);
+}
+
+static PyObject *Float_compare_and_set(Float *self, PyObject *const *args,
+				       Py_ssize_t nargs, PyObject *kwnames)
+{
+	return Float_do_compare_and_set(self, "compare_and_set", args, nargs,
+					kwnames, 0);
+}
+
+static PyObject *Float_weak_compare_and_set(Float *self,
+					    PyObject *const *args,
+					    Py_ssize_t nargs, PyObject *kwnames)
+{
+	return Float_do_compare_and_set(self, "weak_compare_and_set", args,
+					nargs, kwnames, 1);
+}
+
+/* One weak compare-and-swap of an update loop. */
+static inline int Float_update_cas(Float *self, uint64_t *old, uint64_t new,
+				   int order, int failure)
+{
+	ATOMIC_STATS_ONLY(uint64_t expected = *old;)
+	int ret = ATOMIC_CAS_N(self->target, old, new, 1, order, failure);
+
+	ATOMIC_STATS_LOOP_CAS(ATOMIC_STATS_PTR(self), ATOMIC_STATS_FLOAT, ret,
+			      *old == expected);
+	return ret;
+}
+
+#define Float_ADD(old, x) ((old) + (x))
+#define Float_SUB(old, x) ((old) - (x))
+/* A NaN argument never replaces the value, as with C++26 fetch_max(). */
+#define Float_MAX(old, x) ((x) > (old) ? (x) : (old))
+#define Float_MIN(old, x) ((x) < (old) ? (x) : (old))
+
+/*
+ * Replace the value with OP(old, x) by a compare-and-swap loop, returning the
+ * old value in *oldp and the new one. When OP leaves the value unchanged
+ * nothing is written, and the load alone carries the ordering.
+ */
+#define Float_UPDATE(name, OP)							\
+static double Float_update_##name(Float *self, double x, int order,		\
+				  double *oldp)					\
+{										\
+	int failure = atomic_failure_order(order);				\
+	uint64_t old, new;							\
+	double value;								\
+										\
+	old = ATOMIC_LOAD_N(self->target, failure);				\
+	do {									\
+		value = OP(Float_value(old), x);				\
+		new = Float_bits(value);					\
+		if (new == old)							\
+			break;							\
+	} while (!Float_update_cas(self, &old, new, order, failure));		\
+	*oldp = Float_value(old);						\
+	return value;								\
+}
+
+ATOMIC_STATS_GETTER(Float_stats, Float)
+
+Float_UPDATE(add, Float_ADD)
+Float_UPDATE(sub, Float_SUB)
+Float_UPDATE(max, Float_MAX)
+Float_UPDATE(min, Float_MIN)
+
+/* which is 0 to return the old value, 1 to return the new one. */
+#define Float_METHOD_UPDATE(name, method, which)				\
+static PyObject *Float_##method(Float *self, PyObject *const *args,		\
+				Py_ssize_t nargs, PyObject *kwnames)		\
+{										\
+	int order = __ATOMIC_SEQ_CST;						\
+	double x, old, new;							\
+										\
+	if (!atomic_check_nargs(#method, nargs, 1) ||				\
+	    !atomic_parse_order(#method, args, nargs, kwnames,			\
+				ATOMIC_ORDER_RMW, &order) ||			\
+	    !Float_arg(args[0], &x))						\
+		return NULL;							\
+										\
+	new = Float_update_##name(self, x, order, &old);			\
+										\
+	return PyFloat_FromDouble((which) ? new : old);				\
+}
+
+Float_METHOD_UPDATE(add, get_and_add, 0)
+Float_METHOD_UPDATE(sub, get_and_sub, 0)
+Float_METHOD_UPDATE(add, add_and_get, 1)
+Float_METHOD_UPDATE(sub, sub_and_get, 1)
+Float_METHOD_UPDATE(max, fetch_max, 0)
+Float_METHOD_UPDATE(min, fetch_min, 0)
+
+#define Float_INPLACE(name)							\
+static PyObject *Float_inplace_##name(Float *self, PyObject *other)		\
+{										\
+	double x, old;								\
+										\
+	if (!PyFloat_Check(other) && !PyIndex_Check(other))			\
+		Py_RETURN_NOTIMPLEMENTED;					\
+	if (!Float_arg(other, &x))						\
+		return NULL;							\
+										\
+	Float_update_##name(self, x, __ATOMIC_SEQ_CST, &old);			\
+										\
+	Py_INCREF(self);							\
+	return (PyObject *)self;						\
+}
+
+Float_INPLACE(add)
+Float_INPLACE(sub)
+
+#define Float_METHOD(name) \
+	(PyCFunction)(void (*)(void))Float_##name, METH_FASTCALL | METH_KEYWORDS
+
+static PyMethodDef Float_methods[] = {
+	{"from_buffer", (PyCFunction)(void (*)(void))Float_from_buffer,
+	 METH_CLASS | METH_VARARGS | METH_KEYWORDS,
+	 "from_buffer(buffer, offset=0) -> Float\n\n"
+	 "Return an atomic.Float whose value is the C double at the given byte\n"
+	 "offset in a writable buffer, as Integer.from_buffer() does. The offset\n"
+	 "must leave the value 8-byte aligned."},
+	{"get", Float_METHOD(get),
+	 "get(*, order=atomic.SEQ_CST) -> float\n\n"
+	 "Atomically load and return the value of this float."},
+	{"set", Float_METHOD(set),
+	 "set(x, *, order=atomic.SEQ_CST)\n\n"
+	 "Atomically store the given value in this float."},
+	{"get_and_set", Float_METHOD(get_and_set),
+	 "get_and_set(x, *, order=atomic.SEQ_CST) -> float\n\n"
+	 "Atomically store the given value and return the old value."},
+	{"compare_and_set", Float_METHOD(compare_and_set),
+	 "compare_and_set(expect, update, *, order=atomic.SEQ_CST,\n"
+	 "                failure_order=None) -> bool\n\n"
+	 "Atomically store update if the stored value has the same bit pattern\n"
+	 "as expect, returning whether it did. Because bits are compared, a NaN\n"
+	 "matches the same NaN, and 0.0 and -0.0 do not match each other."},
+	{"weak_compare_and_set", Float_METHOD(weak_compare_and_set),
+	 "weak_compare_and_set(expect, update, *, order=atomic.SEQ_CST,\n"
+	 "                     failure_order=None) -> bool\n\n"
+	 "compare_and_set, but can fail spuriously."},
+
+	{"get_and_add", Float_METHOD(get_and_add),
+	 "get_and_add(x, *, order=atomic.SEQ_CST) -> float\n\n"
+	 "Atomically add x and return the previously stored value."},
+	{"get_and_sub", Float_METHOD(get_and_sub),
+	 "get_and_sub(x, *, order=atomic.SEQ_CST) -> float\n\n"
+	 "Atomically subtract x and return the previously stored value."},
+	{"add_and_get", Float_METHOD(add_and_get),
+	 "add_and_get(x, *, order=atomic.SEQ_CST) -> float\n\n"
+	 "Atomically add x and return the resulting value."},
+	{"sub_and_get", Float_METHOD(sub_and_get),
+	 "sub_and_get(x, *, order=atomic.SEQ_CST) -> float\n\n"
+	 "Atomically subtract x and return the resulting value."},
+	{"fetch_max", Float_METHOD(fetch_max),
+	 "fetch_max(x, *, order=atomic.SEQ_CST) -> float\n\n"
+	 "Atomically replace the value with x if x is greater, and return the\n"
+	 "previously stored value. A NaN x is never stored."},
+	{"fetch_min", Float_METHOD(fetch_min),
+	 "fetch_min(x, *, order=atomic.SEQ_CST) -> float\n\n"
+	 "Atomically replace the value with x if x is smaller, and return the\n"
+	 "previously stored value. A NaN x is never stored."},
+
+	ATOMIC_STATS_METHOD_DEF(Float_stats),
+
+	{NULL, NULL, 0, NULL}
+};
+
+#define ATOMIC_FLOAT_DOCSTRING \
+	"atomic.Float(x=0.0) -> new atomic float\n\n" \
+	"C double supporting atomic operations, with the load, store, exchange\n" \
+	"and compare-and-exchange methods and order= keywords of atomic.Integer.\n\n" \
+	"get_and_add(), add_and_get(), the sub variants, fetch_max() and\n" \
+	"fetch_min() are compare-and-swap loops, since hardware has no atomic\n" \
+	"floating-point add; they retry under contention but never block.\n\n" \
+	"The in-place operators += and -= are atomic updates of this object.\n" \
+	"float() and comparisons read the current value; like atomic.Integer,\n" \
+	"floats are not hashable. For long-running sums where rounding error\n" \
+	"accumulates, see atomic.CompensatedFloat."
+
+static PyType_Slot Float_slots[] = {
+	{Py_tp_dealloc, Float_dealloc},
+	{Py_tp_repr, Float_repr},
+	{Py_tp_str, Float_str},
+	{Py_tp_richcompare, Float_richcompare},
+	{Py_nb_float, Float_float},
+	{Py_nb_inplace_add, Float_inplace_add},
+	{Py_nb_inplace_subtract, Float_inplace_sub},
+	{Py_tp_doc, ATOMIC_FLOAT_DOCSTRING},
+	{Py_tp_methods, Float_methods},
+	{Py_tp_init, Float_init},
+	{Py_tp_new, Float_new},
+	{0, NULL}
+};
+
+PyType_Spec Float_spec = {
+	.name = "atomic.Float",
+	.basicsize = sizeof(Float),
+	.flags = ATOMIC_TPFLAGS_DEFAULT,
+	.slots = Float_slots,
+};
+
+/*
+ * Neumaier's variant of Kahan summation: the running sum and the rounding
+ * error it has lost so far share one 16-byte pair (lo holds the sum, hi the
+ * compensation) and are replaced together by a double-width compare-and-swap,
+ * so concurrent additions never see one without the other.
+ */
+typedef struct {
+	PyObject_HEAD
+	atomic_pair pair;
+	ATOMIC_STATS_MEMBER
+} CompensatedFloat;
+
+static inline atomic_pair CompensatedFloat_pack(double sum, double compensation)
+{
+	atomic_pair pair = {Float_bits(sum), Float_bits(compensation)};
+
+	return pair;
+}
+
+static inline double CompensatedFloat_total(atomic_pair pair)
+{
+	return Float_value(pair.lo) + Float_value(pair.hi);
+}
+
+static inline atomic_pair CompensatedFloat_add_pair(atomic_pair pair, double x)
+{
+	double sum = Float_value(pair.lo), c = Float_value(pair.hi), t;
+
+	t = sum + x;
+	if (fabs(sum) >= fabs(x))
+		c += (sum - t) + x;
+	else
+		c += (x - t) + sum;
+	return CompensatedFloat_pack(t, c);
+}
+
+/* One compare-and-swap of an update loop. */
+static inline int CompensatedFloat_cas(CompensatedFloat *self,
+				       atomic_pair *old, atomic_pair desired)
+{
+	int ret = atomic_pair_cas(&self->pair, old, desired);
+
+	ATOMIC_STATS_LOOP_CAS(ATOMIC_STATS_PTR(self),
+			      ATOMIC_STATS_COMPENSATED_FLOAT, ret, 0);
+	return ret;
+}
+
+static atomic_pair CompensatedFloat_exchange(CompensatedFloat *self,
+					     atomic_pair desired)
+{
+	atomic_pair old = atomic_pair_load(&self->pair);
+
+	while (!CompensatedFloat_cas(self, &old, desired))
+		;
+	return old;
+}
+
+/* Add x, returning the pair it was added to. */
+static atomic_pair CompensatedFloat_add_x(CompensatedFloat *self, double x)
+{
+	atomic_pair old = atomic_pair_load(&self->pair);
+
+	while (!CompensatedFloat_cas(self, &old,
+				     CompensatedFloat_add_pair(old, x)))
+		;
+	return old;
+}
+
+static int CompensatedFloat_init(CompensatedFloat *self, PyObject *args,
+				 PyObject *kwds)
+{
+	static char *kwlist[] = {"x", NULL};
+	double value = 0.0;
+
+	if ((uintptr_t)&self->pair % sizeof(self->pair)) {
+		PyErr_SetString(PyExc_SystemError,
+				"atomic.CompensatedFloat is not 16-byte aligned");
+		return -1;
+	}
+
+	if (!atomic_pair_is_lock_free(&self->pair)) {
+		if (PyErr_WarnEx(PyExc_RuntimeWarning,
+				 "atomic.CompensatedFloat is not lock free",
+				 1) < 0)
+			return -1;
+	}
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|d", kwlist, &value))
+		return -1;
+
+	/* __init__ may be called again on an object other threads can see. */
+	CompensatedFloat_exchange(self, CompensatedFloat_pack(value, 0.0));
+
+	return 0;
+}
+
+static void CompensatedFloat_dealloc(CompensatedFloat *self)
+{
+	PyTypeObject *tp = Py_TYPE(self);
+
+	tp->tp_free((PyObject *)self);
+	Py_DECREF(tp);
+}
+
+static PyObject *CompensatedFloat_float(CompensatedFloat *self)
+{
+	return PyFloat_FromDouble(
+		CompensatedFloat_total(atomic_pair_load(&self->pair)));
+}
+
+static PyObject *CompensatedFloat_repr(CompensatedFloat *self)
+{
+	PyObject *value, *ret;
+
+	value = CompensatedFloat_float(self);
+	if (value == NULL)
+		return NULL;
+	ret = PyUnicode_FromFormat("atomic.CompensatedFloat(%R)", value);
+	Py_DECREF(value);
+	return ret;
+}
+
+static PyObject *CompensatedFloat_richcompare(CompensatedFloat *self,
+					      PyObject *other, int op)
+{
+	PyObject *value, *ret;
+
+	value = CompensatedFloat_float(self);
+	if (value == NULL)
+		return NULL;
+	ret = PyObject_RichCompare(value, other, op);
+	Py_DECREF(value);
+	return ret;
+}
+
+/*
+ * Every operation is a full-barrier double-width instruction; order= is
+ * accepted and validated for consistency with the other types.
+ */
+static PyObject *CompensatedFloat_get(CompensatedFloat *self,
+				      PyObject *const *args, Py_ssize_t nargs,
+				      PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+
+	if (!atomic_check_nargs("get", nargs, 0) ||
+	    !atomic_parse_order("get", args, nargs, kwnames, ATOMIC_ORDER_LOAD,
+				&order))
+		return NULL;
+
+	return CompensatedFloat_float(self);
+}
+
+static PyObject *CompensatedFloat_set(CompensatedFloat *self,
+				      PyObject *const *args, Py_ssize_t nargs,
+				      PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	double value;
+
+	if (!atomic_check_nargs("set", nargs, 1) ||
+	    !atomic_parse_order("set", args, nargs, kwnames, ATOMIC_ORDER_STORE,
+				&order) ||
+	    !Float_arg(args[0], &value))
+		return NULL;
+
+	CompensatedFloat_exchange(self, CompensatedFloat_pack(value, 0.0));
+
+	Py_RETURN_NONE;
+}
+
+static PyObject *CompensatedFloat_get_and_set(CompensatedFloat *self,
+					      PyObject *const *args,
+					      Py_ssize_t nargs,
+					      PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	double value;
+	atomic_pair old;
+
+	if (!atomic_check_nargs("get_and_set", nargs, 1) ||
+	    !atomic_parse_order("get_and_set", args, nargs, kwnames,
+				ATOMIC_ORDER_RMW, &order) ||
+	    !Float_arg(args[0], &value))
+		return NULL;
+
+	old = CompensatedFloat_exchange(self, CompensatedFloat_pack(value, 0.0));
+
+	return PyFloat_FromDouble(CompensatedFloat_total(old));
+}
+
+static PyObject *CompensatedFloat_add(CompensatedFloat *self,
+				      PyObject *const *args, Py_ssize_t nargs,
+				      PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	double x;
+
+	if (!atomic_check_nargs("add", nargs, 1) ||
+	    !atomic_parse_order("add", args, nargs, kwnames, ATOMIC_ORDER_RMW,
+				&order) ||
+	    !Float_arg(args[0], &x))
+		return NULL;
+
+	CompensatedFloat_add_x(self, x);
+
+	Py_RETURN_NONE;
+}
+
+static PyObject *CompensatedFloat_add_and_get(CompensatedFloat *self,
+					      PyObject *const *args,
+					      Py_ssize_t nargs,
+					      PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	double x;
+	atomic_pair old;
+
+	if (!atomic_check_nargs("add_and_get", nargs, 1) ||
+	    !atomic_parse_order("add_and_get", args, nargs, kwnames,
+				ATOMIC_ORDER_RMW, &order) ||
+	    !Float_arg(args[0], &x))
+		return NULL;
+
+	old = CompensatedFloat_add_x(self, x);
+
+	return PyFloat_FromDouble(
+		CompensatedFloat_total(CompensatedFloat_add_pair(old, x)));
+}
+
+static PyObject *CompensatedFloat_inplace_add(CompensatedFloat *self,
+					      PyObject *other)
+{
+	double x;
+
+	if (!PyFloat_Check(other) && !PyIndex_Check(other))
+		Py_RETURN_NOTIMPLEMENTED;
+	if (!Float_arg(other, &x))
+		return NULL;
+
+	CompensatedFloat_add_x(self, x);
+
+	Py_INCREF(self);
+	return (PyObject *)self;
+}
+
+ATOMIC_STATS_GETTER(CompensatedFloat_stats, CompensatedFloat)
+
+#define CompensatedFloat_METHOD(name)					\
+	(PyCFunction)(void (*)(void))CompensatedFloat_##name,		\
+	METH_FASTCALL | METH_KEYWORDS
+
+static PyMethodDef CompensatedFloat_methods[] = {
+	{"get", CompensatedFloat_METHOD(get),
+	 "get(*, order=atomic.SEQ_CST) -> float\n\n"
+	 "Atomically load the sum and its compensation and return their total."},
+	{"set", CompensatedFloat_METHOD(set),
+	 "set(x, *, order=atomic.SEQ_CST)\n\n"
+	 "Atomically restart the sum at x, clearing the compensation."},
+	{"get_and_set", CompensatedFloat_METHOD(get_and_set),
+	 "get_and_set(x, *, order=atomic.SEQ_CST) -> float\n\n"
+	 "Atomically restart the sum at x and return the old total, e.g. to\n"
+	 "drain an accumulator with get_and_set(0.0)."},
+	{"add", CompensatedFloat_METHOD(add),
+	 "add(x, *, order=atomic.SEQ_CST)\n\n"
+	 "Atomically add x, carrying the rounding error into the compensation."},
+	{"add_and_get", CompensatedFloat_METHOD(add_and_get),
+	 "add_and_get(x, *, order=atomic.SEQ_CST) -> float\n\n"
+	 "Atomically add x and return the resulting total."},
+
+	ATOMIC_STATS_METHOD_DEF(CompensatedFloat_stats),
+
+	{NULL, NULL, 0, NULL}
+};
+
+#define ATOMIC_COMPENSATED_FLOAT_DOCSTRING \
+	"atomic.CompensatedFloat(x=0.0) -> new compensated accumulator\n\n" \
+	"Floating-point sum that also tracks the rounding error of each\n" \
+	"addition (Kahan-Babuska-Neumaier summation), so a long run of small\n" \
+	"additions to a large total does not drift the way a plain float or\n" \
+	"atomic.Float does. The total is the sum plus the compensation; both\n" \
+	"are updated together by a single 16-byte compare-and-swap.\n\n" \
+	"Every method takes the order= keyword of the other types, but all\n" \
+	"operations are sequentially consistent: the double-width instructions\n" \
+	"are full barriers."
+
+static PyType_Slot CompensatedFloat_slots[] = {
+	{Py_tp_dealloc, CompensatedFloat_dealloc},
+	{Py_tp_repr, CompensatedFloat_repr},
+	{Py_tp_richcompare, CompensatedFloat_richcompare},
+	{Py_nb_float, CompensatedFloat_float},
+	{Py_nb_inplace_add, CompensatedFloat_inplace_add},
+	{Py_tp_doc, ATOMIC_COMPENSATED_FLOAT_DOCSTRING},
+	{Py_tp_methods, CompensatedFloat_methods},
+	{Py_tp_init, CompensatedFloat_init},
+	{0, NULL}
+};
+
+PyType_Spec CompensatedFloat_spec = {
+	.name = "atomic.CompensatedFloat",
+	.basicsize = sizeof(CompensatedFloat),
+	.flags = ATOMIC_TPFLAGS_DEFAULT,
+	.slots = CompensatedFloat_slots,
+};
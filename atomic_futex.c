@@ -0,0 +1,94 @@
+#include <Python.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "atomic_futex.h"
+
+int atomic_futex_deadline(PyObject *timeout, struct timespec *deadline,
+			  struct timespec **deadlinep)
+{
+	double seconds, whole;
+
+	if (timeout == NULL || timeout == Py_None) {
+		*deadlinep = NULL;
+		return 0;
+	}
+
+	seconds = PyFloat_AsDouble(timeout);
+	if (seconds == -1.0 && PyErr_Occurred())
+		return -1;
+	if (!(seconds >= 0.0)) {
+		PyErr_SetString(PyExc_ValueError,
+				"timeout must be a non-negative number");
+		return -1;
+	}
+	/* Anything beyond a few centuries is as good as forever. */
+	if (seconds > 1e10) {
+		*deadlinep = NULL;
+		return 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, deadline);
+	seconds = modf(seconds, &whole);
+	deadline->tv_sec += (time_t)whole;
+	deadline->tv_nsec += (long)(seconds * 1e9);
+	if (deadline->tv_nsec >= 1000000000) {
+		deadline->tv_sec++;
+		deadline->tv_nsec -= 1000000000;
+	}
+	*deadlinep = deadline;
+	return 0;
+}
+
+#ifdef __linux__
+
+int atomic_futex_wait(uint32_t *word, uint32_t expected,
+		      const struct timespec *deadline, int shared)
+{
+	int op = FUTEX_WAIT_BITSET | (shared ? 0 : FUTEX_PRIVATE_FLAG);
+
+	/* FUTEX_WAIT_BITSET takes an absolute CLOCK_MONOTONIC deadline. */
+	if (syscall(SYS_futex, word, op, expected, deadline, NULL,
+		    FUTEX_BITSET_MATCH_ANY) == 0 || errno == EAGAIN)
+		return 0;
+	return errno == ETIMEDOUT || errno == EINTR ? errno : 0;
+}
+
+void atomic_futex_wake(uint32_t *word, int count, int shared)
+{
+	int op = FUTEX_WAKE | (shared ? 0 : FUTEX_PRIVATE_FLAG);
+
+	syscall(SYS_futex, word, op, count, NULL, NULL, 0);
+}
+
+#else
+
+int atomic_futex_wait(uint32_t *word, uint32_t expected,
+		      const struct timespec *deadline, int shared)
+{
+	struct timespec now, nap = {0, 50000};
+
+	if (__atomic_load_n(word, __ATOMIC_SEQ_CST) != expected)
+		return 0;
+	if (deadline) {
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (now.tv_sec > deadline->tv_sec ||
+		    (now.tv_sec == deadline->tv_sec &&
+		     now.tv_nsec >= deadline->tv_nsec))
+			return ETIMEDOUT;
+	}
+	return nanosleep(&nap, NULL) < 0 && errno == EINTR ? EINTR : 0;
+}
+
+void atomic_futex_wake(uint32_t *word, int count, int shared)
+{
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef ATOMIC_FUTEX_H
+#define ATOMIC_FUTEX_H
+
+#include <Python.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "atomic.h"
+
+/*
+ * Blocking on a 32-bit word until another thread (or process, for words in
+ * shared memory) changes it and wakes us, as with C++20 atomic wait/notify.
+ * On Linux this is futex(2); elsewhere waiting degrades to short sleeps and
+ * waking is a no-op.
+ *
+ * atomic_futex_wait() and atomic_futex_wake() may be called without the GIL.
+ * Words in memory private to this process should pass shared = 0, which lets
+ * the kernel skip the lookup of the backing page.
+ */
+
+/*
+ * Parse a timeout argument (None or a non-negative number of seconds) into
+ * an absolute CLOCK_MONOTONIC deadline. *deadlinep is set to NULL for None
+ * and to deadline otherwise. Returns 0, or -1 with an exception set.
+ */
+int atomic_futex_deadline(PyObject *timeout, struct timespec *deadline,
+			  struct timespec **deadlinep);
+
+/*
+ * Sleep while *word == expected, until woken, the deadline (if not NULL)
+ * passes, or a signal arrives. Returns 0 when woken or when *word no longer
+ * held expected (callers must recheck their condition either way), or
+ * ETIMEDOUT or EINTR.
+ */
+int atomic_futex_wait(uint32_t *word, uint32_t expected,
+		      const struct timespec *deadline, int shared);
+
+/* Wake up to count threads sleeping on word. */
+void atomic_futex_wake(uint32_t *word, int count, int shared);
+
+/* The 32 bits of a long that hold its least significant half. */
+static inline uint32_t *atomic_futex_low_word(long *value)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	return (uint32_t *)value + (sizeof(long) / sizeof(uint32_t) - 1);
+#else
+	return (uint32_t *)value;
+#endif
+}
+
+#endif /* ATOMIC_FUTEX_H */
@@ -0,0 +1,166 @@
+#include <Python.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "atomic_hazard.h"
+
+/* Retired pointers that were still protected when they were retired. */
+struct atomic_hazard_deferred {
+	struct atomic_hazard_deferred *next;
+	void *ptr;
+	void (*release)(void *);
+};
+
+__thread struct atomic_hazard_record *atomic_hazard_current;
+struct atomic_hazard_deferred *atomic_hazard_deferred_list;
+
+/* Records are never freed; a thread that exits leaves its record for reuse. */
+static struct atomic_hazard_record *atomic_hazard_records;
+
+static pthread_key_t atomic_hazard_key;
+static pthread_once_t atomic_hazard_once = PTHREAD_ONCE_INIT;
+
+static void atomic_hazard_thread_exit(void *arg)
+{
+	struct atomic_hazard_record *record = arg;
+	int i;
+
+	for (i = 0; i < ATOMIC_HAZARD_SLOTS; i++)
+		__atomic_store_n(&record->hazards[i], 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&record->active, 0, __ATOMIC_RELEASE);
+}
+
+static void atomic_hazard_init_key(void)
+{
+	pthread_key_create(&atomic_hazard_key, atomic_hazard_thread_exit);
+}
+
+struct atomic_hazard_record *atomic_hazard_register(void)
+{
+	struct atomic_hazard_record *record, *head;
+	int expect;
+
+	pthread_once(&atomic_hazard_once, atomic_hazard_init_key);
+
+	for (record = __atomic_load_n(&atomic_hazard_records, __ATOMIC_ACQUIRE);
+	     record; record = record->next) {
+		expect = 0;
+		if (__atomic_compare_exchange_n(&record->active, &expect, 1, 0,
+						__ATOMIC_ACQ_REL,
+						__ATOMIC_RELAXED))
+			goto out;
+	}
+
+	if (posix_memalign((void **)&record, ATOMIC_CACHE_LINE,
+			   sizeof(*record))) {
+		PyErr_NoMemory();
+		return NULL;
+	}
+	memset(record, 0, sizeof(*record));
+	record->active = 1;
+
+	head = __atomic_load_n(&atomic_hazard_records, __ATOMIC_RELAXED);
+	do {
+		record->next = head;
+	} while (!__atomic_compare_exchange_n(&atomic_hazard_records, &head,
+					      record, 1, __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+
+out:
+	pthread_setspecific(atomic_hazard_key, record);
+	atomic_hazard_current = record;
+	return record;
+}
+
+static int atomic_hazard_is_protected(void *ptr)
+{
+	struct atomic_hazard_record *record;
+	int i;
+
+	for (record = __atomic_load_n(&atomic_hazard_records, __ATOMIC_ACQUIRE);
+	     record; record = record->next) {
+		for (i = 0; i < ATOMIC_HAZARD_SLOTS; i++) {
+			if (__atomic_load_n(&record->hazards[i],
+					    __ATOMIC_SEQ_CST) == (uintptr_t)ptr)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+static void atomic_hazard_defer(struct atomic_hazard_deferred *node)
+{
+	struct atomic_hazard_deferred *head;
+
+	head = __atomic_load_n(&atomic_hazard_deferred_list, __ATOMIC_RELAXED);
+	do {
+		node->next = head;
+	} while (!__atomic_compare_exchange_n(&atomic_hazard_deferred_list,
+					      &head, node, 1, __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+}
+
+/*
+ * Release ptr once no thread has it published. The pointer must already be
+ * unreachable from every shared location, so no new hazard can appear for it.
+ */
+void atomic_hazard_retire(void *ptr, void (*release)(void *))
+{
+	struct atomic_hazard_deferred *node;
+
+	/*
+	 * The unlink may have used a weaker order than seq_cst; the scan below
+	 * must not be reordered before it, or a reader could publish a hazard
+	 * we miss while still seeing the old pointer.
+	 */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (!atomic_hazard_is_protected(ptr)) {
+		release(ptr);
+		return;
+	}
+
+	node = PyMem_RawMalloc(sizeof(*node));
+	if (node == NULL) {
+		/* Readers hold hazards only for a few instructions. */
+		while (atomic_hazard_is_protected(ptr))
+			sched_yield();
+		release(ptr);
+		return;
+	}
+	node->ptr = ptr;
+	node->release = release;
+	atomic_hazard_defer(node);
+}
+
+static void atomic_hazard_decref(void *object)
+{
+	Py_DECREF((PyObject *)object);
+}
+
+void atomic_hazard_retire_object(PyObject *object)
+{
+	atomic_hazard_retire(object, atomic_hazard_decref);
+}
+
+/*
+ * Release every deferred pointer that is no longer protected. Called by
+ * readers as they drop a hazard, so deferred releases make progress even if
+ * the writer that retired them never runs again.
+ */
+void atomic_hazard_drain(void)
+{
+	struct atomic_hazard_deferred *node, *next;
+
+	node = __atomic_exchange_n(&atomic_hazard_deferred_list, NULL,
+				   __ATOMIC_ACQUIRE);
+	for (; node; node = next) {
+		next = node->next;
+		if (atomic_hazard_is_protected(node->ptr)) {
+			atomic_hazard_defer(node);
+		} else {
+			node->release(node->ptr);
+			PyMem_RawFree(node);
+		}
+	}
+}
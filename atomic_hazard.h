@@ -0,0 +1,127 @@
+#ifndef ATOMIC_HAZARD_H
+#define ATOMIC_HAZARD_H
+
+#include <Python.h>
+#include <stdint.h>
+
+#include "atomic.h"
+
+/*
+ * Hazard pointers protecting loads of shared pointers from concurrent frees.
+ *
+ * A reader publishes the pointer it is about to dereference in one of its
+ * thread's hazard slots, re-reads the source to check that the pointer is
+ * still installed, and only then touches the pointee (e.g. to Py_INCREF it).
+ * A writer that unlinks a pointer hands it to atomic_hazard_retire() instead
+ * of releasing it directly: if no thread has it published it is released on
+ * the spot, otherwise the release is deferred until the hazard is cleared.
+ *
+ * Readers never block or allocate after their first call on a thread: the
+ * fast path is a store, a reload and a clear.
+ */
+
+#define ATOMIC_HAZARD_SLOTS 4
+
+/* Mask for atomic_hazard_protect() on sources that hold a plain pointer. */
+#define ATOMIC_HAZARD_NO_TAG (~(uintptr_t)0)
+
+struct atomic_hazard_record {
+	uintptr_t hazards[ATOMIC_HAZARD_SLOTS];
+	int active;
+	struct atomic_hazard_record *next;
+} __attribute__((aligned(ATOMIC_CACHE_LINE)));
+
+struct atomic_hazard_deferred;
+
+extern __thread struct atomic_hazard_record *atomic_hazard_current;
+extern struct atomic_hazard_deferred *atomic_hazard_deferred_list;
+
+struct atomic_hazard_record *atomic_hazard_register(void);
+void atomic_hazard_retire(void *ptr, void (*release)(void *));
+void atomic_hazard_retire_object(PyObject *object);
+void atomic_hazard_drain(void);
+
+/*
+ * Return hazard slot i of the calling thread, or NULL with MemoryError set if
+ * the thread could not be registered.
+ */
+static inline uintptr_t *atomic_hazard_slot(int i)
+{
+	struct atomic_hazard_record *record = atomic_hazard_current;
+
+	if (record == NULL) {
+		record = atomic_hazard_register();
+		if (record == NULL)
+			return NULL;
+	}
+	return &record->hazards[i];
+}
+
+/*
+ * Load *src and protect the pointer it holds in hazard. Bits outside mask
+ * (e.g. a mark stored in the low bit) are not part of the pointer. Returns the
+ * whole word as read by the validating load.
+ */
+static inline uintptr_t atomic_hazard_protect(uintptr_t *hazard,
+					      const uintptr_t *src,
+					      uintptr_t mask)
+{
+	uintptr_t word, check;
+
+	__atomic_load(src, &word, __ATOMIC_SEQ_CST);
+	for (;;) {
+		__atomic_store_n(hazard, word & mask, __ATOMIC_SEQ_CST);
+		__atomic_load(src, &check, __ATOMIC_SEQ_CST);
+		if ((check & mask) == (word & mask))
+			return check;
+		word = check;
+	}
+}
+
+static inline void atomic_hazard_release(uintptr_t *hazard)
+{
+	__atomic_store_n(hazard, 0, __ATOMIC_RELEASE);
+
+	if (__atomic_load_n(&atomic_hazard_deferred_list, __ATOMIC_RELAXED))
+		atomic_hazard_drain();
+}
+
+/*
+ * Order actually used for a store or exchange that installs an object read
+ * through atomic_hazard_load_object(): at least release, so that a reader
+ * never sees the pointer before the object it points to. Loads are always
+ * sequentially consistent as part of the hazard protocol.
+ */
+static inline int atomic_hazard_publish_order(int order)
+{
+	if (order == __ATOMIC_RELAXED)
+		return __ATOMIC_RELEASE;
+	if (order == __ATOMIC_ACQUIRE)
+		return __ATOMIC_ACQ_REL;
+	return order;
+}
+
+/*
+ * Return a new reference to the object stored in *src, or NULL with
+ * MemoryError set. *word receives the full word that was read.
+ */
+static inline PyObject *atomic_hazard_load_object(const uintptr_t *src,
+						  uintptr_t mask,
+						  uintptr_t *word)
+{
+	uintptr_t *hazard;
+	PyObject *object;
+
+	hazard = atomic_hazard_slot(0);
+	if (hazard == NULL)
+		return NULL;
+
+	*word = atomic_hazard_protect(hazard, src, mask);
+	object = (PyObject *)(*word & mask);
+	Py_INCREF(object);
+	atomic_hazard_release(hazard);
+
+	return object;
+}
+
+#endif /* ATOMIC_HAZARD_H */
@@ -1,34 +1,183 @@
 #include <Python.h>
 
+#include "atomic.h"
+#include "atomic_futex.h"
+#include "atomic_stats.h"
+#include "atomic_update.h"
+
+/*
+ * target is where the value lives: normally the inline value field, or a
+ * word inside a caller's buffer (see Integer.from_buffer()), in which case
+ * buffer is a memoryview holding that buffer's export. waiters counts
+ * threads blocked in wait() so that notify can skip the system call.
+ */
 typedef struct {
 	PyObject_HEAD
+	long *target;
+	PyObject *buffer;
 	long value;
+	unsigned int waiters;
+	uint32_t epoch;			/* futex word, bumped by every notify */
+	ATOMIC_STATS_MEMBER
 } Integer;
 
-static int Integer_init(Integer *self, PyObject *args, PyObject *kwds)
-{
-	static char *kwlist[] = {"x", NULL};
+static atomic_freelist Integer_freelist;
 
-	if (!__atomic_is_lock_free(sizeof(self->value), &self->value)) {
+static int Integer_check_lock_free(void)
+{
+	if (!atomic_long_is_lock_free) {
 		if (PyErr_WarnEx(PyExc_RuntimeWarning,
 				 "atomic.Integer is not lock free", 1) < 0)
 			return -1;
 	}
+	return 0;
+}
+
+static int Integer_init(Integer *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = {"x", NULL};
 
-	self->value = 0;
+	long value = 0;
+
+	if (Integer_check_lock_free() < 0)
+		return -1;
 
-	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|l", kwlist,
-					 &self->value))
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|l", kwlist, &value))
 		return -1;
 
+	/* __init__ may be called again on an object other threads can see. */
+	__atomic_store(self->target, &value, __ATOMIC_SEQ_CST);
+
 	return 0;
 }
 
+/* Allocate an Integer holding its own value, reusing a freed one if any. */
+static Integer *Integer_alloc(PyTypeObject *type)
+{
+	Integer *self;
+
+	self = (Integer *)atomic_freelist_pop(&Integer_freelist, type);
+	if (self == NULL) {
+		self = (Integer *)type->tp_alloc(type, 0);
+		if (self == NULL)
+			return NULL;
+	}
+
+	self->target = &self->value;
+	return self;
+}
+
+static PyObject *Integer_new(PyTypeObject *type, PyObject *args,
+			     PyObject *kwds)
+{
+	return (PyObject *)Integer_alloc(type);
+}
+
+static void Integer_dealloc(Integer *self)
+{
+	PyTypeObject *tp = Py_TYPE(self);
+
+	Py_XDECREF(self->buffer);
+	if (!atomic_freelist_push(&Integer_freelist, (PyObject *)self))
+		tp->tp_free((PyObject *)self);
+	Py_DECREF(tp);
+}
+
+void Integer_clear_freelist(void)
+{
+	atomic_freelist_clear(&Integer_freelist, PyObject_Free);
+}
+
+/*
+ * Vectorcall constructor: atomic.Integer(x) is by far the most common way
+ * these objects are created, so skip the tuple/dict packing and the generic
+ * tp_new -> tp_init dispatch.
+ */
+PyObject *Integer_vectorcall(PyObject *type, PyObject *const *args,
+			     size_t nargsf, PyObject *kwnames)
+{
+	Py_ssize_t nargs = PyVectorcall_NARGS(nargsf);
+	PyObject *arg = NULL;
+	Integer *self;
+	long value = 0;
+
+	if (kwnames && PyTuple_GET_SIZE(kwnames)) {
+		if (nargs || PyTuple_GET_SIZE(kwnames) != 1 ||
+		    !PyUnicode_Check(PyTuple_GET_ITEM(kwnames, 0)) ||
+		    PyUnicode_CompareWithASCIIString(PyTuple_GET_ITEM(kwnames, 0),
+						     "x") != 0) {
+			PyErr_SetString(PyExc_TypeError,
+					"Integer() takes at most 1 argument (x)");
+			return NULL;
+		}
+		arg = args[0];
+	} else if (nargs > 1) {
+		PyErr_Format(PyExc_TypeError,
+			     "Integer() takes at most 1 argument (%zd given)",
+			     nargs);
+		return NULL;
+	} else if (nargs == 1) {
+		arg = args[0];
+	}
+
+	if (arg) {
+		value = PyLong_AsLong(arg);
+		if (value == -1 && PyErr_Occurred())
+			return NULL;
+	}
+
+	if (Integer_check_lock_free() < 0)
+		return NULL;
+
+	self = Integer_alloc((PyTypeObject *)type);
+	if (self == NULL)
+		return NULL;
+
+	self->value = value;
+
+	return (PyObject *)self;
+}
+
+static PyObject *Integer_from_buffer(PyTypeObject *type, PyObject *args,
+				     PyObject *kwds)
+{
+	static char *kwlist[] = {"buffer", "offset", NULL};
+	PyObject *obj;
+	Py_ssize_t offset = 0;
+	Integer *self;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|n", kwlist, &obj,
+					 &offset))
+		return NULL;
+
+	/* A lock-based fallback would not be shared with other processes. */
+	if (!__atomic_always_lock_free(sizeof(long), 0)) {
+		PyErr_SetString(PyExc_RuntimeError,
+				"atomic.Integer cannot live in shared memory: "
+				"long is not lock free on this platform");
+		return NULL;
+	}
+
+	self = (Integer *)type->tp_alloc(type, 0);
+	if (self == NULL)
+		return NULL;
+
+	self->buffer = atomic_buffer_attach("Integer.from_buffer", obj, offset,
+					    sizeof(long), __alignof__(long),
+					    (void **)&self->target);
+	if (self->buffer == NULL) {
+		Py_DECREF(self);
+		return NULL;
+	}
+
+	return (PyObject *)self;
+}
+
 static PyObject *Integer_repr(Integer *self)
 {
 	long value;
 
-	__atomic_load(&self->value, &value, __ATOMIC_SEQ_CST);
+	__atomic_load(self->target, &value, __ATOMIC_SEQ_CST);
 
 	return PyUnicode_FromFormat("atomic.Integer(%ld)", value);
 }
@@ -37,92 +186,228 @@ static PyObject *Integer_str(Integer *self)
 {
 	long value;
 
-	__atomic_load(&self->value, &value, __ATOMIC_SEQ_CST);
+	__atomic_load(self->target, &value, __ATOMIC_SEQ_CST);
 
 	return PyUnicode_FromFormat("%ld", value);
 }
 
-static PyObject *Integer_get(Integer *self)
+static PyObject *Integer_get(Integer *self, PyObject *const *args,
+			     Py_ssize_t nargs, PyObject *kwnames)
 {
+	int order = __ATOMIC_SEQ_CST;
 	long x;
 
-	__atomic_load(&self->value, &x, __ATOMIC_SEQ_CST);
+	if (!atomic_check_nargs("get", nargs, 0) ||
+	    !atomic_parse_order("get", args, nargs, kwnames, ATOMIC_ORDER_LOAD,
+				&order))
+		return NULL;
+
+	x = ATOMIC_LOAD_N(self->target, order);
 
 	return PyLong_FromLong(x);
 }
 
-static PyObject *Integer_set(Integer *self, PyObject *args)
+static PyObject *Integer_set(Integer *self, PyObject *const *args,
+			     Py_ssize_t nargs, PyObject *kwnames)
 {
+	int order = __ATOMIC_SEQ_CST;
 	long value;
 
-	if (!PyArg_ParseTuple(args, "l", &value))
+	if (!atomic_check_nargs("set", nargs, 1) ||
+	    !atomic_parse_order("set", args, nargs, kwnames, ATOMIC_ORDER_STORE,
+				&order) ||
+	    !atomic_long_arg(args[0], &value))
 		return NULL;
 
-	__atomic_store(&self->value, &value, __ATOMIC_SEQ_CST);
+	ATOMIC_STORE_N(self->target, value, order);
 
 	Py_RETURN_NONE;
 }
 
-static PyObject *Integer_get_and_set(Integer *self, PyObject *args)
+static PyObject *Integer_get_and_set(Integer *self, PyObject *const *args,
+				     Py_ssize_t nargs, PyObject *kwnames)
 {
+	int order = __ATOMIC_SEQ_CST;
 	long value, ret;
 
-	if (!PyArg_ParseTuple(args, "l", &value))
+	if (!atomic_check_nargs("get_and_set", nargs, 1) ||
+	    !atomic_parse_order("get_and_set", args, nargs, kwnames,
+				ATOMIC_ORDER_RMW, &order) ||
+	    !atomic_long_arg(args[0], &value))
 		return NULL;
 
-	__atomic_exchange(&self->value, &value, &ret, __ATOMIC_SEQ_CST);
+	ret = ATOMIC_RMW_N(__atomic_exchange_n, self->target, value, order);
 
 	return PyLong_FromLong(ret);
 }
 
-static PyObject *Integer_compare_and_set(Integer *self, PyObject *args)
+static PyObject *Integer_compare_and_set(Integer *self, PyObject *const *args,
+					 Py_ssize_t nargs, PyObject *kwnames)
 {
+	int success = __ATOMIC_SEQ_CST, failure = __ATOMIC_SEQ_CST;
 	long expect, update, ret;
 
-	if (!PyArg_ParseTuple(args, "ll", &expect, &update))
+	if (!atomic_check_nargs("compare_and_set", nargs, 2) ||
+	    !atomic_parse_cas_orders("compare_and_set", args, nargs, kwnames,
+				     &success, &failure) ||
+	    !atomic_long_arg(args[0], &expect) ||
+	    !atomic_long_arg(args[1], &update))
 		return NULL;
 
-	ret = __atomic_compare_exchange(&self->value, &expect, &update, 0,
-					__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	ret = ATOMIC_CAS_N(self->target, &expect, update, 0, success, failure);
+	ATOMIC_STATS_CAS(ATOMIC_STATS_PTR(self), ATOMIC_STATS_INTEGER, ret, 0);
 
 	return PyBool_FromLong(ret);
 }
 
-static PyObject *Integer_weak_compare_and_set(Integer *self, PyObject *args)
+static PyObject *Integer_weak_compare_and_set(Integer *self, PyObject *const *args,
+					      Py_ssize_t nargs, PyObject *kwnames)
 {
+	int success = __ATOMIC_SEQ_CST, failure = __ATOMIC_SEQ_CST;
 	long expect, update, ret;
+	ATOMIC_STATS_ONLY(long expected;)
 
-	if (!PyArg_ParseTuple(args, "ll", &expect, &update))
+	if (!atomic_check_nargs("weak_compare_and_set", nargs, 2) ||
+	    !atomic_parse_cas_orders("weak_compare_and_set", args, nargs,
+				     kwnames, &success, &failure) ||
+	    !atomic_long_arg(args[0], &expect) ||
+	    !atomic_long_arg(args[1], &update))
 		return NULL;
 
-	ret = __atomic_compare_exchange(&self->value, &expect, &update, 1,
-					__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	ATOMIC_STATS_ONLY(expected = expect;)
+	ret = ATOMIC_CAS_N(self->target, &expect, update, 1, success, failure);
+	ATOMIC_STATS_CAS(ATOMIC_STATS_PTR(self), ATOMIC_STATS_INTEGER, ret,
+			 expect == expected);
 
 	return PyBool_FromLong(ret);
 }
 
+ATOMIC_STATS_GETTER(Integer_stats, Integer)
+
+/*
+ * Replace the value with fn(value), or fn(value, x) if x is given, until the
+ * compare-and-swap succeeds. When fn is one of the functions
+ * atomic_accumulator() knows, it is applied in C without calling it.
+ */
+static int Integer_update(Integer *self, PyObject *fn, PyObject *x, int order,
+			  unsigned int max_spin, long *oldp, long *newp)
+{
+	int failure = atomic_failure_order(order);
+	int kind = ATOMIC_ACCUMULATE_CALL, ret;
+	struct atomic_backoff backoff;
+	PyObject *value, *result;
+	long old, new, operand = 0;
+	ATOMIC_STATS_ONLY(long expected;)
+
+	/* An operand that is not a C long leaves the result to fn itself. */
+	if (x && PyLong_CheckExact(x)) {
+		kind = atomic_accumulator(fn);
+		if (kind != ATOMIC_ACCUMULATE_CALL &&
+		    !atomic_long_arg(x, &operand)) {
+			PyErr_Clear();
+			kind = ATOMIC_ACCUMULATE_CALL;
+		}
+	}
+
+	atomic_backoff_init(&backoff, max_spin);
+	old = ATOMIC_LOAD_N(self->target, failure);
+	for (;;) {
+		if (kind != ATOMIC_ACCUMULATE_CALL) {
+			if (!atomic_accumulate_long(kind, old, operand, &new))
+				return 0;
+		} else {
+			value = PyLong_FromLong(old);
+			if (value == NULL)
+				return 0;
+			if (x)
+				result = PyObject_CallFunctionObjArgs(fn, value,
+								      x, NULL);
+			else
+				result = PyObject_CallOneArg(fn, value);
+			Py_DECREF(value);
+			if (result == NULL)
+				return 0;
+			ret = atomic_long_arg(result, &new);
+			Py_DECREF(result);
+			if (!ret)
+				return 0;
+		}
+
+		if (new == old)
+			break;
+
+		ATOMIC_STATS_ONLY(expected = old;)
+		ret = ATOMIC_CAS_N(self->target, &old, new, 1, order, failure);
+		ATOMIC_STATS_LOOP_CAS(ATOMIC_STATS_PTR(self), ATOMIC_STATS_INTEGER,
+				      ret, old == expected);
+		if (ret)
+			break;
+		atomic_backoff_wait(&backoff);
+	}
+
+	*oldp = old;
+	*newp = new;
+	return 1;
+}
+
+/* which is 0 to return the old value, 1 to return the new one. */
+#define Integer_METHOD_UPDATE(method, nargs_expected, which)			\
+static PyObject *Integer_##method(Integer *self, PyObject *const *args,	\
+				  Py_ssize_t nargs, PyObject *kwnames)		\
+{										\
+	unsigned int max_spin = ATOMIC_DEFAULT_MAX_SPIN;			\
+	int order = __ATOMIC_SEQ_CST;						\
+	long old, new;								\
+										\
+	if (!atomic_check_nargs(#method, nargs, nargs_expected) ||		\
+	    !atomic_parse_update_kwargs(#method, args, nargs, kwnames,		\
+					&order, &max_spin))			\
+		return NULL;							\
+										\
+	if (!Integer_update(self, args[nargs - 1],				\
+			    nargs == 2 ? args[0] : NULL, order, max_spin,	\
+			    &old, &new))					\
+		return NULL;							\
+										\
+	return PyLong_FromLong((which) ? new : old);				\
+}
+
+Integer_METHOD_UPDATE(update_and_get, 1, 1)
+Integer_METHOD_UPDATE(get_and_update, 1, 0)
+Integer_METHOD_UPDATE(accumulate_and_get, 2, 1)
+
 #define Integer_GET_AND(name)							\
-static PyObject *Integer_get_and_##name(Integer *self, PyObject *args)		\
+static PyObject *Integer_get_and_##name(Integer *self, PyObject *const *args,	\
+					Py_ssize_t nargs, PyObject *kwnames)	\
 {										\
+	int order = __ATOMIC_SEQ_CST;						\
 	long value, ret;							\
 										\
-	if (!PyArg_ParseTuple(args, "l", &value))				\
+	if (!atomic_check_nargs("get_and_" #name, nargs, 1) ||			\
+	    !atomic_parse_order("get_and_" #name, args, nargs, kwnames,		\
+				ATOMIC_ORDER_RMW, &order) ||			\
+	    !atomic_long_arg(args[0], &value))					\
 		return NULL;							\
 										\
-	ret = __atomic_fetch_##name(&self->value, value, __ATOMIC_SEQ_CST);	\
+	ret = ATOMIC_RMW_N(__atomic_fetch_##name, self->target, value, order);	\
 										\
 	return PyLong_FromLong(ret);						\
 }
 
 #define Integer_AND_GET(name)							\
-static PyObject *Integer_##name##_and_get(Integer *self, PyObject *args)	\
+static PyObject *Integer_##name##_and_get(Integer *self, PyObject *const *args,	\
+					  Py_ssize_t nargs, PyObject *kwnames)	\
 {										\
+	int order = __ATOMIC_SEQ_CST;						\
 	long value, ret;							\
 										\
-	if (!PyArg_ParseTuple(args, "l", &value))				\
+	if (!atomic_check_nargs(#name "_and_get", nargs, 1) ||			\
+	    !atomic_parse_order(#name "_and_get", args, nargs, kwnames,		\
+				ATOMIC_ORDER_RMW, &order) ||			\
+	    !atomic_long_arg(args[0], &value))					\
 		return NULL;							\
 										\
-	ret = __atomic_##name##_fetch(&self->value, value, __ATOMIC_SEQ_CST);	\
+	ret = ATOMIC_RMW_N(__atomic_##name##_fetch, self->target, value, order);	\
 										\
 	return PyLong_FromLong(ret);						\
 }
@@ -141,75 +426,332 @@ Integer_AND_GET(xor)
 Integer_AND_GET(or)
 Integer_AND_GET(nand)
 
+/*
+ * Number protocol. The in-place operators are single atomic read-modify-writes
+ * that return self, so "counter += 1" updates the shared value rather than
+ * rebinding the name to a new int; __int__ and __index__ are atomic loads.
+ */
+#define Integer_INPLACE(name)							\
+static PyObject *Integer_inplace_##name(Integer *self, PyObject *other)	\
+{										\
+	long value;								\
+										\
+	if (!PyIndex_Check(other))						\
+		Py_RETURN_NOTIMPLEMENTED;					\
+	if (!atomic_long_arg(other, &value))					\
+		return NULL;							\
+										\
+	__atomic_fetch_##name(self->target, value, __ATOMIC_SEQ_CST);		\
+										\
+	Py_INCREF(self);							\
+	return (PyObject *)self;						\
+}
+
+Integer_INPLACE(add)
+Integer_INPLACE(sub)
+Integer_INPLACE(and)
+Integer_INPLACE(xor)
+Integer_INPLACE(or)
+
+static PyObject *Integer_index(Integer *self)
+{
+	return PyLong_FromLong(__atomic_load_n(self->target, __ATOMIC_SEQ_CST));
+}
+
+/* Compare by value against ints and other atomic.Integer objects. */
+static PyObject *Integer_richcompare(Integer *self, PyObject *other, int op)
+{
+	long value, other_value;
+	PyObject *self_long, *ret;
+	int overflow;
+
+	value = __atomic_load_n(self->target, __ATOMIC_SEQ_CST);
+
+	if (Py_TYPE(other) == Py_TYPE(self)) {
+		other_value = __atomic_load_n(((Integer *)other)->target,
+					      __ATOMIC_SEQ_CST);
+		Py_RETURN_RICHCOMPARE(value, other_value, op);
+	}
+
+	if (PyLong_CheckExact(other)) {
+		other_value = PyLong_AsLongAndOverflow(other, &overflow);
+		if (overflow == 0) {
+			if (other_value == -1 && PyErr_Occurred())
+				return NULL;
+			Py_RETURN_RICHCOMPARE(value, other_value, op);
+		}
+		/* Out of range for a long: the sign decides. */
+		Py_RETURN_RICHCOMPARE(0, overflow, op);
+	}
+
+	/* Anything else (floats, int subclasses, ...) compares as an int. */
+	self_long = PyLong_FromLong(value);
+	if (self_long == NULL)
+		return NULL;
+	ret = PyObject_RichCompare(self_long, other, op);
+	Py_DECREF(self_long);
+	return ret;
+}
+
+/* Longest sleep on a value in shared memory between checks of all its bits. */
+#define INTEGER_WAIT_SLICE_NS 10000000L
+
+/*
+ * Like C++20 atomic::wait(), a change only ends a sleep together with the
+ * notify that must follow it. A private Integer sleeps on its own epoch word,
+ * which every notify bumps, so no notify can be missed. A value in shared
+ * memory has no room for one and sleeps on its low 32 bits instead; a change
+ * confined to the high bits leaves that word alone and the kernel would not
+ * wake the sleeper, so it sleeps in slices and checks the whole value between
+ * them.
+ */
+static PyObject *Integer_wait(Integer *self, PyObject *const *args,
+			      Py_ssize_t nargs, PyObject *kwnames)
+{
+	static const char *const kwlist[] = {"timeout", "order", NULL};
+	PyObject *kwargs[] = {NULL, NULL};
+	struct timespec deadline, *deadlinep, slice, *until;
+	int order = __ATOMIC_SEQ_CST, shared = self->buffer != NULL, err;
+	uint32_t *word, expected;
+	long old;
+
+	if (nargs < 1 || nargs > 2) {
+		PyErr_Format(PyExc_TypeError,
+			     "wait() takes 1 or 2 positional arguments (%zd given)",
+			     nargs);
+		return NULL;
+	}
+	if (!atomic_parse_kwargs("wait", args, nargs, kwnames, kwlist, kwargs))
+		return NULL;
+	if (nargs == 2) {
+		if (kwargs[0]) {
+			PyErr_SetString(PyExc_TypeError,
+					"wait() got multiple values for argument 'timeout'");
+			return NULL;
+		}
+		kwargs[0] = args[1];
+	}
+	if (!atomic_order_arg(kwargs[1], ATOMIC_ORDER_LOAD, &order) ||
+	    !atomic_long_arg(args[0], &old) ||
+	    atomic_futex_deadline(kwargs[0], &deadline, &deadlinep) < 0)
+		return NULL;
+
+	for (;;) {
+		if (ATOMIC_LOAD_N(self->target, order) != old)
+			Py_RETURN_TRUE;
+
+		/*
+		 * Register before reading the epoch and checking the value
+		 * again: a notify that does not see this waiter comes after
+		 * the check, which then sees the change it announces.
+		 */
+		__atomic_fetch_add(&self->waiters, 1, __ATOMIC_SEQ_CST);
+		if (shared) {
+			word = atomic_futex_low_word(self->target);
+			expected = (uint32_t)old;
+		} else {
+			word = &self->epoch;
+			expected = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+		}
+		if (ATOMIC_LOAD_N(self->target, __ATOMIC_SEQ_CST) != old) {
+			__atomic_fetch_sub(&self->waiters, 1, __ATOMIC_RELAXED);
+			Py_RETURN_TRUE;
+		}
+
+		until = deadlinep;
+		if (shared) {
+			clock_gettime(CLOCK_MONOTONIC, &slice);
+			slice.tv_nsec += INTEGER_WAIT_SLICE_NS;
+			if (slice.tv_nsec >= 1000000000) {
+				slice.tv_sec++;
+				slice.tv_nsec -= 1000000000;
+			}
+			if (deadlinep == NULL ||
+			    slice.tv_sec < deadlinep->tv_sec ||
+			    (slice.tv_sec == deadlinep->tv_sec &&
+			     slice.tv_nsec < deadlinep->tv_nsec))
+				until = &slice;
+		}
+
+		Py_BEGIN_ALLOW_THREADS
+		err = atomic_futex_wait(word, expected, until, shared);
+		Py_END_ALLOW_THREADS
+		__atomic_fetch_sub(&self->waiters, 1, __ATOMIC_RELAXED);
+
+		if (err == ETIMEDOUT && until == deadlinep)
+			return PyBool_FromLong(ATOMIC_LOAD_N(self->target,
+							     order) != old);
+		if (err == EINTR && PyErr_CheckSignals() < 0)
+			return NULL;
+	}
+}
+
+static void Integer_notify(Integer *self, int count)
+{
+	/*
+	 * Pairs with the increment in wait(): either the waiter is counted
+	 * here, or its futex call sees the value this thread already stored.
+	 * Waiters in other processes are invisible, so shared memory always
+	 * takes the system call.
+	 */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (self->buffer == NULL &&
+	    __atomic_load_n(&self->waiters, __ATOMIC_RELAXED) == 0)
+		return;
+
+	if (self->buffer) {
+		atomic_futex_wake(atomic_futex_low_word(self->target), count, 1);
+	} else {
+		/* A waiter that read the old epoch fails to fall asleep. */
+		__atomic_fetch_add(&self->epoch, 1, __ATOMIC_SEQ_CST);
+		atomic_futex_wake(&self->epoch, count, 0);
+	}
+}
+
+static PyObject *Integer_notify_one(Integer *self)
+{
+	Integer_notify(self, 1);
+	Py_RETURN_NONE;
+}
+
+static PyObject *Integer_notify_all(Integer *self)
+{
+	Integer_notify(self, INT_MAX);
+	Py_RETURN_NONE;
+}
+
 static PyMethodDef Integer_methods[] = {
-	{"get", (PyCFunction)Integer_get, METH_NOARGS,
-	 "get() -> int\n\n"
+	{"from_buffer", (PyCFunction)(void (*)(void))Integer_from_buffer,
+	 METH_CLASS | METH_VARARGS | METH_KEYWORDS,
+	 "from_buffer(buffer, offset=0) -> Integer\n\n"
+	 "Return an atomic.Integer whose value is the C long at the given byte\n"
+	 "offset in a writable buffer, such as an mmap or the buf of a\n"
+	 "multiprocessing.shared_memory.SharedMemory. Nothing is written: the\n"
+	 "integer starts with whatever the buffer holds. Every process that maps\n"
+	 "the same memory sees the same value, and operations stay lock free.\n\n"
+	 "The offset must leave the value aligned to sizeof(long). The buffer's\n"
+	 "export is held until the integer is deleted, so close the mmap or\n"
+	 "SharedMemory only after that."},
+	{"wait", (PyCFunction)(void (*)(void))Integer_wait,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "wait(old, timeout=None, *, order=atomic.SEQ_CST) -> bool\n\n"
+	 "Block until the value differs from old, without holding the GIL.\n"
+	 "Returns True once a different value is seen, or False if timeout\n"
+	 "seconds pass first. Like C++20 atomic::wait(), a change is only\n"
+	 "guaranteed to be noticed if the writer then calls notify_one() or\n"
+	 "notify_all(). Works across processes for Integer.from_buffer()."},
+	{"notify_one", (PyCFunction)Integer_notify_one, METH_NOARGS,
+	 "notify_one()\n\n"
+	 "Wake one thread blocked in wait() on this integer, if any."},
+	{"notify_all", (PyCFunction)Integer_notify_all, METH_NOARGS,
+	 "notify_all()\n\n"
+	 "Wake every thread blocked in wait() on this integer."},
+	{"get", (PyCFunction)(void (*)(void))Integer_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get(*, order=atomic.SEQ_CST) -> int\n\n"
 	 "Atomically load and return the value of this integer."},
-	{"set", (PyCFunction)Integer_set, METH_VARARGS,
-	 "set(x)\n\n"
+	{"set", (PyCFunction)(void (*)(void))Integer_set,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "set(x, *, order=atomic.SEQ_CST)\n\n"
 	 "Atomically store the given value in this integer."},
 
-	{"get_and_set", (PyCFunction)Integer_get_and_set, METH_VARARGS,
-	 "get_and_set(x) -> int\n\n"
+	{"get_and_set", (PyCFunction)(void (*)(void))Integer_get_and_set,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_set(x, *, order=atomic.SEQ_CST) -> int\n\n"
 	 "Atomically store the given value and return the old value."},
-	{"compare_and_set", (PyCFunction)Integer_compare_and_set, METH_VARARGS,
-	 "compare_and_set(expect, update) -> bool\n\n"
+	{"compare_and_set", (PyCFunction)(void (*)(void))Integer_compare_and_set,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "compare_and_set(expect, update, *, order=atomic.SEQ_CST,\n"
+	 "                failure_order=None) -> bool\n\n"
 	 "Atomically store the given value if the old value equals the given expected\n"
 	 "value, returning whether the actual value equaled the expected value."},
-	{"weak_compare_and_set", (PyCFunction)Integer_weak_compare_and_set, METH_VARARGS,
-	 "weak_compare_and_set(expect, update) -> bool\n\n"
-	 "compare_and_set, but can fail spuriously and does not provide ordering\n"
-	 "guarantees."},
-
-	{"get_and_add", (PyCFunction)Integer_get_and_add, METH_VARARGS,
-	 "get_and_add(x) -> int\n\n"
+	{"weak_compare_and_set", (PyCFunction)(void (*)(void))Integer_weak_compare_and_set,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "weak_compare_and_set(expect, update, *, order=atomic.SEQ_CST,\n"
+	 "                     failure_order=None) -> bool\n\n"
+	 "compare_and_set, but can fail spuriously."},
+
+	{"get_and_add", (PyCFunction)(void (*)(void))Integer_get_and_add,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_add(x, *, order=atomic.SEQ_CST) -> int\n\n"
 	 "Atomically add the given value to this integer and return the previously stored\n"
 	 "value."},
-	{"get_and_sub", (PyCFunction)Integer_get_and_sub, METH_VARARGS,
-	 "get_and_sub(x) -> int\n\n"
+	{"get_and_sub", (PyCFunction)(void (*)(void))Integer_get_and_sub,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_sub(x, *, order=atomic.SEQ_CST) -> int\n\n"
 	 "Atomically subtract the given value from this integer and return the previously\n"
 	 "stored value."},
-	{"get_and_and", (PyCFunction)Integer_get_and_and, METH_VARARGS,
-	 "get_and_and(x) -> int\n\n"
+	{"get_and_and", (PyCFunction)(void (*)(void))Integer_get_and_and,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_and(x, *, order=atomic.SEQ_CST) -> int\n\n"
 	 "Atomically bitwise-and the given value with this integer and return the\n"
 	 "previously stored value."},
-	{"get_and_xor", (PyCFunction)Integer_get_and_xor, METH_VARARGS,
-	 "get_and_xor(x) -> int\n\n"
+	{"get_and_xor", (PyCFunction)(void (*)(void))Integer_get_and_xor,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_xor(x, *, order=atomic.SEQ_CST) -> int\n\n"
 	 "Atomically bitwise-xor the given value with this integer and return the\n"
 	 "previously stored value."},
-	{"get_and_or", (PyCFunction)Integer_get_and_or, METH_VARARGS,
-	 "get_and_or(x) -> int\n\n"
+	{"get_and_or", (PyCFunction)(void (*)(void))Integer_get_and_or,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_or(x, *, order=atomic.SEQ_CST) -> int\n\n"
 	 "Atomically bitwise-or the given value with this integer and return the\n"
 	 "previously stored value."},
-	{"get_and_nand", (PyCFunction)Integer_get_and_nand, METH_VARARGS,
-	 "get_and_nand(x) -> int\n\n"
+	{"get_and_nand", (PyCFunction)(void (*)(void))Integer_get_and_nand,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_nand(x, *, order=atomic.SEQ_CST) -> int\n\n"
 	 "Atomically bitwise-nand the given value with this integer and return the\n"
 	 "previously stored value."},
 
-	{"add_and_get", (PyCFunction)Integer_add_and_get, METH_VARARGS,
-	 "add_and_get(x) -> int\n\n"
+	{"add_and_get", (PyCFunction)(void (*)(void))Integer_add_and_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "add_and_get(x, *, order=atomic.SEQ_CST) -> int\n\n"
 	 "Atomically add the given value to this integer and return the resulting value."},
-	{"sub_and_get", (PyCFunction)Integer_sub_and_get, METH_VARARGS,
-	 "sub_and_get(x) -> int\n\n"
+	{"sub_and_get", (PyCFunction)(void (*)(void))Integer_sub_and_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "sub_and_get(x, *, order=atomic.SEQ_CST) -> int\n\n"
 	 "Atomically subtract the given value from this integer and return the resulting\n"
 	 "value."},
-	{"and_and_get", (PyCFunction)Integer_and_and_get, METH_VARARGS,
-	 "and_and_get(x) -> int\n\n"
+	{"and_and_get", (PyCFunction)(void (*)(void))Integer_and_and_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "and_and_get(x, *, order=atomic.SEQ_CST) -> int\n\n"
 	 "Atomically bitwise-and the given value with this integer and return the\n"
 	 "resulting value."},
-	{"xor_and_get", (PyCFunction)Integer_xor_and_get, METH_VARARGS,
-	 "xor_and_get(x) -> int\n\n"
+	{"xor_and_get", (PyCFunction)(void (*)(void))Integer_xor_and_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "xor_and_get(x, *, order=atomic.SEQ_CST) -> int\n\n"
 	 "Atomically bitwise-xor the given value with this integer and return the\n"
 	 "resulting value."},
-	{"or_and_get", (PyCFunction)Integer_or_and_get, METH_VARARGS,
-	 "or_and_get(x) -> int\n\n"
+	{"or_and_get", (PyCFunction)(void (*)(void))Integer_or_and_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "or_and_get(x, *, order=atomic.SEQ_CST) -> int\n\n"
 	 "Atomically bitwise-or the given value to this integer and return the resulting\n"
 	 "value."},
-	{"nand_and_get", (PyCFunction)Integer_nand_and_get, METH_VARARGS,
-	 "nand_and_get(x) -> int\n\n"
+	{"nand_and_get", (PyCFunction)(void (*)(void))Integer_nand_and_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "nand_and_get(x, *, order=atomic.SEQ_CST) -> int\n\n"
 	 "Atomically bitwise-nand the given value to this integer and return the\n"
 	 "resulting value."},
 
+	{"update_and_get", (PyCFunction)(void (*)(void))Integer_update_and_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "update_and_get(fn, *, order=atomic.SEQ_CST, max_spin=128) -> int\n\n"
+	 "Atomically replace the value with fn(value) and return the new value.\n"
+	 "fn is called again with the latest value whenever another thread\n"
+	 "changed it first, so it should be free of side effects. Retries pause\n"
+	 "the CPU for up to max_spin iterations, then yield to other threads."},
+	{"get_and_update", (PyCFunction)(void (*)(void))Integer_get_and_update,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_update(fn, *, order=atomic.SEQ_CST, max_spin=128) -> int\n\n"
+	 "update_and_get, but return the previously stored value."},
+	{"accumulate_and_get", (PyCFunction)(void (*)(void))Integer_accumulate_and_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "accumulate_and_get(x, fn, *, order=atomic.SEQ_CST, max_spin=128) -> int\n\n"
+	 "Atomically replace the value with fn(value, x) and return the new value.\n"
+	 "When fn is max, min, or operator.add, sub, and_, or_ or xor, it is\n"
+	 "applied without calling back into Python."},
+
+	ATOMIC_STATS_METHOD_DEF(Integer_stats),
+
 	{NULL, NULL, 0, NULL}
 };
 
@@ -217,48 +759,44 @@ static PyMethodDef Integer_methods[] = {
 	"atomic.Integer(x=0) -> new atomic integer\n\n" \
 	"Integer supporting atomic operations with the range of a C long and\n" \
 	"sequentially consistent semantics.\n\n" \
+	"Every operation takes an order= keyword (atomic.RELAXED, ACQUIRE,\n" \
+	"RELEASE, ACQ_REL or SEQ_CST) to weaken that default; compare_and_set()\n" \
+	"also takes failure_order=, which defaults to the matching C++ order.\n\n" \
 	"Atomic load (get()), store (set()), exchange (get_and_set()),\n" \
 	"and compare-and-exchange (compare_and_set()) are supported.\n\n" \
 	"The get_and_x methods atomically load, update, and store the result of an\n" \
 	"operation. They return the value that was previously stored.\n\n" \
 	"The x_and_get methods atomically load, update, and store the result of an\n" \
-	"operation. They return the result of the operation."
-
-PyTypeObject Integer_type = {
-	PyVarObject_HEAD_INIT(NULL, 0)
-	"atomic.Integer",		/* tp_name */
-	sizeof(Integer),		/* tp_basicsize */
-	0,				/* tp_itemsize */
-	NULL,				/* tp_dealloc */
-	NULL,				/* tp_print */
-	NULL,				/* tp_getattr */
-	NULL,				/* tp_setattr */
-	NULL,				/* tp_reserved */
-	(reprfunc)Integer_repr,		/* tp_repr */
-	NULL,				/* tp_as_number */
-	NULL,				/* tp_as_sequence */
-	NULL,				/* tp_as_mapping */
-	NULL,				/* tp_hash  */
-	NULL,				/* tp_call */
-	(reprfunc)Integer_str,		/* tp_str */
-	NULL,				/* tp_getattro */
-	NULL,				/* tp_setattro */
-	NULL,				/* tp_as_buffer */
-	Py_TPFLAGS_DEFAULT,		/* tp_flags */
-	ATOMIC_INTEGER_DOCSTRING,	/* tp_doc */
-	NULL,				/* tp_traverse */
-	NULL,				/* tp_clear */
-	NULL,				/* tp_richcompare */
-	0,				/* tp_weaklistoffset */
-	NULL,				/* tp_iter */
-	NULL,				/* tp_iternext */
-	Integer_methods,		/* tp_methods */
-	NULL,				/* tp_members */
-	NULL,				/* tp_getset */
-	NULL,				/* tp_base */
-	NULL,				/* tp_dict */
-	NULL,				/* tp_descr_get */
-	NULL,				/* tp_descr_set */
-	0,				/* tp_dictoffset */
-	(initproc)Integer_init,		/* tp_init */
+	"operation. They return the result of the operation.\n\n" \
+	"The in-place operators +=, -=, &=, ^= and |= are atomic updates of this\n" \
+	"object, so \"counter += 1\" is safe from any number of threads. int(),\n" \
+	"operator.index() and comparisons read the current value. Since the value\n" \
+	"changes, integers compare by value but are not hashable.\n\n" \
+	"Integer.from_buffer() places the value in shared memory instead, for\n" \
+	"counters and flags shared between processes."
+
+static PyType_Slot Integer_slots[] = {
+	{Py_tp_dealloc, Integer_dealloc},
+	{Py_tp_repr, Integer_repr},
+	{Py_tp_str, Integer_str},
+	{Py_tp_richcompare, Integer_richcompare},
+	{Py_nb_int, Integer_index},
+	{Py_nb_index, Integer_index},
+	{Py_nb_inplace_add, Integer_inplace_add},
+	{Py_nb_inplace_subtract, Integer_inplace_sub},
+	{Py_nb_inplace_and, Integer_inplace_and},
+	{Py_nb_inplace_xor, Integer_inplace_xor},
+	{Py_nb_inplace_or, Integer_inplace_or},
+	{Py_tp_doc, ATOMIC_INTEGER_DOCSTRING},
+	{Py_tp_methods, Integer_methods},
+	{Py_tp_init, Integer_init},
+	{Py_tp_new, Integer_new},
+	{0, NULL}
+};
+
+PyType_Spec Integer_spec = {
+	.name = "atomic.Integer",
+	.basicsize = sizeof(Integer),
+	.flags = ATOMIC_TPFLAGS_DEFAULT,
+	.slots = Integer_slots,
 };
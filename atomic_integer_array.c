@@ -0,0 +1,923 @@
+#include <Python.h>
+#include <stdint.h>
+
+#include "atomic.h"
+#include "atomic_stats.h"
+
+/*
+ * items is either owned (PyMem_Calloc) or, for IntegerArray.from_buffer(),
+ * points into a caller's buffer whose export the memoryview buffer holds.
+ */
+typedef struct {
+	PyObject_HEAD
+	Py_ssize_t length;
+	long *items;
+	PyObject *buffer;
+	ATOMIC_STATS_MEMBER
+} IntegerArray;
+
+static const Py_ssize_t IntegerArray_stride = sizeof(long);
+
+static int IntegerArray_init(IntegerArray *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = {"n", NULL};
+	Py_ssize_t length;
+	long *items;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "n", kwlist, &length))
+		return -1;
+
+	if (length < 0) {
+		PyErr_SetString(PyExc_ValueError,
+				"atomic.IntegerArray length must be non-negative");
+		return -1;
+	}
+
+	if (self->items || self->buffer) {
+		PyErr_SetString(PyExc_RuntimeError,
+				"atomic.IntegerArray is already initialized");
+		return -1;
+	}
+
+	items = PyMem_Calloc(length ? length : 1, sizeof(*items));
+	if (items == NULL) {
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	if (!atomic_long_is_lock_free) {
+		if (PyErr_WarnEx(PyExc_RuntimeWarning,
+				 "atomic.IntegerArray is not lock free", 1) < 0) {
+			PyMem_Free(items);
+			return -1;
+		}
+	}
+
+	self->length = length;
+	self->items = items;
+
+	return 0;
+}
+
+static void IntegerArray_dealloc(IntegerArray *self)
+{
+	PyTypeObject *tp = Py_TYPE(self);
+
+	if (self->buffer)
+		Py_DECREF(self->buffer);
+	else
+		PyMem_Free(self->items);
+	tp->tp_free((PyObject *)self);
+	Py_DECREF(tp);
+}
+
+static PyObject *IntegerArray_from_buffer(PyTypeObject *type, PyObject *args,
+					  PyObject *kwds)
+{
+	static char *kwlist[] = {"buffer", "n", "offset", NULL};
+	PyObject *obj, *n_obj = Py_None;
+	Py_ssize_t length, offset = 0;
+	IntegerArray *self;
+	Py_buffer view;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|On", kwlist, &obj,
+					 &n_obj, &offset))
+		return NULL;
+
+	if (!__atomic_always_lock_free(sizeof(long), 0)) {
+		PyErr_SetString(PyExc_RuntimeError,
+				"atomic.IntegerArray cannot live in shared "
+				"memory: long is not lock free on this platform");
+		return NULL;
+	}
+
+	if (n_obj == Py_None) {
+		/* Default to every whole element after offset. */
+		if (PyObject_GetBuffer(obj, &view, PyBUF_SIMPLE) < 0)
+			return NULL;
+		length = offset >= 0 && offset <= view.len ?
+			 (view.len - offset) / IntegerArray_stride : 0;
+		PyBuffer_Release(&view);
+	} else {
+		length = PyNumber_AsSsize_t(n_obj, PyExc_OverflowError);
+		if (length == -1 && PyErr_Occurred())
+			return NULL;
+		if (length < 0 || length > PY_SSIZE_T_MAX / IntegerArray_stride) {
+			PyErr_SetString(PyExc_ValueError,
+					"atomic.IntegerArray length must be "
+					"non-negative");
+			return NULL;
+		}
+	}
+
+	self = (IntegerArray *)type->tp_alloc(type, 0);
+	if (self == NULL)
+		return NULL;
+
+	self->buffer = atomic_buffer_attach("IntegerArray.from_buffer", obj,
+					    offset, length * IntegerArray_stride,
+					    __alignof__(long),
+					    (void **)&self->items);
+	if (self->buffer == NULL) {
+		Py_DECREF(self);
+		return NULL;
+	}
+	self->length = length;
+
+	return (PyObject *)self;
+}
+
+/*
+ * Resolve a Python index (negative indices count from the end) to the address
+ * of the element, or return NULL with IndexError set.
+ */
+static long *IntegerArray_item_ptr(IntegerArray *self, PyObject *arg)
+{
+	Py_ssize_t i;
+
+	i = PyNumber_AsSsize_t(arg, PyExc_IndexError);
+	if (i == -1 && PyErr_Occurred())
+		return NULL;
+
+	if (i < 0)
+		i += self->length;
+	if (i < 0 || i >= self->length) {
+		PyErr_SetString(PyExc_IndexError,
+				"atomic.IntegerArray index out of range");
+		return NULL;
+	}
+
+	return &self->items[i];
+}
+
+static PyObject *IntegerArray_repr(IntegerArray *self)
+{
+	PyObject *list, *ret;
+	Py_ssize_t i;
+	long value;
+
+	list = PyList_New(self->length);
+	if (list == NULL)
+		return NULL;
+
+	for (i = 0; i < self->length; i++) {
+		PyObject *item;
+
+		__atomic_load(&self->items[i], &value, __ATOMIC_SEQ_CST);
+		item = PyLong_FromLong(value);
+		if (item == NULL) {
+			Py_DECREF(list);
+			return NULL;
+		}
+		PyList_SET_ITEM(list, i, item);
+	}
+
+	ret = PyUnicode_FromFormat("atomic.IntegerArray(%R)", list);
+	Py_DECREF(list);
+	return ret;
+}
+
+static Py_ssize_t IntegerArray_length(IntegerArray *self)
+{
+	return self->length;
+}
+
+static PyObject *IntegerArray_item(IntegerArray *self, Py_ssize_t i)
+{
+	long value;
+
+	if (i < 0 || i >= self->length) {
+		PyErr_SetString(PyExc_IndexError,
+				"atomic.IntegerArray index out of range");
+		return NULL;
+	}
+
+	__atomic_load(&self->items[i], &value, __ATOMIC_SEQ_CST);
+
+	return PyLong_FromLong(value);
+}
+
+static int IntegerArray_getbuffer(IntegerArray *self, Py_buffer *view,
+				  int flags)
+{
+	if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+		PyErr_SetString(PyExc_BufferError,
+				"atomic.IntegerArray buffers are read-only");
+		return -1;
+	}
+
+	view->buf = self->items;
+	view->obj = (PyObject *)self;
+	Py_INCREF(self);
+	view->len = self->length * sizeof(long);
+	view->readonly = 1;
+	view->itemsize = sizeof(long);
+	view->format = (flags & PyBUF_FORMAT) == PyBUF_FORMAT ? "l" : NULL;
+	view->ndim = 1;
+	view->shape = (flags & PyBUF_ND) == PyBUF_ND ? &self->length : NULL;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ?
+			(Py_ssize_t *)&IntegerArray_stride : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+
+	return 0;
+}
+
+static PyObject *IntegerArray_get(IntegerArray *self, PyObject *const *args,
+				  Py_ssize_t nargs, PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	long *item, x;
+
+	if (!atomic_check_nargs("get", nargs, 1) ||
+	    !atomic_parse_order("get", args, nargs, kwnames, ATOMIC_ORDER_LOAD,
+				&order) ||
+	    !(item = IntegerArray_item_ptr(self, args[0])))
+		return NULL;
+
+	x = ATOMIC_LOAD_N(item, order);
+
+	return PyLong_FromLong(x);
+}
+
+static PyObject *IntegerArray_set(IntegerArray *self, PyObject *const *args,
+				  Py_ssize_t nargs, PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	long *item, value;
+
+	if (!atomic_check_nargs("set", nargs, 2) ||
+	    !atomic_parse_order("set", args, nargs, kwnames, ATOMIC_ORDER_STORE,
+				&order) ||
+	    !(item = IntegerArray_item_ptr(self, args[0])) ||
+	    !atomic_long_arg(args[1], &value))
+		return NULL;
+
+	ATOMIC_STORE_N(item, value, order);
+
+	Py_RETURN_NONE;
+}
+
+static PyObject *IntegerArray_get_and_set(IntegerArray *self,
+					  PyObject *const *args,
+					  Py_ssize_t nargs, PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	long *item, value, ret;
+
+	if (!atomic_check_nargs("get_and_set", nargs, 2) ||
+	    !atomic_parse_order("get_and_set", args, nargs, kwnames,
+				ATOMIC_ORDER_RMW, &order) ||
+	    !(item = IntegerArray_item_ptr(self, args[0])) ||
+	    !atomic_long_arg(args[1], &value))
+		return NULL;
+
+	ret = ATOMIC_RMW_N(__atomic_exchange_n, item, value, order);
+
+	return PyLong_FromLong(ret);
+}
+
+static PyObject *IntegerArray_compare_and_set(IntegerArray *self,
+					      PyObject *const *args,
+					      Py_ssize_t nargs,
+					      PyObject *kwnames)
+{
+	int success = __ATOMIC_SEQ_CST, failure = __ATOMIC_SEQ_CST;
+	long *item, expect, update, ret;
+
+	if (!atomic_check_nargs("compare_and_set", nargs, 3) ||
+	    !atomic_parse_cas_orders("compare_and_set", args, nargs, kwnames,
+				     &success, &failure) ||
+	    !(item = IntegerArray_item_ptr(self, args[0])) ||
+	    !atomic_long_arg(args[1], &expect) ||
+	    !atomic_long_arg(args[2], &update))
+		return NULL;
+
+	ret = ATOMIC_CAS_N(item, &expect, update, 0, success, failure);
+	ATOMIC_STATS_CAS(ATOMIC_STATS_PTR(self), ATOMIC_STATS_INTEGER_ARRAY, ret,
+			 0);
+
+	return PyBool_FromLong(ret);
+}
+
+static PyObject *IntegerArray_weak_compare_and_set(IntegerArray *self,
+						   PyObject *const *args,
+						   Py_ssize_t nargs,
+						   PyObject *kwnames)
+{
+	int success = __ATOMIC_SEQ_CST, failure = __ATOMIC_SEQ_CST;
+	long *item, expect, update, ret;
+	ATOMIC_STATS_ONLY(long expected;)
+
+	if (!atomic_check_nargs("weak_compare_and_set", nargs, 3) ||
+	    !atomic_parse_cas_orders("weak_compare_and_set", args, nargs,
+				     kwnames, &success, &failure) ||
+	    !(item = IntegerArray_item_ptr(self, args[0])) ||
+	    !atomic_long_arg(args[1], &expect) ||
+	    !atomic_long_arg(args[2], &update))
+		return NULL;
+
+	ATOMIC_STATS_ONLY(expected = expect;)
+	ret = ATOMIC_CAS_N(item, &expect, update, 1, success, failure);
+	ATOMIC_STATS_CAS(ATOMIC_STATS_PTR(self), ATOMIC_STATS_INTEGER_ARRAY, ret,
+			 expect == expected);
+
+	return PyBool_FromLong(ret);
+}
+
+ATOMIC_STATS_GETTER(IntegerArray_stats, IntegerArray)
+
+#define IntegerArray_GET_AND(name)						\
+static PyObject *IntegerArray_get_and_##name(IntegerArray *self,		\
+					     PyObject *const *args,		\
+					     Py_ssize_t nargs,			\
+					     PyObject *kwnames)			\
+{										\
+	int order = __ATOMIC_SEQ_CST;						\
+	long *item, value, ret;							\
+										\
+	if (!atomic_check_nargs("get_and_" #name, nargs, 2) ||			\
+	    !atomic_parse_order("get_and_" #name, args, nargs, kwnames,		\
+				ATOMIC_ORDER_RMW, &order) ||			\
+	    !(item = IntegerArray_item_ptr(self, args[0])) ||			\
+	    !atomic_long_arg(args[1], &value))					\
+		return NULL;							\
+										\
+	ret = ATOMIC_RMW_N(__atomic_fetch_##name, item, value, order);		\
+										\
+	return PyLong_FromLong(ret);						\
+}
+
+#define IntegerArray_AND_GET(name)						\
+static PyObject *IntegerArray_##name##_and_get(IntegerArray *self,		\
+					       PyObject *const *args,		\
+					       Py_ssize_t nargs,		\
+					       PyObject *kwnames)		\
+{										\
+	int order = __ATOMIC_SEQ_CST;						\
+	long *item, value, ret;							\
+										\
+	if (!atomic_check_nargs(#name "_and_get", nargs, 2) ||			\
+	    !atomic_parse_order(#name "_and_get", args, nargs, kwnames,		\
+				ATOMIC_ORDER_RMW, &order) ||			\
+	    !(item = IntegerArray_item_ptr(self, args[0])) ||			\
+	    !atomic_long_arg(args[1], &value))					\
+		return NULL;							\
+										\
+	ret = ATOMIC_RMW_N(__atomic_##name##_fetch, item, value, order);	\
+										\
+	return PyLong_FromLong(ret);						\
+}
+
+IntegerArray_GET_AND(add)
+IntegerArray_GET_AND(sub)
+IntegerArray_GET_AND(and)
+IntegerArray_GET_AND(xor)
+IntegerArray_GET_AND(or)
+IntegerArray_GET_AND(nand)
+
+IntegerArray_AND_GET(add)
+IntegerArray_AND_GET(sub)
+IntegerArray_AND_GET(and)
+IntegerArray_AND_GET(xor)
+IntegerArray_AND_GET(or)
+IntegerArray_AND_GET(nand)
+
+/*
+ * Bulk operations. Index, delta and output arrays can be any contiguous
+ * buffer of native integers (array.array, numpy integer arrays, ...); the
+ * whole batch then runs in one C loop, with the GIL released for batches large
+ * enough to amortize releasing it.
+ */
+#define INTEGER_ARRAY_GIL_MINSIZE 256
+
+typedef struct {
+	Py_buffer view;
+	Py_ssize_t count;
+	int is_signed;
+} IntegerArray_buffer;
+
+static int IntegerArray_get_buffer(PyObject *obj, IntegerArray_buffer *buf,
+				   int writable, const char *what)
+{
+	const char *format;
+	int flags = PyBUF_FORMAT | PyBUF_C_CONTIGUOUS;
+
+	if (writable)
+		flags |= PyBUF_WRITABLE;
+	if (PyObject_GetBuffer(obj, &buf->view, flags) < 0)
+		return -1;
+
+	format = buf->view.format ? buf->view.format : "B";
+	if (*format == '@' || *format == '=')
+		format++;
+#if PY_LITTLE_ENDIAN
+	else if (*format == '<')
+		format++;
+#else
+	else if (*format == '>' || *format == '!')
+		format++;
+#endif
+	if (!format[0] || format[1] || !strchr("bBhHiIlLqQnN", format[0]) ||
+	    (buf->view.itemsize != 1 && buf->view.itemsize != 2 &&
+	     buf->view.itemsize != 4 && buf->view.itemsize != 8)) {
+		PyErr_Format(PyExc_TypeError,
+			     "%s must be a contiguous buffer of integers, not '%s'",
+			     what, buf->view.format ? buf->view.format : "B");
+		PyBuffer_Release(&buf->view);
+		return -1;
+	}
+
+	buf->is_signed = Py_ISLOWER(format[0]);
+	buf->count = buf->view.len / buf->view.itemsize;
+	return 0;
+}
+
+static inline long IntegerArray_buffer_load(const IntegerArray_buffer *buf,
+					    Py_ssize_t i)
+{
+	const char *p = (const char *)buf->view.buf + i * buf->view.itemsize;
+
+	switch (buf->view.itemsize) {
+	case 1:
+		if (buf->is_signed)
+			return *(const int8_t *)p;
+		return *(const uint8_t *)p;
+	case 2:
+		if (buf->is_signed)
+			return *(const int16_t *)p;
+		return *(const uint16_t *)p;
+	case 4:
+		if (buf->is_signed)
+			return *(const int32_t *)p;
+		return *(const uint32_t *)p;
+	default:
+		return (long)*(const int64_t *)p;
+	}
+}
+
+static inline void IntegerArray_buffer_store(IntegerArray_buffer *buf,
+					     Py_ssize_t i, long value)
+{
+	char *p = (char *)buf->view.buf + i * buf->view.itemsize;
+
+	switch (buf->view.itemsize) {
+	case 1:
+		*(int8_t *)p = (int8_t)value;
+		break;
+	case 2:
+		*(int16_t *)p = (int16_t)value;
+		break;
+	case 4:
+		*(int32_t *)p = (int32_t)value;
+		break;
+	default:
+		*(int64_t *)p = (int64_t)value;
+		break;
+	}
+}
+
+/*
+ * Check and resolve every index, with the GIL held, into a private copy that
+ * the loops then use: a bad batch changes nothing, and another thread
+ * rewriting the caller's buffer once the GIL is released cannot redirect an
+ * access out of bounds.
+ */
+static Py_ssize_t *IntegerArray_resolve_indices(IntegerArray *self,
+						const IntegerArray_buffer *indices)
+{
+	Py_ssize_t *resolved, i;
+	long idx;
+
+	resolved = PyMem_New(Py_ssize_t, indices->count ? indices->count : 1);
+	if (resolved == NULL) {
+		PyErr_NoMemory();
+		return NULL;
+	}
+
+	for (i = 0; i < indices->count; i++) {
+		if (indices->view.itemsize == 8 && !indices->is_signed &&
+		    *((const uint64_t *)indices->view.buf + i) > LONG_MAX) {
+			PyErr_Format(PyExc_IndexError,
+				     "atomic.IntegerArray index %llu out of range",
+				     (unsigned long long)
+				     *((const uint64_t *)indices->view.buf + i));
+			goto err;
+		}
+		idx = IntegerArray_buffer_load(indices, i);
+		if (idx < -self->length || idx >= self->length) {
+			PyErr_Format(PyExc_IndexError,
+				     "atomic.IntegerArray index %ld out of range",
+				     idx);
+			goto err;
+		}
+		resolved[i] = idx < 0 ? idx + self->length : idx;
+	}
+	return resolved;
+
+err:
+	PyMem_Free(resolved);
+	return NULL;
+}
+
+enum IntegerArray_bulk_op {
+	INTEGER_ARRAY_BULK_ADD,
+	INTEGER_ARRAY_BULK_OR,
+};
+
+/*
+ * Shared body of add_many() and or_many(): each operand is either an integer
+ * applied to every index or a buffer with one operand per index.
+ */
+static PyObject *IntegerArray_rmw_many(IntegerArray *self, const char *name,
+				       enum IntegerArray_bulk_op op,
+				       PyObject *const *args, Py_ssize_t nargs,
+				       PyObject *kwnames)
+{
+	static const char *const kwlist[] = {"order", NULL};
+	PyObject *kwargs[] = {NULL};
+	IntegerArray_buffer indices, operands;
+	Py_ssize_t *resolved = NULL, i;
+	PyThreadState *ts = NULL;
+	int order = __ATOMIC_SEQ_CST;
+	long scalar = 0, value;
+	int have_operands = 0;
+
+	if (!atomic_check_nargs(name, nargs, 2) ||
+	    !atomic_parse_kwargs(name, args, nargs, kwnames, kwlist, kwargs) ||
+	    !atomic_order_arg(kwargs[0], ATOMIC_ORDER_RMW, &order))
+		return NULL;
+
+	if (IntegerArray_get_buffer(args[0], &indices, 0, "indices") < 0)
+		return NULL;
+
+	if (PyIndex_Check(args[1])) {
+		if (!atomic_long_arg(args[1], &scalar))
+			goto err;
+	} else {
+		if (IntegerArray_get_buffer(args[1], &operands, 0,
+					    "operands") < 0)
+			goto err;
+		have_operands = 1;
+		if (operands.count != indices.count) {
+			PyErr_Format(PyExc_ValueError,
+				     "%s() got %zd indices but %zd operands",
+				     name, indices.count, operands.count);
+			goto err;
+		}
+	}
+
+	resolved = IntegerArray_resolve_indices(self, &indices);
+	if (resolved == NULL)
+		goto err;
+
+	if (indices.count >= INTEGER_ARRAY_GIL_MINSIZE)
+		ts = PyEval_SaveThread();
+
+#define IntegerArray_RMW_LOOP(fetch_op, order)					\
+	for (i = 0; i < indices.count; i++) {					\
+		value = have_operands ?						\
+			IntegerArray_buffer_load(&operands, i) : scalar;	\
+		fetch_op(&self->items[resolved[i]], value, order);		\
+	}
+#define IntegerArray_ADD_LOOP(order) IntegerArray_RMW_LOOP(__atomic_fetch_add, order)
+#define IntegerArray_OR_LOOP(order) IntegerArray_RMW_LOOP(__atomic_fetch_or, order)
+
+	if (op == INTEGER_ARRAY_BULK_ADD)
+		ATOMIC_WITH_ORDER(order, IntegerArray_ADD_LOOP);
+	else
+		ATOMIC_WITH_ORDER(order, IntegerArray_OR_LOOP);
+
+#undef IntegerArray_OR_LOOP
+#undef IntegerArray_ADD_LOOP
+#undef IntegerArray_RMW_LOOP
+
+	if (ts)
+		PyEval_RestoreThread(ts);
+
+	PyMem_Free(resolved);
+	if (have_operands)
+		PyBuffer_Release(&operands.view);
+	PyBuffer_Release(&indices.view);
+	Py_RETURN_NONE;
+
+err:
+	if (have_operands)
+		PyBuffer_Release(&operands.view);
+	PyBuffer_Release(&indices.view);
+	return NULL;
+}
+
+static PyObject *IntegerArray_add_many(IntegerArray *self,
+				       PyObject *const *args, Py_ssize_t nargs,
+				       PyObject *kwnames)
+{
+	return IntegerArray_rmw_many(self, "add_many", INTEGER_ARRAY_BULK_ADD,
+				     args, nargs, kwnames);
+}
+
+static PyObject *IntegerArray_or_many(IntegerArray *self,
+				      PyObject *const *args, Py_ssize_t nargs,
+				      PyObject *kwnames)
+{
+	return IntegerArray_rmw_many(self, "or_many", INTEGER_ARRAY_BULK_OR,
+				     args, nargs, kwnames);
+}
+
+static PyObject *IntegerArray_load_many(IntegerArray *self,
+					PyObject *const *args, Py_ssize_t nargs,
+					PyObject *kwnames)
+{
+	static const char *const kwlist[] = {"out", "order", NULL};
+	PyObject *kwargs[] = {NULL, NULL};
+	IntegerArray_buffer indices, out;
+	Py_ssize_t *resolved = NULL, i;
+	PyThreadState *ts = NULL;
+	int order = __ATOMIC_SEQ_CST;
+	PyObject *ret = NULL;
+	long *values = NULL;
+	long value;
+
+	if (!atomic_check_nargs("load_many", nargs, 1) ||
+	    !atomic_parse_kwargs("load_many", args, nargs, kwnames, kwlist,
+				 kwargs) ||
+	    !atomic_order_arg(kwargs[1], ATOMIC_ORDER_LOAD, &order))
+		return NULL;
+
+	if (IntegerArray_get_buffer(args[0], &indices, 0, "indices") < 0)
+		return NULL;
+
+	if (kwargs[0] && kwargs[0] != Py_None) {
+		if (IntegerArray_get_buffer(kwargs[0], &out, 1, "out") < 0)
+			goto out;
+		if (out.count < indices.count) {
+			PyErr_Format(PyExc_ValueError,
+				     "out holds %zd items but %zd are needed",
+				     out.count, indices.count);
+			PyBuffer_Release(&out.view);
+			goto out;
+		}
+	} else {
+		values = PyMem_Malloc((indices.count ? indices.count : 1) *
+				      sizeof(*values));
+		if (values == NULL) {
+			PyErr_NoMemory();
+			goto out;
+		}
+	}
+
+	resolved = IntegerArray_resolve_indices(self, &indices);
+	if (resolved) {
+		if (indices.count >= INTEGER_ARRAY_GIL_MINSIZE)
+			ts = PyEval_SaveThread();
+
+#define IntegerArray_LOAD_LOOP(order)						\
+		for (i = 0; i < indices.count; i++) {				\
+			__atomic_load(&self->items[resolved[i]], &value, order);\
+			if (values)						\
+				values[i] = value;				\
+			else							\
+				IntegerArray_buffer_store(&out, i, value);	\
+		}
+		ATOMIC_WITH_LOAD_ORDER(order, IntegerArray_LOAD_LOOP);
+#undef IntegerArray_LOAD_LOOP
+
+		if (ts)
+			PyEval_RestoreThread(ts);
+
+		if (values == NULL) {
+			ret = Py_None;
+			Py_INCREF(ret);
+		} else {
+			ret = PyList_New(indices.count);
+			for (i = 0; ret && i < indices.count; i++) {
+				PyObject *item = PyLong_FromLong(values[i]);
+
+				if (item == NULL)
+					Py_CLEAR(ret);
+				else
+					PyList_SET_ITEM(ret, i, item);
+			}
+		}
+	}
+
+	PyMem_Free(resolved);
+	if (values)
+		PyMem_Free(values);
+	else
+		PyBuffer_Release(&out.view);
+out:
+	PyBuffer_Release(&indices.view);
+	return ret;
+}
+
+static PyObject *IntegerArray_snapshot_into(IntegerArray *self,
+					    PyObject *const *args,
+					    Py_ssize_t nargs, PyObject *kwnames)
+{
+	static const char *const kwlist[] = {"order", NULL};
+	PyObject *kwargs[] = {NULL};
+	IntegerArray_buffer out;
+	PyThreadState *ts = NULL;
+	int order = __ATOMIC_SEQ_CST;
+	Py_ssize_t i;
+	long value;
+
+	if (!atomic_check_nargs("snapshot_into", nargs, 1) ||
+	    !atomic_parse_kwargs("snapshot_into", args, nargs, kwnames, kwlist,
+				 kwargs) ||
+	    !atomic_order_arg(kwargs[0], ATOMIC_ORDER_LOAD, &order))
+		return NULL;
+
+	if (IntegerArray_get_buffer(args[0], &out, 1, "buffer") < 0)
+		return NULL;
+
+	if (out.count < self->length) {
+		PyErr_Format(PyExc_ValueError,
+			     "buffer holds %zd items but %zd are needed",
+			     out.count, self->length);
+		PyBuffer_Release(&out.view);
+		return NULL;
+	}
+
+	if (self->length >= INTEGER_ARRAY_GIL_MINSIZE)
+		ts = PyEval_SaveThread();
+
+#define IntegerArray_SNAPSHOT_LOOP(order)				\
+	for (i = 0; i < self->length; i++) {				\
+		__atomic_load(&self->items[i], &value, order);		\
+		IntegerArray_buffer_store(&out, i, value);		\
+	}
+	ATOMIC_WITH_LOAD_ORDER(order, IntegerArray_SNAPSHOT_LOOP);
+#undef IntegerArray_SNAPSHOT_LOOP
+
+	if (ts)
+		PyEval_RestoreThread(ts);
+
+	PyBuffer_Release(&out.view);
+	Py_RETURN_NONE;
+}
+
+static PyMethodDef IntegerArray_methods[] = {
+	{"from_buffer", (PyCFunction)(void (*)(void))IntegerArray_from_buffer,
+	 METH_CLASS | METH_VARARGS | METH_KEYWORDS,
+	 "from_buffer(buffer, n=None, offset=0) -> IntegerArray\n\n"
+	 "Return an atomic.IntegerArray of n C longs stored at the given byte\n"
+	 "offset in a writable buffer, such as an mmap or the buf of a\n"
+	 "multiprocessing.shared_memory.SharedMemory. n defaults to as many whole\n"
+	 "elements as fit after offset. Nothing is written, so processes mapping\n"
+	 "the same memory share the elements and operations stay lock free.\n\n"
+	 "The offset must leave the elements aligned to sizeof(long). The\n"
+	 "buffer's export is held until the array is deleted."},
+	{"get", (PyCFunction)(void (*)(void))IntegerArray_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get(i, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically load and return the value at index i."},
+	{"set", (PyCFunction)(void (*)(void))IntegerArray_set,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "set(i, x, *, order=atomic.SEQ_CST)\n\n"
+	 "Atomically store the given value at index i."},
+
+	{"get_and_set", (PyCFunction)(void (*)(void))IntegerArray_get_and_set,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_set(i, x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically store the given value at index i and return the old value."},
+	{"compare_and_set", (PyCFunction)(void (*)(void))IntegerArray_compare_and_set,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "compare_and_set(i, expect, update, *, order=atomic.SEQ_CST,\n"
+	 "                failure_order=None) -> bool\n\n"
+	 "Atomically store the given value at index i if the old value equals the\n"
+	 "given expected value, returning whether the actual value equaled the\n"
+	 "expected value."},
+	{"weak_compare_and_set", (PyCFunction)(void (*)(void))IntegerArray_weak_compare_and_set,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "weak_compare_and_set(i, expect, update, *, order=atomic.SEQ_CST,\n"
+	 "                     failure_order=None) -> bool\n\n"
+	 "compare_and_set, but can fail spuriously."},
+
+	{"get_and_add", (PyCFunction)(void (*)(void))IntegerArray_get_and_add,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_add(i, x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically add the given value to the element at index i and return the\n"
+	 "previously stored value."},
+	{"get_and_sub", (PyCFunction)(void (*)(void))IntegerArray_get_and_sub,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_sub(i, x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically subtract the given value from the element at index i and return\n"
+	 "the previously stored value."},
+	{"get_and_and", (PyCFunction)(void (*)(void))IntegerArray_get_and_and,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_and(i, x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically bitwise-and the given value with the element at index i and\n"
+	 "return the previously stored value."},
+	{"get_and_xor", (PyCFunction)(void (*)(void))IntegerArray_get_and_xor,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_xor(i, x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically bitwise-xor the given value with the element at index i and\n"
+	 "return the previously stored value."},
+	{"get_and_or", (PyCFunction)(void (*)(void))IntegerArray_get_and_or,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_or(i, x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically bitwise-or the given value with the element at index i and\n"
+	 "return the previously stored value."},
+	{"get_and_nand", (PyCFunction)(void (*)(void))IntegerArray_get_and_nand,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_nand(i, x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically bitwise-nand the given value with the element at index i and\n"
+	 "return the previously stored value."},
+
+	{"add_and_get", (PyCFunction)(void (*)(void))IntegerArray_add_and_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "add_and_get(i, x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically add the given value to the element at index i and return the\n"
+	 "resulting value."},
+	{"sub_and_get", (PyCFunction)(void (*)(void))IntegerArray_sub_and_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "sub_and_get(i, x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically subtract the given value from the element at index i and return\n"
+	 "the resulting value."},
+	{"and_and_get", (PyCFunction)(void (*)(void))IntegerArray_and_and_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "and_and_get(i, x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically bitwise-and the given value with the element at index i and\n"
+	 "return the resulting value."},
+	{"xor_and_get", (PyCFunction)(void (*)(void))IntegerArray_xor_and_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "xor_and_get(i, x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically bitwise-xor the given value with the element at index i and\n"
+	 "return the resulting value."},
+	{"or_and_get", (PyCFunction)(void (*)(void))IntegerArray_or_and_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "or_and_get(i, x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically bitwise-or the given value with the element at index i and\n"
+	 "return the resulting value."},
+	{"nand_and_get", (PyCFunction)(void (*)(void))IntegerArray_nand_and_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "nand_and_get(i, x, *, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically bitwise-nand the given value with the element at index i and\n"
+	 "return the resulting value."},
+
+	{"add_many", (PyCFunction)(void (*)(void))IntegerArray_add_many,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "add_many(indices, deltas, *, order=atomic.SEQ_CST)\n\n"
+	 "Atomically add deltas[k] to the element at indices[k] for every k. deltas\n"
+	 "may also be a single integer added at every index. Indices may repeat."},
+	{"or_many", (PyCFunction)(void (*)(void))IntegerArray_or_many,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "or_many(indices, masks, *, order=atomic.SEQ_CST)\n\n"
+	 "Atomically bitwise-or masks[k] into the element at indices[k] for every k.\n"
+	 "masks may also be a single integer used at every index."},
+	{"load_many", (PyCFunction)(void (*)(void))IntegerArray_load_many,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "load_many(indices, out=None, *, order=atomic.SEQ_CST) -> list or None\n\n"
+	 "Atomically load the element at each of the given indices. The values are\n"
+	 "returned as a list, or written to the writable integer buffer out."},
+	{"snapshot_into", (PyCFunction)(void (*)(void))IntegerArray_snapshot_into,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "snapshot_into(buffer, *, order=atomic.SEQ_CST)\n\n"
+	 "Atomically load every element into the writable integer buffer, which\n"
+	 "must hold at least len(self) items. Each element is loaded atomically,\n"
+	 "but the copy as a whole is not a consistent snapshot."},
+
+	ATOMIC_STATS_METHOD_DEF(IntegerArray_stats),
+
+	{NULL, NULL, 0, NULL}
+};
+
+#define ATOMIC_INTEGER_ARRAY_DOCSTRING \
+	"atomic.IntegerArray(n) -> new array of n atomic integers, all zero\n\n" \
+	"Fixed-length array of C longs stored contiguously, supporting the same\n" \
+	"atomic operations as atomic.Integer on each element. Every method takes\n" \
+	"the element index as its first argument; negative indices count from the\n" \
+	"end.\n\n" \
+	"len() and indexing (an atomic load) are supported. The array exports a\n" \
+	"read-only buffer of C longs, so e.g. numpy.frombuffer() or memoryview()\n" \
+	"can read it without copying. Such a view is live: each element read is\n" \
+	"an aligned load, but the view as a whole is not a consistent snapshot.\n\n" \
+	"The *_many() methods and snapshot_into() apply a whole batch given as\n" \
+	"integer buffers in one call, releasing the GIL for large batches.\n\n" \
+	"IntegerArray.from_buffer() places the elements in shared memory, e.g.\n" \
+	"an mmap, so that several processes can update them.\n\n" \
+	"Every method takes an order= keyword (atomic.RELAXED, atomic.SEQ_CST,\n" \
+	"...), and the compare_and_set() methods also take failure_order=, as on\n" \
+	"atomic.Integer."
+
+static PyType_Slot IntegerArray_slots[] = {
+	{Py_tp_dealloc, IntegerArray_dealloc},
+	{Py_tp_repr, IntegerArray_repr},
+	{Py_tp_doc, ATOMIC_INTEGER_ARRAY_DOCSTRING},
+	{Py_tp_methods, IntegerArray_methods},
+	{Py_tp_init, IntegerArray_init},
+	{Py_tp_new, PyType_GenericNew},
+	{Py_sq_length, IntegerArray_length},
+	{Py_sq_item, IntegerArray_item},
+	{Py_bf_getbuffer, IntegerArray_getbuffer},
+	{0, NULL}
+};
+
+PyType_Spec IntegerArray_spec = {
+	.name = "atomic.IntegerArray",
+	.basicsize = sizeof(IntegerArray),
+	.flags = ATOMIC_TPFLAGS_DEFAULT,
+	.slots = IntegerArray_slots,
+};
@@ -1,290 +1,355 @@
 #include <Python.h>
+#include <stdint.h>
+
+#include "atomic.h"
+#include "atomic_hazard.h"
+#include "atomic_stats.h"
+
 #define PyBool_ExcCheck(bool, message) if (!PyBool_Check(bool)) \
     { \
         PyErr_SetString(PyExc_TypeError, message); \
         return NULL; \
     }
-#define PyBool_ConvertChar(bool, chr) chr = (bool == Py_True); \
-    if (bool == Py_True) \
-        Py_XDECREF(Py_True); \
-    else \
-        Py_XDECREF(Py_False);
-#define PyBool_Decref(bool) if (bool == Py_True) \
-    Py_XDECREF(Py_True); \
-else \
-    Py_XDECREF(Py_False);
-#define PyBool_Incref(bool) if (bool == Py_True) \
-    Py_INCREF(Py_True); \
-else \
-    Py_INCREF(Py_False);
+#define PyBool_ConvertChar(bool, chr) chr = (bool == Py_True);
+
+/*
+ * The reference and the mark share a single word: objects are at least
+ * pointer aligned, so the low bit of the PyObject * is free to hold the mark.
+ * Every operation on the pair is then one lock-free load, store, exchange or
+ * compare-and-exchange of that word.
+ */
+#define MARK_BIT ((uintptr_t)1)
+#define MarkableReference_PACK(object, mark) \
+    ((uintptr_t)(object) | ((mark) ? MARK_BIT : 0))
+#define MarkableReference_OBJECT(word) ((PyObject *)((word) & ~MARK_BIT))
+#define MarkableReference_MARK(word) ((char)((word) & MARK_BIT))
     
 typedef struct {
     PyObject_HEAD
-    PyObject *object;
-    char mark;
+    uintptr_t word;
+    ATOMIC_STATS_MEMBER
 } MarkableReference;
 
 static int MarkableReference_init(MarkableReference *self, PyObject *args, 
     PyObject *kwds) 
 {
         static char *kwlist[] = {"obj", "mark", NULL};
-        PyObject *mark_as_pybool;
-        char mark;
+        PyObject *object, *mark_as_pybool;
+        uintptr_t old_word;
         
-        if (!__atomic_is_lock_free(sizeof(self->object), &self->object) &&
-                !__atomic_is_lock_free(sizeof(self->mark), &self->mark))
+        if (!atomic_pointer_is_lock_free)
         {
             if(PyErr_WarnEx(PyExc_RuntimeWarning, 
                     "atomic.MarkableReference is not lock free", 1) < 0)
                 return -1;
         }
         
-        self->object = Py_None;
-        self->mark = 0;
+        object = Py_None;
         mark_as_pybool = Py_False;
-        Py_INCREF(Py_False);
         
         if(!PyArg_ParseTupleAndKeywords(args, kwds, "|OO", kwlist, 
-                &self->object, &mark_as_pybool))
+                &object, &mark_as_pybool))
             return -1; 
         if(!PyBool_Check(mark_as_pybool))
         {
             PyErr_SetString(PyExc_TypeError, "Passed mark is not a boolean");
             return -1;
         }
-        PyBool_ConvertChar(mark_as_pybool, mark);
-        __atomic_store(&self->mark, &mark, __ATOMIC_SEQ_CST);
             
-        Py_INCREF(self->object);
-        Py_DECREF(Py_False);
+        Py_INCREF(object);
+        old_word = __atomic_exchange_n(&self->word,
+                MarkableReference_PACK(object, mark_as_pybool == Py_True),
+                __ATOMIC_SEQ_CST);
+        if (old_word)
+            atomic_hazard_retire_object(MarkableReference_OBJECT(old_word));
         return 0;
 }
     
 static int MarkableReference_traverse(MarkableReference *self, 
             visitproc visit, void *arg)
 {
-    PyObject *object;
+    uintptr_t word;
         
-    __atomic_load(&self->object, &object, __ATOMIC_SEQ_CST);
+    __atomic_load(&self->word, &word, __ATOMIC_SEQ_CST);
         
-    Py_VISIT(object);
+    Py_VISIT(MarkableReference_OBJECT(word));
+    Py_VISIT(Py_TYPE(self));
         
     return 0;
 }
 
 static int MarkableReference_clear(MarkableReference *self)
 {
-    PyObject *object;
+    uintptr_t word;
         
-    object = __atomic_exchange_n(&self->object, NULL, __ATOMIC_SEQ_CST);
-    __atomic_exchange_n(&self->mark, 0, __ATOMIC_SEQ_CST);
+    word = __atomic_exchange_n(&self->word, 0, __ATOMIC_SEQ_CST);
         
-    Py_XDECREF(object);
+    Py_XDECREF(MarkableReference_OBJECT(word));
     
     return 0;
 }
     
 static void MarkableReference_dealloc(MarkableReference *self)
 {
+    PyTypeObject *tp = Py_TYPE(self);
+
+    PyObject_GC_UnTrack(self);
     MarkableReference_clear(self);
-    Py_TYPE(self)->tp_free((PyObject *)self);
-}
-    
-static PyObject *MarkableReference_repr(MarkableReference *self)
-{
-    PyObject *object;
-    char mark;
-        
-    __atomic_load(&self->object, &object, __ATOMIC_SEQ_CST);
-    __atomic_load(&self->mark, &mark, __ATOMIC_SEQ_CST);
-    
-    return PyUnicode_FromFormat("atomic.MarkableReference(%R, %R)",
-        object, mark);
+    tp->tp_free((PyObject *)self);
+    Py_DECREF(tp);
 }
     
 
-static PyObject *MarkableReference_get_reference(MarkableReference *self)
+static PyObject *MarkableReference_get_reference(MarkableReference *self,
+        PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
 {
-    PyObject *object;
-    
-    __atomic_load(&self->object, &object, __ATOMIC_SEQ_CST);
+    int order = __ATOMIC_SEQ_CST;
+    uintptr_t word;
     
-    Py_INCREF(object);
-    return object;
+    /* The order is validated, but the hazard protocol needs seq_cst. */
+    if (!atomic_check_nargs("get_reference", nargs, 0) ||
+        !atomic_parse_order("get_reference", args, nargs, kwnames,
+            ATOMIC_ORDER_LOAD, &order))
+        return NULL;
+
+    return atomic_hazard_load_object(&self->word, ~MARK_BIT, &word);
 }
 
-static PyObject *MarkableReference_is_marked(MarkableReference *self)
+static PyObject *MarkableReference_is_marked(MarkableReference *self,
+        PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
 {
-    char mark;
-    __atomic_load(&self->mark, &mark, __ATOMIC_SEQ_CST);
-    if (mark) 
+    int order = __ATOMIC_SEQ_CST;
+    uintptr_t word;
+
+    if (!atomic_check_nargs("is_marked", nargs, 0) ||
+        !atomic_parse_order("is_marked", args, nargs, kwnames,
+            ATOMIC_ORDER_LOAD, &order))
+        return NULL;
+
+    /* Only the mark is used, so no hazard is needed and any order works. */
+    word = ATOMIC_LOAD_N(&self->word, order);
+    if (MarkableReference_MARK(word)) 
     {
         Py_RETURN_TRUE;
     }
     Py_RETURN_FALSE;
 }
 
-static PyObject *MarkableReference_get(MarkableReference *self)
+static PyObject *MarkableReference_load(MarkableReference *self)
 {
-    PyObject *object, *converted_mark;
-    char mark;
+    PyObject *object, *converted_mark, *output_tuple;
+    uintptr_t word;
         
-    __atomic_load(&self->object, &object, __ATOMIC_SEQ_CST);
-    __atomic_load(&self->mark, &mark, __ATOMIC_SEQ_CST);
-    
-    if (mark){
-        converted_mark = Py_True;
-        Py_INCREF(Py_True);
-    }
-    else{
-        converted_mark = Py_False;
-        Py_INCREF(Py_False);
-    }
-    PyObject *output_tuple = PyTuple_New(2);
-    if (PyTuple_SetItem(output_tuple, 0, object) != 0) {
-        PyErr_SetString(PyExc_ValueError, "Cannot return internal reference"
-        "due to inability to insert in return tuple");
+    /* The mark comes from the same load that validated the hazard. */
+    object = atomic_hazard_load_object(&self->word, ~MARK_BIT, &word);
+    if (object == NULL)
         return NULL;
-    }
-    if (PyTuple_SetItem(output_tuple, 1, converted_mark) != 0) {
-        PyErr_SetString(PyExc_ValueError, "Cannot return mark due to" 
-        "inability to insert into return tuple");
+    converted_mark = MarkableReference_MARK(word) ? Py_True : Py_False;
+    Py_INCREF(converted_mark);
+
+    output_tuple = PyTuple_New(2);
+    if (output_tuple == NULL) {
+        Py_DECREF(object);
+        Py_DECREF(converted_mark);
         return NULL;
     }
+    PyTuple_SET_ITEM(output_tuple, 0, object);
+    PyTuple_SET_ITEM(output_tuple, 1, converted_mark);
     return output_tuple;
 }
 
-static PyObject *MarkableReference_weak_compare_and_set(MarkableReference *self,
-        PyObject *args) 
+static PyObject *MarkableReference_get(MarkableReference *self,
+        PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
+{
+    int order = __ATOMIC_SEQ_CST;
+
+    if (!atomic_check_nargs("get", nargs, 0) ||
+        !atomic_parse_order("get", args, nargs, kwnames, ATOMIC_ORDER_LOAD,
+            &order))
+        return NULL;
+
+    return MarkableReference_load(self);
+}
+
+static PyObject *MarkableReference_repr(MarkableReference *self)
 {
+    PyObject *pair, *ret;
+
+    /* Format from our own snapshot; set() may drop the stored reference. */
+    pair = MarkableReference_load(self);
+    if (pair == NULL)
+        return NULL;
+    ret = PyUnicode_FromFormat("atomic.MarkableReference(%R, %R)",
+        PyTuple_GET_ITEM(pair, 0), PyTuple_GET_ITEM(pair, 1));
+    Py_DECREF(pair);
+    return ret;
+}
+
+/*
+ * Shared body of compare_and_set() and weak_compare_and_set(). On success the
+ * word now owns a new reference to update_obj and the reference it held to
+ * expect_obj is released; on failure nothing changes.
+ */
+static PyObject *MarkableReference_do_compare_and_set(MarkableReference *self,
+        const char *name, PyObject *const *args, Py_ssize_t nargs,
+        PyObject *kwnames, int weak)
+{
+    int success = __ATOMIC_SEQ_CST, failure = __ATOMIC_SEQ_CST;
     PyObject *expect_obj, *update_obj, *exp_mark_as_pybool, *upd_mark_as_pybool;
     char expect_mark, update_mark;
+    uintptr_t expect_word, update_word;
     long ret;
     
-    if(!PyArg_ParseTuple(args, "OOOO", &expect_obj, &update_obj,
-        &exp_mark_as_pybool, &upd_mark_as_pybool))
+    if (!atomic_check_nargs(name, nargs, 4) ||
+        !atomic_parse_cas_orders(name, args, nargs, kwnames, &success,
+            &failure))
         return NULL;
+    expect_obj = args[0];
+    update_obj = args[1];
+    exp_mark_as_pybool = args[2];
+    upd_mark_as_pybool = args[3];
     
-    PyBool_Incref(exp_mark_as_pybool)
-    PyBool_Incref(upd_mark_as_pybool)
     PyBool_ExcCheck(exp_mark_as_pybool, "Expected mark is not a boolean")
-    PyBool_ExcCheck(upd_mark_as_pybool, "Update mark is not a booean")
+    PyBool_ExcCheck(upd_mark_as_pybool, "Update mark is not a boolean")
     PyBool_ConvertChar(exp_mark_as_pybool, expect_mark);
     PyBool_ConvertChar(upd_mark_as_pybool, update_mark);
+
+    expect_word = MarkableReference_PACK(expect_obj, expect_mark);
+    update_word = MarkableReference_PACK(update_obj, update_mark);
     Py_INCREF(update_obj);
     
-    ret = __atomic_compare_exchange(&self->object, &expect_obj, &update_obj, 1,
-            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
-    ret &= __atomic_compare_exchange(&self->mark, &expect_mark, &update_mark, 1,
-            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    ret = ATOMIC_CAS_N(&self->word, &expect_word, update_word, weak,
+            atomic_hazard_publish_order(success), failure);
+    ATOMIC_STATS_CAS(ATOMIC_STATS_PTR(self),
+            ATOMIC_STATS_MARKABLE_REFERENCE, ret,
+            weak && expect_word == MarkableReference_PACK(expect_obj,
+                expect_mark));
     
-    if (!ret)
+    if (ret)
+        atomic_hazard_retire_object(expect_obj);
+    else
         Py_DECREF(update_obj);
     return PyBool_FromLong(ret);
 }
 
+static PyObject *MarkableReference_weak_compare_and_set(MarkableReference *self,
+        PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
+{
+    return MarkableReference_do_compare_and_set(self, "weak_compare_and_set",
+            args, nargs, kwnames, 1);
+}
+
 static PyObject *MarkableReference_compare_and_set(MarkableReference *self, 
-        PyObject *args)
+        PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
 {
-    PyObject *expect_obj, *update_obj, *exp_mark_as_pybool, *upd_mark_as_pybool;
-    char expect_mark, update_mark;
-    long ret;
-    
-    if(!PyArg_ParseTuple(args, "OOOO", &expect_obj, &update_obj, 
-        &exp_mark_as_pybool, &upd_mark_as_pybool))
-            return NULL;
-    
-    Py_INCREF(update_obj);
-    
-    PyBool_Incref(upd_mark_as_pybool)
-    PyBool_Incref(exp_mark_as_pybool)
-    PyBool_ExcCheck(exp_mark_as_pybool, "Expected mark is not a boolean")
-    PyBool_ExcCheck(upd_mark_as_pybool, "Update mark is not a boolean")
-    PyBool_ConvertChar(exp_mark_as_pybool, expect_mark);
-    PyBool_ConvertChar(upd_mark_as_pybool, update_mark);
-    
-    ret = __atomic_compare_exchange(&self->object, &expect_obj, &update_obj, 0,
-            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
-    ret &= __atomic_compare_exchange(&self->mark, &expect_mark, &update_mark, 0,
-            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
-    
-    if(!ret)
-        Py_DECREF(update_obj);
-    return PyBool_FromLong(ret);
+    return MarkableReference_do_compare_and_set(self, "compare_and_set",
+            args, nargs, kwnames, 0);
 }
     
-static PyObject *MarkableReference_set(MarkableReference *self, PyObject *args)
+static PyObject *MarkableReference_set(MarkableReference *self,
+        PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
 {
-    PyObject *object, *old_object, *mark_as_pybool;
-    char mark, old_mark;
+    int order = __ATOMIC_SEQ_CST;
+    PyObject *object, *mark_as_pybool;
+    uintptr_t old_word;
+    char mark;
     
-    if (!PyArg_ParseTuple(args, "OO", &object, &mark_as_pybool))
+    if (!atomic_check_nargs("set", nargs, 2) ||
+        !atomic_parse_order("set", args, nargs, kwnames, ATOMIC_ORDER_STORE,
+            &order))
         return NULL;
+    object = args[0];
+    mark_as_pybool = args[1];
     
     PyBool_ExcCheck(mark_as_pybool, "Mark is not a boolean")
     PyBool_ConvertChar(mark_as_pybool, mark);
     Py_INCREF(object);
     
-    __atomic_exchange(&self->object, &object, &old_object, __ATOMIC_SEQ_CST);
-    __atomic_exchange(&self->mark, &mark, &old_mark, __ATOMIC_SEQ_CST);
+    old_word = ATOMIC_RMW_N(__atomic_exchange_n, &self->word,
+            MarkableReference_PACK(object, mark),
+            atomic_hazard_publish_order(order));
     
-    Py_XDECREF(old_object);
+    atomic_hazard_retire_object(MarkableReference_OBJECT(old_word));
     Py_RETURN_NONE;
 }
 
 static PyObject *MarkableReference_attempt_mark(MarkableReference *self, 
-    PyObject *args)
+    PyObject *const *args, Py_ssize_t nargs, PyObject *kwnames)
 {
+    int order = __ATOMIC_SEQ_CST;
     PyObject *exp_mark_as_pybool, *upd_mark_as_pybool;
     char expect_mark, update_mark;
-    long ret;
+    uintptr_t word;
     
-    if (!PyArg_ParseTuple(args, "OO", &exp_mark_as_pybool, &upd_mark_as_pybool))
+    if (!atomic_check_nargs("attempt_mark", nargs, 2) ||
+        !atomic_parse_order("attempt_mark", args, nargs, kwnames,
+            ATOMIC_ORDER_RMW, &order))
         return NULL;
+    exp_mark_as_pybool = args[0];
+    upd_mark_as_pybool = args[1];
     
     PyBool_ExcCheck(exp_mark_as_pybool, "Expected mark is not a boolean")
     PyBool_ExcCheck(upd_mark_as_pybool, "Update mark is not a boolean")
     PyBool_ConvertChar(exp_mark_as_pybool, expect_mark);
     PyBool_ConvertChar(upd_mark_as_pybool, update_mark);
     
-    ret = __atomic_compare_exchange(&self->mark, &expect_mark, &update_mark, 0,
-            __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    /*
+     * Setting or clearing the mark bit is a single fetch_or/fetch_and; the
+     * old bit tells us whether the expected mark was there.
+     */
+    if (expect_mark == update_mark)
+        word = ATOMIC_LOAD_N(&self->word, order);
+    else if (update_mark)
+        word = ATOMIC_RMW_N(__atomic_fetch_or, &self->word, MARK_BIT, order);
+    else
+        word = ATOMIC_RMW_N(__atomic_fetch_and, &self->word, ~MARK_BIT,
+                order);
     
-    return PyBool_FromLong(ret);
+    return PyBool_FromLong(MarkableReference_MARK(word) == expect_mark);
 }
 
+ATOMIC_STATS_GETTER(MarkableReference_stats, MarkableReference)
+
+#define MarkableReference_METHOD(name) \
+    (PyCFunction)(void (*)(void))MarkableReference_##name, \
+    METH_FASTCALL | METH_KEYWORDS
+
 static PyMethodDef MarkableReference_methods[] = {
-   {"get_reference", (PyCFunction)MarkableReference_get_reference, METH_NOARGS,
-    "get_reference() -> object\n\n"
+   {"get_reference", MarkableReference_METHOD(get_reference),
+    "get_reference(*, order=atomic.SEQ_CST) -> object\n\n"
     "Atomically load and return the stored reference."},
-   {"is_marked", (PyCFunction)MarkableReference_is_marked, METH_NOARGS,
-    "is_marked() -> bool\n\n"
+   {"is_marked", MarkableReference_METHOD(is_marked),
+    "is_marked(*, order=atomic.SEQ_CST) -> bool\n\n"
     "Atomically loads and returns the given mark."},
-   {"get", (PyCFunction)MarkableReference_get, METH_NOARGS,
-    "get() -> (object, mark) \n\n"
-    "Returns the current values of both the reference and the mark. "
+   {"get", MarkableReference_METHOD(get),
+    "get(*, order=atomic.SEQ_CST) -> (object, mark) \n\n"
+    "Atomically loads and returns both the reference and the mark as a single\n"
+    "consistent snapshot."
    },
-   {"weak_compare_and_set", (PyCFunction)MarkableReference_weak_compare_and_set,
-    METH_VARARGS, "weak_compare_and_set(expect_ref, update_ref, expect_mark,"
-    "update_mark) -> bool\n\nAtomically stores the given mark and reference"
-    "if the old mark and reference equals the given expected mark and reference"
-    "by identitym returning whether the actual reference equaled the expected"
+   {"weak_compare_and_set", MarkableReference_METHOD(weak_compare_and_set),
+    "weak_compare_and_set(expect_ref, update_ref, expect_mark, update_mark,\n"
+    "                     *, order=atomic.SEQ_CST, failure_order=None) -> bool"
+    "\n\nAtomically stores the given mark and reference "
+    "if the old mark and reference equals the given expected mark and reference "
+    "by identity, returning whether the actual reference equaled the expected "
     "value. Can fail spuriously and does not provide ordering guarantees."},
-   {"compare_and_set", (PyCFunction)MarkableReference_compare_and_set, 
-   METH_VARARGS, "compare_and_set(expect_ref, update_ref, expect_mark,"
-   "update_mark) -> bool\n\nAtomically stores the given mark and reference if"
-   "the old mark and reference equals the expected mark and reference by"
-   "identity, returning whether or not the actual mark and reference equaled"
+   {"compare_and_set", MarkableReference_METHOD(compare_and_set),
+   "compare_and_set(expect_ref, update_ref, expect_mark, update_mark,\n"
+   "                *, order=atomic.SEQ_CST, failure_order=None) -> bool"
+   "\n\nAtomically stores the given mark and reference if "
+   "the old mark and reference equals the expected mark and reference by "
+   "identity, returning whether or not the actual mark and reference equaled "
    "the expected values."},
-   {"set", (PyCFunction)MarkableReference_set, METH_VARARGS, "set(obj, mark)"
+   {"set", MarkableReference_METHOD(set),
+    "set(obj, mark, *, order=atomic.SEQ_CST)"
     "\n\nAtomically stores the given mark and reference."},
-   {"attempt_mark", (PyCFunction)MarkableReference_attempt_mark, METH_VARARGS,
-    "attempt_mark(expect_mark, update_mark) -> bool\n\nAtomically sets the"
-    "value of the mark to the given update value if the current reference is"
-    "equal to the expected reference by identity. Any given invocation of this"
-    "operation may fail (return false) spuriously, but repeated invocation when"
-    "the current value holds the expected value and no other thread is also"
-    "attempting to set the value will eventually succeed."},
+   {"attempt_mark", MarkableReference_METHOD(attempt_mark),
+    "attempt_mark(expect_mark, update_mark, *, order=atomic.SEQ_CST) -> bool"
+    "\n\nAtomically sets the "
+    "value of the mark to the given update value if the current mark equals "
+    "the expected mark, leaving the reference untouched. Returns whether the "
+    "current mark equaled the expected mark. Never fails spuriously."},
+   ATOMIC_STATS_METHOD_DEF(MarkableReference_stats),
     {NULL, NULL, 0, NULL}
 };
 
@@ -293,44 +358,26 @@ static PyMethodDef MarkableReference_methods[] = {
         "markable reference \n\nMarkable reference supporting atomic" \
         "operations with sequentially consistent semantics.\n\n Atomic load" \
         "(get()), store (set()), compare-and-exchange(compare_and_set())," \
-        "mark (attempt_mark()) are supported."
+        "mark (attempt_mark()) are supported.\n\nEvery method takes an " \
+        "order= keyword as on atomic.Integer. Stores of the reference are " \
+        "never weaker than atomic.RELEASE and loads of it are always " \
+        "sequentially consistent, since other threads dereference it."
         
-PyTypeObject MarkableReference_type = {
-    PyVarObject_HEAD_INIT(NULL, 0)
-    "atomic.MarkableReference",  /* tp_name */
-    sizeof(MarkableReference),   /* tp_basicsize */
-    0,      /*tp_itemsize */
-    (destructor)MarkableReference_dealloc, /* tp_dealloc */ 
-    NULL,                       /* tp_print */
-    NULL,					/* tp_getattr */
-	NULL,					/* tp_setattr */
-	NULL,					/* tp_reserved */
-	(reprfunc)MarkableReference_repr,    /*tp_repr*/
-	NULL,					/* tp_as_number */
-	NULL,					/* tp_as_sequence */
-	NULL,					/* tp_as_mapping */
-	NULL,					/* tp_hash  */
-	NULL,					/* tp_call */
-	NULL,					/* tp_str */
-	NULL,					/* tp_getattro */
-	NULL,					/* tp_setattro */
-	NULL,					/* tp_as_buffer */
-	Py_TPFLAGS_DEFAULT,     /* tp_flags */
-	ATOMIC_MARKABLE_REFERENCE_DOCSTRING, /* tp_doc */
-	(traverseproc)MarkableReference_traverse,   /* tp_traverse */
-	(inquiry)MarkableReference_clear,       /* tp_clear */
-	NULL,					/* tp_richcompare */
-	0,					/* tp_weaklistoffset */
-	NULL,					/* tp_iter */
-	NULL,					/* tp_iternext */
-	MarkableReference_methods,			/* tp_methods */
-	NULL,					/* tp_members */
-	NULL,					/* tp_getset */
-	NULL,					/* tp_base */
-	NULL,					/* tp_dict */
-	NULL,					/* tp_descr_get */
-	NULL,					/* tp_descr_set */
-	0,					/* tp_dictoffset */
-	(initproc)MarkableReference_init,		/* tp_init */
+static PyType_Slot MarkableReference_slots[] = {
+    {Py_tp_dealloc, MarkableReference_dealloc},
+    {Py_tp_repr, MarkableReference_repr},
+    {Py_tp_doc, ATOMIC_MARKABLE_REFERENCE_DOCSTRING},
+    {Py_tp_traverse, MarkableReference_traverse},
+    {Py_tp_clear, MarkableReference_clear},
+    {Py_tp_methods, MarkableReference_methods},
+    {Py_tp_init, MarkableReference_init},
+    {Py_tp_new, PyType_GenericNew},
+    {0, NULL}
 };
 
+PyType_Spec MarkableReference_spec = {
+    .name = "atomic.MarkableReference",
+    .basicsize = sizeof(MarkableReference),
+    .flags = ATOMIC_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+    .slots = MarkableReference_slots,
+};
@@ -1,60 +1,188 @@
 #include <Python.h>
 
+#include "atomic.h"
+#include "atomic_stats.h"
+#include "atomic_update.h"
+
 #define ATOMIC_MODULE_NAME "atomic"
 #define ATOMIC_MODULE_DOCSTRING \
 	"Module providing types supporting atomic operations."
 
-extern PyTypeObject Integer_type, Reference_type, MarkableReference_type;
+extern PyType_Spec Integer_spec, IntegerArray_spec, Adder_spec, Reference_spec,
+	MarkableReference_spec, StampedReference_spec, BoundedQueue_spec,
+	Float_spec, CompensatedFloat_spec, Bitset_spec, Sequence_spec,
+	Record_spec, OrderedSet_spec, CounterMap_spec, Stack_spec,
+	ObjectPool_spec, ObjectPoolLease_spec;
+extern PyType_Spec *atomic_fixed_integer_specs[];
+extern PyObject *Integer_vectorcall(PyObject *type, PyObject *const *args,
+				    size_t nargsf, PyObject *kwnames);
+extern PyObject *Reference_vectorcall(PyObject *type, PyObject *const *args,
+				      size_t nargsf, PyObject *kwnames);
+extern void Integer_clear_freelist(void);
+extern void Reference_clear_freelist(void);
 
-#if PY_MAJOR_VERSION >= 3
-static struct PyModuleDef atomicmodule = {
-	PyModuleDef_HEAD_INIT,
-	ATOMIC_MODULE_NAME,
-	ATOMIC_MODULE_DOCSTRING,
-	-1,
+int atomic_long_is_lock_free;
+int atomic_pointer_is_lock_free;
+
+static PyTypeObject *atomic_add_type(PyObject *m, PyType_Spec *spec)
+{
+	PyTypeObject *type;
+
+	type = (PyTypeObject *)PyType_FromModuleAndSpec(m, spec, NULL);
+	if (type == NULL)
+		return NULL;
+
+	if (PyModule_AddType(m, type) < 0) {
+		Py_DECREF(type);
+		return NULL;
+	}
+
+	/* The module holds its own reference from PyModule_AddType(). */
+	Py_DECREF(type);
+	return type;
+}
+
+static int atomic_exec(PyObject *m)
+{
+	struct atomic_state *state = PyModule_GetState(m);
+	PyTypeObject *type;
+	PyType_Spec **spec;
+
+	if (PyModule_AddIntConstant(m, "RELAXED", __ATOMIC_RELAXED) < 0 ||
+	    PyModule_AddIntConstant(m, "ACQUIRE", __ATOMIC_ACQUIRE) < 0 ||
+	    PyModule_AddIntConstant(m, "RELEASE", __ATOMIC_RELEASE) < 0 ||
+	    PyModule_AddIntConstant(m, "ACQ_REL", __ATOMIC_ACQ_REL) < 0 ||
+	    PyModule_AddIntConstant(m, "SEQ_CST", __ATOMIC_SEQ_CST) < 0)
+		return -1;
+
+	atomic_long_is_lock_free = __atomic_is_lock_free(sizeof(long), NULL);
+	atomic_pointer_is_lock_free = __atomic_is_lock_free(sizeof(void *),
+							    NULL);
+
+	if (atomic_update_init() < 0)
+		return -1;
+
+	type = atomic_add_type(m, &Integer_spec);
+	if (type == NULL)
+		return -1;
+	type->tp_vectorcall = Integer_vectorcall;
+
+	for (spec = atomic_fixed_integer_specs; *spec; spec++) {
+		if (atomic_add_type(m, *spec) == NULL)
+			return -1;
+	}
+
+	if (atomic_add_type(m, &IntegerArray_spec) == NULL)
+		return -1;
+
+	if (atomic_add_type(m, &Float_spec) == NULL)
+		return -1;
+
+	if (atomic_add_type(m, &CompensatedFloat_spec) == NULL)
+		return -1;
+
+	if (atomic_add_type(m, &Bitset_spec) == NULL)
+		return -1;
+
+	if (atomic_add_type(m, &Sequence_spec) == NULL)
+		return -1;
+
+	if (atomic_add_type(m, &Record_spec) == NULL)
+		return -1;
+
+	if (atomic_add_type(m, &OrderedSet_spec) == NULL)
+		return -1;
+
+	if (atomic_add_type(m, &CounterMap_spec) == NULL)
+		return -1;
+
+	if (atomic_add_type(m, &Adder_spec) == NULL)
+		return -1;
+
+	type = atomic_add_type(m, &Reference_spec);
+	if (type == NULL)
+		return -1;
+	type->tp_vectorcall = Reference_vectorcall;
+
+	if (atomic_add_type(m, &MarkableReference_spec) == NULL)
+		return -1;
+
+	if (atomic_add_type(m, &StampedReference_spec) == NULL)
+		return -1;
+
+	if (atomic_add_type(m, &BoundedQueue_spec) == NULL)
+		return -1;
+
+	if (atomic_add_type(m, &Stack_spec) == NULL)
+		return -1;
+
+	if (atomic_add_type(m, &ObjectPool_spec) == NULL)
+		return -1;
+
+	/* Only reachable through ObjectPool.borrow(), not the module. */
+	state->ObjectPoolLease_type = (PyTypeObject *)
+		PyType_FromModuleAndSpec(m, &ObjectPoolLease_spec, NULL);
+	if (state->ObjectPoolLease_type == NULL)
+		return -1;
+
+	return 0;
+}
+
+static PyMethodDef atomic_methods[] = {
+	{"contention_stats", atomic_contention_stats, METH_NOARGS,
+	 "contention_stats() -> dict or None\n\n"
+	 "Return the CAS attempts, failures, spurious weak CAS failures and\n"
+	 "internal retries of every thread so far, as a dict mapping each type\n"
+	 "name to a dict like the one its stats() method returns, or None if\n"
+	 "the module was built without ATOMIC_STATS."},
+	{NULL, NULL, 0, NULL}
 };
 
-#define INITERROR return NULL;
+static int atomic_traverse(PyObject *m, visitproc visit, void *arg)
+{
+	struct atomic_state *state = PyModule_GetState(m);
 
-PyMODINIT_FUNC PyInit_atomic(void)
-#else
-#define INITERROR return;
+	Py_VISIT(state->ObjectPoolLease_type);
+	return 0;
+}
 
-void initatomic(void)
-#endif
+static int atomic_clear(PyObject *m)
 {
-	PyObject *m;
-
-	Integer_type.tp_new = PyType_GenericNew;
-	if (PyType_Ready(&Integer_type) < 0)
-		INITERROR;
-
-	Reference_type.tp_new = PyType_GenericNew;
-	if (PyType_Ready(&Reference_type) < 0)
-		INITERROR;
-		
-	MarkableReference_type.tp_new = PyType_GenericNew;
-	if(PyType_Ready(&MarkableReference_type) < 0)
-		INITERROR;
-
-#if PY_MAJOR_VERSION >= 3
-	m = PyModule_Create(&atomicmodule);
-#else
-	m = Py_InitModule3(ATOMIC_MODULE_NAME, NULL, ATOMIC_MODULE_DOCSTRING);
-#endif
-	if (m == NULL)
-		INITERROR;
+	struct atomic_state *state = PyModule_GetState(m);
 
-	Py_INCREF(&Integer_type);
-	PyModule_AddObject(m, "Integer", (PyObject *)&Integer_type);
+	Py_CLEAR(state->ObjectPoolLease_type);
+	return 0;
+}
 
-	Py_INCREF(&Reference_type);
-	PyModule_AddObject(m, "Reference", (PyObject *)&Reference_type);
-	
-	Py_INCREF(&MarkableReference_type);
-	PyModule_AddObject(m, "MarkableReference", (PyObject *)&MarkableReference_type);
+static void atomic_free(void *m)
+{
+	Integer_clear_freelist();
+	Reference_clear_freelist();
+	atomic_clear((PyObject *)m);
+}
 
-#if PY_MAJOR_VERSION >= 3
-	return m;
+static PyModuleDef_Slot atomic_slots[] = {
+	{Py_mod_exec, atomic_exec},
+#ifdef Py_mod_gil
+	/* Every type is safe to use without the GIL. */
+	{Py_mod_gil, Py_MOD_GIL_NOT_USED},
 #endif
+	{0, NULL}
+};
+
+static struct PyModuleDef atomicmodule = {
+	PyModuleDef_HEAD_INIT,
+	.m_name = ATOMIC_MODULE_NAME,
+	.m_doc = ATOMIC_MODULE_DOCSTRING,
+	.m_size = sizeof(struct atomic_state),
+	.m_methods = atomic_methods,
+	.m_traverse = atomic_traverse,
+	.m_clear = atomic_clear,
+	.m_free = atomic_free,
+	.m_slots = atomic_slots,
+};
+
+PyMODINIT_FUNC PyInit_atomic(void)
+{
+	return PyModuleDef_Init(&atomicmodule);
 }
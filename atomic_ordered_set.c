@@ -0,0 +1,526 @@
+#include <Python.h>
+#include <limits.h>
+#include <stdint.h>
+
+#include "atomic.h"
+#include "atomic_hazard.h"
+#include "atomic_stats.h"
+
+/*
+ * Sorted set of C longs as a Harris-Michael lock-free linked list. As in
+ * MarkableReference, the low bit of a node's next pointer is a mark: a node
+ * is removed by first marking its next pointer, which logically deletes it
+ * and freezes the link, and then swinging its predecessor past it. Any
+ * traversal that finds a marked node finishes that unlink itself, so no
+ * operation ever waits for another.
+ *
+ * Nodes are plain C structs, freed through the hazard pointer scheme once
+ * unlinked. A traversal holds three hazards, in slots 1 to 3 of the calling
+ * thread (slot 0 belongs to atomic_hazard_load_object()): the node whose link
+ * it follows, the current node and the next one. The hazards are cleared
+ * before anything can run Python code, since that code may use the set too.
+ */
+typedef struct OrderedSet_node {
+	long key;
+	uintptr_t next;
+} OrderedSet_node;
+
+#define NODE_MARK ((uintptr_t)1)
+#define NODE_PTR(word) ((OrderedSet_node *)((word) & ~NODE_MARK))
+
+typedef struct {
+	PyObject_HEAD
+	uintptr_t head;
+	Py_ssize_t size;
+	ATOMIC_STATS_MEMBER
+} OrderedSet;
+
+/* Indexes into OrderedSet_cursor.hazards. */
+enum { HAZARD_NEXT, HAZARD_CUR, HAZARD_PREV };
+
+/*
+ * Position in the list: *prev is the unmarked link that pointed to cur, and
+ * next is cur's link as last read.
+ */
+struct OrderedSet_cursor {
+	uintptr_t *hazards;
+	uintptr_t *prev;
+	OrderedSet_node *cur;
+	uintptr_t next;
+};
+
+static int OrderedSet_cursor_init(struct OrderedSet_cursor *c)
+{
+	c->hazards = atomic_hazard_slot(1);
+	return c->hazards != NULL;
+}
+
+static void OrderedSet_cursor_release(struct OrderedSet_cursor *c)
+{
+	__atomic_store_n(&c->hazards[HAZARD_NEXT], 0, __ATOMIC_RELEASE);
+	__atomic_store_n(&c->hazards[HAZARD_CUR], 0, __ATOMIC_RELEASE);
+	atomic_hazard_release(&c->hazards[HAZARD_PREV]);
+}
+
+static inline void OrderedSet_protect(struct OrderedSet_cursor *c, int i,
+				      OrderedSet_node *node)
+{
+	__atomic_store_n(&c->hazards[i], (uintptr_t)node, __ATOMIC_SEQ_CST);
+}
+
+static void OrderedSet_free_node(void *node)
+{
+	PyMem_RawFree(node);
+}
+
+/*
+ * Move c to the first unmarked node with a key of at least key, or to the
+ * end of the list (cur == NULL), unlinking marked nodes on the way. With
+ * resume, start after the node c is on instead of at the head. Returns
+ * whether the node holds key.
+ */
+static int OrderedSet_search(OrderedSet *self, long key,
+			     struct OrderedSet_cursor *c, int resume)
+{
+	OrderedSet_node *cur, *next;
+	uintptr_t word, expected;
+	int ret;
+
+	if (resume) {
+		cur = c->cur;
+		c->prev = &cur->next;
+		OrderedSet_protect(c, HAZARD_PREV, cur);
+		cur = NODE_PTR(c->next);
+		OrderedSet_protect(c, HAZARD_CUR, cur);
+		goto check;
+	}
+
+restart:
+	c->prev = &self->head;
+	cur = NODE_PTR(__atomic_load_n(c->prev, __ATOMIC_SEQ_CST));
+	OrderedSet_protect(c, HAZARD_CUR, cur);
+check:
+	/* cur is only safe to use while the link we came through holds it. */
+	if (__atomic_load_n(c->prev, __ATOMIC_SEQ_CST) != (uintptr_t)cur) {
+		ATOMIC_STATS_RETRY(ATOMIC_STATS_PTR(self),
+				   ATOMIC_STATS_ORDERED_SET);
+		goto restart;
+	}
+
+	for (;;) {
+		if (cur == NULL) {
+			c->cur = NULL;
+			return 0;
+		}
+
+		word = __atomic_load_n(&cur->next, __ATOMIC_SEQ_CST);
+		next = NODE_PTR(word);
+		OrderedSet_protect(c, HAZARD_NEXT, next);
+		if (__atomic_load_n(&cur->next, __ATOMIC_SEQ_CST) != word ||
+		    __atomic_load_n(c->prev, __ATOMIC_SEQ_CST) !=
+		    (uintptr_t)cur) {
+			ATOMIC_STATS_RETRY(ATOMIC_STATS_PTR(self),
+					   ATOMIC_STATS_ORDERED_SET);
+			goto restart;
+		}
+
+		if (word & NODE_MARK) {
+			expected = (uintptr_t)cur;
+			ret = __atomic_compare_exchange_n(c->prev, &expected,
+							  (uintptr_t)next, 0,
+							  __ATOMIC_SEQ_CST,
+							  __ATOMIC_SEQ_CST);
+			ATOMIC_STATS_LOOP_CAS(ATOMIC_STATS_PTR(self),
+					      ATOMIC_STATS_ORDERED_SET, ret, 0);
+			if (!ret)
+				goto restart;
+			OrderedSet_protect(c, HAZARD_CUR, next);
+			atomic_hazard_retire(cur, OrderedSet_free_node);
+			cur = next;
+			continue;
+		}
+
+		if (cur->key >= key) {
+			c->cur = cur;
+			c->next = word;
+			return cur->key == key;
+		}
+
+		c->prev = &cur->next;
+		OrderedSet_protect(c, HAZARD_PREV, cur);
+		cur = next;
+		OrderedSet_protect(c, HAZARD_CUR, cur);
+	}
+}
+
+/* Returns 1 if key was added, 0 if present, -1 on error. */
+static int OrderedSet_insert(OrderedSet *self, long key)
+{
+	struct OrderedSet_cursor c;
+	OrderedSet_node *node = NULL;
+	uintptr_t expected;
+	int ret;
+
+	if (!OrderedSet_cursor_init(&c))
+		return -1;
+
+	for (;;) {
+		if (OrderedSet_search(self, key, &c, 0)) {
+			ret = 0;
+			break;
+		}
+
+		if (node == NULL) {
+			node = PyMem_RawMalloc(sizeof(*node));
+			if (node == NULL) {
+				PyErr_NoMemory();
+				ret = -1;
+				break;
+			}
+			node->key = key;
+		}
+		node->next = (uintptr_t)c.cur;
+
+		expected = (uintptr_t)c.cur;
+		ret = __atomic_compare_exchange_n(c.prev, &expected,
+						  (uintptr_t)node, 0,
+						  __ATOMIC_SEQ_CST,
+						  __ATOMIC_SEQ_CST);
+		ATOMIC_STATS_LOOP_CAS(ATOMIC_STATS_PTR(self),
+				      ATOMIC_STATS_ORDERED_SET, ret, 0);
+		if (ret) {
+			node = NULL;
+			__atomic_fetch_add(&self->size, 1, __ATOMIC_RELAXED);
+			break;
+		}
+	}
+
+	OrderedSet_cursor_release(&c);
+	PyMem_RawFree(node);
+	return ret;
+}
+
+/* Returns 1 if key was removed, 0 if absent, -1 on error. */
+static int OrderedSet_remove(OrderedSet *self, long key)
+{
+	struct OrderedSet_cursor c;
+	uintptr_t word, expected;
+	int ret;
+
+	if (!OrderedSet_cursor_init(&c))
+		return -1;
+
+	for (;;) {
+		if (!OrderedSet_search(self, key, &c, 0)) {
+			ret = 0;
+			break;
+		}
+
+		/* Marking the node is what removes the key. */
+		word = c.next;
+		ret = __atomic_compare_exchange_n(&c.cur->next, &word,
+						  word | NODE_MARK, 0,
+						  __ATOMIC_SEQ_CST,
+						  __ATOMIC_SEQ_CST);
+		ATOMIC_STATS_LOOP_CAS(ATOMIC_STATS_PTR(self),
+				      ATOMIC_STATS_ORDERED_SET, ret, 0);
+		if (!ret)
+			continue;
+		__atomic_fetch_sub(&self->size, 1, __ATOMIC_RELAXED);
+
+		expected = (uintptr_t)c.cur;
+		ret = __atomic_compare_exchange_n(c.prev, &expected, word, 0,
+						  __ATOMIC_SEQ_CST,
+						  __ATOMIC_SEQ_CST);
+		ATOMIC_STATS_CAS(ATOMIC_STATS_PTR(self),
+				 ATOMIC_STATS_ORDERED_SET, ret, 0);
+		if (ret) {
+			OrderedSet_protect(&c, HAZARD_CUR, NULL);
+			atomic_hazard_retire(c.cur, OrderedSet_free_node);
+		} else {
+			/* Let a search unlink it. */
+			OrderedSet_search(self, key, &c, 0);
+		}
+		ret = 1;
+		break;
+	}
+
+	OrderedSet_cursor_release(&c);
+	return ret;
+}
+
+static int OrderedSet_init(OrderedSet *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = {"iterable", NULL};
+	PyObject *iterable = NULL, *iterator, *item;
+	long key;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &iterable))
+		return -1;
+
+	if (iterable == NULL)
+		return 0;
+
+	iterator = PyObject_GetIter(iterable);
+	if (iterator == NULL)
+		return -1;
+
+	while ((item = PyIter_Next(iterator))) {
+		if (!atomic_long_arg(item, &key) ||
+		    OrderedSet_insert(self, key) < 0) {
+			Py_DECREF(item);
+			Py_DECREF(iterator);
+			return -1;
+		}
+		Py_DECREF(item);
+	}
+	Py_DECREF(iterator);
+
+	return PyErr_Occurred() ? -1 : 0;
+}
+
+static void OrderedSet_dealloc(OrderedSet *self)
+{
+	PyTypeObject *tp = Py_TYPE(self);
+	OrderedSet_node *node, *next;
+
+	/* Nobody else can reach the list; unlinked nodes were retired. */
+	for (node = NODE_PTR(self->head); node; node = next) {
+		next = NODE_PTR(node->next);
+		PyMem_RawFree(node);
+	}
+	tp->tp_free((PyObject *)self);
+	Py_DECREF(tp);
+}
+
+static PyObject *OrderedSet_add(OrderedSet *self, PyObject *arg)
+{
+	long key;
+	int ret;
+
+	if (!atomic_long_arg(arg, &key))
+		return NULL;
+
+	ret = OrderedSet_insert(self, key);
+	if (ret < 0)
+		return NULL;
+	return PyBool_FromLong(ret);
+}
+
+static PyObject *OrderedSet_discard(OrderedSet *self, PyObject *arg)
+{
+	long key;
+	int ret;
+
+	if (!atomic_long_arg(arg, &key))
+		return NULL;
+
+	ret = OrderedSet_remove(self, key);
+	if (ret < 0)
+		return NULL;
+	return PyBool_FromLong(ret);
+}
+
+static int OrderedSet_contains(OrderedSet *self, PyObject *arg)
+{
+	struct OrderedSet_cursor c;
+	long key;
+	int ret;
+
+	/* Like a set of ints, anything that is not such an int is absent. */
+	if (!PyIndex_Check(arg))
+		return 0;
+	if (!atomic_long_arg(arg, &key)) {
+		if (!PyErr_ExceptionMatches(PyExc_OverflowError))
+			return -1;
+		PyErr_Clear();
+		return 0;
+	}
+
+	if (!OrderedSet_cursor_init(&c))
+		return -1;
+	ret = OrderedSet_search(self, key, &c, 0);
+	OrderedSet_cursor_release(&c);
+
+	return ret;
+}
+
+/*
+ * Return a list of the keys in [lo, last] from one pass over the list. The
+ * keys are gathered into a C array first and only turned into ints once the
+ * hazards are cleared.
+ */
+static PyObject *OrderedSet_collect(OrderedSet *self, long lo, long last)
+{
+	struct OrderedSet_cursor c;
+	Py_ssize_t count = 0, capacity = 0, i;
+	long *keys = NULL, *grown;
+	PyObject *list, *item;
+	int ret = 0;
+
+	if (lo > last)
+		return PyList_New(0);
+
+	if (!OrderedSet_cursor_init(&c))
+		return NULL;
+
+	OrderedSet_search(self, lo, &c, 0);
+	while (c.cur && c.cur->key <= last) {
+		if (count == capacity) {
+			capacity = capacity ? capacity * 2 : 16;
+			grown = PyMem_RawRealloc(keys,
+						 capacity * sizeof(*keys));
+			if (grown == NULL) {
+				ret = -1;
+				break;
+			}
+			keys = grown;
+		}
+		keys[count++] = c.cur->key;
+		if (c.cur->key == LONG_MAX)
+			break;
+
+		/* If the node was removed meanwhile, this restarts. */
+		OrderedSet_search(self, c.cur->key + 1, &c, 1);
+	}
+
+	OrderedSet_cursor_release(&c);
+
+	if (ret < 0) {
+		PyMem_RawFree(keys);
+		return PyErr_NoMemory();
+	}
+
+	list = PyList_New(count);
+	for (i = 0; list && i < count; i++) {
+		item = PyLong_FromLong(keys[i]);
+		if (item == NULL)
+			Py_CLEAR(list);
+		else
+			PyList_SET_ITEM(list, i, item);
+	}
+	PyMem_RawFree(keys);
+	return list;
+}
+
+static PyObject *OrderedSet_range(OrderedSet *self, PyObject *const *args,
+				  Py_ssize_t nargs, PyObject *kwnames)
+{
+	static const char *const kwlist[] = {"lo", "hi", NULL};
+	PyObject *bounds[] = {NULL, NULL};
+	long lo = LONG_MIN, last = LONG_MAX, hi;
+	Py_ssize_t i;
+
+	if (nargs > 2) {
+		PyErr_Format(PyExc_TypeError,
+			     "range() takes at most 2 arguments (%zd given)",
+			     nargs);
+		return NULL;
+	}
+	for (i = 0; i < nargs; i++)
+		bounds[i] = args[i];
+	if (kwnames && !atomic_parse_kwargs("range", args, nargs, kwnames,
+					    kwlist, bounds))
+		return NULL;
+
+	if (bounds[0] && bounds[0] != Py_None &&
+	    !atomic_long_arg(bounds[0], &lo))
+		return NULL;
+	if (bounds[1] && bounds[1] != Py_None) {
+		if (!atomic_long_arg(bounds[1], &hi))
+			return NULL;
+		if (hi == LONG_MIN)
+			return PyList_New(0);
+		last = hi - 1;
+	}
+
+	return OrderedSet_collect(self, lo, last);
+}
+
+static PyObject *OrderedSet_iter(OrderedSet *self)
+{
+	PyObject *list, *iterator;
+
+	list = OrderedSet_collect(self, LONG_MIN, LONG_MAX);
+	if (list == NULL)
+		return NULL;
+	iterator = PyObject_GetIter(list);
+	Py_DECREF(list);
+	return iterator;
+}
+
+static Py_ssize_t OrderedSet_length(OrderedSet *self)
+{
+	Py_ssize_t size = __atomic_load_n(&self->size, __ATOMIC_RELAXED);
+
+	/* A remover may decrement before the matching adder increments. */
+	return size < 0 ? 0 : size;
+}
+
+static PyObject *OrderedSet_repr(OrderedSet *self)
+{
+	PyObject *list, *ret;
+
+	list = OrderedSet_collect(self, LONG_MIN, LONG_MAX);
+	if (list == NULL)
+		return NULL;
+	ret = PyUnicode_FromFormat("atomic.OrderedSet(%R)", list);
+	Py_DECREF(list);
+	return ret;
+}
+
+ATOMIC_STATS_GETTER(OrderedSet_stats, OrderedSet)
+
+static PyMethodDef OrderedSet_methods[] = {
+	{"add", (PyCFunction)OrderedSet_add, METH_O,
+	 "add(key) -> bool\n\n"
+	 "Add key to the set. Returns whether it was added, False if it was\n"
+	 "already present."},
+	{"discard", (PyCFunction)OrderedSet_discard, METH_O,
+	 "discard(key) -> bool\n\n"
+	 "Remove key from the set if present. Returns whether it was removed by\n"
+	 "this call."},
+	{"range", (PyCFunction)(void (*)(void))OrderedSet_range,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "range(lo=None, hi=None) -> list\n\n"
+	 "Return the keys k with lo <= k < hi in ascending order, from a single\n"
+	 "pass over the set. A key present for the whole pass is included, one\n"
+	 "absent for the whole pass is not, and keys added or removed during it\n"
+	 "may or may not be. None leaves a bound open."},
+
+	ATOMIC_STATS_METHOD_DEF(OrderedSet_stats),
+
+	{NULL, NULL, 0, NULL}
+};
+
+#define ATOMIC_ORDERED_SET_DOCSTRING \
+	"atomic.OrderedSet(iterable=()) -> new ordered set\n\n" \
+	"Set of integers in the range of a C long, kept in ascending order, that\n" \
+	"any number of threads can update and read without a lock.\n\n" \
+	"add(), discard() and the in operator each take effect atomically.\n" \
+	"Iteration and range() walk the set once and return keys in ascending\n" \
+	"order with the same guarantees as range(); len() is exact whenever no\n" \
+	"update is in progress.\n\n" \
+	"The set is a lock-free linked list, so each operation takes time\n" \
+	"linear in the number of smaller keys. It suits indexes of up to a few\n" \
+	"thousand keys."
+
+static PyType_Slot OrderedSet_slots[] = {
+	{Py_tp_dealloc, OrderedSet_dealloc},
+	{Py_tp_repr, OrderedSet_repr},
+	{Py_tp_doc, ATOMIC_ORDERED_SET_DOCSTRING},
+	{Py_tp_methods, OrderedSet_methods},
+	{Py_tp_iter, OrderedSet_iter},
+	{Py_sq_length, OrderedSet_length},
+	{Py_sq_contains, OrderedSet_contains},
+	{Py_tp_init, OrderedSet_init},
+	{Py_tp_new, PyType_GenericNew},
+	{0, NULL}
+};
+
+PyType_Spec OrderedSet_spec = {
+	.name = "atomic.OrderedSet",
+	.basicsize = sizeof(OrderedSet),
+	.flags = ATOMIC_TPFLAGS_DEFAULT,
+	.slots = OrderedSet_slots,
+};
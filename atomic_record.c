@@ -0,0 +1,307 @@
+#include <Python.h>
+#include <string.h>
+
+#include "atomic.h"
+#include "atomic_stats.h"
+#include "atomic_update.h"
+
+/*
+ * A group of words published together under a sequence lock. seq is even
+ * while the record is stable and odd while a writer is storing; a writer
+ * takes the lock by compare-and-swapping seq from even to odd, so writers
+ * exclude each other but never wait for readers. A reader copies the fields
+ * between two loads of seq and retries if a writer ran in between, so
+ * readers never write shared memory and scale with the number of threads.
+ *
+ * The fields are read and written with relaxed atomics, so a torn read is
+ * merely discarded rather than being a data race. A writer never releases
+ * the GIL (or calls back into Python) while it holds the lock.
+ */
+typedef struct {
+	PyObject_HEAD
+	Py_ssize_t nfields;
+	unsigned long seq;
+	long *fields;
+	ATOMIC_STATS_MEMBER
+} Record;
+
+/* Records up to this size are copied through the C stack. */
+#define RECORD_STACK_FIELDS 16
+
+static int Record_init(Record *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = {"fields", NULL};
+	Py_ssize_t nfields;
+	long *fields;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "n", kwlist, &nfields))
+		return -1;
+
+	if (nfields < 0) {
+		PyErr_SetString(PyExc_ValueError,
+				"atomic.Record fields must be non-negative");
+		return -1;
+	}
+
+	if (self->fields) {
+		PyErr_SetString(PyExc_RuntimeError,
+				"atomic.Record is already initialized");
+		return -1;
+	}
+
+	fields = PyMem_Calloc(nfields ? nfields : 1, sizeof(*fields));
+	if (fields == NULL) {
+		PyErr_NoMemory();
+		return -1;
+	}
+
+	self->nfields = nfields;
+	self->fields = fields;
+
+	return 0;
+}
+
+static void Record_dealloc(Record *self)
+{
+	PyTypeObject *tp = Py_TYPE(self);
+
+	PyMem_Free(self->fields);
+	tp->tp_free((PyObject *)self);
+	Py_DECREF(tp);
+}
+
+static void Record_write_lock(Record *self)
+{
+	struct atomic_backoff backoff;
+	unsigned long seq;
+	int ret;
+
+	atomic_backoff_init(&backoff, ATOMIC_DEFAULT_MAX_SPIN);
+	seq = __atomic_load_n(&self->seq, __ATOMIC_RELAXED);
+	for (;;) {
+		if (!(seq & 1)) {
+			ATOMIC_STATS_ONLY(unsigned long expected = seq;)
+
+			ret = __atomic_compare_exchange_n(&self->seq, &seq,
+							  seq + 1, 1,
+							  __ATOMIC_ACQUIRE,
+							  __ATOMIC_RELAXED);
+			ATOMIC_STATS_LOOP_CAS(ATOMIC_STATS_PTR(self),
+					      ATOMIC_STATS_RECORD, ret,
+					      seq == expected);
+			if (ret)
+				break;
+		}
+		atomic_backoff_wait(&backoff);
+		seq = __atomic_load_n(&self->seq, __ATOMIC_RELAXED);
+	}
+
+	/* Readers that see any of the new fields also see seq odd. */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void Record_write_unlock(Record *self)
+{
+	__atomic_fetch_add(&self->seq, 1, __ATOMIC_RELEASE);
+}
+
+/* Wait for no writer to hold the lock and return the even sequence. */
+static unsigned long Record_read_begin(Record *self,
+				       struct atomic_backoff *backoff)
+{
+	unsigned long seq;
+
+	for (;;) {
+		seq = __atomic_load_n(&self->seq, __ATOMIC_ACQUIRE);
+		if (!(seq & 1))
+			return seq;
+		ATOMIC_STATS_RETRY(ATOMIC_STATS_PTR(self), ATOMIC_STATS_RECORD);
+		atomic_backoff_wait(backoff);
+	}
+}
+
+/* Whether a writer ran since Record_read_begin() returned seq. */
+static inline int Record_read_retry(Record *self, unsigned long seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&self->seq, __ATOMIC_RELAXED) == seq)
+		return 0;
+	ATOMIC_STATS_RETRY(ATOMIC_STATS_PTR(self), ATOMIC_STATS_RECORD);
+	return 1;
+}
+
+/* Copy a consistent snapshot of the fields to out, which may be unaligned. */
+static void Record_snapshot(Record *self, char *out)
+{
+	struct atomic_backoff backoff;
+	unsigned long seq;
+	Py_ssize_t i;
+	long value;
+
+	atomic_backoff_init(&backoff, ATOMIC_DEFAULT_MAX_SPIN);
+	do {
+		seq = Record_read_begin(self, &backoff);
+		for (i = 0; i < self->nfields; i++) {
+			value = __atomic_load_n(&self->fields[i],
+						__ATOMIC_RELAXED);
+			memcpy(out + i * sizeof(long), &value, sizeof(long));
+		}
+	} while (Record_read_retry(self, seq));
+}
+
+static PyObject *Record_write(Record *self, PyObject *const *args,
+			      Py_ssize_t nargs)
+{
+	long stack[RECORD_STACK_FIELDS], *values = stack;
+	Py_ssize_t i;
+
+	if (nargs != self->nfields) {
+		PyErr_Format(PyExc_TypeError,
+			     "write() takes exactly %zd argument%s (%zd given)",
+			     self->nfields, self->nfields == 1 ? "" : "s",
+			     nargs);
+		return NULL;
+	}
+
+	/* Convert everything first: the lock is held only for the stores. */
+	if (nargs > RECORD_STACK_FIELDS) {
+		values = PyMem_New(long, nargs);
+		if (values == NULL)
+			return PyErr_NoMemory();
+	}
+	for (i = 0; i < nargs; i++) {
+		if (!atomic_long_arg(args[i], &values[i])) {
+			if (values != stack)
+				PyMem_Free(values);
+			return NULL;
+		}
+	}
+
+	Record_write_lock(self);
+	for (i = 0; i < nargs; i++)
+		__atomic_store_n(&self->fields[i], values[i], __ATOMIC_RELAXED);
+	Record_write_unlock(self);
+
+	if (values != stack)
+		PyMem_Free(values);
+	Py_RETURN_NONE;
+}
+
+static PyObject *Record_read(Record *self, PyObject *Py_UNUSED(unused))
+{
+	long stack[RECORD_STACK_FIELDS], *values = stack;
+	PyObject *tuple, *item;
+	Py_ssize_t i;
+
+	if (self->nfields > RECORD_STACK_FIELDS) {
+		values = PyMem_New(long, self->nfields);
+		if (values == NULL)
+			return PyErr_NoMemory();
+	}
+
+	Record_snapshot(self, (char *)values);
+
+	tuple = PyTuple_New(self->nfields);
+	for (i = 0; tuple && i < self->nfields; i++) {
+		item = PyLong_FromLong(values[i]);
+		if (item == NULL)
+			Py_CLEAR(tuple);
+		else
+			PyTuple_SET_ITEM(tuple, i, item);
+	}
+
+	if (values != stack)
+		PyMem_Free(values);
+	return tuple;
+}
+
+static PyObject *Record_read_into(Record *self, PyObject *arg)
+{
+	Py_buffer view;
+
+	if (PyObject_GetBuffer(arg, &view, PyBUF_WRITABLE) < 0)
+		return NULL;
+
+	if (view.len < self->nfields * (Py_ssize_t)sizeof(long)) {
+		PyErr_Format(PyExc_ValueError,
+			     "read_into() buffer is too small: %zd bytes "
+			     "needed, %zd given",
+			     self->nfields * (Py_ssize_t)sizeof(long),
+			     view.len);
+		PyBuffer_Release(&view);
+		return NULL;
+	}
+
+	Record_snapshot(self, view.buf);
+
+	PyBuffer_Release(&view);
+	Py_RETURN_NONE;
+}
+
+ATOMIC_STATS_GETTER(Record_stats, Record)
+
+static Py_ssize_t Record_length(Record *self)
+{
+	return self->nfields;
+}
+
+static PyObject *Record_repr(Record *self)
+{
+	PyObject *tuple, *ret;
+
+	tuple = Record_read(self, NULL);
+	if (tuple == NULL)
+		return NULL;
+	ret = PyUnicode_FromFormat("atomic.Record(%R)", tuple);
+	Py_DECREF(tuple);
+	return ret;
+}
+
+static PyMethodDef Record_methods[] = {
+	{"write", (PyCFunction)(void (*)(void))Record_write, METH_FASTCALL,
+	 "write(*values)\n\n"
+	 "Atomically replace every field, given one value per field. Readers\n"
+	 "see either all of the old values or all of the new ones."},
+	{"read", (PyCFunction)Record_read, METH_NOARGS,
+	 "read() -> tuple\n\n"
+	 "Return a consistent snapshot of the fields, retrying while a write is\n"
+	 "in progress. Never blocks writers."},
+	{"read_into", (PyCFunction)Record_read_into, METH_O,
+	 "read_into(buffer)\n\n"
+	 "Copy a consistent snapshot of the fields into a writable buffer as\n"
+	 "native C longs, such as an array.array('l') or a numpy int array,\n"
+	 "without creating Python ints. The buffer must hold at least\n"
+	 "len(record) longs."},
+
+	ATOMIC_STATS_METHOD_DEF(Record_stats),
+
+	{NULL, NULL, 0, NULL}
+};
+
+#define ATOMIC_RECORD_DOCSTRING \
+	"atomic.Record(fields) -> new atomic record\n\n" \
+	"Fixed number of C long fields, all zero initially, that are written\n" \
+	"and read together as one consistent snapshot.\n\n" \
+	"The record is a sequence lock: write() holds a lock that only excludes\n" \
+	"other writers, while read() and read_into() take no lock, copy the\n" \
+	"fields and retry if a write overlapped the copy. Readers never delay a\n" \
+	"writer, so the record suits data that is read far more often than it\n" \
+	"is written."
+
+static PyType_Slot Record_slots[] = {
+	{Py_tp_dealloc, Record_dealloc},
+	{Py_tp_repr, Record_repr},
+	{Py_tp_doc, ATOMIC_RECORD_DOCSTRING},
+	{Py_tp_methods, Record_methods},
+	{Py_sq_length, Record_length},
+	{Py_tp_init, Record_init},
+	{Py_tp_new, PyType_GenericNew},
+	{0, NULL}
+};
+
+PyType_Spec Record_spec = {
+	.name = "atomic.Record",
+	.basicsize = sizeof(Record),
+	.flags = ATOMIC_TPFLAGS_DEFAULT,
+	.slots = Record_slots,
+};
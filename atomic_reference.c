@@ -1,28 +1,47 @@
 #include <Python.h>
 
+#include "atomic.h"
+#include "atomic_hazard.h"
+#include "atomic_stats.h"
+#include "atomic_update.h"
+
 typedef struct {
 	PyObject_HEAD
 	PyObject *object;
+	ATOMIC_STATS_MEMBER
 } Reference;
 
-static int Reference_init(Reference *self, PyObject *args, PyObject *kwds)
-{
-	static char *kwlist[] = {"obj", NULL};
+static atomic_freelist Reference_freelist;
 
-	if (!__atomic_is_lock_free(sizeof(self->object), &self->object)) {
+static int Reference_check_lock_free(void)
+{
+	if (!atomic_pointer_is_lock_free) {
 		if (PyErr_WarnEx(PyExc_RuntimeWarning,
 				 "atomic.Reference is not lock free", 1) < 0)
 			return -1;
 	}
+	return 0;
+}
+
+static int Reference_init(Reference *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = {"obj", NULL};
+	PyObject *object = Py_None, *old_object;
 
-	self->object = Py_None;
+	if (Reference_check_lock_free() < 0)
+		return -1;
 
-	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist,
-					 &self->object))
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &object))
 		return -1;
 
-	Py_INCREF(self->object);
+	Py_INCREF(object);
+
+	/* __init__ may be called again on an object other threads can see. */
+	old_object = __atomic_exchange_n(&self->object, object,
+					 __ATOMIC_SEQ_CST);
 
+	if (old_object)
+		atomic_hazard_retire_object(old_object);
 	return 0;
 }
 
@@ -33,6 +52,7 @@ static int Reference_traverse(Reference *self, visitproc visit, void *arg)
 	__atomic_load(&self->object, &object, __ATOMIC_SEQ_CST);
 	
 	Py_VISIT(object);
+	Py_VISIT(Py_TYPE(self));
 	return 0;
 }
 
@@ -48,118 +68,353 @@ static int Reference_clear(Reference *self)
 
 static void Reference_dealloc(Reference *self)
 {
+	PyTypeObject *tp = Py_TYPE(self);
+
+	PyObject_GC_UnTrack(self);
 	Reference_clear(self);
-	Py_TYPE(self)->tp_free((PyObject *)self);
+	if (!atomic_freelist_push(&Reference_freelist, (PyObject *)self))
+		tp->tp_free((PyObject *)self);
+	Py_DECREF(tp);
 }
 
-static PyObject *Reference_repr(Reference *self)
+void Reference_clear_freelist(void)
 {
-	PyObject *object;
+	atomic_freelist_clear(&Reference_freelist, PyObject_GC_Del);
+}
 
-	__atomic_load(&self->object, &object, __ATOMIC_SEQ_CST);
+static PyObject *Reference_new(PyTypeObject *type, PyObject *args,
+			       PyObject *kwds)
+{
+	PyObject *self;
 
-	return PyUnicode_FromFormat("atomic.Reference(%R)", object);
+	self = atomic_freelist_pop(&Reference_freelist, type);
+	if (self == NULL)
+		return type->tp_alloc(type, 0);
+	PyObject_GC_Track(self);
+	return self;
 }
 
-static PyObject *Reference_get(Reference *self)
+/*
+ * Vectorcall constructor, as for atomic.Integer: skip packing the arguments
+ * and the tp_new -> tp_init dispatch. A new object is not shared yet, so the
+ * reference is stored directly.
+ */
+PyObject *Reference_vectorcall(PyObject *type, PyObject *const *args,
+			       size_t nargsf, PyObject *kwnames)
 {
-	PyObject *object;
+	Py_ssize_t nargs = PyVectorcall_NARGS(nargsf);
+	PyObject *object = Py_None;
+	Reference *self;
+
+	if (kwnames && PyTuple_GET_SIZE(kwnames)) {
+		if (nargs || PyTuple_GET_SIZE(kwnames) != 1 ||
+		    !PyUnicode_Check(PyTuple_GET_ITEM(kwnames, 0)) ||
+		    PyUnicode_CompareWithASCIIString(PyTuple_GET_ITEM(kwnames, 0),
+						     "obj") != 0) {
+			PyErr_SetString(PyExc_TypeError,
+					"Reference() takes at most 1 argument (obj)");
+			return NULL;
+		}
+		object = args[0];
+	} else if (nargs > 1) {
+		PyErr_Format(PyExc_TypeError,
+			     "Reference() takes at most 1 argument (%zd given)",
+			     nargs);
+		return NULL;
+	} else if (nargs == 1) {
+		object = args[0];
+	}
 
-	__atomic_load(&self->object, &object, __ATOMIC_SEQ_CST);
+	if (Reference_check_lock_free() < 0)
+		return NULL;
+
+	self = (Reference *)Reference_new((PyTypeObject *)type, NULL, NULL);
+	if (self == NULL)
+		return NULL;
 
 	Py_INCREF(object);
-	return object;
+	self->object = object;
+	return (PyObject *)self;
+}
+
+static PyObject *Reference_load(Reference *self)
+{
+	uintptr_t word;
+
+	/*
+	 * A plain load followed by Py_INCREF could race with set() dropping
+	 * the last reference in between; the hazard pointer keeps the object
+	 * alive until we own a reference.
+	 */
+	return atomic_hazard_load_object((uintptr_t *)&self->object,
+					 ATOMIC_HAZARD_NO_TAG, &word);
+}
+
+static PyObject *Reference_get(Reference *self, PyObject *const *args,
+			       Py_ssize_t nargs, PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+
+	/* The order is validated, but the hazard protocol needs seq_cst. */
+	if (!atomic_check_nargs("get", nargs, 0) ||
+	    !atomic_parse_order("get", args, nargs, kwnames, ATOMIC_ORDER_LOAD,
+				&order))
+		return NULL;
+
+	return Reference_load(self);
+}
+
+static PyObject *Reference_repr(Reference *self)
+{
+	PyObject *object, *ret;
+
+	/* Hold our own reference while formatting; set() may drop the stored one. */
+	object = Reference_load(self);
+	if (object == NULL)
+		return NULL;
+	ret = PyUnicode_FromFormat("atomic.Reference(%R)", object);
+	Py_DECREF(object);
+	return ret;
 }
 
-static PyObject *Reference_set(Reference *self, PyObject *args)
+static PyObject *Reference_set(Reference *self, PyObject *const *args,
+			       Py_ssize_t nargs, PyObject *kwnames)
 {
+	int order = __ATOMIC_SEQ_CST;
 	PyObject *object, *old_object;
 
-	if (!PyArg_ParseTuple(args, "O", &object))
+	if (!atomic_check_nargs("set", nargs, 1) ||
+	    !atomic_parse_order("set", args, nargs, kwnames, ATOMIC_ORDER_STORE,
+				&order))
 		return NULL;
+	object = args[0];
 
 	Py_INCREF(object);
 
-	__atomic_exchange(&self->object, &object, &old_object,
-			  __ATOMIC_SEQ_CST);
+	/* The old reference has to be retired, so this is always an exchange. */
+	old_object = ATOMIC_RMW_N(__atomic_exchange_n, &self->object, object,
+				  atomic_hazard_publish_order(order));
 
-	Py_DECREF(old_object);
+	atomic_hazard_retire_object(old_object);
 	Py_RETURN_NONE;
 }
 
-static PyObject *Reference_get_and_set(Reference *self, PyObject *args)
+static PyObject *Reference_get_and_set(Reference *self, PyObject *const *args,
+				       Py_ssize_t nargs, PyObject *kwnames)
 {
+	int order = __ATOMIC_SEQ_CST;
 	PyObject *object, *ret;
 
-	if (!PyArg_ParseTuple(args, "O", &object))
+	if (!atomic_check_nargs("get_and_set", nargs, 1) ||
+	    !atomic_parse_order("get_and_set", args, nargs, kwnames,
+				ATOMIC_ORDER_RMW, &order))
 		return NULL;
+	object = args[0];
 
 	Py_INCREF(object);
 
-	__atomic_exchange(&self->object, &object, &ret, __ATOMIC_SEQ_CST);
+	ret = ATOMIC_RMW_N(__atomic_exchange_n, &self->object, object,
+			   atomic_hazard_publish_order(order));
 
+	/*
+	 * Retire the stored reference rather than handing it to the caller: a
+	 * reader that already protected the object may be about to take its own
+	 * reference, and must not find it freed once the caller drops this one.
+	 */
+	Py_INCREF(ret);
+	atomic_hazard_retire_object(ret);
 	return ret;
 }
 
-static PyObject *Reference_compare_and_set(Reference *self, PyObject *args)
+static PyObject *Reference_do_compare_and_set(Reference *self,
+					      const char *name,
+					      PyObject *const *args,
+					      Py_ssize_t nargs,
+					      PyObject *kwnames, int weak)
 {
+	int success = __ATOMIC_SEQ_CST, failure = __ATOMIC_SEQ_CST;
 	PyObject *expect, *update;
 	long ret;
 
-	if (!PyArg_ParseTuple(args, "OO", &expect, &update))
+	if (!atomic_check_nargs(name, nargs, 2) ||
+	    !atomic_parse_cas_orders(name, args, nargs, kwnames, &success,
+				     &failure))
 		return NULL;
+	expect = args[0];
+	update = args[1];
 
 	Py_INCREF(update);
 
-	ret = __atomic_compare_exchange(&self->object, &expect, &update, 0,
-					__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
-
-	if (!ret)
+	ret = ATOMIC_CAS_N(&self->object, &expect, update, weak,
+			   atomic_hazard_publish_order(success), failure);
+	ATOMIC_STATS_CAS(ATOMIC_STATS_PTR(self), ATOMIC_STATS_REFERENCE, ret,
+			 weak && expect == args[0]);
+
+	/*
+	 * On success the stored reference to expect is ours to release. On
+	 * failure expect now holds the current value, which we don't own.
+	 */
+	if (ret)
+		atomic_hazard_retire_object(expect);
+	else
 		Py_DECREF(update);
-	Py_DECREF(expect);
 	return PyBool_FromLong(ret);
 }
 
-static PyObject *Reference_weak_compare_and_set(Reference *self, PyObject *args)
+static PyObject *Reference_compare_and_set(Reference *self,
+					   PyObject *const *args,
+					   Py_ssize_t nargs, PyObject *kwnames)
 {
-	PyObject *expect, *update;
-	long ret;
+	return Reference_do_compare_and_set(self, "compare_and_set", args,
+					    nargs, kwnames, 0);
+}
 
-	if (!PyArg_ParseTuple(args, "OO", &expect, &update))
-		return NULL;
+static PyObject *Reference_weak_compare_and_set(Reference *self,
+						PyObject *const *args,
+						Py_ssize_t nargs,
+						PyObject *kwnames)
+{
+	return Reference_do_compare_and_set(self, "weak_compare_and_set", args,
+					    nargs, kwnames, 1);
+}
 
-	Py_INCREF(update);
+ATOMIC_STATS_GETTER(Reference_stats, Reference)
 
-	ret = __atomic_compare_exchange(&self->object, &expect, &update, 1,
-					__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+/*
+ * Replace the reference with fn(obj), or fn(obj, x) if x is given, until the
+ * compare-and-swap succeeds. Returns new references to the old and new
+ * objects.
+ */
+static int Reference_update(Reference *self, PyObject *fn, PyObject *x,
+			    int order, unsigned int max_spin, PyObject **oldp,
+			    PyObject **newp)
+{
+	int failure = atomic_failure_order(order);
+	struct atomic_backoff backoff;
+	PyObject *old, *expect, *new;
+	int ret;
+
+	atomic_backoff_init(&backoff, max_spin);
+	for (;;) {
+		old = Reference_load(self);
+		if (x)
+			new = PyObject_CallFunctionObjArgs(fn, old, x, NULL);
+		else
+			new = PyObject_CallOneArg(fn, old);
+		if (new == NULL) {
+			Py_DECREF(old);
+			return 0;
+		}
+
+		if (new == old)
+			break;
+
+		/* The stored reference to new, if the swap succeeds. */
+		Py_INCREF(new);
+		expect = old;
+		ret = ATOMIC_CAS_N(&self->object, &expect, new, 1,
+				   atomic_hazard_publish_order(order), failure);
+		ATOMIC_STATS_LOOP_CAS(ATOMIC_STATS_PTR(self),
+				      ATOMIC_STATS_REFERENCE, ret,
+				      expect == old);
+		if (ret) {
+			/* The stored reference to old is ours to release. */
+			atomic_hazard_retire_object(old);
+			break;
+		}
+
+		Py_DECREF(new);
+		Py_DECREF(new);
+		Py_DECREF(old);
+		atomic_backoff_wait(&backoff);
+	}
 
-	if (!ret)
-		Py_DECREF(update);
-	Py_DECREF(expect);
-	return PyBool_FromLong(ret);
+	*oldp = old;
+	*newp = new;
+	return 1;
+}
+
+/* which is 0 to return the old reference, 1 to return the new one. */
+#define Reference_METHOD_UPDATE(method, nargs_expected, which)			\
+static PyObject *Reference_##method(Reference *self, PyObject *const *args,	\
+				    Py_ssize_t nargs, PyObject *kwnames)	\
+{										\
+	unsigned int max_spin = ATOMIC_DEFAULT_MAX_SPIN;			\
+	int order = __ATOMIC_SEQ_CST;						\
+	PyObject *old, *new;							\
+										\
+	if (!atomic_check_nargs(#method, nargs, nargs_expected) ||		\
+	    !atomic_parse_update_kwargs(#method, args, nargs, kwnames,		\
+					&order, &max_spin))			\
+		return NULL;							\
+										\
+	if (!Reference_update(self, args[nargs - 1],				\
+			      nargs == 2 ? args[0] : NULL, order, max_spin,	\
+			      &old, &new))					\
+		return NULL;							\
+										\
+	if (which) {								\
+		Py_DECREF(old);							\
+		return new;							\
+	}									\
+	Py_DECREF(new);								\
+	return old;								\
 }
 
+Reference_METHOD_UPDATE(update_and_get, 1, 1)
+Reference_METHOD_UPDATE(get_and_update, 1, 0)
+Reference_METHOD_UPDATE(accumulate_and_get, 2, 1)
+
 static PyMethodDef Reference_methods[] = {
-	{"get", (PyCFunction)Reference_get, METH_NOARGS,
-	 "get() -> object\n\n"
+	{"get", (PyCFunction)(void (*)(void))Reference_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get(*, order=atomic.SEQ_CST) -> object\n\n"
 	 "Atomically load and return the stored reference."},
-	{"set", (PyCFunction)Reference_set, METH_VARARGS,
-	 "set(obj)\n\n"
+	{"set", (PyCFunction)(void (*)(void))Reference_set,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "set(obj, *, order=atomic.SEQ_CST)\n\n"
 	 "Atomically store the given reference."},
 
-	{"get_and_set", (PyCFunction)Reference_get_and_set, METH_VARARGS,
-	 "get_and_set(x) -> object\n\n"
+	{"get_and_set", (PyCFunction)(void (*)(void))Reference_get_and_set,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_set(x, *, order=atomic.SEQ_CST) -> object\n\n"
 	 "Atomically store the given reference and return the old reference."},
-	{"compare_and_set", (PyCFunction)Reference_compare_and_set, METH_VARARGS,
-	 "compare_and_set(expect, update) -> bool\n\n"
+	{"compare_and_set", (PyCFunction)(void (*)(void))Reference_compare_and_set,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "compare_and_set(expect, update, *, order=atomic.SEQ_CST,\n"
+	 "                failure_order=None) -> bool\n\n"
 	 "Atomically store the given reference if the old reference equals the given\n"
 	 "expected reference by identity, returning whether the actual reference equaled\n"
 	 "the expected value."},
-	{"weak_compare_and_set", (PyCFunction)Reference_weak_compare_and_set, METH_VARARGS,
-	 "weak_compare_and_set(expect, update) -> bool\n\n"
+	{"weak_compare_and_set",
+	 (PyCFunction)(void (*)(void))Reference_weak_compare_and_set,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "weak_compare_and_set(expect, update, *, order=atomic.SEQ_CST,\n"
+	 "                     failure_order=None) -> bool\n\n"
 	 "compare_and_set, but can fail spuriously and does not provide ordering\n"
 	 "guarantees."},
 
+	{"update_and_get", (PyCFunction)(void (*)(void))Reference_update_and_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "update_and_get(fn, *, order=atomic.SEQ_CST, max_spin=128) -> object\n\n"
+	 "Atomically replace the reference with fn(obj) and return the new\n"
+	 "reference. fn is called again with the latest object whenever another\n"
+	 "thread replaced it first, so it should be free of side effects. Retries\n"
+	 "pause the CPU for up to max_spin iterations, then yield to other threads."},
+	{"get_and_update", (PyCFunction)(void (*)(void))Reference_get_and_update,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get_and_update(fn, *, order=atomic.SEQ_CST, max_spin=128) -> object\n\n"
+	 "update_and_get, but return the old reference."},
+	{"accumulate_and_get",
+	 (PyCFunction)(void (*)(void))Reference_accumulate_and_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "accumulate_and_get(x, fn, *, order=atomic.SEQ_CST, max_spin=128)\n"
+	 "    -> object\n\n"
+	 "Atomically replace the reference with fn(obj, x) and return the new\n"
+	 "reference."},
+
+	ATOMIC_STATS_METHOD_DEF(Reference_stats),
+
 	{NULL, NULL, 0, NULL}
 };
 
@@ -167,43 +422,26 @@ static PyMethodDef Reference_methods[] = {
 	"atomic.Reference(obj=None) -> new atomic reference\n\n" \
 	"Reference supporting atomic operations with sequentially consistent semantics.\n\n" \
 	"Atomic load (get()), store (set()), exchange (get_and_set()),\n" \
-	"and compare-and-exchange (compare_and_set()) are supported."
-
-PyTypeObject Reference_type = {
-	PyVarObject_HEAD_INIT(NULL, 0)
-	"atomic.Reference",			/* tp_name */
-	sizeof(Reference),			/* tp_basicsize */
-	0,					/* tp_itemsize */
-	(destructor)Reference_dealloc,		/* tp_dealloc */
-	NULL,					/* tp_print */
-	NULL,					/* tp_getattr */
-	NULL,					/* tp_setattr */
-	NULL,					/* tp_reserved */
-	(reprfunc)Reference_repr,		/* tp_repr */
-	NULL,					/* tp_as_number */
-	NULL,					/* tp_as_sequence */
-	NULL,					/* tp_as_mapping */
-	NULL,					/* tp_hash  */
-	NULL,					/* tp_call */
-	NULL,					/* tp_str */
-	NULL,					/* tp_getattro */
-	NULL,					/* tp_setattro */
-	NULL,					/* tp_as_buffer */
-	Py_TPFLAGS_DEFAULT,			/* tp_flags */
-	ATOMIC_REFERENCE_DOCSTRING,		/* tp_doc */
-	(traverseproc)Reference_traverse,	/* tp_traverse */
-	(inquiry)Reference_clear,		/* tp_clear */
-	NULL,					/* tp_richcompare */
-	0,					/* tp_weaklistoffset */
-	NULL,					/* tp_iter */
-	NULL,					/* tp_iternext */
-	Reference_methods,			/* tp_methods */
-	NULL,					/* tp_members */
-	NULL,					/* tp_getset */
-	NULL,					/* tp_base */
-	NULL,					/* tp_dict */
-	NULL,					/* tp_descr_get */
-	NULL,					/* tp_descr_set */
-	0,					/* tp_dictoffset */
-	(initproc)Reference_init,		/* tp_init */
+	"and compare-and-exchange (compare_and_set()) are supported.\n\n" \
+	"Every method takes an order= keyword as on atomic.Integer. Since other\n" \
+	"threads dereference the stored object, stores are never weaker than\n" \
+	"atomic.RELEASE and loads are always sequentially consistent."
+
+static PyType_Slot Reference_slots[] = {
+	{Py_tp_dealloc, Reference_dealloc},
+	{Py_tp_repr, Reference_repr},
+	{Py_tp_doc, ATOMIC_REFERENCE_DOCSTRING},
+	{Py_tp_traverse, Reference_traverse},
+	{Py_tp_clear, Reference_clear},
+	{Py_tp_methods, Reference_methods},
+	{Py_tp_init, Reference_init},
+	{Py_tp_new, Reference_new},
+	{0, NULL}
+};
+
+PyType_Spec Reference_spec = {
+	.name = "atomic.Reference",
+	.basicsize = sizeof(Reference),
+	.flags = ATOMIC_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+	.slots = Reference_slots,
 };
@@ -0,0 +1,270 @@
+#include <Python.h>
+#include <limits.h>
+#include <stdint.h>
+
+#include "atomic.h"
+
+/*
+ * ID generator that hands each thread a block of IDs at a time. The shared
+ * word next is only touched to reserve a block, with one fetch-add; the IDs
+ * inside a block come from a per-thread cache and cost no atomic operation
+ * at all.
+ *
+ * Each thread caches one block per sequence in Sequence_blocks, a small
+ * direct-mapped table indexed by the sequence's id. Ids come from a global
+ * counter and are never reused, so a slot left behind by a freed sequence
+ * can never be mistaken for a live one. When two sequences share a slot, the
+ * one that takes it over abandons the other's remaining IDs, which leaves
+ * gaps but never duplicates.
+ *
+ * Block sizes adapt per thread: a reservation that starts exactly where the
+ * thread's previous block ended saw no other thread in between, so the next
+ * block is half as large; otherwise it is twice as large, up to max_block.
+ * A thread on its own therefore reserves one ID at a time and the IDs stay
+ * dense, while contending threads quickly move to large blocks.
+ */
+typedef struct {
+	PyObject_HEAD
+	uint64_t id;
+	long start;
+	long max_block;
+	long next;
+} Sequence;
+
+#define SEQUENCE_CACHE_SIZE 16
+#define SEQUENCE_DEFAULT_MAX_BLOCK 1024
+
+struct SequenceBlock {
+	uint64_t id;	/* the sequence's id, 0 if the slot is unused */
+	/* IDs [next, end) are reserved; unsigned so end can be LONG_MAX + 1. */
+	unsigned long next;
+	unsigned long end;
+	long size;	/* size of the next block to reserve */
+};
+
+static __thread struct SequenceBlock Sequence_blocks[SEQUENCE_CACHE_SIZE];
+
+static uint64_t Sequence_last_id;
+
+static inline struct SequenceBlock *Sequence_block(Sequence *self)
+{
+	return &Sequence_blocks[self->id % SEQUENCE_CACHE_SIZE];
+}
+
+static PyObject *Sequence_new(PyTypeObject *type, PyObject *args,
+			      PyObject *kwds)
+{
+	Sequence *self;
+
+	self = (Sequence *)type->tp_alloc(type, 0);
+	if (self == NULL)
+		return NULL;
+
+	self->id = __atomic_add_fetch(&Sequence_last_id, 1, __ATOMIC_RELAXED);
+	return (PyObject *)self;
+}
+
+static int Sequence_init(Sequence *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = {"start", "max_block", NULL};
+	long start = 0, max_block = SEQUENCE_DEFAULT_MAX_BLOCK;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|l$l", kwlist, &start,
+					 &max_block))
+		return -1;
+
+	if (max_block < 1) {
+		PyErr_SetString(PyExc_ValueError,
+				"atomic.Sequence max_block must be positive");
+		return -1;
+	}
+
+	/* Restarting would hand out IDs that threads already hold. */
+	if (self->max_block) {
+		PyErr_SetString(PyExc_RuntimeError,
+				"atomic.Sequence is already initialized");
+		return -1;
+	}
+
+	self->start = start;
+	self->max_block = max_block;
+	__atomic_store_n(&self->next, start, __ATOMIC_SEQ_CST);
+
+	return 0;
+}
+
+static int Sequence_check_ready(Sequence *self)
+{
+	if (self->max_block == 0) {
+		PyErr_SetString(PyExc_RuntimeError,
+				"atomic.Sequence is not initialized");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Replace the calling thread's block with a new one of at least want IDs.
+ * Returns 0 with OverflowError set if fewer than want IDs are left below
+ * LONG_MAX, after keeping any that are in the block.
+ */
+static int Sequence_reserve(Sequence *self, struct SequenceBlock *block,
+			    long want)
+{
+	long size, start;
+	int fresh = block->id != self->id;
+
+	if (fresh) {
+		block->id = self->id;
+		block->size = 1;
+	}
+
+	size = block->size > want ? block->size : want;
+	start = __atomic_fetch_add(&self->next, size, __ATOMIC_RELAXED);
+
+	/* The word wraps around past LONG_MAX; a wrapped start is below it. */
+	if (start < self->start) {
+		block->next = block->end = 0;
+		PyErr_SetString(PyExc_OverflowError,
+				"atomic.Sequence is exhausted");
+		return 0;
+	}
+
+	if (!fresh && (unsigned long)start == block->end) {
+		if (block->size > 1)
+			block->size /= 2;
+	} else if (!fresh) {
+		if (block->size < self->max_block / 2)
+			block->size *= 2;
+		else
+			block->size = self->max_block;
+	}
+
+	/* The last block stops at LONG_MAX, which is still a valid ID. */
+	if ((unsigned long)size - 1 > (unsigned long)LONG_MAX - start)
+		size = LONG_MAX - start + 1;
+	block->next = start;
+	block->end = (unsigned long)start + size;
+	if (size < want) {
+		PyErr_SetString(PyExc_OverflowError,
+				"atomic.Sequence is exhausted");
+		return 0;
+	}
+	return 1;
+}
+
+static PyObject *Sequence_next(Sequence *self, PyObject *Py_UNUSED(unused))
+{
+	struct SequenceBlock *block = Sequence_block(self);
+
+	if (block->id != self->id || block->next == block->end) {
+		if (!Sequence_check_ready(self) ||
+		    !Sequence_reserve(self, block, 1))
+			return NULL;
+	}
+	return PyLong_FromLong((long)block->next++);
+}
+
+static PyObject *Sequence_iternext(Sequence *self)
+{
+	return Sequence_next(self, NULL);
+}
+
+static PyObject *Sequence_next_n(Sequence *self, PyObject *arg)
+{
+	struct SequenceBlock *block = Sequence_block(self);
+	unsigned long first;
+	long k;
+
+	k = PyLong_AsLong(arg);
+	if (k == -1 && PyErr_Occurred())
+		return NULL;
+	if (k < 0) {
+		PyErr_SetString(PyExc_ValueError,
+				"next_n() count must be non-negative");
+		return NULL;
+	}
+
+	/* The rest of a block too small for k is abandoned, keeping order. */
+	if (block->id != self->id ||
+	    block->end - block->next < (unsigned long)k) {
+		if (!Sequence_check_ready(self) ||
+		    !Sequence_reserve(self, block, k))
+			return NULL;
+	}
+	first = block->next;
+	block->next += k;
+	/* Only a batch ending with LONG_MAX stops outside a long. */
+	if ((long)first > LONG_MAX - k)
+		return PyObject_CallFunction((PyObject *)&PyRange_Type, "lk",
+					     (long)first, first + k);
+	return PyObject_CallFunction((PyObject *)&PyRange_Type, "ll",
+				     (long)first, (long)first + k);
+}
+
+static PyObject *Sequence_get(Sequence *self, PyObject *const *args,
+			      Py_ssize_t nargs, PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+
+	if (!atomic_check_nargs("get", nargs, 0) ||
+	    !atomic_parse_order("get", args, nargs, kwnames, ATOMIC_ORDER_LOAD,
+				&order))
+		return NULL;
+
+	return PyLong_FromLong(ATOMIC_LOAD_N(&self->next, order));
+}
+
+static PyObject *Sequence_repr(Sequence *self)
+{
+	return PyUnicode_FromFormat("atomic.Sequence(%ld)",
+				    __atomic_load_n(&self->next,
+						    __ATOMIC_SEQ_CST));
+}
+
+static PyMethodDef Sequence_methods[] = {
+	{"next", (PyCFunction)Sequence_next, METH_NOARGS,
+	 "next() -> int\n\n"
+	 "Return a new ID. IDs are unique across threads and increase on each\n"
+	 "call from the same thread."},
+	{"next_n", (PyCFunction)Sequence_next_n, METH_O,
+	 "next_n(k) -> range\n\n"
+	 "Return a range of k consecutive new IDs, all greater than any ID this\n"
+	 "thread got before."},
+	{"get", (PyCFunction)(void (*)(void))Sequence_get,
+	 METH_FASTCALL | METH_KEYWORDS,
+	 "get(*, order=atomic.SEQ_CST) -> int\n\n"
+	 "Return the first ID no thread has reserved yet. Every ID handed out so\n"
+	 "far is below it, but IDs still cached by threads may be handed out\n"
+	 "later."},
+
+	{NULL, NULL, 0, NULL}
+};
+
+#define ATOMIC_SEQUENCE_DOCSTRING \
+	"atomic.Sequence(start=0, *, max_block=1024) -> new ID sequence\n\n" \
+	"Generator of unique integer IDs starting at start. Each thread reserves\n" \
+	"blocks of IDs from a shared counter with a single atomic add, and the\n" \
+	"block size grows with contention up to max_block, so threads rarely\n" \
+	"touch the shared counter. IDs from one thread always increase, but IDs\n" \
+	"from different threads interleave and a thread's unused IDs may be\n" \
+	"skipped, so the sequence as a whole is neither ordered nor dense.\n\n" \
+	"Iterating over a sequence yields next() forever."
+
+static PyType_Slot Sequence_slots[] = {
+	{Py_tp_repr, Sequence_repr},
+	{Py_tp_doc, ATOMIC_SEQUENCE_DOCSTRING},
+	{Py_tp_methods, Sequence_methods},
+	{Py_tp_iter, PyObject_SelfIter},
+	{Py_tp_iternext, Sequence_iternext},
+	{Py_tp_init, Sequence_init},
+	{Py_tp_new, Sequence_new},
+	{0, NULL}
+};
+
+PyType_Spec Sequence_spec = {
+	.name = "atomic.Sequence",
+	.basicsize = sizeof(Sequence),
+	.flags = ATOMIC_TPFLAGS_DEFAULT,
+	.slots = Sequence_slots,
+};
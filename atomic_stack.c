@@ -0,0 +1,663 @@
+#include <Python.h>
+#include <stdint.h>
+
+#include "atomic.h"
+#include "atomic_hazard.h"
+#include "atomic_stats.h"
+#include "atomic_update.h"
+
+/*
+ * Treiber stack: a singly linked list of nodes, each owning one reference,
+ * whose top is replaced with one compare-and-swap per push or pop.
+ *
+ * A pop has to read top->next before its compare-and-swap, which is only
+ * safe if the node cannot be freed (or freed and reused at the same address,
+ * turning a stale compare-and-swap into a successful one: the ABA problem)
+ * in between. The popper therefore protects the node with a hazard pointer,
+ * and popped nodes are retired rather than freed, exactly as Reference does
+ * for the objects it stores. pop_all() detaches the whole list with a single
+ * exchange.
+ */
+typedef struct Stack_node {
+	PyObject *object;
+	struct Stack_node *next;
+} Stack_node;
+
+struct Stack_head {
+	Stack_node *top;
+	Py_ssize_t size;
+};
+
+static void Stack_free_node(void *node)
+{
+	PyMem_RawFree(node);
+}
+
+/*
+ * Push object, stealing the caller's reference, without counting it in
+ * size. Returns 0 on error.
+ */
+static int Stack_head_link(struct Stack_head *head, PyObject *object,
+			   atomic_stats *stats, int type)
+{
+	Stack_node *node, *top;
+	int ret;
+
+	node = PyMem_RawMalloc(sizeof(*node));
+	if (node == NULL) {
+		Py_DECREF(object);
+		PyErr_NoMemory();
+		return 0;
+	}
+	node->object = object;
+
+	top = __atomic_load_n(&head->top, __ATOMIC_RELAXED);
+	do {
+		node->next = top;
+		ret = __atomic_compare_exchange_n(&head->top, &top, node, 1,
+						  __ATOMIC_RELEASE,
+						  __ATOMIC_RELAXED);
+		ATOMIC_STATS_LOOP_CAS(stats, type, ret, top == node->next);
+	} while (!ret);
+
+	return 1;
+}
+
+static int Stack_head_push(struct Stack_head *head, PyObject *object,
+			   atomic_stats *stats, int type)
+{
+	if (!Stack_head_link(head, object, stats, type))
+		return 0;
+	__atomic_fetch_add(&head->size, 1, __ATOMIC_RELAXED);
+	return 1;
+}
+
+/*
+ * Pop the top object into *object, transferring its reference. Returns 1, 0
+ * if the stack is empty, or -1 on error.
+ */
+static int Stack_head_pop(struct Stack_head *head, PyObject **object,
+			  atomic_stats *stats, int type)
+{
+	struct atomic_backoff backoff;
+	Stack_node *node, *next;
+	uintptr_t *hazard;
+	int ret;
+
+	hazard = atomic_hazard_slot(0);
+	if (hazard == NULL)
+		return -1;
+
+	atomic_backoff_init(&backoff, ATOMIC_DEFAULT_MAX_SPIN);
+	for (;;) {
+		node = (Stack_node *)atomic_hazard_protect(hazard,
+							   (uintptr_t *)&head->top,
+							   ATOMIC_HAZARD_NO_TAG);
+		if (node == NULL) {
+			atomic_hazard_release(hazard);
+			return 0;
+		}
+
+		next = node->next;
+		ret = __atomic_compare_exchange_n(&head->top, &node, next, 0,
+						  __ATOMIC_ACQUIRE,
+						  __ATOMIC_RELAXED);
+		ATOMIC_STATS_LOOP_CAS(stats, type, ret, 0);
+		if (ret)
+			break;
+		atomic_backoff_wait(&backoff);
+	}
+
+	atomic_hazard_release(hazard);
+	__atomic_fetch_sub(&head->size, 1, __ATOMIC_RELAXED);
+
+	*object = node->object;
+	atomic_hazard_retire(node, Stack_free_node);
+	return 1;
+}
+
+/* Detach every node; the caller must retire each one. */
+static Stack_node *Stack_head_take(struct Stack_head *head, Py_ssize_t *count)
+{
+	Stack_node *top, *node;
+
+	top = __atomic_exchange_n(&head->top, NULL, __ATOMIC_ACQUIRE);
+	*count = 0;
+	for (node = top; node; node = node->next)
+		(*count)++;
+	__atomic_fetch_sub(&head->size, *count, __ATOMIC_RELAXED);
+	return top;
+}
+
+static int Stack_head_traverse(struct Stack_head *head, visitproc visit,
+			       void *arg)
+{
+	Stack_node *node;
+
+	/* The collector runs with every other thread stopped. */
+	for (node = head->top; node; node = node->next)
+		Py_VISIT(node->object);
+	return 0;
+}
+
+static void Stack_head_clear(struct Stack_head *head)
+{
+	Stack_node *node, *next;
+	Py_ssize_t count;
+
+	for (node = Stack_head_take(head, &count); node; node = next) {
+		next = node->next;
+		Py_DECREF(node->object);
+		atomic_hazard_retire(node, Stack_free_node);
+	}
+}
+
+static Py_ssize_t Stack_head_length(struct Stack_head *head)
+{
+	Py_ssize_t size = __atomic_load_n(&head->size, __ATOMIC_RELAXED);
+
+	/* A popper may decrement before the matching pusher increments. */
+	return size < 0 ? 0 : size;
+}
+
+typedef struct {
+	PyObject_HEAD
+	struct Stack_head head;
+	ATOMIC_STATS_MEMBER
+} Stack;
+
+static int Stack_init(Stack *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = {"iterable", NULL};
+	PyObject *iterable = NULL, *iterator, *item;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|O", kwlist, &iterable))
+		return -1;
+
+	if (iterable == NULL)
+		return 0;
+
+	iterator = PyObject_GetIter(iterable);
+	if (iterator == NULL)
+		return -1;
+
+	while ((item = PyIter_Next(iterator))) {
+		if (!Stack_head_push(&self->head, item, ATOMIC_STATS_PTR(self),
+				     ATOMIC_STATS_STACK)) {
+			Py_DECREF(iterator);
+			return -1;
+		}
+	}
+	Py_DECREF(iterator);
+
+	return PyErr_Occurred() ? -1 : 0;
+}
+
+static int Stack_traverse(Stack *self, visitproc visit, void *arg)
+{
+	Py_VISIT(Py_TYPE(self));
+	return Stack_head_traverse(&self->head, visit, arg);
+}
+
+static int Stack_clear(Stack *self)
+{
+	Stack_head_clear(&self->head);
+	return 0;
+}
+
+static void Stack_dealloc(Stack *self)
+{
+	PyTypeObject *tp = Py_TYPE(self);
+
+	PyObject_GC_UnTrack(self);
+	Stack_clear(self);
+	tp->tp_free((PyObject *)self);
+	Py_DECREF(tp);
+}
+
+static PyObject *Stack_push(Stack *self, PyObject *object)
+{
+	Py_INCREF(object);
+	if (!Stack_head_push(&self->head, object, ATOMIC_STATS_PTR(self),
+			     ATOMIC_STATS_STACK))
+		return NULL;
+	Py_RETURN_NONE;
+}
+
+static PyObject *Stack_pop(Stack *self, PyObject *const *args,
+			   Py_ssize_t nargs)
+{
+	PyObject *object;
+	int ret;
+
+	if (nargs > 1) {
+		PyErr_Format(PyExc_TypeError,
+			     "pop() takes at most 1 argument (%zd given)",
+			     nargs);
+		return NULL;
+	}
+
+	ret = Stack_head_pop(&self->head, &object, ATOMIC_STATS_PTR(self),
+			     ATOMIC_STATS_STACK);
+	if (ret < 0)
+		return NULL;
+	if (ret)
+		return object;
+
+	if (nargs) {
+		Py_INCREF(args[0]);
+		return args[0];
+	}
+	PyErr_SetString(PyExc_IndexError, "pop from empty stack");
+	return NULL;
+}
+
+static PyObject *Stack_pop_all(Stack *self, PyObject *Py_UNUSED(unused))
+{
+	Stack_node *node, *next;
+	Py_ssize_t count, i = 0;
+	PyObject *list;
+
+	node = Stack_head_take(&self->head, &count);
+	list = PyList_New(count);
+	for (; node; node = next) {
+		next = node->next;
+		if (list)
+			PyList_SET_ITEM(list, i++, node->object);
+		else
+			Py_DECREF(node->object);
+		atomic_hazard_retire(node, Stack_free_node);
+	}
+	return list;
+}
+
+static Py_ssize_t Stack_length(Stack *self)
+{
+	return Stack_head_length(&self->head);
+}
+
+static PyObject *Stack_repr(Stack *self)
+{
+	return PyUnicode_FromFormat("<atomic.Stack object at %p, size %zd>",
+				    self, Stack_length(self));
+}
+
+ATOMIC_STATS_GETTER(Stack_stats, Stack)
+
+static PyMethodDef Stack_methods[] = {
+	{"push", (PyCFunction)Stack_push, METH_O,
+	 "push(obj)\n\n"
+	 "Push obj onto the top of the stack."},
+	{"pop", (PyCFunction)(void (*)(void))Stack_pop, METH_FASTCALL,
+	 "pop([default]) -> object\n\n"
+	 "Remove and return the top object. If the stack is empty, return\n"
+	 "default if given and raise IndexError otherwise."},
+	{"pop_all", (PyCFunction)Stack_pop_all, METH_NOARGS,
+	 "pop_all() -> list\n\n"
+	 "Atomically empty the stack and return its objects, top first."},
+
+	ATOMIC_STATS_METHOD_DEF(Stack_stats),
+
+	{NULL, NULL, 0, NULL}
+};
+
+#define ATOMIC_STACK_DOCSTRING \
+	"atomic.Stack(iterable=()) -> new lock-free stack\n\n" \
+	"Last-in, first-out stack that any number of threads can push to and pop\n" \
+	"from without a lock. push() and pop() are each a single compare-and-swap\n" \
+	"of the top of the stack, and pop_all() a single exchange. Objects from\n" \
+	"iterable are pushed in order, so the last one ends up on top.\n\n" \
+	"len() is exact whenever no push or pop is in progress."
+
+static PyType_Slot Stack_slots[] = {
+	{Py_tp_dealloc, Stack_dealloc},
+	{Py_tp_repr, Stack_repr},
+	{Py_tp_doc, ATOMIC_STACK_DOCSTRING},
+	{Py_tp_traverse, Stack_traverse},
+	{Py_tp_clear, Stack_clear},
+	{Py_tp_methods, Stack_methods},
+	{Py_sq_length, Stack_length},
+	{Py_tp_init, Stack_init},
+	{Py_tp_new, PyType_GenericNew},
+	{0, NULL}
+};
+
+PyType_Spec Stack_spec = {
+	.name = "atomic.Stack",
+	.basicsize = sizeof(Stack),
+	.flags = ATOMIC_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+	.slots = Stack_slots,
+};
+
+/*
+ * Pool of reusable objects on a Treiber stack. size in the head counts
+ * objects in the pool plus releases that reserved room but have not pushed
+ * yet, so the pool never holds more than max_size objects.
+ */
+typedef struct {
+	PyObject_HEAD
+	struct Stack_head head;
+	PyObject *factory;
+	Py_ssize_t max_size;
+	ATOMIC_STATS_MEMBER
+} ObjectPool;
+
+/* Context manager returned by ObjectPool.borrow(). */
+typedef struct {
+	PyObject_HEAD
+	ObjectPool *pool;
+	PyObject *object;
+} ObjectPoolLease;
+
+static int ObjectPool_init(ObjectPool *self, PyObject *args, PyObject *kwds)
+{
+	static char *kwlist[] = {"factory", "max_size", NULL};
+	PyObject *factory;
+	Py_ssize_t max_size;
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "On", kwlist, &factory,
+					 &max_size))
+		return -1;
+
+	if (!PyCallable_Check(factory)) {
+		PyErr_SetString(PyExc_TypeError,
+				"atomic.ObjectPool factory must be callable");
+		return -1;
+	}
+	if (max_size < 0) {
+		PyErr_SetString(PyExc_ValueError,
+				"atomic.ObjectPool max_size must be non-negative");
+		return -1;
+	}
+
+	if (self->factory) {
+		PyErr_SetString(PyExc_RuntimeError,
+				"atomic.ObjectPool is already initialized");
+		return -1;
+	}
+
+	Py_INCREF(factory);
+	self->factory = factory;
+	self->max_size = max_size;
+
+	return 0;
+}
+
+static int ObjectPool_traverse(ObjectPool *self, visitproc visit, void *arg)
+{
+	Py_VISIT(self->factory);
+	Py_VISIT(Py_TYPE(self));
+	return Stack_head_traverse(&self->head, visit, arg);
+}
+
+static int ObjectPool_clear_refs(ObjectPool *self)
+{
+	Py_CLEAR(self->factory);
+	Stack_head_clear(&self->head);
+	return 0;
+}
+
+static void ObjectPool_dealloc(ObjectPool *self)
+{
+	PyTypeObject *tp = Py_TYPE(self);
+
+	PyObject_GC_UnTrack(self);
+	ObjectPool_clear_refs(self);
+	tp->tp_free((PyObject *)self);
+	Py_DECREF(tp);
+}
+
+static int ObjectPool_check_ready(ObjectPool *self)
+{
+	if (self->factory == NULL) {
+		PyErr_SetString(PyExc_RuntimeError,
+				"atomic.ObjectPool is not initialized");
+		return 0;
+	}
+	return 1;
+}
+
+static PyObject *ObjectPool_acquire(ObjectPool *self,
+				    PyObject *Py_UNUSED(unused))
+{
+	PyObject *object;
+	int ret;
+
+	if (!ObjectPool_check_ready(self))
+		return NULL;
+
+	ret = Stack_head_pop(&self->head, &object, ATOMIC_STATS_PTR(self),
+			     ATOMIC_STATS_OBJECT_POOL);
+	if (ret < 0)
+		return NULL;
+	if (ret)
+		return object;
+
+	return PyObject_CallNoArgs(self->factory);
+}
+
+/* Return object to the pool, stealing the reference. Returns 0 on error. */
+static int ObjectPool_put(ObjectPool *self, PyObject *object)
+{
+	Py_ssize_t size;
+
+	size = __atomic_fetch_add(&self->head.size, 1, __ATOMIC_RELAXED);
+	if (size >= self->max_size) {
+		__atomic_fetch_sub(&self->head.size, 1, __ATOMIC_RELAXED);
+		Py_DECREF(object);
+		return 1;
+	}
+
+	if (!Stack_head_link(&self->head, object, ATOMIC_STATS_PTR(self),
+			     ATOMIC_STATS_OBJECT_POOL)) {
+		__atomic_fetch_sub(&self->head.size, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	return 1;
+}
+
+static PyObject *ObjectPool_release(ObjectPool *self, PyObject *object)
+{
+	if (!ObjectPool_check_ready(self))
+		return NULL;
+
+	Py_INCREF(object);
+	if (!ObjectPool_put(self, object))
+		return NULL;
+	Py_RETURN_NONE;
+}
+
+static PyObject *ObjectPool_borrow(ObjectPool *self,
+				   PyObject *Py_UNUSED(unused))
+{
+	struct atomic_state *state;
+	ObjectPoolLease *lease;
+
+	if (!ObjectPool_check_ready(self))
+		return NULL;
+
+	/* ObjectPool is not subclassable, so this is always its own type. */
+	state = PyType_GetModuleState(Py_TYPE(self));
+	if (state == NULL)
+		return NULL;
+	lease = PyObject_GC_New(ObjectPoolLease, state->ObjectPoolLease_type);
+	if (lease == NULL)
+		return NULL;
+
+	Py_INCREF(self);
+	lease->pool = self;
+	lease->object = NULL;
+	PyObject_GC_Track(lease);
+	return (PyObject *)lease;
+}
+
+static PyObject *ObjectPool_clear(ObjectPool *self,
+				  PyObject *Py_UNUSED(unused))
+{
+	Stack_head_clear(&self->head);
+	Py_RETURN_NONE;
+}
+
+static Py_ssize_t ObjectPool_length(ObjectPool *self)
+{
+	return Stack_head_length(&self->head);
+}
+
+static PyObject *ObjectPool_repr(ObjectPool *self)
+{
+	return PyUnicode_FromFormat("<atomic.ObjectPool object at %p, "
+				    "size %zd, max_size %zd>", self,
+				    ObjectPool_length(self), self->max_size);
+}
+
+ATOMIC_STATS_GETTER(ObjectPool_stats, ObjectPool)
+
+static PyMethodDef ObjectPool_methods[] = {
+	{"acquire", (PyCFunction)ObjectPool_acquire, METH_NOARGS,
+	 "acquire() -> object\n\n"
+	 "Take an idle object from the pool, or create one with factory() if\n"
+	 "the pool is empty."},
+	{"release", (PyCFunction)ObjectPool_release, METH_O,
+	 "release(obj)\n\n"
+	 "Return obj to the pool for reuse, or drop it if the pool already\n"
+	 "holds max_size objects."},
+	{"borrow", (PyCFunction)ObjectPool_borrow, METH_NOARGS,
+	 "borrow() -> context manager\n\n"
+	 "Return a context manager that acquires an object on entry, as the\n"
+	 "target of the with statement, and releases it on exit:\n\n"
+	 "    with pool.borrow() as buf:\n"
+	 "        ..."},
+	{"clear", (PyCFunction)ObjectPool_clear, METH_NOARGS,
+	 "clear()\n\n"
+	 "Drop every idle object in the pool."},
+
+	ATOMIC_STATS_METHOD_DEF(ObjectPool_stats),
+
+	{NULL, NULL, 0, NULL}
+};
+
+#define ATOMIC_OBJECT_POOL_DOCSTRING \
+	"atomic.ObjectPool(factory, max_size) -> new object pool\n\n" \
+	"Lock-free pool of reusable objects, such as buffers or parsers that are\n" \
+	"expensive to create. acquire() pops an idle object with a single\n" \
+	"compare-and-swap, calling factory() only when none is idle, and\n" \
+	"release() pushes it back, keeping at most max_size idle objects.\n" \
+	"borrow() wraps the two in a context manager.\n\n" \
+	"len() is the number of idle objects. The pool does not track objects\n" \
+	"that are out, and does not reset an object on release."
+
+static PyType_Slot ObjectPool_slots[] = {
+	{Py_tp_dealloc, ObjectPool_dealloc},
+	{Py_tp_repr, ObjectPool_repr},
+	{Py_tp_doc, ATOMIC_OBJECT_POOL_DOCSTRING},
+	{Py_tp_traverse, ObjectPool_traverse},
+	{Py_tp_clear, ObjectPool_clear_refs},
+	{Py_tp_methods, ObjectPool_methods},
+	{Py_sq_length, ObjectPool_length},
+	{Py_tp_init, ObjectPool_init},
+	{Py_tp_new, PyType_GenericNew},
+	{0, NULL}
+};
+
+PyType_Spec ObjectPool_spec = {
+	.name = "atomic.ObjectPool",
+	.basicsize = sizeof(ObjectPool),
+	.flags = ATOMIC_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+	.slots = ObjectPool_slots,
+};
+
+static int ObjectPoolLease_traverse(ObjectPoolLease *self, visitproc visit,
+				    void *arg)
+{
+	Py_VISIT(self->pool);
+	Py_VISIT(self->object);
+	Py_VISIT(Py_TYPE(self));
+	return 0;
+}
+
+static int ObjectPoolLease_clear(ObjectPoolLease *self)
+{
+	Py_CLEAR(self->pool);
+	Py_CLEAR(self->object);
+	return 0;
+}
+
+static void ObjectPoolLease_dealloc(ObjectPoolLease *self)
+{
+	PyTypeObject *tp = Py_TYPE(self);
+
+	/* An object still out was never exited; it is not returned. */
+	PyObject_GC_UnTrack(self);
+	ObjectPoolLease_clear(self);
+	tp->tp_free((PyObject *)self);
+	Py_DECREF(tp);
+}
+
+static PyObject *ObjectPoolLease_new(PyTypeObject *type, PyObject *args,
+				     PyObject *kwds)
+{
+	PyErr_SetString(PyExc_TypeError,
+			"atomic.ObjectPoolLease objects come from "
+			"ObjectPool.borrow()");
+	return NULL;
+}
+
+static PyObject *ObjectPoolLease_enter(ObjectPoolLease *self,
+				       PyObject *Py_UNUSED(unused))
+{
+	PyObject *object;
+
+	if (self->object) {
+		PyErr_SetString(PyExc_RuntimeError,
+				"object pool lease is already entered");
+		return NULL;
+	}
+
+	object = ObjectPool_acquire(self->pool, NULL);
+	if (object == NULL)
+		return NULL;
+
+	Py_INCREF(object);
+	self->object = object;
+	return object;
+}
+
+static PyObject *ObjectPoolLease_exit(ObjectPoolLease *self,
+				      PyObject *Py_UNUSED(args))
+{
+	PyObject *object = self->object;
+
+	if (object == NULL) {
+		PyErr_SetString(PyExc_RuntimeError,
+				"object pool lease is not entered");
+		return NULL;
+	}
+
+	self->object = NULL;
+	if (!ObjectPool_put(self->pool, object))
+		return NULL;
+	Py_RETURN_FALSE;
+}
+
+static PyMethodDef ObjectPoolLease_methods[] = {
+	{"__enter__", (PyCFunction)ObjectPoolLease_enter, METH_NOARGS, NULL},
+	{"__exit__", (PyCFunction)ObjectPoolLease_exit, METH_VARARGS, NULL},
+
+	{NULL, NULL, 0, NULL}
+};
+
+static PyType_Slot ObjectPoolLease_slots[] = {
+	{Py_tp_dealloc, ObjectPoolLease_dealloc},
+	{Py_tp_traverse, ObjectPoolLease_traverse},
+	{Py_tp_clear, ObjectPoolLease_clear},
+	{Py_tp_methods, ObjectPoolLease_methods},
+	{Py_tp_new, ObjectPoolLease_new},
+	{0, NULL}
+};
+
+PyType_Spec ObjectPoolLease_spec = {
+	.name = "atomic.ObjectPoolLease",
+	.basicsize = sizeof(ObjectPoolLease),
+	.flags = ATOMIC_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+	.slots = ObjectPoolLease_slots,
+};
@@ -0,0 +1,455 @@
+#include <Python.h>
+#include <stdint.h>
+
+#include "atomic.h"
+#include "atomic_hazard.h"
+#include "atomic_stats.h"
+
+/*
+ * The reference and a 64-bit stamp share one 16-byte aligned pair (lo holds
+ * the PyObject *, hi the stamp), so every operation on both is a single
+ * double-width load or compare-and-swap. Bumping the stamp on each update
+ * lets compare_and_set() tell a reference that was replaced and then put
+ * back (the ABA problem) from one that never changed.
+ */
+typedef struct {
+	PyObject_HEAD
+	atomic_pair pair;
+	ATOMIC_STATS_MEMBER
+} StampedReference;
+
+#define StampedReference_OBJECT(pair) ((PyObject *)(uintptr_t)(pair).lo)
+
+static inline atomic_pair StampedReference_PACK(PyObject *object,
+						uint64_t stamp)
+{
+	atomic_pair pair = {(uintptr_t)object, stamp};
+
+	return pair;
+}
+
+static int StampedReference_stamp_arg(PyObject *arg, uint64_t *stamp)
+{
+	unsigned long long value;
+
+	value = PyLong_AsUnsignedLongLong(arg);
+	if (value == (unsigned long long)-1 && PyErr_Occurred())
+		return 0;
+	*stamp = value;
+	return 1;
+}
+
+/* Replace the pair, returning the old one (whose reference the caller owns). */
+static atomic_pair StampedReference_exchange(StampedReference *self,
+					     atomic_pair desired)
+{
+	atomic_pair old;
+	int ret;
+
+	/* A torn first guess only costs one failed compare-and-swap. */
+	old.lo = __atomic_load_n(&self->pair.lo, __ATOMIC_RELAXED);
+	old.hi = __atomic_load_n(&self->pair.hi, __ATOMIC_RELAXED);
+	for (;;) {
+		ret = atomic_pair_cas(&self->pair, &old, desired);
+		ATOMIC_STATS_LOOP_CAS(ATOMIC_STATS_PTR(self),
+				      ATOMIC_STATS_STAMPED_REFERENCE, ret, 0);
+		if (ret)
+			return old;
+	}
+}
+
+static PyObject *StampedReference_new(PyTypeObject *type, PyObject *args,
+				      PyObject *kwds)
+{
+	StampedReference *self;
+
+	self = (StampedReference *)type->tp_alloc(type, 0);
+	if (self == NULL)
+		return NULL;
+
+	/* Never expose a NULL reference, even if __init__ is skipped. */
+	Py_INCREF(Py_None);
+	self->pair = StampedReference_PACK(Py_None, 0);
+	return (PyObject *)self;
+}
+
+static int StampedReference_init(StampedReference *self, PyObject *args,
+				 PyObject *kwds)
+{
+	static char *kwlist[] = {"obj", "stamp", NULL};
+	PyObject *object = Py_None, *stamp_arg = NULL;
+	uint64_t stamp = 0;
+	atomic_pair old;
+
+	if ((uintptr_t)&self->pair % sizeof(self->pair)) {
+		PyErr_SetString(PyExc_SystemError,
+				"atomic.StampedReference is not 16-byte aligned");
+		return -1;
+	}
+
+	if (!atomic_pair_is_lock_free(&self->pair)) {
+		if (PyErr_WarnEx(PyExc_RuntimeWarning,
+				 "atomic.StampedReference is not lock free",
+				 1) < 0)
+			return -1;
+	}
+
+	if (!PyArg_ParseTupleAndKeywords(args, kwds, "|OO", kwlist, &object,
+					 &stamp_arg))
+		return -1;
+	if (stamp_arg && !StampedReference_stamp_arg(stamp_arg, &stamp))
+		return -1;
+
+	Py_INCREF(object);
+
+	/* __init__ may be called again on an object other threads can see. */
+	old = StampedReference_exchange(self,
+					StampedReference_PACK(object, stamp));
+
+	if (StampedReference_OBJECT(old))
+		atomic_hazard_retire_object(StampedReference_OBJECT(old));
+	return 0;
+}
+
+static int StampedReference_traverse(StampedReference *self, visitproc visit,
+				     void *arg)
+{
+	PyObject *object;
+
+	object = (PyObject *)__atomic_load_n((uintptr_t *)&self->pair.lo,
+					     __ATOMIC_SEQ_CST);
+
+	Py_VISIT(object);
+	Py_VISIT(Py_TYPE(self));
+	return 0;
+}
+
+static int StampedReference_clear(StampedReference *self)
+{
+	atomic_pair old;
+
+	old = StampedReference_exchange(self, StampedReference_PACK(NULL, 0));
+
+	Py_XDECREF(StampedReference_OBJECT(old));
+	return 0;
+}
+
+static void StampedReference_dealloc(StampedReference *self)
+{
+	PyTypeObject *tp = Py_TYPE(self);
+
+	PyObject_GC_UnTrack(self);
+	StampedReference_clear(self);
+	tp->tp_free((PyObject *)self);
+	Py_DECREF(tp);
+}
+
+/*
+ * Return a new reference to the stored object and, in *pair, the snapshot of
+ * the whole pair it came from; NULL with an exception set on failure.
+ */
+static PyObject *StampedReference_load(StampedReference *self,
+				       atomic_pair *pair)
+{
+	uintptr_t *hazard, object;
+
+	hazard = atomic_hazard_slot(0);
+	if (hazard == NULL)
+		return NULL;
+
+	/*
+	 * Publish the pointer half, then take a consistent snapshot of the
+	 * pair: if it still holds the same object, the hazard was in place
+	 * while the object was installed and the stamp belongs to it.
+	 */
+	object = atomic_hazard_protect(hazard, (uintptr_t *)&self->pair.lo,
+				       ATOMIC_HAZARD_NO_TAG);
+	for (;;) {
+		*pair = atomic_pair_load(&self->pair);
+		if (pair->lo == object)
+			break;
+		ATOMIC_STATS_RETRY(ATOMIC_STATS_PTR(self),
+				   ATOMIC_STATS_STAMPED_REFERENCE);
+		object = atomic_hazard_protect(hazard,
+					       (uintptr_t *)&self->pair.lo,
+					       ATOMIC_HAZARD_NO_TAG);
+	}
+
+	Py_INCREF((PyObject *)object);
+	atomic_hazard_release(hazard);
+	return (PyObject *)object;
+}
+
+/*
+ * Every operation is a full-barrier double-width instruction; order= is
+ * accepted and validated for consistency with the other types.
+ */
+static PyObject *StampedReference_get(StampedReference *self,
+				      PyObject *const *args, Py_ssize_t nargs,
+				      PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	PyObject *object, *stamp, *ret;
+	atomic_pair pair;
+
+	if (!atomic_check_nargs("get", nargs, 0) ||
+	    !atomic_parse_order("get", args, nargs, kwnames, ATOMIC_ORDER_LOAD,
+				&order))
+		return NULL;
+
+	object = StampedReference_load(self, &pair);
+	if (object == NULL)
+		return NULL;
+	stamp = PyLong_FromUnsignedLongLong(pair.hi);
+	ret = stamp ? PyTuple_New(2) : NULL;
+	if (ret == NULL) {
+		Py_DECREF(object);
+		Py_XDECREF(stamp);
+		return NULL;
+	}
+	PyTuple_SET_ITEM(ret, 0, object);
+	PyTuple_SET_ITEM(ret, 1, stamp);
+	return ret;
+}
+
+static PyObject *StampedReference_get_reference(StampedReference *self,
+						PyObject *const *args,
+						Py_ssize_t nargs,
+						PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	atomic_pair pair;
+
+	if (!atomic_check_nargs("get_reference", nargs, 0) ||
+	    !atomic_parse_order("get_reference", args, nargs, kwnames,
+				ATOMIC_ORDER_LOAD, &order))
+		return NULL;
+
+	return StampedReference_load(self, &pair);
+}
+
+static PyObject *StampedReference_get_stamp(StampedReference *self,
+					    PyObject *const *args,
+					    Py_ssize_t nargs, PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	uint64_t stamp;
+
+	if (!atomic_check_nargs("get_stamp", nargs, 0) ||
+	    !atomic_parse_order("get_stamp", args, nargs, kwnames,
+				ATOMIC_ORDER_LOAD, &order))
+		return NULL;
+
+	/* The stamp alone needs no hazard. */
+	stamp = ATOMIC_LOAD_N(&self->pair.hi, order);
+
+	return PyLong_FromUnsignedLongLong(stamp);
+}
+
+static PyObject *StampedReference_repr(StampedReference *self)
+{
+	PyObject *object, *ret;
+	atomic_pair pair;
+
+	/* Format from our own snapshot; set() may drop the stored reference. */
+	object = StampedReference_load(self, &pair);
+	if (object == NULL)
+		return NULL;
+	ret = PyUnicode_FromFormat("atomic.StampedReference(%R, %llu)", object,
+				   (unsigned long long)pair.hi);
+	Py_DECREF(object);
+	return ret;
+}
+
+static PyObject *StampedReference_set(StampedReference *self,
+				      PyObject *const *args, Py_ssize_t nargs,
+				      PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	PyObject *object;
+	uint64_t stamp;
+	atomic_pair old;
+
+	if (!atomic_check_nargs("set", nargs, 2) ||
+	    !atomic_parse_order("set", args, nargs, kwnames, ATOMIC_ORDER_STORE,
+				&order) ||
+	    !StampedReference_stamp_arg(args[1], &stamp))
+		return NULL;
+	object = args[0];
+
+	Py_INCREF(object);
+
+	old = StampedReference_exchange(self,
+					StampedReference_PACK(object, stamp));
+
+	atomic_hazard_retire_object(StampedReference_OBJECT(old));
+	Py_RETURN_NONE;
+}
+
+static PyObject *StampedReference_do_compare_and_set(StampedReference *self,
+						     const char *name,
+						     PyObject *const *args,
+						     Py_ssize_t nargs,
+						     PyObject *kwnames)
+{
+	int success = __ATOMIC_SEQ_CST, failure = __ATOMIC_SEQ_CST;
+	PyObject *expect_obj, *update_obj;
+	uint64_t expect_stamp, update_stamp;
+	atomic_pair expect;
+	int ret;
+
+	if (!atomic_check_nargs(name, nargs, 4) ||
+	    !atomic_parse_cas_orders(name, args, nargs, kwnames, &success,
+				     &failure) ||
+	    !StampedReference_stamp_arg(args[2], &expect_stamp) ||
+	    !StampedReference_stamp_arg(args[3], &update_stamp))
+		return NULL;
+	expect_obj = args[0];
+	update_obj = args[1];
+
+	expect = StampedReference_PACK(expect_obj, expect_stamp);
+	Py_INCREF(update_obj);
+
+	ret = atomic_pair_cas(&self->pair, &expect,
+			      StampedReference_PACK(update_obj, update_stamp));
+	ATOMIC_STATS_CAS(ATOMIC_STATS_PTR(self), ATOMIC_STATS_STAMPED_REFERENCE,
+			 ret, 0);
+
+	/* On success the pair's reference to expect_obj is ours to release. */
+	if (ret)
+		atomic_hazard_retire_object(expect_obj);
+	else
+		Py_DECREF(update_obj);
+	return PyBool_FromLong(ret);
+}
+
+static PyObject *StampedReference_compare_and_set(StampedReference *self,
+						  PyObject *const *args,
+						  Py_ssize_t nargs,
+						  PyObject *kwnames)
+{
+	return StampedReference_do_compare_and_set(self, "compare_and_set",
+						   args, nargs, kwnames);
+}
+
+/* A double-width CAS never fails spuriously; this is compare_and_set(). */
+static PyObject *StampedReference_weak_compare_and_set(StampedReference *self,
+						       PyObject *const *args,
+						       Py_ssize_t nargs,
+						       PyObject *kwnames)
+{
+	return StampedReference_do_compare_and_set(self,
+						   "weak_compare_and_set",
+						   args, nargs, kwnames);
+}
+
+static PyObject *StampedReference_attempt_stamp(StampedReference *self,
+						PyObject *const *args,
+						Py_ssize_t nargs,
+						PyObject *kwnames)
+{
+	int order = __ATOMIC_SEQ_CST;
+	PyObject *expect_obj;
+	uint64_t stamp;
+	atomic_pair old;
+	int ret;
+
+	if (!atomic_check_nargs("attempt_stamp", nargs, 2) ||
+	    !atomic_parse_order("attempt_stamp", args, nargs, kwnames,
+				ATOMIC_ORDER_RMW, &order) ||
+	    !StampedReference_stamp_arg(args[1], &stamp))
+		return NULL;
+	expect_obj = args[0];
+
+	/*
+	 * Retry only while the reference stays the expected one; the object
+	 * keeps the same reference, so no refcounts change.
+	 */
+	old = StampedReference_PACK(expect_obj, __atomic_load_n(&self->pair.hi,
+							       __ATOMIC_RELAXED));
+	for (;;) {
+		ret = atomic_pair_cas(&self->pair, &old,
+				      StampedReference_PACK(expect_obj, stamp));
+		ATOMIC_STATS_CAS(ATOMIC_STATS_PTR(self),
+				 ATOMIC_STATS_STAMPED_REFERENCE, ret, 0);
+		if (ret)
+			Py_RETURN_TRUE;
+		if (StampedReference_OBJECT(old) != expect_obj)
+			Py_RETURN_FALSE;
+		ATOMIC_STATS_RETRY(ATOMIC_STATS_PTR(self),
+				   ATOMIC_STATS_STAMPED_REFERENCE);
+	}
+}
+
+ATOMIC_STATS_GETTER(StampedReference_stats, StampedReference)
+
+#define StampedReference_METHOD(name) \
+	(PyCFunction)(void (*)(void))StampedReference_##name, \
+	METH_FASTCALL | METH_KEYWORDS
+
+static PyMethodDef StampedReference_methods[] = {
+	{"get", StampedReference_METHOD(get),
+	 "get(*, order=atomic.SEQ_CST) -> (object, stamp)\n\n"
+	 "Atomically load and return the reference and the stamp as one\n"
+	 "consistent snapshot."},
+	{"get_reference", StampedReference_METHOD(get_reference),
+	 "get_reference(*, order=atomic.SEQ_CST) -> object\n\n"
+	 "Atomically load and return the stored reference."},
+	{"get_stamp", StampedReference_METHOD(get_stamp),
+	 "get_stamp(*, order=atomic.SEQ_CST) -> int\n\n"
+	 "Atomically load and return the stamp."},
+	{"set", StampedReference_METHOD(set),
+	 "set(obj, stamp, *, order=atomic.SEQ_CST)\n\n"
+	 "Atomically store the given reference and stamp."},
+	{"compare_and_set", StampedReference_METHOD(compare_and_set),
+	 "compare_and_set(expect_ref, update_ref, expect_stamp, update_stamp,\n"
+	 "                *, order=atomic.SEQ_CST, failure_order=None) -> bool\n\n"
+	 "Atomically store the given reference and stamp if the current reference\n"
+	 "is expect_ref (by identity) and the current stamp equals expect_stamp,\n"
+	 "returning whether they did."},
+	{"weak_compare_and_set", StampedReference_METHOD(weak_compare_and_set),
+	 "weak_compare_and_set(expect_ref, update_ref, expect_stamp,\n"
+	 "                     update_stamp, *, order=atomic.SEQ_CST,\n"
+	 "                     failure_order=None) -> bool\n\n"
+	 "Same as compare_and_set(); the double-width compare-and-swap never\n"
+	 "fails spuriously."},
+	{"attempt_stamp", StampedReference_METHOD(attempt_stamp),
+	 "attempt_stamp(expect_ref, new_stamp, *, order=atomic.SEQ_CST) -> bool\n\n"
+	 "Atomically set the stamp to new_stamp if the current reference is\n"
+	 "expect_ref, leaving the reference untouched. Returns whether it was.\n"
+	 "Never fails spuriously."},
+
+	ATOMIC_STATS_METHOD_DEF(StampedReference_stats),
+
+	{NULL, NULL, 0, NULL}
+};
+
+#define ATOMIC_STAMPED_REFERENCE_DOCSTRING \
+	"atomic.StampedReference(obj=None, stamp=0) -> new stamped reference\n\n" \
+	"Reference paired with an unsigned 64-bit stamp, updated together by a\n" \
+	"single 16-byte compare-and-swap (cmpxchg16b on x86-64). Incrementing\n" \
+	"the stamp on every update makes compare_and_set() fail when the\n" \
+	"reference was swapped out and back in since it was read, which a plain\n" \
+	"atomic.Reference cannot detect.\n\n" \
+	"Every method takes the order= keyword of the other types, but all\n" \
+	"operations are sequentially consistent: the double-width instructions\n" \
+	"are full barriers."
+
+static PyType_Slot StampedReference_slots[] = {
+	{Py_tp_dealloc, StampedReference_dealloc},
+	{Py_tp_repr, StampedReference_repr},
+	{Py_tp_doc, ATOMIC_STAMPED_REFERENCE_DOCSTRING},
+	{Py_tp_traverse, StampedReference_traverse},
+	{Py_tp_clear, StampedReference_clear},
+	{Py_tp_methods, StampedReference_methods},
+	{Py_tp_init, StampedReference_init},
+	{Py_tp_new, StampedReference_new},
+	{0, NULL}
+};
+
+PyType_Spec StampedReference_spec = {
+	.name = "atomic.StampedReference",
+	.basicsize = sizeof(StampedReference),
+	.flags = ATOMIC_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_GC,
+	.slots = StampedReference_slots,
+};
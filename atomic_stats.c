@@ -0,0 +1,278 @@
+#include <Python.h>
+#include <pthread.h>
+
+#include "atomic_stats.h"
+
+#ifdef ATOMIC_STATS
+
+static const char *const atomic_stats_names[ATOMIC_NUM_STATS] = {
+	"cas", "cas_failed", "cas_spurious", "retries",
+};
+
+static const char *const atomic_stats_type_names[ATOMIC_STATS_NUM_TYPES] = {
+	"Integer", "Int8", "Int16", "Int32", "Int64", "UInt8", "UInt16",
+	"UInt32", "UInt64", "Int128", "IntegerArray", "Float",
+	"CompensatedFloat", "Bitset", "Record", "OrderedSet", "CounterMap",
+	"Adder", "Reference", "MarkableReference", "StampedReference",
+	"BoundedQueue", "Stack", "ObjectPool",
+};
+
+__thread struct atomic_stats_record *atomic_stats_current;
+
+/* The last object ID handed out; IDs are never reused. */
+static uint64_t atomic_stats_last_id;
+
+#define ATOMIC_STATS_MIN_TABLE 64
+
+/*
+ * Records are never freed; a thread that exits leaves its record, counts and
+ * all, for the next thread to keep adding to, so the totals never go down.
+ */
+static struct atomic_stats_record *atomic_stats_records;
+
+static pthread_key_t atomic_stats_key;
+static pthread_once_t atomic_stats_once = PTHREAD_ONCE_INIT;
+
+static void atomic_stats_thread_exit(void *arg)
+{
+	struct atomic_stats_record *record = arg;
+
+	__atomic_store_n(&record->active, 0, __ATOMIC_RELEASE);
+}
+
+static void atomic_stats_init_key(void)
+{
+	pthread_key_create(&atomic_stats_key, atomic_stats_thread_exit);
+}
+
+/*
+ * Return a record for the calling thread, or NULL if none could be allocated,
+ * in which case the thread's counts are dropped. No exception is set, since
+ * the callers are in the middle of operations that have already succeeded.
+ */
+struct atomic_stats_record *atomic_stats_register(void)
+{
+	struct atomic_stats_record *record, *head;
+	int expect;
+
+	pthread_once(&atomic_stats_once, atomic_stats_init_key);
+
+	for (record = __atomic_load_n(&atomic_stats_records, __ATOMIC_ACQUIRE);
+	     record; record = record->next) {
+		expect = 0;
+		if (__atomic_compare_exchange_n(&record->active, &expect, 1, 0,
+						__ATOMIC_ACQ_REL,
+						__ATOMIC_RELAXED))
+			goto out;
+	}
+
+	if (posix_memalign((void **)&record, ATOMIC_CACHE_LINE,
+			   sizeof(*record)))
+		return NULL;
+	memset(record, 0, sizeof(*record));
+	record->active = 1;
+
+	head = __atomic_load_n(&atomic_stats_records, __ATOMIC_RELAXED);
+	do {
+		record->next = head;
+	} while (!__atomic_compare_exchange_n(&atomic_stats_records, &head,
+					      record, 1, __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+
+out:
+	pthread_setspecific(atomic_stats_key, record);
+	atomic_stats_current = record;
+	return record;
+}
+
+static inline size_t atomic_stats_hash(uint64_t id)
+{
+	return (size_t)(id * 0x9e3779b97f4a7c15ULL >> 32);
+}
+
+/* Find id in a thread's table, or the empty entry where it would go. */
+static struct atomic_stats_entry *
+atomic_stats_find(struct atomic_stats_table *table, uint64_t id)
+{
+	struct atomic_stats_entry *entry;
+	size_t i = atomic_stats_hash(id) & table->mask;
+	uint64_t found;
+
+	for (;; i = (i + 1) & table->mask) {
+		entry = &table->entries[i];
+		found = __atomic_load_n(&entry->id, __ATOMIC_ACQUIRE);
+		if (found == id || found == 0)
+			return entry;
+	}
+}
+
+static struct atomic_stats_table *atomic_stats_table_new(size_t size)
+{
+	struct atomic_stats_table *table;
+
+	table = calloc(1, sizeof(*table) + size * sizeof(table->entries[0]));
+	if (table)
+		table->mask = size - 1;
+	return table;
+}
+
+/*
+ * Move the calling thread's entries to a table twice the size. Other threads
+ * may still be reading the old table, which is left allocated: it only ever
+ * has half the entries of the new one.
+ */
+static struct atomic_stats_table *
+atomic_stats_grow(struct atomic_stats_record *record)
+{
+	struct atomic_stats_table *old = record->objects, *table;
+	struct atomic_stats_entry *entry;
+	size_t i;
+
+	table = atomic_stats_table_new(old ? (old->mask + 1) * 2 :
+					     ATOMIC_STATS_MIN_TABLE);
+	if (table == NULL)
+		return NULL;
+
+	for (i = 0; old && i <= old->mask; i++) {
+		if (old->entries[i].id == 0)
+			continue;
+		entry = atomic_stats_find(table, old->entries[i].id);
+		*entry = old->entries[i];
+		table->used++;
+	}
+
+	__atomic_store_n(&record->objects, table, __ATOMIC_RELEASE);
+	return table;
+}
+
+/*
+ * Return the calling thread's entry for the object, giving the object an ID
+ * and the thread an entry as needed, or NULL if no memory was left, in which
+ * case the object's counts are dropped.
+ */
+struct atomic_stats_entry *
+atomic_stats_entry(struct atomic_stats_record *record, atomic_stats *stats)
+{
+	struct atomic_stats_table *table = record->objects;
+	struct atomic_stats_entry *entry;
+	uint64_t id, expected = 0;
+
+	id = __atomic_load_n(&stats->id, __ATOMIC_RELAXED);
+	if (id == 0) {
+		id = __atomic_add_fetch(&atomic_stats_last_id, 1,
+					__ATOMIC_RELAXED);
+		/* Another thread may have given it one first. */
+		if (!__atomic_compare_exchange_n(&stats->id, &expected, id, 0,
+						 __ATOMIC_RELAXED,
+						 __ATOMIC_RELAXED))
+			id = expected;
+	}
+
+	if (table == NULL || (table->used + 1) * 2 > table->mask + 1) {
+		table = atomic_stats_grow(record);
+		if (table == NULL)
+			return NULL;
+	}
+
+	entry = atomic_stats_find(table, id);
+	if (entry->id == 0) {
+		/* Counts start zeroed; publishing the ID makes the entry live. */
+		__atomic_store_n(&entry->id, id, __ATOMIC_RELEASE);
+		table->used++;
+	}
+	record->last = entry;
+	return entry;
+}
+
+PyObject *atomic_stats_dict(const uint64_t *counts)
+{
+	PyObject *dict, *value;
+	int i;
+
+	dict = PyDict_New();
+	if (dict == NULL)
+		return NULL;
+
+	for (i = 0; i < ATOMIC_NUM_STATS; i++) {
+		value = PyLong_FromUnsignedLongLong(
+			__atomic_load_n(&counts[i], __ATOMIC_RELAXED));
+		if (value == NULL ||
+		    PyDict_SetItemString(dict, atomic_stats_names[i], value) < 0) {
+			Py_XDECREF(value);
+			Py_DECREF(dict);
+			return NULL;
+		}
+		Py_DECREF(value);
+	}
+	return dict;
+}
+
+/* Sum one object's counts over every thread's record. */
+PyObject *atomic_stats_object_dict(atomic_stats *stats)
+{
+	uint64_t totals[ATOMIC_NUM_STATS] = {0};
+	struct atomic_stats_record *record;
+	struct atomic_stats_table *table;
+	struct atomic_stats_entry *entry;
+	uint64_t id;
+	int i;
+
+	id = __atomic_load_n(&stats->id, __ATOMIC_RELAXED);
+	for (record = __atomic_load_n(&atomic_stats_records, __ATOMIC_ACQUIRE);
+	     id && record; record = record->next) {
+		table = __atomic_load_n(&record->objects, __ATOMIC_ACQUIRE);
+		if (table == NULL)
+			continue;
+		entry = atomic_stats_find(table, id);
+		if (__atomic_load_n(&entry->id, __ATOMIC_ACQUIRE) != id)
+			continue;
+		for (i = 0; i < ATOMIC_NUM_STATS; i++)
+			totals[i] += __atomic_load_n(&entry->counts[i],
+						     __ATOMIC_RELAXED);
+	}
+	return atomic_stats_dict(totals);
+}
+
+PyObject *atomic_contention_stats(PyObject *module, PyObject *unused)
+{
+	uint64_t totals[ATOMIC_STATS_NUM_TYPES][ATOMIC_NUM_STATS] = {{0}};
+	struct atomic_stats_record *record;
+	PyObject *dict, *counts;
+	int type, i;
+
+	for (record = __atomic_load_n(&atomic_stats_records, __ATOMIC_ACQUIRE);
+	     record; record = record->next) {
+		for (type = 0; type < ATOMIC_STATS_NUM_TYPES; type++) {
+			for (i = 0; i < ATOMIC_NUM_STATS; i++)
+				totals[type][i] += __atomic_load_n(
+					&record->counts[type][i],
+					__ATOMIC_RELAXED);
+		}
+	}
+
+	dict = PyDict_New();
+	if (dict == NULL)
+		return NULL;
+
+	for (type = 0; type < ATOMIC_STATS_NUM_TYPES; type++) {
+		counts = atomic_stats_dict(totals[type]);
+		if (counts == NULL ||
+		    PyDict_SetItemString(dict, atomic_stats_type_names[type],
+					 counts) < 0) {
+			Py_XDECREF(counts);
+			Py_DECREF(dict);
+			return NULL;
+		}
+		Py_DECREF(counts);
+	}
+	return dict;
+}
+
+#else
+
+PyObject *atomic_contention_stats(PyObject *module, PyObject *unused)
+{
+	Py_RETURN_NONE;
+}
+
+#endif
@@ -0,0 +1,209 @@
+#ifndef ATOMIC_STATS_H
+#define ATOMIC_STATS_H
+
+#include <Python.h>
+#include <stdint.h>
+
+#include "atomic.h"
+
+/*
+ * Optional contention counters for the compare-and-swap paths.
+ *
+ * Built with ATOMIC_STATS defined (ATOMIC_STATS=1 python setup.py build),
+ * every CAS a type performs is counted, along with its failures, the failures
+ * of weak CASes whose expected value did in fact match (spurious failures)
+ * and the times an internal loop had to go round again. Each thread counts
+ * in a record of its own cache lines, per type and per object, so counting
+ * never writes memory another thread writes; in particular not the object,
+ * whose cache line is the one being contended. atomic.contention_stats()
+ * sums the per-type counts across threads, and an object's stats() method its
+ * own. An object only stores an ID, given to it the first time it counts.
+ * Entries outlive their objects, so the records grow with the number of
+ * objects ever counted: the counters are for measuring, not for production.
+ *
+ * Built without it, the macros below expand to nothing, objects carry no
+ * counters, stats() and contention_stats() return None and the CAS paths are
+ * exactly what they would be without this header.
+ */
+
+enum {
+	ATOMIC_STAT_CAS,
+	ATOMIC_STAT_CAS_FAILED,
+	ATOMIC_STAT_CAS_SPURIOUS,
+	ATOMIC_STAT_RETRIES,
+	ATOMIC_NUM_STATS
+};
+
+/* Types counted separately in atomic.contention_stats(). */
+enum {
+	ATOMIC_STATS_INTEGER,
+	ATOMIC_STATS_INT8,
+	ATOMIC_STATS_INT16,
+	ATOMIC_STATS_INT32,
+	ATOMIC_STATS_INT64,
+	ATOMIC_STATS_UINT8,
+	ATOMIC_STATS_UINT16,
+	ATOMIC_STATS_UINT32,
+	ATOMIC_STATS_UINT64,
+	ATOMIC_STATS_INT128,
+	ATOMIC_STATS_INTEGER_ARRAY,
+	ATOMIC_STATS_FLOAT,
+	ATOMIC_STATS_COMPENSATED_FLOAT,
+	ATOMIC_STATS_BITSET,
+	ATOMIC_STATS_RECORD,
+	ATOMIC_STATS_ORDERED_SET,
+	ATOMIC_STATS_COUNTER_MAP,
+	ATOMIC_STATS_ADDER,
+	ATOMIC_STATS_REFERENCE,
+	ATOMIC_STATS_MARKABLE_REFERENCE,
+	ATOMIC_STATS_STAMPED_REFERENCE,
+	ATOMIC_STATS_BOUNDED_QUEUE,
+	ATOMIC_STATS_STACK,
+	ATOMIC_STATS_OBJECT_POOL,
+	ATOMIC_STATS_NUM_TYPES
+};
+
+/* Complete only when the counters are compiled in. */
+typedef struct atomic_stats atomic_stats;
+
+PyObject *atomic_contention_stats(PyObject *module, PyObject *unused);
+
+#ifdef ATOMIC_STATS
+
+struct atomic_stats {
+	uint64_t id;			/* 0 until the object first counts */
+};
+
+/* One object's counts in one thread's record. */
+struct atomic_stats_entry {
+	uint64_t id;
+	uint64_t counts[ATOMIC_NUM_STATS];
+};
+
+/* Open-addressing table of a thread's entries, keyed by object ID. */
+struct atomic_stats_table {
+	size_t mask;
+	size_t used;
+	struct atomic_stats_entry entries[];
+};
+
+struct atomic_stats_record {
+	uint64_t counts[ATOMIC_STATS_NUM_TYPES][ATOMIC_NUM_STATS];
+	struct atomic_stats_table *objects;
+	struct atomic_stats_entry *last;	/* entry counted in last */
+	int active;
+	struct atomic_stats_record *next;
+} __attribute__((aligned(ATOMIC_CACHE_LINE)));
+
+extern __thread struct atomic_stats_record *atomic_stats_current;
+
+struct atomic_stats_record *atomic_stats_register(void);
+struct atomic_stats_entry *
+atomic_stats_entry(struct atomic_stats_record *record, atomic_stats *stats);
+PyObject *atomic_stats_dict(const uint64_t *counts);
+PyObject *atomic_stats_object_dict(atomic_stats *stats);
+
+/* Only this thread writes its record; readers only need no tearing. */
+static inline void atomic_stats_bump(uint64_t *count)
+{
+	__atomic_store_n(count, *count + 1, __ATOMIC_RELAXED);
+}
+
+static inline void atomic_stats_add(atomic_stats *stats, int type, int stat)
+{
+	struct atomic_stats_record *record = atomic_stats_current;
+	struct atomic_stats_entry *entry;
+
+	if (record == NULL) {
+		record = atomic_stats_register();
+		if (record == NULL)
+			return;
+	}
+	atomic_stats_bump(&record->counts[type][stat]);
+
+	/* Runs of events on one object skip the table lookup. */
+	entry = record->last;
+	if (entry == NULL ||
+	    entry->id != __atomic_load_n(&stats->id, __ATOMIC_RELAXED)) {
+		entry = atomic_stats_entry(record, stats);
+		if (entry == NULL)
+			return;
+	}
+	atomic_stats_bump(&entry->counts[stat]);
+}
+
+static inline void atomic_stats_cas(atomic_stats *stats, int type, int ok,
+				    int spurious)
+{
+	atomic_stats_add(stats, type, ATOMIC_STAT_CAS);
+	if (!ok) {
+		atomic_stats_add(stats, type, ATOMIC_STAT_CAS_FAILED);
+		if (spurious)
+			atomic_stats_add(stats, type, ATOMIC_STAT_CAS_SPURIOUS);
+	}
+}
+
+/* A member holding the object's ID in the threads' records. */
+#define ATOMIC_STATS_MEMBER atomic_stats stats;
+
+/* The object's stats member, or NULL when compiled out. */
+#define ATOMIC_STATS_PTR(self) (&(self)->stats)
+
+/* Declarations and statements only needed to count. */
+#define ATOMIC_STATS_ONLY(...) __VA_ARGS__
+
+/*
+ * Count one CAS of a type. spurious is only evaluated for a failed CAS and
+ * says whether it failed although the expected value matched.
+ */
+#define ATOMIC_STATS_CAS(stats, type, ok, spurious) \
+	atomic_stats_cas(stats, type, ok, !(ok) && (spurious))
+
+/* Count one extra trip round an internal retry loop. */
+#define ATOMIC_STATS_RETRY(stats, type) \
+	atomic_stats_add(stats, type, ATOMIC_STAT_RETRIES)
+
+/* Count one CAS of an internal loop, which goes round again if it failed. */
+#define ATOMIC_STATS_LOOP_CAS(stats, type, ok, spurious)		\
+	do {								\
+		ATOMIC_STATS_CAS(stats, type, ok, spurious);		\
+		if (!(ok))						\
+			ATOMIC_STATS_RETRY(stats, type);		\
+	} while (0)
+
+/* Define name as a type's stats() method. */
+#define ATOMIC_STATS_GETTER(name, Type)					\
+	static PyObject *name(Type *self, PyObject *Py_UNUSED(unused))	\
+	{								\
+		return atomic_stats_object_dict(&self->stats);		\
+	}
+
+#else
+
+#define ATOMIC_STATS_MEMBER
+#define ATOMIC_STATS_PTR(self) ((atomic_stats *)NULL)
+#define ATOMIC_STATS_ONLY(...)
+#define ATOMIC_STATS_CAS(stats, type, ok, spurious) ((void)0)
+#define ATOMIC_STATS_RETRY(stats, type) ((void)0)
+#define ATOMIC_STATS_LOOP_CAS(stats, type, ok, spurious) ((void)0)
+
+#define ATOMIC_STATS_GETTER(name, Type)					\
+	static PyObject *name(Type *Py_UNUSED(self),			\
+			      PyObject *Py_UNUSED(unused))		\
+	{								\
+		Py_RETURN_NONE;						\
+	}
+
+#endif
+
+#define ATOMIC_STATS_DOC							\
+	"stats() -> dict or None\n\n"					\
+	"Return the number of CAS attempts (\"cas\"), failures (\"cas_failed\"),\n" \
+	"spurious weak CAS failures (\"cas_spurious\") and internal retries\n" \
+	"(\"retries\") on this object, or None if the module was built\n"	\
+	"without ATOMIC_STATS."
+
+#define ATOMIC_STATS_METHOD_DEF(name) \
+	{"stats", (PyCFunction)name, METH_NOARGS, ATOMIC_STATS_DOC}
+
+#endif
@@ -0,0 +1,67 @@
+#include <Python.h>
+
+#include "atomic_update.h"
+
+/*
+ * The C functions behind builtins.max() and friends. Matching on the
+ * function pointer rather than the object recognizes them however they were
+ * looked up, and never mistakes a rebound name for them.
+ */
+static struct {
+	const char *module, *name;
+	int kind;
+	PyCFunction function;
+} atomic_accumulators[] = {
+	{"builtins", "max", ATOMIC_ACCUMULATE_MAX},
+	{"builtins", "min", ATOMIC_ACCUMULATE_MIN},
+	{"operator", "add", ATOMIC_ACCUMULATE_ADD},
+	{"operator", "sub", ATOMIC_ACCUMULATE_SUB},
+	{"operator", "and_", ATOMIC_ACCUMULATE_AND},
+	{"operator", "or_", ATOMIC_ACCUMULATE_OR},
+	{"operator", "xor", ATOMIC_ACCUMULATE_XOR},
+};
+
+#define ATOMIC_NUM_ACCUMULATORS \
+	(sizeof(atomic_accumulators) / sizeof(atomic_accumulators[0]))
+
+/* Look up the functions; called by the module's exec slot. */
+int atomic_update_init(void)
+{
+	PyObject *module, *function;
+	size_t i;
+
+	for (i = 0; i < ATOMIC_NUM_ACCUMULATORS; i++) {
+		module = PyImport_ImportModule(atomic_accumulators[i].module);
+		if (module == NULL)
+			return -1;
+		function = PyObject_GetAttrString(module,
+						  atomic_accumulators[i].name);
+		Py_DECREF(module);
+		if (function == NULL)
+			return -1;
+
+		/* A pure-Python operator module is simply not recognized. */
+		if (PyCFunction_Check(function))
+			atomic_accumulators[i].function =
+				PyCFunction_GET_FUNCTION(function);
+		Py_DECREF(function);
+	}
+	return 0;
+}
+
+/* Return the ATOMIC_ACCUMULATE_* kind of fn. */
+int atomic_accumulator(PyObject *fn)
+{
+	PyCFunction function;
+	size_t i;
+
+	if (!PyCFunction_Check(fn))
+		return ATOMIC_ACCUMULATE_CALL;
+
+	function = PyCFunction_GET_FUNCTION(fn);
+	for (i = 0; i < ATOMIC_NUM_ACCUMULATORS; i++) {
+		if (atomic_accumulators[i].function == function)
+			return atomic_accumulators[i].kind;
+	}
+	return ATOMIC_ACCUMULATE_CALL;
+}
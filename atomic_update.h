@@ -0,0 +1,150 @@
+#ifndef ATOMIC_UPDATE_H
+#define ATOMIC_UPDATE_H
+
+#include <Python.h>
+#include <limits.h>
+#include <sched.h>
+
+#include "atomic.h"
+
+/*
+ * Shared parts of update_and_get(), get_and_update() and
+ * accumulate_and_get(), which run the compare-and-swap loop around a
+ * function of the current value in C instead of in Python.
+ *
+ * A failed compare-and-swap backs off before the next attempt: it pauses the
+ * CPU for 1, 2, 4, ... iterations up to max_spin, and from then on yields
+ * the CPU with the GIL released, so that under heavy contention one thread
+ * at a time gets to finish rather than all of them retrying in lockstep.
+ */
+
+#define ATOMIC_DEFAULT_MAX_SPIN 128
+
+static inline void atomic_cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+	__asm__ __volatile__("yield" ::: "memory");
+#else
+	__asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+struct atomic_backoff {
+	unsigned int spins;
+	unsigned int max_spin;
+};
+
+static inline void atomic_backoff_init(struct atomic_backoff *backoff,
+				       unsigned int max_spin)
+{
+	backoff->spins = 1;
+	backoff->max_spin = max_spin;
+}
+
+/* Wait after a failed compare-and-swap. The caller holds the GIL. */
+static inline void atomic_backoff_wait(struct atomic_backoff *backoff)
+{
+	unsigned int i;
+
+	if (backoff->spins <= backoff->max_spin) {
+		for (i = 0; i < backoff->spins; i++)
+			atomic_cpu_relax();
+		backoff->spins *= 2;
+		return;
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	sched_yield();
+	Py_END_ALLOW_THREADS
+}
+
+/* Parse the order= and max_spin= keywords of an update method. */
+static inline int atomic_parse_update_kwargs(const char *name,
+					     PyObject *const *args,
+					     Py_ssize_t nargs,
+					     PyObject *kwnames, int *order,
+					     unsigned int *max_spin)
+{
+	static const char *const kwlist[] = {"order", "max_spin", NULL};
+	PyObject *kwargs[] = {NULL, NULL};
+	long value;
+
+	if (kwnames == NULL)
+		return 1;
+
+	if (!atomic_parse_kwargs(name, args, nargs, kwnames, kwlist, kwargs) ||
+	    !atomic_order_arg(kwargs[0], ATOMIC_ORDER_RMW, order))
+		return 0;
+
+	if (kwargs[1]) {
+		if (!atomic_long_arg(kwargs[1], &value))
+			return 0;
+		if (value < 0 || value > UINT_MAX / 2) {
+			PyErr_Format(PyExc_ValueError,
+				     "%s() max_spin out of range", name);
+			return 0;
+		}
+		*max_spin = value;
+	}
+	return 1;
+}
+
+/*
+ * Functions accumulate_and_get() recognizes and applies to C longs itself
+ * instead of calling back into Python.
+ */
+enum {
+	ATOMIC_ACCUMULATE_CALL,
+	ATOMIC_ACCUMULATE_MAX,
+	ATOMIC_ACCUMULATE_MIN,
+	ATOMIC_ACCUMULATE_ADD,
+	ATOMIC_ACCUMULATE_SUB,
+	ATOMIC_ACCUMULATE_AND,
+	ATOMIC_ACCUMULATE_OR,
+	ATOMIC_ACCUMULATE_XOR,
+};
+
+int atomic_update_init(void);
+int atomic_accumulator(PyObject *fn);
+
+/*
+ * Apply a recognized function to a and b with the result of the Python
+ * version: OverflowError where a Python int would not fit in a long.
+ */
+static inline int atomic_accumulate_long(int kind, long a, long b,
+					 long *result)
+{
+	switch (kind) {
+	case ATOMIC_ACCUMULATE_MAX:
+		*result = a >= b ? a : b;
+		return 1;
+	case ATOMIC_ACCUMULATE_MIN:
+		*result = a <= b ? a : b;
+		return 1;
+	case ATOMIC_ACCUMULATE_ADD:
+		if (__builtin_add_overflow(a, b, result))
+			break;
+		return 1;
+	case ATOMIC_ACCUMULATE_SUB:
+		if (__builtin_sub_overflow(a, b, result))
+			break;
+		return 1;
+	case ATOMIC_ACCUMULATE_AND:
+		*result = a & b;
+		return 1;
+	case ATOMIC_ACCUMULATE_OR:
+		*result = a | b;
+		return 1;
+	case ATOMIC_ACCUMULATE_XOR:
+		*result = a ^ b;
+		return 1;
+	}
+
+	PyErr_SetString(PyExc_OverflowError,
+			"Python int too large to convert to C long");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,233 @@
+/*
+ * Cost of the atomic primitives behind the Python types, without the
+ * interpreter in the way: T threads each run one operation on a 64-bit word
+ * laid out as in suite.py (their own cache line, neighbouring words on one
+ * line, or one shared word), all sequentially consistent like the Python
+ * defaults.
+ *
+ * suite.py --c-harness builds and runs this; by hand:
+ *
+ *	cc -O2 -pthread -o atomic_harness benchmarks/atomic_harness.c
+ *	./atomic_harness [OPS [BATCH [THREADS...]]]
+ *
+ * Prints a JSON array of {"op", "layout", "threads", "ops_per_sec",
+ * "p50_ns", "p99_ns"} objects, with latencies per operation measured over
+ * batches of BATCH operations.
+ */
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+enum { OP_LOAD, OP_STORE, OP_EXCHANGE, OP_CAS, OP_FETCH_ADD, NUM_OPS };
+
+static const char *const op_names[] = {
+	"load", "store", "exchange", "compare_exchange", "fetch_add",
+};
+
+enum { LAYOUT_UNCONTENDED, LAYOUT_FALSE_SHARING, LAYOUT_HOT_SPOT, NUM_LAYOUTS };
+
+static const char *const layout_names[] = {
+	"uncontended", "false_sharing", "hot_spot",
+};
+
+/* Two lines apart, so the adjacent-line prefetcher does not pair them up. */
+#define UNCONTENDED_STRIDE (128 / sizeof(long))
+
+struct worker {
+	pthread_t thread;
+	pthread_barrier_t *barrier;
+	long *word;
+	int op;
+	long ops, batch;
+	uint64_t *samples;
+	uint64_t start, end;
+};
+
+static volatile long sink;
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void run_batch(long *word, int op, long n)
+{
+	long i, acc = 0, expect;
+
+	switch (op) {
+	case OP_LOAD:
+		for (i = 0; i < n; i++)
+			acc += __atomic_load_n(word, __ATOMIC_SEQ_CST);
+		break;
+	case OP_STORE:
+		for (i = 0; i < n; i++)
+			__atomic_store_n(word, i, __ATOMIC_SEQ_CST);
+		break;
+	case OP_EXCHANGE:
+		for (i = 0; i < n; i++)
+			acc += __atomic_exchange_n(word, 0, __ATOMIC_SEQ_CST);
+		break;
+	case OP_CAS:
+		for (i = 0; i < n; i++) {
+			expect = 0;
+			acc += __atomic_compare_exchange_n(word, &expect, 0, 0,
+							   __ATOMIC_SEQ_CST,
+							   __ATOMIC_SEQ_CST);
+		}
+		break;
+	case OP_FETCH_ADD:
+		for (i = 0; i < n; i++)
+			acc += __atomic_fetch_add(word, 1, __ATOMIC_SEQ_CST);
+		break;
+	}
+	sink = acc;
+}
+
+static void *worker_main(void *arg)
+{
+	struct worker *w = arg;
+	long i, nbatches = w->ops / w->batch;
+	uint64_t t;
+
+	pthread_barrier_wait(w->barrier);
+	w->start = now_ns();
+	for (i = 0; i < nbatches; i++) {
+		t = now_ns();
+		run_batch(w->word, w->op, w->batch);
+		w->samples[i] = now_ns() - t;
+	}
+	w->end = now_ns();
+	return NULL;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double percentile(uint64_t *sorted, long n, double p, long batch)
+{
+	long i = (long)(p / 100.0 * n + 0.5) - 1;
+
+	if (i < 0)
+		i = 0;
+	if (i >= n)
+		i = n - 1;
+	return (double)sorted[i] / batch;
+}
+
+static int run(long *words, int op, int layout, int nthreads, long ops,
+	       long batch, int first)
+{
+	long nbatches = ops / batch, total = 0;
+	struct worker *workers;
+	pthread_barrier_t barrier;
+	uint64_t start = UINT64_MAX, end = 0, *all;
+	int t;
+
+	workers = calloc(nthreads, sizeof(*workers));
+	all = malloc(sizeof(*all) * nbatches * nthreads);
+	if (workers == NULL || all == NULL)
+		return -1;
+	memset(words, 0, UNCONTENDED_STRIDE * sizeof(long) * nthreads);
+	pthread_barrier_init(&barrier, NULL, nthreads);
+
+	for (t = 0; t < nthreads; t++) {
+		struct worker *w = &workers[t];
+
+		w->barrier = &barrier;
+		w->word = layout == LAYOUT_UNCONTENDED ? &words[t * UNCONTENDED_STRIDE] :
+			  layout == LAYOUT_FALSE_SHARING ? &words[t] : &words[0];
+		w->op = op;
+		w->ops = ops;
+		w->batch = batch;
+		w->samples = &all[t * nbatches];
+		if (pthread_create(&w->thread, NULL, worker_main, w))
+			return -1;
+	}
+	for (t = 0; t < nthreads; t++) {
+		pthread_join(workers[t].thread, NULL);
+		if (workers[t].start < start)
+			start = workers[t].start;
+		if (workers[t].end > end)
+			end = workers[t].end;
+		total += nbatches * batch;
+	}
+	pthread_barrier_destroy(&barrier);
+
+	qsort(all, nbatches * nthreads, sizeof(*all), compare_u64);
+	printf("%s  {\"op\": \"%s\", \"layout\": \"%s\", \"threads\": %d, "
+	       "\"ops_per_sec\": %.1f, \"p50_ns\": %.2f, \"p99_ns\": %.2f}",
+	       first ? "" : ",\n", op_names[op], layout_names[layout],
+	       nthreads, total / ((end - start) / 1e9),
+	       percentile(all, nbatches * nthreads, 50, batch),
+	       percentile(all, nbatches * nthreads, 99, batch));
+
+	free(all);
+	free(workers);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	static const int default_threads[] = {1, 2, 4};
+	long ops = argc > 1 ? atol(argv[1]) : 1000000;
+	long batch = argc > 2 ? atol(argv[2]) : 1000;
+	int nthreads = argc > 3 ? argc - 3 : 3, max_threads = 1, i, t;
+	int *threads, op, layout, first = 1;
+	long *words;
+
+	if (ops <= 0 || batch <= 0 || batch > ops) {
+		fprintf(stderr, "usage: %s [OPS [BATCH [THREADS...]]]\n",
+			argv[0]);
+		return 2;
+	}
+
+	threads = malloc(sizeof(*threads) * nthreads);
+	if (threads == NULL)
+		return 1;
+	for (i = 0; i < nthreads; i++) {
+		threads[i] = argc > 3 ? atoi(argv[i + 3]) : default_threads[i];
+		if (threads[i] <= 0) {
+			fprintf(stderr, "%s: invalid thread count\n", argv[0]);
+			return 2;
+		}
+		if (threads[i] > max_threads)
+			max_threads = threads[i];
+	}
+
+	if (posix_memalign((void **)&words, 128,
+			   UNCONTENDED_STRIDE * sizeof(long) * max_threads))
+		return 1;
+
+	printf("[\n");
+	for (i = 0; i < nthreads; i++) {
+		t = threads[i];
+		for (layout = 0; layout < NUM_LAYOUTS; layout++) {
+			/* One thread has nothing to contend with. */
+			if (t == 1 && layout != LAYOUT_UNCONTENDED)
+				continue;
+			for (op = 0; op < NUM_OPS; op++) {
+				if (run(words, op, layout, t, ops, batch,
+					first) < 0) {
+					perror("atomic_harness");
+					return 1;
+				}
+				first = 0;
+			}
+		}
+	}
+	printf("\n]\n");
+
+	free(words);
+	free(threads);
+	return 0;
+}
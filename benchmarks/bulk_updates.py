@@ -0,0 +1,53 @@
+"""Compare per-call IntegerArray updates with the batched *_many() methods.
+
+Usage: python benchmarks/bulk_updates.py [-n UPDATES] [-s SIZE]
+
+Simulates a histogram workload: N increments spread over SIZE counters,
+applied either one get_and_add() call at a time or as one add_many() batch
+(seq_cst and relaxed). Reports updates/sec for each.
+"""
+
+import argparse
+import array
+import random
+import time
+
+import atomic
+
+
+def timed(func):
+    begin = time.perf_counter()
+    func()
+    return time.perf_counter() - begin
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-n', '--updates', type=int, default=1000000)
+    parser.add_argument('-s', '--size', type=int, default=4096)
+    args = parser.parse_args()
+
+    rng = random.Random(0)
+    indices = array.array('q', (rng.randrange(args.size)
+                                for _ in range(args.updates)))
+    counters = atomic.IntegerArray(args.size)
+
+    def per_call():
+        add = counters.get_and_add
+        for i in indices:
+            add(i, 1)
+
+    results = [
+        ('get_and_add loop', timed(per_call)),
+        ('add_many seq_cst', timed(lambda: counters.add_many(indices, 1))),
+        ('add_many relaxed', timed(lambda: counters.add_many(
+            indices, 1, order=atomic.RELAXED))),
+    ]
+
+    print('%-20s %16s' % ('method', 'updates/s'))
+    for name, elapsed in results:
+        print('%-20s %16.0f' % (name, args.updates / elapsed))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,102 @@
+"""Measure the per-call overhead of every atomic method in ns/call.
+
+Usage: python benchmarks/call_overhead.py [-n LOOPS] [-r REPEAT]
+
+Each method is timed with timeit against a bound method looked up once, so
+the figures are dominated by argument handling and the atomic operation
+itself rather than attribute lookup.
+"""
+
+import argparse
+import operator
+import timeit
+
+import atomic
+
+
+def integer_cases():
+    x = atomic.Integer(1)
+    cases = [
+        ('Integer()', atomic.Integer, ()),
+        ('Integer(x)', atomic.Integer, (5,)),
+        ('Integer.get', x.get, ()),
+        ('Integer.set', x.set, (1,)),
+        ('Integer.get_and_set', x.get_and_set, (1,)),
+        ('Integer.compare_and_set', x.compare_and_set, (1, 1)),
+        ('Integer.weak_compare_and_set', x.weak_compare_and_set, (1, 1)),
+        ('Integer += (operator.iadd)', operator.iadd, (x, 1)),
+        ('int(Integer)', int, (x,)),
+        ('Integer == int', operator.eq, (x, 1)),
+    ]
+    for op in ('add', 'sub', 'and', 'xor', 'or', 'nand'):
+        cases.append(('Integer.get_and_%s' % op,
+                      getattr(x, 'get_and_%s' % op), (1,)))
+        cases.append(('Integer.%s_and_get' % op,
+                      getattr(x, '%s_and_get' % op), (1,)))
+    return cases
+
+
+def reference_cases():
+    o = object()
+    r = atomic.Reference(o)
+    return [
+        ('Reference.get', r.get, ()),
+        ('Reference.set', r.set, (o,)),
+        ('Reference.get_and_set', r.get_and_set, (o,)),
+        ('Reference.compare_and_set', r.compare_and_set, (o, o)),
+        ('Reference.weak_compare_and_set', r.weak_compare_and_set, (o, o)),
+    ]
+
+
+def markable_reference_cases():
+    o = object()
+    r = atomic.MarkableReference(o, False)
+    return [
+        ('MarkableReference.get', r.get, ()),
+        ('MarkableReference.get_reference', r.get_reference, ()),
+        ('MarkableReference.is_marked', r.is_marked, ()),
+        ('MarkableReference.set', r.set, (o, False)),
+        ('MarkableReference.compare_and_set', r.compare_and_set,
+         (o, o, False, False)),
+        ('MarkableReference.weak_compare_and_set', r.weak_compare_and_set,
+         (o, o, False, False)),
+        ('MarkableReference.attempt_mark', r.attempt_mark, (False, False)),
+    ]
+
+
+def stamped_reference_cases():
+    o = object()
+    r = atomic.StampedReference(o, 0)
+    return [
+        ('StampedReference.get', r.get, ()),
+        ('StampedReference.get_stamp', r.get_stamp, ()),
+        ('StampedReference.set', r.set, (o, 0)),
+        ('StampedReference.compare_and_set', r.compare_and_set,
+         (o, o, 0, 0)),
+        ('StampedReference.attempt_stamp', r.attempt_stamp, (o, 0)),
+    ]
+
+
+def bench(func, args, loops, repeat):
+    timer = timeit.Timer('f(*a)', globals={'f': func, 'a': args})
+    return min(timer.repeat(repeat=repeat, number=loops)) / loops * 1e9
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-n', '--loops', type=int, default=200000)
+    parser.add_argument('-r', '--repeat', type=int, default=5)
+    args = parser.parse_args()
+
+    baseline = bench(lambda *a: None, (), args.loops, args.repeat)
+    print('%-42s %8s' % ('method', 'ns/call'))
+    for name, func, fargs in (integer_cases() + reference_cases() +
+                              markable_reference_cases() +
+                              stamped_reference_cases()):
+        ns = bench(func, fargs, args.loops, args.repeat)
+        print('%-42s %8.1f' % (name, ns))
+    print('%-42s %8.1f' % ('(empty Python call)', baseline))
+
+
+if __name__ == '__main__':
+    main()
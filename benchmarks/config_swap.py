@@ -0,0 +1,84 @@
+"""Read-heavy config-swap stress benchmark for Reference and MarkableReference.
+
+Usage: python benchmarks/config_swap.py [-t 1,2,4,...] [-d SECONDS]
+
+N reader threads call get() in a tight loop while one writer thread keeps
+publishing freshly built config dicts with set(), so readers constantly race
+with the last reference to the previous config being dropped. Reports total
+reads/sec and writes/sec for each thread count.
+"""
+
+import argparse
+import sys
+import threading
+import time
+
+import atomic
+
+
+def run(kind, nreaders, duration):
+    if kind == 'Reference':
+        ref = atomic.Reference({'generation': 0})
+        publish = ref.set
+        read = ref.get
+    else:
+        ref = atomic.MarkableReference({'generation': 0}, False)
+        publish = lambda config: ref.set(config, False)
+        read = ref.get
+
+    stop = threading.Event()
+    start = threading.Barrier(nreaders + 2)
+    reads = [0] * nreaders
+    writes = [0]
+
+    def reader(i):
+        n = 0
+        start.wait()
+        while not stop.is_set():
+            for _ in range(1000):
+                read()
+            n += 1000
+        reads[i] = n
+
+    def writer():
+        n = 0
+        start.wait()
+        while not stop.is_set():
+            publish({'generation': n})
+            n += 1
+        writes[0] = n
+
+    threads = [threading.Thread(target=reader, args=(i,))
+               for i in range(nreaders)]
+    threads.append(threading.Thread(target=writer))
+    for t in threads:
+        t.start()
+    start.wait()
+    begin = time.perf_counter()
+    time.sleep(duration)
+    stop.set()
+    for t in threads:
+        t.join()
+    elapsed = time.perf_counter() - begin
+    return sum(reads) / elapsed, writes[0] / elapsed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-t', '--threads', default='1,2,4,8,16,32,64',
+                        help='comma-separated reader thread counts')
+    parser.add_argument('-d', '--duration', type=float, default=1.0,
+                        help='seconds per measurement')
+    args = parser.parse_args()
+
+    gil = getattr(sys, '_is_gil_enabled', lambda: True)()
+    print('GIL %s' % ('enabled' if gil else 'disabled'))
+    print('%-18s %8s %14s %14s' % ('type', 'readers', 'reads/s', 'writes/s'))
+    for kind in ('Reference', 'MarkableReference'):
+        for n in map(int, args.threads.split(',')):
+            r, w = run(kind, n, args.duration)
+            print('%-18s %8d %14.0f %14.0f' % (kind, n, r, w))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,95 @@
+"""Measure thread ping-pong latency: Integer.wait()/notify vs alternatives.
+
+Usage: python benchmarks/handoff.py [-n ROUNDS] [--sleep SECONDS]
+
+Two threads take turns: each waits for a shared counter to reach its turn,
+bumps it and wakes the other. The handoff is done with Integer.wait() and
+notify_one(), with a threading.Condition, and by polling get() with
+time.sleep() as code without wait() had to. Results are microseconds per
+one-way handoff.
+"""
+
+import argparse
+import threading
+import time
+
+import atomic
+
+
+def pingpong(rounds, wait_turn, advance):
+    def player(parity):
+        for i in range(parity, 2 * rounds, 2):
+            wait_turn(i)
+            advance(i)
+
+    threads = [threading.Thread(target=player, args=(p,)) for p in (0, 1)]
+    start = time.perf_counter()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    return (time.perf_counter() - start) / (2 * rounds) * 1e6
+
+
+def bench_atomic_wait(rounds, sleep):
+    x = atomic.Integer()
+
+    def wait_turn(i):
+        v = x.get()
+        while v != i:
+            x.wait(v)
+            v = x.get()
+
+    def advance(i):
+        x.set(i + 1)
+        x.notify_one()
+
+    return pingpong(rounds, wait_turn, advance)
+
+
+def bench_condition(rounds, sleep):
+    cond = threading.Condition()
+    state = [0]
+
+    def wait_turn(i):
+        with cond:
+            cond.wait_for(lambda: state[0] == i)
+
+    def advance(i):
+        with cond:
+            state[0] = i + 1
+            cond.notify()
+
+    return pingpong(rounds, wait_turn, advance)
+
+
+def bench_polling(rounds, sleep):
+    x = atomic.Integer()
+
+    def wait_turn(i):
+        while x.get() != i:
+            time.sleep(sleep)
+
+    def advance(i):
+        x.set(i + 1)
+
+    return pingpong(rounds, wait_turn, advance)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-n', '--rounds', type=int, default=20000)
+    parser.add_argument('--sleep', type=float, default=0.0001,
+                        help='polling interval for the polling variant')
+    args = parser.parse_args()
+
+    print('%-28s %12s' % ('handoff', 'us/handoff'))
+    for name, bench in (('Integer.wait/notify_one', bench_atomic_wait),
+                        ('threading.Condition', bench_condition),
+                        ('poll get() + sleep(%g)' % args.sleep,
+                         bench_polling)):
+        print('%-28s %12.1f' % (name, bench(args.rounds, args.sleep)))
+
+
+if __name__ == '__main__':
+    main()
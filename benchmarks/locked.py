@@ -0,0 +1,135 @@
+"""threading.Lock-protected equivalents of the atomic types.
+
+These implement the same methods as atomic.Integer, atomic.Reference and
+atomic.MarkableReference (without the order= keywords) the way they would
+be written without this module, as the baseline for the benchmarks.
+"""
+
+import threading
+
+
+class LockedInteger:
+    def __init__(self, x=0):
+        self._lock = threading.Lock()
+        self._value = x
+
+    def get(self):
+        with self._lock:
+            return self._value
+
+    def set(self, x):
+        with self._lock:
+            self._value = x
+
+    def get_and_set(self, x):
+        with self._lock:
+            old = self._value
+            self._value = x
+            return old
+
+    def compare_and_set(self, expect, update):
+        with self._lock:
+            if self._value != expect:
+                return False
+            self._value = update
+            return True
+
+    weak_compare_and_set = compare_and_set
+
+
+def _add_fetch_ops(cls):
+    ops = {
+        'add': lambda a, b: a + b,
+        'sub': lambda a, b: a - b,
+        'and': lambda a, b: a & b,
+        'xor': lambda a, b: a ^ b,
+        'or': lambda a, b: a | b,
+        'nand': lambda a, b: ~(a & b),
+    }
+
+    def make(f, return_new):
+        def method(self, x):
+            with self._lock:
+                old = self._value
+                self._value = new = f(old, x)
+                return new if return_new else old
+        return method
+
+    for name, f in ops.items():
+        setattr(cls, 'get_and_' + name, make(f, False))
+        setattr(cls, name + '_and_get', make(f, True))
+    return cls
+
+
+_add_fetch_ops(LockedInteger)
+
+
+class LockedReference:
+    def __init__(self, obj=None):
+        self._lock = threading.Lock()
+        self._obj = obj
+
+    def get(self):
+        with self._lock:
+            return self._obj
+
+    def set(self, obj):
+        with self._lock:
+            self._obj = obj
+
+    def get_and_set(self, obj):
+        with self._lock:
+            old = self._obj
+            self._obj = obj
+            return old
+
+    def compare_and_set(self, expect, update):
+        with self._lock:
+            if self._obj is not expect:
+                return False
+            self._obj = update
+            return True
+
+    weak_compare_and_set = compare_and_set
+
+
+class LockedMarkableReference:
+    def __init__(self, obj=None, mark=False):
+        self._lock = threading.Lock()
+        self._obj = obj
+        self._mark = mark
+
+    def get(self):
+        with self._lock:
+            return self._obj, self._mark
+
+    def get_reference(self):
+        with self._lock:
+            return self._obj
+
+    def is_marked(self):
+        with self._lock:
+            return self._mark
+
+    def set(self, obj, mark):
+        with self._lock:
+            self._obj = obj
+            self._mark = mark
+
+    def compare_and_set(self, expect_ref, update_ref, expect_mark,
+                        update_mark):
+        with self._lock:
+            if self._obj is not expect_ref or self._mark != expect_mark:
+                return False
+            self._obj = update_ref
+            self._mark = update_mark
+            return True
+
+    weak_compare_and_set = compare_and_set
+
+    def attempt_mark(self, expect_mark, update_mark):
+        with self._lock:
+            if self._mark != expect_mark:
+                return False
+            self._mark = update_mark
+            return True
@@ -0,0 +1,46 @@
+"""Time every method of the atomic types and their lock baselines with pyperf.
+
+Usage: python benchmarks/pyperf_methods.py [pyperf options] [-o FILE]
+
+pyperf runs each case in several calibrated worker processes and reports
+the mean and standard deviation. -o FILE writes pyperf's JSON, which
+"python -m pyperf compare_to old.json new.json" compares across commits or
+interpreters. The cases are the single-threaded ones of suite.py, which
+covers the multi-threaded layouts. Requires pyperf (pip install pyperf).
+"""
+
+import pyperf
+
+from suite import METHODS, SENTINEL
+
+SETUP = {
+    ('Integer', 'atomic'): 'x = atomic.Integer()',
+    ('Integer', 'lock'): 'x = locked.LockedInteger()',
+    ('Reference', 'atomic'): 'x = atomic.Reference(SENTINEL)',
+    ('Reference', 'lock'): 'x = locked.LockedReference(SENTINEL)',
+    ('MarkableReference', 'atomic'):
+        'x = atomic.MarkableReference(SENTINEL, False)',
+    ('MarkableReference', 'lock'):
+        'x = locked.LockedMarkableReference(SENTINEL, False)',
+}
+
+
+def main():
+    runner = pyperf.Runner()
+    for type_name, methods in METHODS.items():
+        for method, args in methods:
+            # Pass the same objects as suite.py, by name.
+            arg_names = ', '.join('SENTINEL' if a is SENTINEL else repr(a)
+                                  for a in args)
+            for impl in ('atomic', 'lock'):
+                runner.timeit(
+                    '%s.%s (%s)' % (type_name, method, impl),
+                    stmt='f(%s)' % arg_names,
+                    setup='import atomic, locked\n'
+                          'from suite import SENTINEL\n' +
+                          SETUP[type_name, impl] +
+                          '\nf = x.%s' % method)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,125 @@
+"""Compare producer/consumer throughput: BoundedQueue vs queue.Queue.
+
+Usage: python benchmarks/queue_throughput.py [-n ITEMS] [-c CAPACITY]
+                                             [-t THREADS...] [-b BATCH]
+
+P producer threads push n items each through one queue to P consumer
+threads. Variants: queue.Queue(maxsize) with put()/get(), BoundedQueue with
+blocking put()/get(), and BoundedQueue with put_many()/get_many() batches
+(spinning with time.sleep(0) when the queue is full or empty). Figures are
+items per second through the queue.
+"""
+
+import argparse
+import queue
+import threading
+import time
+
+import atomic
+
+STOP = object()
+
+
+def run(producers, n, make_producer, make_consumer):
+    threads = [threading.Thread(target=make_consumer())
+               for _ in range(producers)]
+    threads += [threading.Thread(target=make_producer())
+                for _ in range(producers)]
+    start = time.perf_counter()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    return producers * n / (time.perf_counter() - start)
+
+
+def bench_queue(producers, n, capacity, batch):
+    q = queue.Queue(capacity)
+
+    def make_producer():
+        def produce():
+            for i in range(n):
+                q.put(i)
+            q.put(STOP)
+        return produce
+
+    def make_consumer():
+        def consume():
+            while q.get() is not STOP:
+                pass
+        return consume
+
+    return run(producers, n, make_producer, make_consumer)
+
+
+def bench_bounded(producers, n, capacity, batch):
+    q = atomic.BoundedQueue(capacity)
+
+    def make_producer():
+        def produce():
+            for i in range(n):
+                q.put(i)
+            q.put(STOP)
+        return produce
+
+    def make_consumer():
+        def consume():
+            while q.get() is not STOP:
+                pass
+        return consume
+
+    return run(producers, n, make_producer, make_consumer)
+
+
+def bench_bounded_batch(producers, n, capacity, batch):
+    q = atomic.BoundedQueue(capacity)
+
+    def make_producer():
+        def produce():
+            items = list(range(batch))
+            for _ in range(n // batch):
+                rest = items
+                while rest:
+                    rest = rest[q.put_many(rest):]
+                    if rest:
+                        time.sleep(0)
+            q.put(STOP)
+        return produce
+
+    def make_consumer():
+        def consume():
+            while True:
+                items = q.get_many(batch) or [q.get()]
+                if STOP in items:
+                    # Leave whatever followed our marker to the others.
+                    rest = items[items.index(STOP) + 1:]
+                    while rest:
+                        rest = rest[q.put_many(rest):]
+                    return
+        return consume
+
+    return run(producers, n // batch * batch, make_producer, make_consumer)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-n', '--items', type=int, default=100000)
+    parser.add_argument('-c', '--capacity', type=int, default=1024)
+    parser.add_argument('-t', '--threads', type=int, nargs='+',
+                        default=[1, 2, 4])
+    parser.add_argument('-b', '--batch', type=int, default=64)
+    args = parser.parse_args()
+
+    print('%-8s %-28s %12s' % ('threads', 'queue', 'items/s'))
+    for producers in args.threads:
+        for name, bench in (('queue.Queue', bench_queue),
+                            ('BoundedQueue put/get', bench_bounded),
+                            ('BoundedQueue *_many(%d)' % args.batch,
+                             bench_bounded_batch)):
+            rate = bench(producers, args.items, args.capacity, args.batch)
+            print('%-8s %-28s %12.0f' % ('%dx%d' % (producers, producers),
+                                         name, rate))
+
+
+if __name__ == '__main__':
+    main()
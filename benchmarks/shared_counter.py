@@ -0,0 +1,80 @@
+"""Compare cross-process counters: Integer.from_buffer() vs multiprocessing.
+
+Usage: python benchmarks/shared_counter.py [-n INCREMENTS] [-p PROCESSES...]
+
+Each worker process increments one shared counter n times. The counter is
+either an atomic.Integer placed in a multiprocessing.shared_memory block, or
+a multiprocessing.Value updated under its lock. The table shows the
+aggregate increments per second and checks that no update was lost.
+"""
+
+import argparse
+import multiprocessing
+import time
+from multiprocessing import shared_memory
+
+import atomic
+
+
+def atomic_worker(name, n, start):
+    shm = shared_memory.SharedMemory(name=name)
+    counter = atomic.Integer.from_buffer(shm.buf)
+    start.wait()
+    for _ in range(n):
+        counter += 1
+    del counter
+    shm.close()
+
+
+def value_worker(value, n, start):
+    start.wait()
+    for _ in range(n):
+        with value.get_lock():
+            value.value += 1
+
+
+def run(target, shared, n, processes):
+    start = multiprocessing.Event()
+    workers = [multiprocessing.Process(target=target, args=(shared, n, start))
+               for _ in range(processes)]
+    for w in workers:
+        w.start()
+    t0 = time.perf_counter()
+    start.set()
+    for w in workers:
+        w.join()
+    return time.perf_counter() - t0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-n', '--increments', type=int, default=200000)
+    parser.add_argument('-p', '--processes', type=int, nargs='+',
+                        default=[1, 2, 4])
+    args = parser.parse_args()
+
+    print('%-9s %-24s %14s' % ('processes', 'counter', 'increments/s'))
+    for processes in args.processes:
+        total = args.increments * processes
+
+        shm = shared_memory.SharedMemory(create=True, size=8)
+        try:
+            elapsed = run(atomic_worker, shm.name, args.increments, processes)
+            counter = atomic.Integer.from_buffer(shm.buf)
+            assert counter.get() == total, (counter.get(), total)
+            del counter
+        finally:
+            shm.close()
+            shm.unlink()
+        print('%-9d %-24s %14.0f' % (processes, 'Integer.from_buffer',
+                                     total / elapsed))
+
+        value = multiprocessing.Value('l', 0)
+        elapsed = run(value_worker, value, args.increments, processes)
+        assert value.value == total, (value.value, total)
+        print('%-9d %-24s %14.0f' % (processes, 'multiprocessing.Value',
+                                     total / elapsed))
+
+
+if __name__ == '__main__':
+    main()
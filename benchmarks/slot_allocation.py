@@ -0,0 +1,79 @@
+"""Compare slot allocation: Bitset.acquire_free vs a locked list scan.
+
+Usage: python benchmarks/slot_allocation.py [-n OPS] [-s SLOTS]
+                                            [-f FILL...] [-t THREADS...]
+
+Each thread repeatedly allocates a slot and frees it again while a fraction
+(FILL) of the slots stays permanently taken, so every allocation has to skip
+that many busy slots first. The baseline is the pattern Bitset replaces: a
+list of booleans scanned for the first free entry under a threading.Lock.
+Figures are allocate+free pairs per second across all threads.
+"""
+
+import argparse
+import threading
+import time
+
+import atomic
+
+
+def run(threads, work):
+    workers = [threading.Thread(target=work) for _ in range(threads)]
+    start = time.perf_counter()
+    for t in workers:
+        t.start()
+    for t in workers:
+        t.join()
+    return time.perf_counter() - start
+
+
+def bench_list(threads, ops, slots, fill):
+    used = [True] * fill + [False] * (slots - fill)
+    lock = threading.Lock()
+
+    def work():
+        for _ in range(ops):
+            with lock:
+                i = used.index(False)
+                used[i] = True
+            with lock:
+                used[i] = False
+
+    return threads * ops / run(threads, work)
+
+
+def bench_bitset(threads, ops, slots, fill):
+    b = atomic.Bitset(slots)
+    b.set_range(0, fill)
+
+    def work():
+        acquire, release = b.acquire_free, b.test_and_clear
+        for _ in range(ops):
+            release(acquire())
+
+    return threads * ops / run(threads, work)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-n', '--ops', type=int, default=100000)
+    parser.add_argument('-s', '--slots', type=int, default=4096)
+    parser.add_argument('-f', '--fill', type=float, nargs='+',
+                        default=[0.0, 0.5, 0.99])
+    parser.add_argument('-t', '--threads', type=int, nargs='+',
+                        default=[1, 4])
+    args = parser.parse_args()
+
+    print('%-8s %-6s %-18s %12s' % ('threads', 'fill', 'allocator', 'ops/s'))
+    for threads in args.threads:
+        for fill in args.fill:
+            busy = min(int(fill * args.slots), args.slots - threads)
+            for name, bench in (('locked list', bench_list),
+                                ('Bitset', bench_bitset)):
+                rate = bench(threads, args.ops, args.slots, busy)
+                print('%-8d %-6.2f %-18s %12.0f' % (threads, fill, name,
+                                                    rate))
+
+
+if __name__ == '__main__':
+    main()
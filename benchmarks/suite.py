@@ -0,0 +1,274 @@
+"""Multi-threaded benchmark suite for the atomic types and their lock baselines.
+
+Usage: python benchmarks/suite.py [-n OPS] [-b BATCH] [-t THREADS...]
+                                  [--types TYPE...] [--layouts LAYOUT...]
+                                  [-m PATTERN] [--no-lock] [--c-harness]
+                                  [-o FILE]
+
+For every method of Integer, Reference and MarkableReference, T threads
+each call the method n times, with the objects in one of three layouts:
+
+  uncontended    every thread has its own value on its own cache lines
+  false_sharing  every thread has its own value, but neighbouring values
+                 share a cache line
+  hot_spot       every thread uses the same object
+
+The same runs are repeated with the threading.Lock-based classes in
+locked.py. Each run reports throughput (calls per second over all threads)
+and the p50/p99 latency of a call. Latency is measured over batches of -b
+calls, because timing each call separately would cost more than the call.
+
+Integer layouts are exact: Integer.from_buffer() places the values in an
+mmap at 128-byte strides (uncontended) or 8-byte strides (false_sharing).
+The reference types and the lock baselines cannot be placed, so their
+uncontended and false_sharing layouts are both objects allocated back to
+back, which CPython's allocator usually puts next to each other.
+
+Results print as a table. -o FILE also writes them as JSON for tracking
+over time. The JSON records the interpreter and whether the GIL was enabled,
+so run the suite once on a regular build and once on a free-threaded build
+(3.13t or later) to compare them. --c-harness also builds and runs
+atomic_harness.c, which measures the underlying primitives without the
+interpreter, and adds its results under "c_harness".
+
+For rigorous single-threaded timings of each method, see pyperf_methods.py.
+"""
+
+import argparse
+import datetime
+import itertools
+import json
+import mmap
+import os
+import platform
+import re
+import subprocess
+import sys
+import sysconfig
+import tempfile
+import threading
+import time
+
+import atomic
+from locked import LockedInteger, LockedMarkableReference, LockedReference
+
+LAYOUTS = ('uncontended', 'false_sharing', 'hot_spot')
+SENTINEL = object()
+
+FETCH_OPS = ('add', 'sub', 'and', 'xor', 'or', 'nand')
+
+# type name -> [(method, args)]
+METHODS = {
+    'Integer': [
+        ('get', ()),
+        ('set', (0,)),
+        ('get_and_set', (0,)),
+        ('compare_and_set', (0, 0)),
+        ('weak_compare_and_set', (0, 0)),
+    ] + [('get_and_' + op, (1,)) for op in FETCH_OPS] +
+        [(op + '_and_get', (1,)) for op in FETCH_OPS],
+    'Reference': [
+        ('get', ()),
+        ('set', (SENTINEL,)),
+        ('get_and_set', (SENTINEL,)),
+        ('compare_and_set', (SENTINEL, SENTINEL)),
+        ('weak_compare_and_set', (SENTINEL, SENTINEL)),
+    ],
+    'MarkableReference': [
+        ('get', ()),
+        ('get_reference', ()),
+        ('is_marked', ()),
+        ('set', (SENTINEL, False)),
+        ('compare_and_set', (SENTINEL, SENTINEL, False, False)),
+        ('weak_compare_and_set', (SENTINEL, SENTINEL, False, False)),
+        ('attempt_mark', (False, False)),
+    ],
+}
+
+# type name -> (atomic factory, lock factory), each returning a new object
+FACTORIES = {
+    'Integer': (atomic.Integer, LockedInteger),
+    'Reference': (lambda: atomic.Reference(SENTINEL),
+                  lambda: LockedReference(SENTINEL)),
+    'MarkableReference': (lambda: atomic.MarkableReference(SENTINEL, False),
+                          lambda: LockedMarkableReference(SENTINEL, False)),
+}
+
+
+def make_objects(type_name, impl, layout, threads):
+    """Return one object per thread, laid out as requested."""
+    factory = FACTORIES[type_name][impl == 'lock']
+    if layout == 'hot_spot':
+        return [factory()] * threads
+    if type_name == 'Integer' and impl == 'atomic':
+        stride = 128 if layout == 'uncontended' else 8
+        m = mmap.mmap(-1, max(stride * threads, mmap.PAGESIZE))
+        return [atomic.Integer.from_buffer(m, i * stride)
+                for i in range(threads)]
+    return [factory() for _ in range(threads)]
+
+
+def worker(call, args, nbatches, batch, barrier, results):
+    samples = []
+    perf_counter_ns = time.perf_counter_ns
+    barrier.wait()
+    start = perf_counter_ns()
+    for _ in range(nbatches):
+        t = perf_counter_ns()
+        for _ in itertools.repeat(None, batch):
+            call(*args)
+        samples.append(perf_counter_ns() - t)
+    results.append((start, perf_counter_ns(), samples))
+
+
+def percentile(sorted_samples, p):
+    i = min(max(round(p / 100 * len(sorted_samples)) - 1, 0),
+            len(sorted_samples) - 1)
+    return sorted_samples[i]
+
+
+def run(type_name, method, args, impl, layout, threads, ops, batch):
+    objects = make_objects(type_name, impl, layout, threads)
+    nbatches = max(ops // batch, 1)
+    barrier = threading.Barrier(threads)
+    results = []
+    workers = [threading.Thread(target=worker,
+                                args=(getattr(obj, method), args, nbatches,
+                                      batch, barrier, results))
+               for obj in objects]
+    for t in workers:
+        t.start()
+    for t in workers:
+        t.join()
+    if len(results) != threads:
+        raise RuntimeError('%s.%s failed' % (type_name, method))
+
+    elapsed = (max(end for _, end, _ in results) -
+               min(start for start, _, _ in results)) / 1e9
+    samples = sorted(s / batch for _, _, batch_samples in results
+                     for s in batch_samples)
+    return {
+        'type': type_name,
+        'method': method,
+        'impl': impl,
+        'layout': layout,
+        'threads': threads,
+        'ops_per_sec': threads * nbatches * batch / elapsed,
+        'p50_ns': percentile(samples, 50),
+        'p99_ns': percentile(samples, 99),
+    }
+
+
+def run_c_harness(ops, batch, threads):
+    src = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                       'atomic_harness.c')
+    cc = (sysconfig.get_config_var('CC') or 'cc').split()
+    with tempfile.TemporaryDirectory() as tmp:
+        exe = os.path.join(tmp, 'atomic_harness')
+        subprocess.run(cc + ['-O2', '-pthread', '-o', exe, src], check=True)
+        out = subprocess.run([exe, str(ops), str(batch)] +
+                             [str(t) for t in threads],
+                             check=True, stdout=subprocess.PIPE).stdout
+    return json.loads(out)
+
+
+def default_threads():
+    ncpus = os.cpu_count() or 1
+    counts = {1, 2, 4, ncpus}
+    n = 8
+    while n < ncpus:
+        counts.add(n)
+        n *= 2
+    return sorted(counts)
+
+
+def gil_enabled():
+    is_gil_enabled = getattr(sys, '_is_gil_enabled', None)
+    return is_gil_enabled() if is_gil_enabled else True
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('-n', '--ops', type=int, default=20000,
+                        help='calls per thread per run')
+    parser.add_argument('-b', '--batch', type=int, default=100,
+                        help='calls per latency sample')
+    parser.add_argument('-t', '--threads', type=int, nargs='+',
+                        default=default_threads())
+    parser.add_argument('--types', nargs='+', choices=sorted(METHODS),
+                        default=list(METHODS))
+    parser.add_argument('--layouts', nargs='+', choices=LAYOUTS,
+                        default=list(LAYOUTS))
+    parser.add_argument('-m', '--methods', metavar='PATTERN',
+                        help='only run methods matching this regex')
+    parser.add_argument('--no-lock', action='store_true',
+                        help='skip the threading.Lock baselines')
+    parser.add_argument('--c-harness', action='store_true',
+                        help='also build and run atomic_harness.c')
+    parser.add_argument('-o', '--output', metavar='FILE',
+                        help='write the results as JSON to FILE')
+    args = parser.parse_args()
+
+    impls = ('atomic',) if args.no_lock else ('atomic', 'lock')
+    pattern = re.compile(args.methods) if args.methods else None
+    results = []
+
+    print('%-40s %-13s %7s %-6s %13s %9s %9s' %
+          ('method', 'layout', 'threads', 'impl', 'ops/s', 'p50 ns',
+           'p99 ns'))
+    for threads in args.threads:
+        for type_name in args.types:
+            for method, margs in METHODS[type_name]:
+                if pattern and not pattern.search(method):
+                    continue
+                for layout in args.layouts:
+                    # One thread has nothing to contend with.
+                    if threads == 1 and layout != 'uncontended':
+                        continue
+                    for impl in impls:
+                        r = run(type_name, method, margs, impl, layout,
+                                threads, args.ops, args.batch)
+                        results.append(r)
+                        print('%-40s %-13s %7d %-6s %13.0f %9.1f %9.1f' %
+                              ('%s.%s' % (type_name, method), layout,
+                               threads, impl, r['ops_per_sec'], r['p50_ns'],
+                               r['p99_ns']))
+
+    c_results = None
+    if args.c_harness:
+        c_results = run_c_harness(max(args.ops * 50, 1000000), 1000,
+                                  args.threads)
+        print()
+        print('%-40s %-13s %7s %-6s %13s %9s %9s' %
+              ('C primitive', 'layout', 'threads', '', 'ops/s', 'p50 ns',
+               'p99 ns'))
+        for r in c_results:
+            print('%-40s %-13s %7d %-6s %13.0f %9.2f %9.2f' %
+                  (r['op'], r['layout'], r['threads'], '', r['ops_per_sec'],
+                   r['p50_ns'], r['p99_ns']))
+
+    if args.output:
+        report = {
+            'version': 1,
+            'date': datetime.datetime.now(datetime.timezone.utc).isoformat(),
+            'python': sys.version,
+            'implementation': platform.python_implementation(),
+            'platform': platform.platform(),
+            'machine': platform.machine(),
+            'cpu_count': os.cpu_count(),
+            'free_threaded_build':
+                bool(sysconfig.get_config_var('Py_GIL_DISABLED')),
+            'gil_enabled': gil_enabled(),
+            'ops_per_thread': args.ops,
+            'batch': args.batch,
+            'results': results,
+        }
+        if c_results is not None:
+            report['c_harness'] = c_results
+        with open(args.output, 'w') as f:
+            json.dump(report, f, indent=1)
+            f.write('\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -1,12 +1,50 @@
 from setuptools import setup, Extension
+import os
+import platform
 import sys
 
+# Double-width CAS (atomic_pair in atomic.h) is cmpxchg16b on x86-64, which
+# GCC only emits inline with -mcx16; other targets may need libatomic.
+if platform.machine() in ('x86_64', 'AMD64'):
+    pair_compile_args, pair_libraries = ['-mcx16'], []
+elif platform.machine() in ('aarch64', 'arm64'):
+    pair_compile_args, pair_libraries = [], []
+else:
+    pair_compile_args, pair_libraries = [], ['atomic']
+
+# ATOMIC_STATS=1 builds in the contention counters (see atomic_stats.h).
+if os.environ.get('ATOMIC_STATS', '0') not in ('', '0'):
+    stats_macros = [('ATOMIC_STATS', '1')]
+else:
+    stats_macros = []
+
 base_module = Extension(
     'atomic', ['atomic_module.c', 
                'atomic_integer.c',
+               'atomic_integer_array.c',
+               'atomic_fixed_integer.c',
+               'atomic_float.c',
+               'atomic_bitset.c',
+               'atomic_sequence.c',
+               'atomic_record.c',
+               'atomic_ordered_set.c',
+               'atomic_counter_map.c',
+               'atomic_adder.c',
+               'atomic_bounded_queue.c',
+               'atomic_stack.c',
                'atomic_reference.c',
-               'atomic_markable_reference.c'],
-    extra_compile_args=['-fno-strict-aliasing'])
+               'atomic_markable_reference.c',
+               'atomic_stamped_reference.c',
+               'atomic_hazard.c',
+               'atomic_futex.c',
+               'atomic_stats.c',
+               'atomic_update.c'],
+    depends=['atomic.h', 'atomic_hazard.h', 'atomic_futex.h',
+             'atomic_fixed_integer.h', 'atomic_stats.h',
+             'atomic_update.h'],
+    define_macros=stats_macros,
+    extra_compile_args=['-fno-strict-aliasing'] + pair_compile_args,
+    libraries=pair_libraries)
 
 setup(
     name='atomic',
@@ -16,4 +54,5 @@ setup(
     author_email='osandov@osandov.com',
     url='https://github.com/osandov/python-atomic',
     ext_modules=[base_module],
+    python_requires='>=3.9',
     test_suite='tests')
@@ -0,0 +1,55 @@
+import threading
+import unittest
+
+import atomic
+
+
+class TestAtomicAdder(unittest.TestCase):
+    def test_init(self):
+        x = atomic.Adder()
+        self.assertEqual(x.sum(), 0)
+
+        x = atomic.Adder(5)
+        self.assertEqual(x.sum(), 5)
+
+    def test_add(self):
+        x = atomic.Adder()
+        x.add(3)
+        x.add(-1)
+        x.increment()
+        self.assertEqual(x.sum(), 3)
+        self.assertRaises(TypeError, x.add, 'a')
+
+    def test_sum_then_reset(self):
+        x = atomic.Adder(7)
+        x.increment()
+        self.assertEqual(x.sum_then_reset(), 8)
+        self.assertEqual(x.sum(), 0)
+
+    def test_reset(self):
+        x = atomic.Adder(7)
+        x.reset()
+        self.assertEqual(x.sum(), 0)
+
+    def test_repr(self):
+        self.assertEqual(repr(atomic.Adder(2)), 'atomic.Adder(2)')
+
+    def test_concurrent_increment(self):
+        x = atomic.Adder()
+        drained = []
+
+        def worker():
+            for _ in range(20000):
+                x.increment()
+            drained.append(x.sum_then_reset())
+
+        threads = [threading.Thread(target=worker) for _ in range(8)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(sum(drained) + x.sum(), 8 * 20000)
+
+
+if __name__ == '__main__':
+    unittest.main()
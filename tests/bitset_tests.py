@@ -0,0 +1,132 @@
+import mmap
+import os
+import threading
+import unittest
+
+import atomic
+
+
+class TestAtomicBitset(unittest.TestCase):
+    def test_init(self):
+        b = atomic.Bitset(100)
+        self.assertEqual(len(b), 100)
+        self.assertEqual(repr(b), 'atomic.Bitset(100)')
+        self.assertEqual(b.popcount(), 0)
+        self.assertEqual(len(atomic.Bitset(0)), 0)
+        self.assertRaises(ValueError, atomic.Bitset, -1)
+        self.assertRaises(TypeError, atomic.Bitset)
+        self.assertRaises(RuntimeError, b.__init__, 10)
+
+    def test_bits(self):
+        b = atomic.Bitset(130)
+        for i in (0, 63, 64, 129, -1):
+            with self.subTest(i=i):
+                self.assertFalse(b.test(i))
+                self.assertFalse(b.test_and_set(i))
+                self.assertTrue(b.test_and_set(i, order=atomic.ACQUIRE))
+                self.assertTrue(b[i])
+                self.assertTrue(b.test_and_clear(i, order=atomic.RELEASE))
+                self.assertFalse(b.test_and_clear(i))
+                self.assertFalse(b.test(i, order=atomic.RELAXED))
+        self.assertRaises(IndexError, b.test, 130)
+        self.assertRaises(IndexError, b.test_and_set, -131)
+        self.assertRaises(IndexError, b.__getitem__, 130)
+        self.assertRaises(TypeError, b.test, 'a')
+        self.assertRaises(ValueError, b.test, 0, order=atomic.RELEASE)
+
+    def test_acquire_free(self):
+        for nbits in (1, 63, 64, 65, 300):
+            with self.subTest(nbits=nbits):
+                b = atomic.Bitset(nbits)
+                got = [b.acquire_free() for _ in range(nbits)]
+                self.assertEqual(got, list(range(nbits)))
+                self.assertEqual(b.acquire_free(), -1)
+                self.assertEqual(b.popcount(), nbits)
+                b.test_and_clear(nbits // 2)
+                self.assertEqual(b.acquire_free(), nbits // 2)
+        self.assertEqual(atomic.Bitset(0).acquire_free(), -1)
+
+    def test_acquire_free_start(self):
+        b = atomic.Bitset(200)
+        self.assertEqual(b.acquire_free(70), 70)
+        self.assertEqual(b.acquire_free(70), 71)
+        self.assertEqual(b.acquire_free(-1), 199)
+        self.assertEqual(b.acquire_free(199), 0)
+        self.assertEqual(b.acquire_free(400), 1)
+        b.set_range(0, 200)
+        b.test_and_clear(65)
+        self.assertEqual(b.acquire_free(66), 65)
+        self.assertEqual(b.acquire_free(66), -1)
+        self.assertRaises(TypeError, b.acquire_free, 1, 2)
+
+    def test_ranges(self):
+        b = atomic.Bitset(200)
+        self.assertEqual(b.set_range(10, 150), 140)
+        self.assertEqual(b.set_range(0, 20), 10)
+        self.assertEqual(b.popcount(), 150)
+        self.assertEqual(b.popcount(5, 15), 10)
+        self.assertEqual(b.popcount(140), 10)
+        self.assertEqual(b.popcount(-60, None), 10)
+        self.assertEqual(b.popcount(stop=64), 64)
+        self.assertEqual(b.clear_range(60, 1000), 90)
+        self.assertEqual(b.popcount(), 60)
+        self.assertEqual(b.set_range(50, 50), 0)
+        self.assertEqual(b.clear_range(-10, 0), 0)
+        self.assertEqual([i for i in range(200) if b[i]], list(range(60)))
+        self.assertRaises(TypeError, b.set_range, 1)
+
+    def test_from_buffer(self):
+        buf = bytearray(8 + 16)
+        b = atomic.Bitset.from_buffer(buf, 100, 8)
+        self.assertEqual(len(b), 100)
+        b.test_and_set(0)
+        b.test_and_set(64)
+        self.assertEqual(buf, bytes(8) + b'\x01' + bytes(7) + b'\x01' +
+                         bytes(7))
+        # Bits past nbits in the buffer are never used.
+        buf[-1] = 0xff
+        self.assertEqual(b.popcount(), 2)
+        self.assertRaises(ValueError, atomic.Bitset.from_buffer, buf, 200)
+        self.assertRaises(ValueError, atomic.Bitset.from_buffer, buf, 8, 4)
+        self.assertRaises(TypeError, atomic.Bitset.from_buffer, bytes(8), 8)
+        del b
+
+    @unittest.skipUnless(hasattr(os, 'fork'), 'requires os.fork()')
+    def test_from_buffer_processes(self):
+        n = 1000
+        with mmap.mmap(-1, mmap.PAGESIZE) as m:
+            b = atomic.Bitset.from_buffer(m, 2 * n)
+            r, w = os.pipe()
+            pid = os.fork()
+            if pid == 0:
+                try:
+                    got = [b.acquire_free() for _ in range(n)]
+                    os.write(w, ' '.join(map(str, got)).encode())
+                finally:
+                    os._exit(0)
+            os.close(w)
+            mine = [b.acquire_free() for _ in range(n)]
+            os.waitpid(pid, 0)
+            with os.fdopen(r) as f:
+                theirs = [int(i) for i in f.read().split()]
+            self.assertEqual(sorted(mine + theirs), list(range(2 * n)))
+            del b
+
+    def test_threads(self):
+        b = atomic.Bitset(1000)
+        results = []
+
+        def allocate():
+            results.append([b.acquire_free() for _ in range(250)])
+
+        threads = [threading.Thread(target=allocate) for _ in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(sorted(i for got in results for i in got),
+                         list(range(1000)))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,125 @@
+import gc
+import sys
+import threading
+import time
+import unittest
+import weakref
+
+import atomic
+
+
+class TestAtomicBoundedQueue(unittest.TestCase):
+    def test_init(self):
+        q = atomic.BoundedQueue(4)
+        self.assertEqual(q.capacity, 4)
+        self.assertEqual(len(q), 0)
+        self.assertEqual(repr(q), 'atomic.BoundedQueue(4)')
+        self.assertRaises(ValueError, atomic.BoundedQueue, 1)
+        self.assertRaises(ValueError, atomic.BoundedQueue, -1)
+        self.assertRaises(TypeError, atomic.BoundedQueue)
+        self.assertRaises(RuntimeError, q.__init__, 4)
+
+    def test_try_put_get(self):
+        for capacity in (2, 3, 4):
+            q = atomic.BoundedQueue(capacity)
+            for round in range(3):
+                for i in range(capacity):
+                    self.assertTrue(q.try_put(i))
+                self.assertFalse(q.try_put('full'))
+                self.assertEqual(len(q), capacity)
+                for i in range(capacity):
+                    self.assertEqual(q.try_get(), i)
+                self.assertIsNone(q.try_get())
+                self.assertIs(q.try_get(Ellipsis), Ellipsis)
+
+    def test_many(self):
+        q = atomic.BoundedQueue(5)
+        self.assertEqual(q.put_many(range(3)), 3)
+        self.assertEqual(q.put_many(iter(range(3, 10))), 2)
+        self.assertEqual(q.get_many(2), [0, 1])
+        self.assertEqual(q.get_many(100), [2, 3, 4])
+        self.assertEqual(q.get_many(1), [])
+        self.assertRaises(ValueError, q.get_many, -1)
+        self.assertRaises(TypeError, q.put_many, 1)
+
+    def test_refcount(self):
+        o = object()
+        refcount = sys.getrefcount(o)
+        q = atomic.BoundedQueue(2)
+        q.put_many([o, o])
+        self.assertFalse(q.try_put(o))
+        self.assertEqual(sys.getrefcount(o), refcount + 2)
+        self.assertIs(q.try_get(), o)
+        self.assertEqual(sys.getrefcount(o), refcount + 1)
+        del q
+        self.assertEqual(sys.getrefcount(o), refcount)
+
+    def test_reference_cycle(self):
+        class Node:
+            pass
+
+        q = atomic.BoundedQueue(2)
+        n = Node()
+        n.q = q
+        q.try_put(n)
+        r = weakref.ref(n)
+        del q, n
+        gc.collect()
+        self.assertIsNone(r())
+
+    def test_blocking(self):
+        q = atomic.BoundedQueue(2)
+        start = time.monotonic()
+        self.assertIsNone(q.get(timeout=0.05))
+        self.assertEqual(q.get(timeout=0, default=-1), -1)
+        self.assertGreaterEqual(time.monotonic() - start, 0.04)
+        self.assertTrue(q.put(1))
+        self.assertTrue(q.put(2, timeout=0))
+        self.assertFalse(q.put(3, timeout=0.01))
+        self.assertEqual(q.get(), 1)
+        self.assertRaises(ValueError, q.get, timeout=-1)
+        self.assertRaises(TypeError, q.put)
+        self.assertRaises(TypeError, q.get, 1)
+
+    def test_producers_consumers(self):
+        q = atomic.BoundedQueue(8)
+        n, producers, consumers = 2000, 3, 3
+        results = []
+        stop = object()
+
+        def produce(base):
+            for i in range(n):
+                q.put(base + i)
+
+        def consume():
+            got = []
+            while True:
+                item = q.get()
+                if item is stop:
+                    break
+                got.append(item)
+            results.append(got)
+
+        threads = [threading.Thread(target=consume) for _ in range(consumers)]
+        threads += [threading.Thread(target=produce, args=(p * n,))
+                    for p in range(producers)]
+        for t in threads:
+            t.start()
+        for t in threads[consumers:]:
+            t.join()
+        for _ in range(consumers):
+            q.put(stop)
+        for t in threads[:consumers]:
+            t.join()
+
+        self.assertEqual(sorted(x for got in results for x in got),
+                         list(range(producers * n)))
+        for got in results:
+            # Each producer's items come out in the order they went in.
+            for p in range(producers):
+                mine = [x for x in got if p * n <= x < (p + 1) * n]
+                self.assertEqual(mine, sorted(mine))
+
+
+if __name__ == '__main__':
+    unittest.main()
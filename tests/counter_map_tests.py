@@ -0,0 +1,164 @@
+import collections
+import gc
+import sys
+import threading
+import unittest
+import weakref
+
+import atomic
+
+
+class Key:
+    """Hashable key whose equal instances are distinct objects."""
+
+    def __init__(self, name, hash_value=None):
+        self.name = name
+        self.hash_value = hash(name) if hash_value is None else hash_value
+
+    def __hash__(self):
+        return self.hash_value
+
+    def __eq__(self, other):
+        return isinstance(other, Key) and self.name == other.name
+
+
+class TestAtomicCounterMap(unittest.TestCase):
+    def test_init(self):
+        c = atomic.CounterMap()
+        self.assertEqual(len(c), 0)
+        self.assertEqual(c.items(), [])
+        self.assertEqual(repr(c), 'atomic.CounterMap({})')
+        c = atomic.CounterMap('abracadabra')
+        self.assertEqual(c['a'], 5)
+        self.assertEqual(len(c), 5)
+        self.assertEqual(repr(c),
+                         "atomic.CounterMap({'a': 5, 'b': 2, 'r': 2, "
+                         "'c': 1, 'd': 1})")
+        self.assertRaises(TypeError, atomic.CounterMap, 5)
+        self.assertRaises(TypeError, atomic.CounterMap, [[]])
+
+    def test_increment(self):
+        c = atomic.CounterMap()
+        self.assertEqual(c.increment('x'), 1)
+        self.assertEqual(c.increment('x', 5), 6)
+        self.assertEqual(c.increment('x', -7), -1)
+        self.assertEqual(c.increment(('y', 1), 0), 0)
+        self.assertEqual(len(c), 2)
+        self.assertRaises(TypeError, c.increment)
+        self.assertRaises(TypeError, c.increment, 'x', 1, 2)
+        self.assertRaises(TypeError, c.increment, 'x', 1.5)
+        self.assertRaises(TypeError, c.increment, [], 1)
+        self.assertRaises(OverflowError, c.increment, 'x', 2 ** 64)
+        self.assertEqual(c['x'], -1)
+
+    def test_get(self):
+        c = atomic.CounterMap(['a'])
+        self.assertEqual(c.get('a'), 1)
+        self.assertEqual(c.get('b'), 0)
+        self.assertIsNone(c.get('b', None))
+        self.assertEqual(c['b'], 0)
+        self.assertIn('a', c)
+        self.assertNotIn('b', c)
+        self.assertEqual(len(c), 1)
+        self.assertRaises(TypeError, c.get)
+        self.assertRaises(TypeError, c.get, [])
+        self.assertRaises(TypeError, c.__getitem__, [])
+
+    def test_equal_keys(self):
+        c = atomic.CounterMap()
+        c.increment(Key('a'))
+        c.increment(Key('a'))
+        c.increment(Key('b', hash('a')))
+        self.assertEqual(c[Key('a')], 2)
+        self.assertEqual(c[Key('b', hash('a'))], 1)
+        c.increment(1)
+        c.increment(1.0)
+        c.increment(True)
+        self.assertEqual(c[1], 3)
+        self.assertEqual(len(c), 3)
+
+    def test_compare_error(self):
+        class Bad:
+            def __hash__(self):
+                return 0
+
+            def __eq__(self, other):
+                raise ZeroDivisionError
+
+        c = atomic.CounterMap([Bad()])
+        self.assertRaises(ZeroDivisionError, c.increment, Bad())
+        self.assertRaises(ZeroDivisionError, c.get, Bad())
+        self.assertEqual(len(c), 1)
+
+    def test_items_most_common(self):
+        text = 'the quick brown fox jumps over the lazy dog'.split() * 3
+        text += ['the', 'fox']
+        c = atomic.CounterMap(text)
+        expected = collections.Counter(text)
+        self.assertEqual(c.items(), list(expected.items()))
+        self.assertEqual(c.most_common(), expected.most_common())
+        self.assertEqual(c.most_common(2), expected.most_common(2))
+        self.assertEqual(c.most_common(0), [])
+        self.assertEqual(c.most_common(-1), [])
+        self.assertEqual(c.most_common(None), expected.most_common())
+        self.assertRaises(TypeError, c.most_common, 'x')
+        self.assertRaises(TypeError, c.most_common, 1, 2)
+
+    def test_resize(self):
+        c = atomic.CounterMap()
+        for i in range(10000):
+            self.assertEqual(c.increment(i, i), i)
+        self.assertEqual(len(c), 10000)
+        for i in range(10000):
+            self.assertEqual(c[i], i)
+        self.assertEqual(c.items(), [(i, i) for i in range(10000)])
+
+    def test_refcount(self):
+        key = Key('k')
+        refcount = sys.getrefcount(key)
+        c = atomic.CounterMap()
+        c.increment(key)
+        c.increment(Key('k'))
+        for i in range(1000):
+            c.increment(i)
+        self.assertEqual(sys.getrefcount(key), refcount + 1)
+        del c
+        self.assertEqual(sys.getrefcount(key), refcount)
+
+    def test_reference_cycle_collected(self):
+        class Node:
+            pass
+
+        n = Node()
+        n.counts = atomic.CounterMap([n])
+        wr = weakref.ref(n)
+        del n
+        gc.collect()
+        self.assertIsNone(wr())
+
+    def test_threads(self):
+        c = atomic.CounterMap()
+        nthreads, nkeys, rounds = 4, 3000, 3
+
+        def worker():
+            for _ in range(rounds):
+                for i in range(nkeys):
+                    c.increment(str(i))
+                    c.increment('hot')
+
+        threads = [threading.Thread(target=worker) for _ in range(nthreads)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+
+        self.assertEqual(len(c), nkeys + 1)
+        self.assertEqual(c['hot'], nthreads * rounds * nkeys)
+        for i in range(nkeys):
+            self.assertEqual(c[str(i)], nthreads * rounds)
+        self.assertEqual(c.most_common(1),
+                         [('hot', nthreads * rounds * nkeys)])
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,158 @@
+import struct
+import threading
+import unittest
+
+import atomic
+import operator
+
+FETCH_OPS = {
+    'add': operator.add,
+    'sub': operator.sub,
+    'and': operator.and_,
+    'xor': operator.xor,
+    'or': operator.or_,
+    'nand': lambda x, y: ~(x & y),
+}
+
+# name -> (bits, signed, struct format)
+TYPES = {
+    'Int8': (8, True, 'b'),
+    'Int16': (16, True, 'h'),
+    'Int32': (32, True, 'i'),
+    'Int64': (64, True, 'q'),
+    'UInt8': (8, False, 'B'),
+    'UInt16': (16, False, 'H'),
+    'UInt32': (32, False, 'I'),
+    'UInt64': (64, False, 'Q'),
+}
+if hasattr(atomic, 'Int128'):
+    TYPES['Int128'] = (128, True, None)
+
+
+def wrap(x, bits, signed):
+    x &= (1 << bits) - 1
+    if signed and x >> (bits - 1):
+        x -= 1 << bits
+    return x
+
+
+class TestAtomicFixedInteger(unittest.TestCase):
+    def types(self):
+        for name, (bits, signed, fmt) in TYPES.items():
+            with self.subTest(name):
+                yield getattr(atomic, name), bits, signed, fmt
+
+    def test_init(self):
+        for tp, bits, signed, fmt in self.types():
+            self.assertEqual(tp().get(), 0)
+            self.assertEqual(tp(3).get(), 3)
+            self.assertEqual(tp(x=4).get(), 4)
+            self.assertEqual(tp(-1).get(), wrap(-1, bits, signed))
+            self.assertEqual(repr(tp(5)), 'atomic.%s(5)' % tp.__name__)
+            self.assertRaises(TypeError, tp, 1, 2)
+            self.assertRaises(TypeError, tp, 'a')
+            self.assertRaises(TypeError, tp, 1.0)
+
+    def test_bounds(self):
+        for tp, bits, signed, fmt in self.types():
+            lo = -(1 << (bits - 1)) if signed else 0
+            hi = lo + (1 << bits) - 1
+            x = tp(hi)
+            self.assertEqual(x.get(), hi)
+            self.assertEqual(x.add_and_get(1), lo)
+            self.assertEqual(x.sub_and_get(1), hi)
+            x.set(hi + 1)
+            self.assertEqual(x.get(), lo)
+            x.set(1 << 200)
+            self.assertEqual(x.get(), 0)
+            self.assertEqual(x.get_and_set(lo - 1), 0)
+            self.assertEqual(x.get(), hi)
+
+    def test_fetch_ops(self):
+        values = (0, 1, 3, 100, -7, 1 << 40, -(1 << 100) + 12345)
+        for tp, bits, signed, fmt in self.types():
+            for op, f in FETCH_OPS.items():
+                for a in values:
+                    for b in values:
+                        expected = wrap(f(wrap(a, bits, signed), b), bits,
+                                        signed)
+                        x = tp(a)
+                        self.assertEqual(getattr(x, 'get_and_' + op)(b),
+                                         wrap(a, bits, signed))
+                        self.assertEqual(x.get(), expected)
+                        x = tp(a)
+                        self.assertEqual(getattr(x, op + '_and_get')(b),
+                                         expected)
+
+    def test_compare_and_set(self):
+        for tp, bits, signed, fmt in self.types():
+            x = tp(-1)
+            self.assertTrue(x.compare_and_set((1 << bits) - 1, 5))
+            self.assertEqual(x.get(), 5)
+            self.assertFalse(x.compare_and_set(4, 6))
+            self.assertEqual(x.get(), 5)
+            while not x.weak_compare_and_set(5, 6, order=atomic.ACQ_REL,
+                                             failure_order=atomic.ACQUIRE):
+                pass
+            self.assertEqual(x.get(order=atomic.RELAXED), 6)
+            self.assertRaises(ValueError, x.compare_and_set, 6, 7,
+                              order=atomic.RELAXED,
+                              failure_order=atomic.SEQ_CST)
+            self.assertRaises(ValueError, x.set, 1, order=atomic.ACQUIRE)
+
+    def test_number_protocol(self):
+        for tp, bits, signed, fmt in self.types():
+            x = y = tp(250)
+            x += 10
+            self.assertIs(x, y)
+            self.assertEqual(int(x), wrap(260, bits, signed))
+            x -= 260
+            self.assertEqual(x, 0)
+            x |= 6
+            x &= 3
+            x ^= 1
+            self.assertEqual(operator.index(x), 3)
+            self.assertEqual(str(x), '3')
+            self.assertLess(x, 4)
+            self.assertRaises(TypeError, hash, x)
+            with self.assertRaises(TypeError):
+                x += 'a'
+
+    def test_from_buffer(self):
+        for tp, bits, signed, fmt in self.types():
+            size = bits // 8
+            buf = bytearray(4 * size)
+            x = tp.from_buffer(buf, 2 * size)
+            x.set(-2)
+            if fmt:
+                self.assertEqual(struct.unpack_from(fmt, buf, 2 * size),
+                                 (wrap(-2, bits, signed),))
+            self.assertEqual(buf[:2 * size], bytes(2 * size))
+            self.assertEqual(tp.from_buffer(buf, offset=2 * size).get(),
+                             wrap(-2, bits, signed))
+            self.assertRaises(ValueError, tp.from_buffer, buf, 3 * size + 1)
+            self.assertRaises(ValueError, tp.from_buffer, buf, 4 * size)
+            if size > 1:
+                self.assertRaises(ValueError, tp.from_buffer, buf, 1)
+            self.assertRaises(TypeError, tp.from_buffer, bytes(size))
+            del x
+
+    def test_threads(self):
+        n, nthreads = 10000, 4
+        for tp, bits, signed, fmt in self.types():
+            x = tp()
+
+            def add():
+                for _ in range(n):
+                    x.get_and_add(1)
+
+            threads = [threading.Thread(target=add) for _ in range(nthreads)]
+            for t in threads:
+                t.start()
+            for t in threads:
+                t.join()
+            self.assertEqual(x.get(), wrap(n * nthreads, bits, signed))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,152 @@
+import math
+import struct
+import threading
+import unittest
+
+import atomic
+
+
+class TestAtomicFloat(unittest.TestCase):
+    def test_init(self):
+        self.assertEqual(atomic.Float().get(), 0.0)
+        self.assertEqual(atomic.Float(1.5).get(), 1.5)
+        self.assertEqual(atomic.Float(x=3).get(), 3.0)
+        self.assertIsInstance(atomic.Float(3).get(), float)
+        self.assertEqual(repr(atomic.Float(0.25)), 'atomic.Float(0.25)')
+        self.assertRaises(TypeError, atomic.Float, 1, 2)
+        self.assertRaises(TypeError, atomic.Float, 'a')
+
+    def test_set(self):
+        x = atomic.Float()
+        x.set(2.5)
+        self.assertEqual(x.get(), 2.5)
+        x.set(7, order=atomic.RELEASE)
+        self.assertEqual(x.get(order=atomic.ACQUIRE), 7.0)
+        self.assertEqual(x.get_and_set(-1.0), 7.0)
+        self.assertEqual(x.get(), -1.0)
+        self.assertRaises(TypeError, x.set, 'a')
+        self.assertRaises(ValueError, x.set, 1.0, order=atomic.ACQUIRE)
+
+    def test_compare_and_set(self):
+        x = atomic.Float(1.0)
+        self.assertTrue(x.compare_and_set(1.0, 2.0))
+        self.assertFalse(x.compare_and_set(1.0, 3.0))
+        self.assertEqual(x.get(), 2.0)
+        while not x.weak_compare_and_set(2.0, 3.0, order=atomic.ACQ_REL):
+            pass
+        self.assertEqual(x.get(), 3.0)
+
+        # Values are compared bit for bit.
+        x.set(0.0)
+        self.assertFalse(x.compare_and_set(-0.0, 1.0))
+        x.set(math.nan)
+        self.assertTrue(x.compare_and_set(math.nan, 1.0))
+
+    def test_add(self):
+        x = atomic.Float(1.0)
+        self.assertEqual(x.get_and_add(0.5), 1.0)
+        self.assertEqual(x.add_and_get(0.5), 2.0)
+        self.assertEqual(x.get_and_sub(1.5), 2.0)
+        self.assertEqual(x.sub_and_get(0.5, order=atomic.RELAXED), 0.0)
+        self.assertEqual(x.add_and_get(math.inf), math.inf)
+
+    def test_max_min(self):
+        x = atomic.Float(1.0)
+        self.assertEqual(x.fetch_max(0.5), 1.0)
+        self.assertEqual(x.get(), 1.0)
+        self.assertEqual(x.fetch_max(3.0), 1.0)
+        self.assertEqual(x.get(), 3.0)
+        self.assertEqual(x.fetch_min(4.0), 3.0)
+        self.assertEqual(x.fetch_min(-2.0, order=atomic.ACQUIRE), 3.0)
+        self.assertEqual(x.get(), -2.0)
+        x.fetch_max(math.nan)
+        x.fetch_min(math.nan)
+        self.assertEqual(x.get(), -2.0)
+
+    def test_number_protocol(self):
+        x = y = atomic.Float(1.0)
+        x += 2
+        x -= 0.5
+        self.assertIs(x, y)
+        self.assertEqual(float(x), 2.5)
+        self.assertEqual(str(x), '2.5')
+        self.assertEqual(x, 2.5)
+        self.assertGreater(x, 2)
+        self.assertRaises(TypeError, hash, x)
+        with self.assertRaises(TypeError):
+            x += 'a'
+
+    def test_from_buffer(self):
+        buf = bytearray(24)
+        struct.pack_into('d', buf, 8, 1.25)
+        x = atomic.Float.from_buffer(buf, 8)
+        self.assertEqual(x.get(), 1.25)
+        x += 1
+        self.assertEqual(struct.unpack_from('d', buf, 8), (2.25,))
+        self.assertRaises(ValueError, atomic.Float.from_buffer, buf, 4)
+        self.assertRaises(ValueError, atomic.Float.from_buffer, buf, 24)
+        self.assertRaises(TypeError, atomic.Float.from_buffer, bytes(8))
+        del x
+
+    def test_threads(self):
+        x = atomic.Float()
+        n, nthreads = 10000, 4
+
+        def add():
+            for _ in range(n):
+                x.get_and_add(1.0)
+
+        threads = [threading.Thread(target=add) for _ in range(nthreads)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(x.get(), n * nthreads)
+
+
+class TestAtomicCompensatedFloat(unittest.TestCase):
+    def test_init(self):
+        self.assertEqual(atomic.CompensatedFloat().get(), 0.0)
+        self.assertEqual(atomic.CompensatedFloat(2.5).get(), 2.5)
+        self.assertEqual(repr(atomic.CompensatedFloat(1)),
+                         'atomic.CompensatedFloat(1.0)')
+        self.assertRaises(TypeError, atomic.CompensatedFloat, 'a')
+
+    def test_accuracy(self):
+        values = [0.1] * 10000 + [1e16, 1.0, -1e16]
+        x = atomic.CompensatedFloat()
+        for v in values:
+            x.add(v)
+        self.assertEqual(x.get(), math.fsum(values))
+
+    def test_methods(self):
+        x = atomic.CompensatedFloat(1e16)
+        self.assertEqual(x.add_and_get(1.0), 1e16 + 1)
+        x += 1.0
+        self.assertEqual(float(x), 1e16 + 2)
+        self.assertEqual(x.get_and_set(0.0), 1e16 + 2)
+        self.assertEqual(x, 0.0)
+        x.set(3, order=atomic.RELAXED)
+        self.assertEqual(x.get(order=atomic.ACQUIRE), 3.0)
+        self.assertRaises(ValueError, x.add, 1.0, order=8)
+        self.assertRaises(TypeError, x.add, 'a')
+        self.assertRaises(TypeError, hash, x)
+
+    def test_threads(self):
+        x = atomic.CompensatedFloat()
+        n, nthreads = 10000, 4
+
+        def add():
+            for _ in range(n):
+                x.add(0.1)
+
+        threads = [threading.Thread(target=add) for _ in range(nthreads)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(x.get(), math.fsum([0.1] * (n * nthreads)))
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,220 @@
+import array
+import mmap
+import os
+import unittest
+
+import atomic
+from tests.integer_tests import FETCH_OPS
+
+
+class TestAtomicIntegerArray(unittest.TestCase):
+    def test_init(self):
+        x = atomic.IntegerArray(4)
+        self.assertEqual(len(x), 4)
+        self.assertEqual(list(x), [0, 0, 0, 0])
+
+        x = atomic.IntegerArray(0)
+        self.assertEqual(len(x), 0)
+
+        self.assertRaises(ValueError, atomic.IntegerArray, -1)
+        self.assertRaises(TypeError, atomic.IntegerArray)
+
+    def test_index(self):
+        x = atomic.IntegerArray(3)
+        x.set(-1, 7)
+        self.assertEqual(x.get(2), 7)
+        self.assertEqual(x[-1], 7)
+        self.assertRaises(IndexError, x.get, 3)
+        self.assertRaises(IndexError, x.get, -4)
+        self.assertRaises(IndexError, x.__getitem__, 3)
+        self.assertRaises(TypeError, x.get, 'a')
+
+    def test_set(self):
+        x = atomic.IntegerArray(2)
+        x.set(1, 99)
+        self.assertEqual(x.get(0), 0)
+        self.assertEqual(x.get(1), 99)
+
+    def test_get_and_set(self):
+        x = atomic.IntegerArray(2)
+        x.set(0, 1)
+        ret = x.get_and_set(0, 99)
+        self.assertEqual(ret, 1)
+        self.assertEqual(x.get(0), 99)
+
+    def test_compare_and_set(self):
+        x = atomic.IntegerArray(2)
+        x.set(1, 1)
+
+        ret = x.compare_and_set(1, 1, 99)
+        self.assertTrue(ret)
+        self.assertEqual(x.get(1), 99)
+
+        ret = x.compare_and_set(1, 1, 100)
+        self.assertFalse(ret)
+        self.assertEqual(x.get(1), 99)
+
+    def test_get_and(self):
+        for op, f in FETCH_OPS.items():
+            x = atomic.IntegerArray(2)
+            x.set(1, 1)
+            ret = getattr(x, 'get_and_%s' % op)(1, 2)
+            self.assertEqual(x.get(1), f(1, 2))
+            self.assertEqual(x.get(0), 0)
+            self.assertEqual(ret, 1)
+
+    def test_and_get(self):
+        for op, f in FETCH_OPS.items():
+            x = atomic.IntegerArray(2)
+            x.set(1, 1)
+            ret = getattr(x, '%s_and_get' % op)(1, 2)
+            self.assertEqual(x.get(1), f(1, 2))
+            self.assertEqual(x.get(0), 0)
+            self.assertEqual(ret, f(1, 2))
+
+    def test_order(self):
+        x = atomic.IntegerArray(2)
+        x.set(1, 5, order=atomic.RELEASE)
+        self.assertEqual(x.get(1, order=atomic.ACQUIRE), 5)
+        self.assertEqual(x.get_and_add(1, 1, order=atomic.RELAXED), 5)
+        self.assertTrue(x.compare_and_set(1, 6, 7, order=atomic.ACQ_REL))
+        self.assertRaises(ValueError, x.get, 1, order=atomic.RELEASE)
+        self.assertRaises(ValueError, x.compare_and_set, 1, 7, 8,
+                          order=atomic.RELAXED, failure_order=atomic.SEQ_CST)
+        self.assertEqual(x.get(1), 7)
+
+    def test_buffer(self):
+        x = atomic.IntegerArray(3)
+        x.set(1, -5)
+        m = memoryview(x)
+        self.assertTrue(m.readonly)
+        self.assertEqual(m.format, 'l')
+        self.assertEqual(m.shape, (3,))
+        self.assertEqual(m.tolist(), [0, -5, 0])
+
+        # The view is live, not a copy.
+        x.set(2, 8)
+        self.assertEqual(m[2], 8)
+        self.assertEqual(array.array('l', m).tolist(), [0, -5, 8])
+
+    def test_add_many(self):
+        x = atomic.IntegerArray(4)
+        x.add_many(array.array('q', [0, 1, 1, -1]), array.array('i', [5, 1, 2, 3]))
+        self.assertEqual(list(x), [5, 3, 0, 3])
+
+        x.add_many(array.array('B', [0, 2]), -1, order=atomic.RELAXED)
+        self.assertEqual(list(x), [4, 3, -1, 3])
+
+        x.add_many(array.array('l', range(4)) * 100, 1)
+        self.assertEqual(list(x), [104, 103, 99, 103])
+
+    def test_or_many(self):
+        x = atomic.IntegerArray(3)
+        x.or_many(array.array('h', [0, 0, 2]), array.array('H', [1, 4, 8]))
+        self.assertEqual(list(x), [5, 0, 8])
+
+    def test_rmw_many_errors(self):
+        x = atomic.IntegerArray(3)
+        # A bad index anywhere in the batch leaves the array untouched.
+        self.assertRaises(IndexError, x.add_many, array.array('l', [0, 3]), 1)
+        self.assertRaises(ValueError, x.add_many, array.array('l', [0]),
+                          array.array('l', [1, 2]))
+        self.assertRaises(TypeError, x.add_many, array.array('d', [0.0]), 1)
+        self.assertRaises(TypeError, x.add_many, [0], 1)
+        self.assertRaises(TypeError, x.add_many, array.array('l', [0]), 1,
+                          ordering=atomic.RELAXED)
+        self.assertRaises(ValueError, x.add_many, array.array('l', [0]), 1,
+                          order=99)
+        self.assertEqual(list(x), [0, 0, 0])
+
+    def test_many_errors_large_batch(self):
+        # Batches this large run without the GIL; the indices are checked
+        # before it is released.
+        x = atomic.IntegerArray(10)
+        bad = array.array('q', [0] * 300 + [99])
+        self.assertRaises(IndexError, x.add_many, bad, 1)
+        self.assertRaises(IndexError, x.or_many, bad, 1)
+        self.assertRaises(IndexError, x.load_many, bad)
+        self.assertRaises(IndexError, x.load_many, bad,
+                          out=array.array('q', [0] * 301))
+        huge = array.array('Q', [0] * 300 + [2 ** 64 - 1])
+        self.assertRaises(IndexError, x.add_many, huge, 1)
+        self.assertRaises(IndexError, x.load_many, huge)
+        self.assertEqual(list(x), [0] * 10)
+        x.add_many(array.array('Q', [9] * 300), 1)
+        self.assertEqual(x.get(9), 300)
+
+    def test_load_many(self):
+        x = atomic.IntegerArray(3)
+        for i in range(3):
+            x.set(i, i * 10)
+        self.assertEqual(x.load_many(array.array('l', [2, 0, -1])), [20, 0, 20])
+
+        out = array.array('q', [0] * 3)
+        self.assertIsNone(x.load_many(array.array('i', [1, 1]), out=out,
+                                      order=atomic.ACQUIRE))
+        self.assertEqual(out.tolist(), [10, 10, 0])
+
+        self.assertRaises(ValueError, x.load_many, array.array('l', [0]),
+                          order=atomic.RELEASE)
+        self.assertRaises(ValueError, x.load_many, array.array('l', [0, 1]),
+                          out=array.array('l', [0]))
+
+    def test_snapshot_into(self):
+        x = atomic.IntegerArray(3)
+        x.set(1, -2)
+        out = array.array('l', [9] * 4)
+        x.snapshot_into(out, order=atomic.RELAXED)
+        self.assertEqual(out.tolist(), [0, -2, 0, 9])
+
+        self.assertRaises(ValueError, x.snapshot_into, array.array('l', [0]))
+        self.assertRaises(BufferError, x.snapshot_into, b'\0' * 64)
+        self.assertRaises(TypeError, x.snapshot_into, array.array('d', [0] * 3))
+
+    def test_from_buffer(self):
+        buf = array.array('l', range(6))
+        x = atomic.IntegerArray.from_buffer(buf)
+        self.assertEqual(len(x), 6)
+        self.assertEqual(x[5], 5)
+        x.add_and_get(5, 10)
+        self.assertEqual(buf[5], 15)
+
+        y = atomic.IntegerArray.from_buffer(buf, 2, offset=buf.itemsize)
+        self.assertEqual(list(y), [1, 2])
+        y.set(-1, 20)
+        self.assertEqual(buf[2], 20)
+        self.assertEqual(len(atomic.IntegerArray.from_buffer(buf, 0)), 0)
+        self.assertRaises(RuntimeError, y.__init__, 2)
+
+        self.assertRaises(ValueError, atomic.IntegerArray.from_buffer, buf, 7)
+        self.assertRaises(ValueError, atomic.IntegerArray.from_buffer, buf,
+                          -1)
+        self.assertRaises(ValueError, atomic.IntegerArray.from_buffer, buf,
+                          1, 4)
+        self.assertRaises(TypeError, atomic.IntegerArray.from_buffer,
+                          bytes(8))
+
+    @unittest.skipUnless(hasattr(os, 'fork'), 'requires os.fork()')
+    def test_from_buffer_processes(self):
+        n = 10000
+        with mmap.mmap(-1, mmap.PAGESIZE) as m:
+            x = atomic.IntegerArray.from_buffer(m, 4)
+            pid = os.fork()
+            if pid == 0:
+                try:
+                    x.add_many(array.array('l', [0, 1, 2, 3] * n), 1)
+                finally:
+                    os._exit(0)
+            x.add_many(array.array('l', [3, 2, 1, 0] * n), 1)
+            os.waitpid(pid, 0)
+            self.assertEqual(list(x), [2 * n] * 4)
+            del x
+
+    def test_repr(self):
+        x = atomic.IntegerArray(2)
+        x.set(0, 3)
+        self.assertEqual(repr(x), 'atomic.IntegerArray([3, 0])')
+
+
+if __name__ == '__main__':
+    unittest.main()
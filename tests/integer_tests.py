@@ -1,3 +1,9 @@
+import mmap
+import os
+import struct
+import sys
+import threading
+import time
 import unittest
 
 import atomic
@@ -21,6 +27,35 @@ class TestAtomicInteger(unittest.TestCase):
         x = atomic.Integer(3)
         self.assertEqual(x.get(), 3)
 
+        x = atomic.Integer(x=4)
+        self.assertEqual(x.get(), 4)
+
+        self.assertRaises(TypeError, atomic.Integer, 1, 2)
+        self.assertRaises(TypeError, atomic.Integer, y=1)
+        self.assertRaises(TypeError, atomic.Integer, 'a')
+
+    def test_reuse(self):
+        # Freed integers are recycled; a recycled one must start afresh.
+        m = mmap.mmap(-1, mmap.PAGESIZE)
+        xs = [atomic.Integer(i) for i in range(1000)]
+        xs.append(atomic.Integer.from_buffer(m))
+        xs[-1].set(7)
+        del xs
+        xs = [atomic.Integer() for _ in range(1000)]
+        self.assertTrue(all(x.get() == 0 for x in xs))
+        xs[0].set(5)
+        self.assertEqual(struct.unpack_from('l', m)[0], 7)
+        m.close()
+
+    def test_arguments(self):
+        x = atomic.Integer()
+        self.assertRaises(TypeError, x.set)
+        self.assertRaises(TypeError, x.set, 1, 2)
+        self.assertRaises(TypeError, x.set, 'a')
+        self.assertRaises(TypeError, x.compare_and_set, 1)
+        self.assertRaises(OverflowError, x.add_and_get, 1 << 64)
+        self.assertEqual(x.get(), 0)
+
     def test_set(self):
         x = atomic.Integer()
         x.set(99)
@@ -57,6 +92,263 @@ class TestAtomicInteger(unittest.TestCase):
             self.assertEqual(x.get(), f(1, 2))
             self.assertEqual(ret, f(1, 2))
 
+    def test_update(self):
+        x = atomic.Integer(3)
+        self.assertEqual(x.update_and_get(lambda v: v * 2), 6)
+        self.assertEqual(x.get_and_update(lambda v: v - 1), 6)
+        self.assertEqual(x.get(), 5)
+        self.assertEqual(x.accumulate_and_get(4, lambda v, y: v * y), 20)
+        self.assertEqual(x.update_and_get(lambda v: v), 20)
+        self.assertEqual(x.update_and_get(lambda v: -v, order=atomic.RELAXED,
+                                          max_spin=0), -20)
+
+    def test_accumulate_builtins(self):
+        for f in (max, min, operator.add, operator.sub, operator.and_,
+                  operator.or_, operator.xor):
+            for a, b in ((5, 3), (3, 5), (-6, 12)):
+                x = atomic.Integer(a)
+                self.assertEqual(x.accumulate_and_get(b, f), f(a, b))
+                self.assertEqual(x.get(), f(a, b))
+        x = atomic.Integer(sys.maxsize)
+        self.assertRaises(OverflowError, x.accumulate_and_get, 1,
+                          operator.add)
+        self.assertRaises(OverflowError, x.accumulate_and_get, 2 ** 70, max)
+        self.assertEqual(x.accumulate_and_get(2 ** 70, min), sys.maxsize)
+        self.assertRaises(TypeError, x.accumulate_and_get, 2.5, min)
+        self.assertRaises(TypeError, x.accumulate_and_get, 'a', max)
+
+    def test_update_errors(self):
+        x = atomic.Integer(1)
+        self.assertRaises(ZeroDivisionError, x.update_and_get,
+                          lambda v: v // 0)
+        self.assertRaises(TypeError, x.update_and_get, lambda v: str(v))
+        self.assertRaises(OverflowError, x.update_and_get, lambda v: 2 ** 70)
+        self.assertRaises(TypeError, x.update_and_get, 1)
+        self.assertRaises(TypeError, x.update_and_get)
+        self.assertRaises(TypeError, x.accumulate_and_get, max)
+        self.assertRaises(ValueError, x.update_and_get, abs, max_spin=-1)
+        self.assertRaises(ValueError, x.update_and_get, abs, order=42)
+        self.assertRaises(TypeError, x.update_and_get, abs, spin=1)
+        self.assertEqual(x.get(), 1)
+
+    def test_update_threads(self):
+        for max_spin in (0, 128):
+            x = atomic.Integer()
+
+            def worker():
+                for _ in range(2000):
+                    x.update_and_get(lambda v: v + 1, max_spin=max_spin)
+                    x.accumulate_and_get(1, operator.add)
+
+            threads = [threading.Thread(target=worker) for _ in range(4)]
+            for t in threads:
+                t.start()
+            for t in threads:
+                t.join()
+            self.assertEqual(x.get(), 16000)
+
+    def test_order(self):
+        x = atomic.Integer(1)
+        for order in (atomic.RELAXED, atomic.ACQUIRE, atomic.SEQ_CST):
+            self.assertEqual(x.get(order=order), 1)
+        for order in (atomic.RELAXED, atomic.RELEASE, atomic.SEQ_CST):
+            x.set(2, order=order)
+            self.assertEqual(x.get(), 2)
+        for op, f in FETCH_OPS.items():
+            for order in (atomic.RELAXED, atomic.ACQUIRE, atomic.RELEASE,
+                          atomic.ACQ_REL, atomic.SEQ_CST):
+                x.set(1)
+                ret = getattr(x, '%s_and_get' % op)(2, order=order)
+                self.assertEqual(ret, f(1, 2))
+        x.set(1)
+        self.assertTrue(x.compare_and_set(1, 2, order=atomic.ACQ_REL))
+        self.assertTrue(x.compare_and_set(2, 3, order=atomic.RELEASE,
+                                          failure_order=atomic.RELAXED))
+        self.assertFalse(x.compare_and_set(1, 4, order=atomic.SEQ_CST,
+                                           failure_order=atomic.ACQUIRE))
+        self.assertEqual(x.get(), 3)
+
+    def test_order_errors(self):
+        x = atomic.Integer()
+        self.assertRaises(ValueError, x.get, order=atomic.RELEASE)
+        self.assertRaises(ValueError, x.get, order=atomic.ACQ_REL)
+        self.assertRaises(ValueError, x.set, 1, order=atomic.ACQUIRE)
+        self.assertRaises(ValueError, x.get_and_add, 1, order=42)
+        self.assertRaises(ValueError, x.compare_and_set, 0, 1,
+                          order=atomic.RELAXED, failure_order=atomic.ACQUIRE)
+        self.assertRaises(ValueError, x.compare_and_set, 0, 1,
+                          failure_order=atomic.RELEASE)
+        self.assertRaises(TypeError, x.get, order='relaxed')
+        self.assertRaises(TypeError, x.get, ordering=atomic.RELAXED)
+        self.assertRaises(TypeError, x.set, 1, failure_order=atomic.RELAXED)
+        self.assertEqual(x.get(), 0)
+
+    def test_inplace(self):
+        ops = {'add': operator.iadd, 'sub': operator.isub,
+               'and': operator.iand, 'xor': operator.ixor,
+               'or': operator.ior}
+        for op, f in ops.items():
+            x = atomic.Integer(6)
+            y = x
+            y = f(y, 3)
+            self.assertIs(y, x)
+            self.assertEqual(x.get(), FETCH_OPS[op](6, 3))
+
+        x = atomic.Integer()
+        x += True
+        self.assertEqual(x.get(), 1)
+        with self.assertRaises(TypeError):
+            x += 1.5
+        with self.assertRaises(OverflowError):
+            x += 1 << 64
+        self.assertEqual(x.get(), 1)
+
+    def test_index(self):
+        x = atomic.Integer(2)
+        self.assertEqual(int(x), 2)
+        self.assertIs(type(int(x)), int)
+        self.assertEqual(operator.index(x), 2)
+        self.assertEqual('abcd'[x], 'c')
+        self.assertEqual(atomic.Integer(x).get(), 2)
+
+    def test_richcompare(self):
+        x = atomic.Integer(2)
+        self.assertTrue(x == 2)
+        self.assertTrue(2 == x)
+        self.assertTrue(x != 3)
+        self.assertTrue(x < 3 and x <= 2 and x > 1 and x >= 2)
+        self.assertTrue(x == atomic.Integer(2))
+        self.assertTrue(x < atomic.Integer(3))
+        self.assertTrue(x == 2.0)
+        self.assertTrue(x < 1 << 100)
+        self.assertTrue(x > -(1 << 100))
+        self.assertFalse(x == 'a')
+        self.assertRaises(TypeError, operator.lt, x, 'a')
+        self.assertRaises(TypeError, hash, x)
+
+    def test_from_buffer(self):
+        buf = bytearray(3 * struct.calcsize('l'))
+        struct.pack_into('l', buf, 8, 41)
+        x = atomic.Integer.from_buffer(buf, 8)
+        self.assertEqual(x.get(), 41)
+        x += 1
+        self.assertEqual(struct.unpack_from('l', buf, 8), (42,))
+        y = atomic.Integer.from_buffer(buf, offset=8)
+        self.assertTrue(y.compare_and_set(42, 7))
+        self.assertEqual(x.get(), 7)
+        self.assertEqual(atomic.Integer.from_buffer(buf).get(), 0)
+
+        self.assertRaises(BufferError, buf.append, 0)
+        del x, y
+        buf.append(0)
+
+    def test_from_buffer_errors(self):
+        buf = bytearray(16)
+        self.assertRaises(ValueError, atomic.Integer.from_buffer, buf, 9)
+        self.assertRaises(ValueError, atomic.Integer.from_buffer, buf, 16)
+        self.assertRaises(ValueError, atomic.Integer.from_buffer, buf, -8)
+        self.assertRaises(ValueError, atomic.Integer.from_buffer, buf, 3)
+        self.assertRaises(TypeError, atomic.Integer.from_buffer, bytes(16))
+        self.assertRaises(TypeError, atomic.Integer.from_buffer, 1)
+        self.assertRaises(ValueError, atomic.Integer.from_buffer,
+                          memoryview(buf)[::2])
+
+    @unittest.skipUnless(hasattr(os, 'fork'), 'requires os.fork()')
+    def test_from_buffer_processes(self):
+        n = 10000
+        with mmap.mmap(-1, mmap.PAGESIZE) as m:
+            x = atomic.Integer.from_buffer(m)
+            pid = os.fork()
+            if pid == 0:
+                try:
+                    for _ in range(n):
+                        x += 1
+                finally:
+                    os._exit(0)
+            for _ in range(n):
+                x += 1
+            os.waitpid(pid, 0)
+            self.assertEqual(x.get(), 2 * n)
+            del x
+
+    def test_wait(self):
+        x = atomic.Integer(1)
+        self.assertTrue(x.wait(0))
+        self.assertFalse(x.wait(1, 0))
+        start = time.monotonic()
+        self.assertFalse(x.wait(1, timeout=0.05))
+        self.assertGreaterEqual(time.monotonic() - start, 0.04)
+        x.notify_one()
+        x.notify_all()
+
+        self.assertRaises(TypeError, x.wait)
+        self.assertRaises(TypeError, x.wait, 1, 0, 0)
+        self.assertRaises(TypeError, x.wait, 1, 0, timeout=0)
+        self.assertRaises(ValueError, x.wait, 1, -1)
+        self.assertRaises(ValueError, x.wait, 1, 0, order=atomic.RELEASE)
+
+    def test_wait_notify(self):
+        x = atomic.Integer()
+        seen = []
+
+        def waiter():
+            seen.append(x.wait(0, timeout=10))
+
+        threads = [threading.Thread(target=waiter) for _ in range(4)]
+        for t in threads:
+            t.start()
+        time.sleep(0.05)
+        x.set(1)
+        x.notify_all()
+        for t in threads:
+            t.join()
+        self.assertEqual(seen, [True] * 4)
+
+        # A change confined to the high bits still wakes on notify.
+        x.set(0)
+        t = threading.Thread(target=waiter)
+        t.start()
+        time.sleep(0.05)
+        x.set(1 << 40)
+        x.notify_one()
+        t.join()
+        self.assertEqual(seen[-1], True)
+
+    def test_wait_notify_high_bits(self):
+        # A store that leaves the low 32 bits alone, racing with the waiter
+        # going to sleep, must not lose the notify that follows it.
+        with mmap.mmap(-1, mmap.PAGESIZE) as m:
+            for x in (atomic.Integer(), atomic.Integer.from_buffer(m)):
+                for i in range(200):
+                    x.set(0)
+                    seen = []
+                    t = threading.Thread(
+                        target=lambda: seen.append(x.wait(0, timeout=5)))
+                    t.start()
+                    start = time.monotonic()
+                    x.set(1 << 32)
+                    x.notify_all()
+                    t.join()
+                    self.assertEqual(seen, [True])
+                    self.assertLess(time.monotonic() - start, 1)
+                del x
+
+    @unittest.skipUnless(hasattr(os, 'fork'), 'requires os.fork()')
+    def test_wait_processes(self):
+        with mmap.mmap(-1, mmap.PAGESIZE) as m:
+            x = atomic.Integer.from_buffer(m)
+            pid = os.fork()
+            if pid == 0:
+                try:
+                    time.sleep(0.05)
+                    x.set(1)
+                    x.notify_all()
+                finally:
+                    os._exit(0)
+            self.assertTrue(x.wait(0, timeout=10))
+            os.waitpid(pid, 0)
+            del x
+
 
 if __name__ == '__main__':
     unittest.main()
@@ -1,3 +1,4 @@
+import sys
 import unittest
 
 import atomic
@@ -77,12 +78,60 @@ class TestAtomicMarkableReference(unittest.TestCase):
         self.assertIs(o.get_reference(), d2)
         self.assertIsNot(o.get_reference(), d3)
     
+    def test_compare_and_set_is_atomic(self):
+        d1 = {}
+        d2 = {}
+        o = atomic.MarkableReference(d1, True)
+        refcount = sys.getrefcount(d2)
+
+        # Matching reference but mismatched mark must not swap the reference.
+        ret = o.compare_and_set(d1, d2, False, False)
+        self.assertFalse(ret)
+        self.assertEqual(o.get(), (d1, True))
+        self.assertEqual(sys.getrefcount(d2), refcount)
+
+        ret = o.compare_and_set(d1, d2, True, False)
+        self.assertTrue(ret)
+        self.assertEqual(o.get(), (d2, False))
+        self.assertEqual(sys.getrefcount(d2), refcount + 1)
+
+        o.set(None, False)
+        self.assertEqual(sys.getrefcount(d2), refcount)
+
     def test_attempt_mark(self):
         d = {}
         o = atomic.MarkableReference(d)
         self.assertFalse(o.is_marked())
-        o.attempt_mark(False, True)
+        self.assertTrue(o.attempt_mark(False, True))
+        self.assertTrue(o.is_marked())
+        self.assertIs(o.get_reference(), d)
+        self.assertFalse(o.attempt_mark(False, True))
         self.assertTrue(o.is_marked())
+        self.assertTrue(o.attempt_mark(True, False))
+        self.assertEqual(o.get(), (d, False))
+        self.assertFalse(o.attempt_mark(True, True))
+        self.assertTrue(o.attempt_mark(False, False))
+
+    def test_order(self):
+        d = {}
+        o = atomic.MarkableReference()
+        o.set(d, True, order=atomic.RELEASE)
+        self.assertEqual(o.get(order=atomic.ACQUIRE), (d, True))
+        self.assertIs(o.get_reference(order=atomic.RELAXED), d)
+        self.assertTrue(o.is_marked(order=atomic.RELAXED))
+        self.assertTrue(o.attempt_mark(True, False, order=atomic.ACQ_REL))
+        self.assertTrue(o.compare_and_set(d, None, False, True,
+                                          order=atomic.RELAXED))
+        self.assertEqual(o.get(), (None, True))
+        self.assertRaises(ValueError, o.is_marked, order=atomic.RELEASE)
+        self.assertRaises(ValueError, o.compare_and_set, None, d, True, False,
+                          order=atomic.RELEASE, failure_order=atomic.ACQUIRE)
+        self.assertRaises(TypeError, o.get, 1)
+        self.assertEqual(o.get(), (None, True))
+
+    def test_repr(self):
+        o = atomic.MarkableReference(None, True)
+        self.assertEqual(repr(o), 'atomic.MarkableReference(None, True)')
         
     def test_reference_cycle(self):
         o = atomic.MarkableReference()
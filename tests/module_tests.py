@@ -0,0 +1,107 @@
+import sys
+import sysconfig
+import threading
+import unittest
+
+import atomic
+
+TYPES = ('Integer', 'Int8', 'Int16', 'Int32', 'Int64', 'UInt8', 'UInt16',
+         'UInt32', 'UInt64', 'IntegerArray', 'Float', 'CompensatedFloat',
+         'Bitset', 'Sequence', 'Record', 'OrderedSet', 'CounterMap', 'Adder',
+         'Reference', 'MarkableReference', 'StampedReference', 'BoundedQueue',
+         'Stack', 'ObjectPool')
+
+# Types that never compare-and-swap, so have no stats().
+UNCOUNTED = ('Sequence',)
+COUNTED = tuple(name for name in TYPES if name not in UNCOUNTED)
+
+STATS = {'cas', 'cas_failed', 'cas_spurious', 'retries'}
+
+# Built with ATOMIC_STATS=1?
+HAVE_STATS = atomic.contention_stats() is not None
+
+
+class TestAtomicModule(unittest.TestCase):
+    def test_types(self):
+        for name in TYPES:
+            tp = getattr(atomic, name)
+            self.assertIsInstance(tp, type)
+            self.assertEqual(tp.__module__, 'atomic')
+            self.assertEqual(tp.__name__, name)
+
+    def test_stats_method(self):
+        for name in COUNTED:
+            self.assertTrue(callable(getattr(atomic, name).stats))
+        stats = atomic.Integer().stats()
+        if HAVE_STATS:
+            self.assertEqual(stats, dict.fromkeys(STATS, 0))
+        else:
+            self.assertIsNone(stats)
+
+    @unittest.skipUnless(HAVE_STATS, 'requires a build with ATOMIC_STATS=1')
+    def test_stats_count_cas(self):
+        before = atomic.contention_stats()['Reference']
+        obj = object()
+        r = atomic.Reference(obj)
+        self.assertFalse(r.compare_and_set(None, obj))
+        self.assertTrue(r.compare_and_set(obj, None))
+        self.assertEqual(r.stats(), {'cas': 2, 'cas_failed': 1,
+                                     'cas_spurious': 0, 'retries': 0})
+        after = atomic.contention_stats()['Reference']
+        self.assertEqual(after['cas'] - before['cas'], 2)
+        self.assertEqual(after['cas_failed'] - before['cas_failed'], 1)
+
+    @unittest.skipUnless(HAVE_STATS, 'requires a build with ATOMIC_STATS=1')
+    def test_contention_stats_threads(self):
+        def work():
+            a = atomic.Integer()
+            for _ in range(100):
+                a.compare_and_set(1, 2)
+
+        before = atomic.contention_stats()['Integer']['cas_failed']
+        threads = [threading.Thread(target=work) for _ in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        # Threads that exit keep their counts in the totals.
+        stats = atomic.contention_stats()
+        self.assertEqual(set(stats), set(COUNTED) | {'Int128'})
+        self.assertEqual(stats['Integer']['cas_failed'] - before, 400)
+
+    @unittest.skipUnless(HAVE_STATS, 'requires a build with ATOMIC_STATS=1')
+    def test_stats_per_object_threads(self):
+        # Each thread counts separately; stats() sums them per object.
+        shared = atomic.Integer()
+        others = [atomic.Integer() for _ in range(200)]
+
+        def work():
+            for other in others:
+                shared.compare_and_set(1, 2)
+                other.compare_and_set(1, 2)
+
+        threads = [threading.Thread(target=work) for _ in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(shared.stats()['cas_failed'], 800)
+        self.assertEqual(others[-1].stats()['cas_failed'], 4)
+
+        # A new object never inherits counts, even in reused memory.
+        del others
+        self.assertEqual(atomic.Integer().stats(), dict.fromkeys(STATS, 0))
+
+    @unittest.skipIf(HAVE_STATS, 'requires a build without ATOMIC_STATS')
+    def test_contention_stats_disabled(self):
+        self.assertIsNone(atomic.contention_stats())
+
+    @unittest.skipUnless(sysconfig.get_config_var('Py_GIL_DISABLED'),
+                         'requires a free-threaded build')
+    def test_gil_not_enabled(self):
+        # Importing the module must not turn the GIL back on.
+        self.assertFalse(sys._is_gil_enabled())
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,140 @@
+import random
+import sys
+import threading
+import unittest
+
+import atomic
+
+
+class TestAtomicOrderedSet(unittest.TestCase):
+    def test_init(self):
+        s = atomic.OrderedSet()
+        self.assertEqual(len(s), 0)
+        self.assertEqual(list(s), [])
+        self.assertEqual(repr(s), 'atomic.OrderedSet([])')
+        s = atomic.OrderedSet([5, -1, 3, 5])
+        self.assertEqual(list(s), [-1, 3, 5])
+        self.assertEqual(len(s), 3)
+        self.assertEqual(repr(s), 'atomic.OrderedSet([-1, 3, 5])')
+        self.assertRaises(TypeError, atomic.OrderedSet, [1, 'a'])
+        self.assertRaises(TypeError, atomic.OrderedSet, 5)
+
+    def test_add_discard(self):
+        s = atomic.OrderedSet()
+        self.assertTrue(s.add(2))
+        self.assertFalse(s.add(2))
+        self.assertTrue(s.add(1))
+        self.assertTrue(s.discard(2))
+        self.assertFalse(s.discard(2))
+        self.assertFalse(s.discard(7))
+        self.assertEqual(list(s), [1])
+        self.assertRaises(TypeError, s.add, 1.5)
+        self.assertRaises(OverflowError, s.add, 2 ** 70)
+
+    def test_contains(self):
+        s = atomic.OrderedSet([1, 10, 100])
+        self.assertIn(10, s)
+        self.assertNotIn(11, s)
+        self.assertNotIn('a', s)
+        self.assertNotIn(1.5, s)
+        self.assertNotIn(2 ** 70, s)
+
+    def test_extremes(self):
+        keys = [-sys.maxsize - 1, -1, 0, sys.maxsize]
+        s = atomic.OrderedSet(reversed(keys))
+        self.assertEqual(list(s), keys)
+        self.assertEqual(s.range(sys.maxsize), [sys.maxsize])
+        self.assertEqual(s.range(hi=-sys.maxsize - 1), [])
+        self.assertEqual(s.range(hi=-sys.maxsize), [-sys.maxsize - 1])
+
+    def test_range(self):
+        s = atomic.OrderedSet(range(0, 100, 10))
+        self.assertEqual(s.range(), list(range(0, 100, 10)))
+        self.assertEqual(s.range(15, 55), [20, 30, 40, 50])
+        self.assertEqual(s.range(20, 50), [20, 30, 40])
+        self.assertEqual(s.range(lo=85), [90])
+        self.assertEqual(s.range(None, 15), [0, 10])
+        self.assertEqual(s.range(50, 50), [])
+        self.assertEqual(s.range(60, 10), [])
+        self.assertRaises(TypeError, s.range, 'a')
+        self.assertRaises(TypeError, s.range, 1, 2, 3)
+        self.assertRaises(TypeError, s.range, low=1)
+
+    def test_random(self):
+        rng = random.Random(1)
+        s = atomic.OrderedSet()
+        model = set()
+        for _ in range(3000):
+            key = rng.randrange(-50, 50)
+            if rng.random() < 0.5:
+                self.assertEqual(s.add(key), key not in model)
+                model.add(key)
+            else:
+                self.assertEqual(s.discard(key), key in model)
+                model.discard(key)
+        self.assertEqual(list(s), sorted(model))
+        self.assertEqual(len(s), len(model))
+
+    def test_threads(self):
+        s = atomic.OrderedSet(range(0, 1000, 2))
+        added = [0] * 4
+        removed = [0] * 4
+
+        def worker(i):
+            rng = random.Random(i)
+            for _ in range(3000):
+                key = rng.randrange(1000)
+                if rng.random() < 0.5:
+                    added[i] += s.add(key)
+                else:
+                    removed[i] += s.discard(key)
+                snapshot = s.range(200, 300)
+                assert snapshot == sorted(set(snapshot)), snapshot
+
+        threads = [threading.Thread(target=worker, args=(i,))
+                   for i in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+
+        keys = list(s)
+        self.assertEqual(keys, sorted(set(keys)))
+        self.assertEqual(len(keys), 500 + sum(added) - sum(removed))
+        self.assertEqual(len(s), len(keys))
+
+    def test_stable_keys_while_updating(self):
+        # Keys that are never touched must show up in every pass.
+        s = atomic.OrderedSet(range(0, 1000, 10))
+        stop = threading.Event()
+        missing = []
+
+        def writer():
+            rng = random.Random(2)
+            while not stop.is_set():
+                key = rng.randrange(1000)
+                if key % 10:
+                    s.add(key)
+                    s.discard(key)
+
+        def reader():
+            for _ in range(200):
+                if not set(range(0, 1000, 10)) <= set(s):
+                    missing.append(True)
+
+        threads = [threading.Thread(target=writer) for _ in range(2)]
+        for t in threads:
+            t.start()
+        readers = [threading.Thread(target=reader) for _ in range(2)]
+        for t in readers:
+            t.start()
+        for t in readers:
+            t.join()
+        stop.set()
+        for t in threads:
+            t.join()
+        self.assertEqual(missing, [])
+
+
+if __name__ == '__main__':
+    unittest.main()
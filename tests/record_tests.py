@@ -0,0 +1,83 @@
+import array
+import threading
+import unittest
+
+import atomic
+
+
+class TestAtomicRecord(unittest.TestCase):
+    def test_init(self):
+        r = atomic.Record(3)
+        self.assertEqual(len(r), 3)
+        self.assertEqual(r.read(), (0, 0, 0))
+        self.assertEqual(repr(r), 'atomic.Record((0, 0, 0))')
+        self.assertEqual(atomic.Record(fields=0).read(), ())
+        self.assertRaises(ValueError, atomic.Record, -1)
+        self.assertRaises(TypeError, atomic.Record)
+        self.assertRaises(TypeError, atomic.Record, 'a')
+        self.assertRaises(RuntimeError, r.__init__, 2)
+
+    def test_write(self):
+        r = atomic.Record(4)
+        r.write(1, -2, 3, 2 ** 40)
+        self.assertEqual(r.read(), (1, -2, 3, 2 ** 40))
+        self.assertRaises(TypeError, r.write, 1, 2, 3)
+        self.assertRaises(TypeError, r.write, 1, 2, 3, 4, 5)
+        self.assertRaises(TypeError, r.write, 1, 2, 3, 'a')
+        self.assertRaises(OverflowError, r.write, 1, 2, 3, 2 ** 70)
+        self.assertEqual(r.read(), (1, -2, 3, 2 ** 40))
+
+    def test_large(self):
+        r = atomic.Record(100)
+        r.write(*range(100))
+        self.assertEqual(r.read(), tuple(range(100)))
+
+    def test_read_into(self):
+        r = atomic.Record(3)
+        r.write(7, 8, 9)
+        buf = array.array('l', [0] * 4)
+        r.read_into(buf)
+        self.assertEqual(buf.tolist(), [7, 8, 9, 0])
+        raw = bytearray(3 * buf.itemsize + 1)
+        r.read_into(memoryview(raw)[1:])
+        self.assertEqual(array.array('l', raw[1:]).tolist(), [7, 8, 9])
+        self.assertRaises(ValueError, r.read_into, array.array('l', [0] * 2))
+        self.assertRaises(BufferError, r.read_into, b'x' * 64)
+
+    def test_threads(self):
+        # Every field of a write holds the same value, so a torn read would
+        # show up as a snapshot with differing fields.
+        r = atomic.Record(8)
+        stop = threading.Event()
+        torn = []
+
+        def writer(base):
+            for i in range(2000):
+                r.write(*([base + i] * 8))
+
+        def reader():
+            buf = array.array('l', [0] * 8)
+            while not stop.is_set():
+                snapshot = r.read()
+                if len(set(snapshot)) != 1:
+                    torn.append(snapshot)
+                r.read_into(buf)
+                if len(set(buf)) != 1:
+                    torn.append(tuple(buf))
+
+        readers = [threading.Thread(target=reader) for _ in range(3)]
+        writers = [threading.Thread(target=writer, args=(i * 10000,))
+                   for i in range(2)]
+        for t in readers + writers:
+            t.start()
+        for t in writers:
+            t.join()
+        stop.set()
+        for t in readers:
+            t.join()
+        self.assertEqual(torn, [])
+        self.assertIn(r.read()[0], (1999, 11999))
+
+
+if __name__ == '__main__':
+    unittest.main()
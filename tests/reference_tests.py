@@ -1,4 +1,8 @@
+import gc
+import sys
+import threading
 import unittest
+import weakref
 
 import atomic
 
@@ -12,6 +16,23 @@ class TestAtomicReference(unittest.TestCase):
         o = atomic.Reference(d)
         self.assertIs(o.get(), d)
 
+    def test_init_arguments(self):
+        d = {}
+        self.assertIs(atomic.Reference(obj=d).get(), d)
+        self.assertRaises(TypeError, atomic.Reference, 1, 2)
+        self.assertRaises(TypeError, atomic.Reference, x=1)
+        self.assertRaises(TypeError, atomic.Reference, d, obj=d)
+
+    def test_reuse(self):
+        # Freed references are recycled without leaking what they held.
+        d = {}
+        refcount = sys.getrefcount(d)
+        rs = [atomic.Reference(d) for _ in range(1000)]
+        del rs
+        self.assertEqual(sys.getrefcount(d), refcount)
+        rs = [atomic.Reference() for _ in range(1000)]
+        self.assertTrue(all(r.get() is None for r in rs))
+
     def test_set(self):
         d = {}
         o = atomic.Reference()
@@ -40,11 +61,138 @@ class TestAtomicReference(unittest.TestCase):
         self.assertFalse(ret)
         self.assertIs(o.get(), d2)
 
+    def test_order(self):
+        d1 = {}
+        d2 = {}
+        o = atomic.Reference(d1)
+        self.assertIs(o.get(order=atomic.ACQUIRE), d1)
+        o.set(d2, order=atomic.RELAXED)
+        self.assertIs(o.get(order=atomic.RELAXED), d2)
+        self.assertIs(o.get_and_set(d1, order=atomic.ACQ_REL), d2)
+        self.assertTrue(o.compare_and_set(d1, d2, order=atomic.RELEASE,
+                                          failure_order=atomic.RELAXED))
+        self.assertFalse(o.weak_compare_and_set(d1, d2, order=atomic.ACQUIRE))
+        self.assertIs(o.get(), d2)
+        self.assertRaises(ValueError, o.get, order=atomic.RELEASE)
+        self.assertRaises(ValueError, o.set, d1, order=atomic.ACQUIRE)
+        self.assertRaises(TypeError, o.set, d1, ordering=atomic.RELAXED)
+        self.assertIs(o.get(), d2)
+
+    def test_compare_and_set_refcount(self):
+        d1 = {}
+        d2 = {}
+        o = atomic.Reference(d1)
+        refcounts = sys.getrefcount(d1), sys.getrefcount(d2)
+
+        self.assertFalse(o.compare_and_set(d2, d2))
+        self.assertFalse(o.weak_compare_and_set(d2, d2))
+        self.assertEqual((sys.getrefcount(d1), sys.getrefcount(d2)), refcounts)
+
+        self.assertTrue(o.compare_and_set(d1, d2))
+        self.assertEqual(sys.getrefcount(d1), refcounts[0] - 1)
+        self.assertEqual(sys.getrefcount(d2), refcounts[1] + 1)
+
+    def test_update(self):
+        o = atomic.Reference((1,))
+        self.assertEqual(o.update_and_get(lambda t: t + (2,)), (1, 2))
+        self.assertEqual(o.get_and_update(lambda t: t[1:]), (1, 2))
+        self.assertEqual(o.get(), (2,))
+        self.assertEqual(o.accumulate_and_get(3, lambda t, x: t * x),
+                         (2, 2, 2))
+        obj = o.get()
+        self.assertIs(o.update_and_get(lambda t: t, max_spin=0), obj)
+        self.assertRaises(ZeroDivisionError, o.update_and_get,
+                          lambda t: 1 / 0)
+        self.assertRaises(TypeError, o.accumulate_and_get, len)
+        self.assertRaises(ValueError, o.update_and_get, len, max_spin=-1)
+        self.assertIs(o.get(), obj)
+
+    def test_update_refcount(self):
+        d1 = {}
+        d2 = {}
+        o = atomic.Reference(d1)
+        refcounts = sys.getrefcount(d1), sys.getrefcount(d2)
+
+        self.assertIs(o.update_and_get(lambda d: d), d1)
+        self.assertEqual((sys.getrefcount(d1), sys.getrefcount(d2)), refcounts)
+
+        self.assertIs(o.get_and_update(lambda d: d2), d1)
+        self.assertEqual(sys.getrefcount(d1), refcounts[0] - 1)
+        self.assertEqual(sys.getrefcount(d2), refcounts[1] + 1)
+
+    def test_update_threads(self):
+        o = atomic.Reference(())
+
+        def worker(i):
+            for j in range(1000):
+                o.update_and_get(lambda t: t + ((i, j),))
+
+        threads = [threading.Thread(target=worker, args=(i,))
+                   for i in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(sorted(o.get()),
+                         [(i, j) for i in range(4) for j in range(1000)])
+
+    def test_concurrent_get_and_set(self):
+        configs = [{'generation': i} for i in range(4)]
+        refcounts = [sys.getrefcount(c) for c in configs]
+        o = atomic.Reference({'generation': -1})
+        stop = threading.Event()
+        errors = []
+
+        def reader():
+            try:
+                while not stop.is_set():
+                    self.assertIsInstance(o.get()['generation'], int)
+            except BaseException as e:
+                errors.append(e)
+
+        def writer():
+            try:
+                for i in range(20000):
+                    # Fresh objects, dropped at once, are freed as soon as
+                    # the last reader lets go of them.
+                    old = o.get_and_set({'generation': i})
+                    self.assertIsInstance(old['generation'], int)
+                    del old
+                    o.set(configs[i % len(configs)])
+                    o.get_and_set({'generation': i})
+            except BaseException as e:
+                errors.append(e)
+            finally:
+                stop.set()
+
+        threads = [threading.Thread(target=reader) for _ in range(4)]
+        threads.append(threading.Thread(target=writer))
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(errors, [])
+
+        o.set(None)
+        o.get()
+        self.assertEqual([sys.getrefcount(c) for c in configs], refcounts)
+
     def test_reference_cycle(self):
         o = atomic.Reference()
         o.set(o)
         del o
 
+    def test_reference_cycle_collected(self):
+        class Node:
+            pass
+
+        n = Node()
+        n.ref = atomic.Reference(n)
+        wr = weakref.ref(n)
+        del n
+        gc.collect()
+        self.assertIsNone(wr())
+
 
 if __name__ == '__main__':
     unittest.main()
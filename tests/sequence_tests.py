@@ -0,0 +1,119 @@
+import itertools
+import sys
+import threading
+import unittest
+
+import atomic
+
+
+class TestAtomicSequence(unittest.TestCase):
+    def test_init(self):
+        s = atomic.Sequence()
+        self.assertEqual(s.get(), 0)
+        self.assertEqual(repr(s), 'atomic.Sequence(0)')
+        self.assertEqual(atomic.Sequence(-5).next(), -5)
+        self.assertEqual(atomic.Sequence(start=7, max_block=1).next(), 7)
+        self.assertRaises(ValueError, atomic.Sequence, max_block=0)
+        self.assertRaises(TypeError, atomic.Sequence, 0, 16)
+        self.assertRaises(TypeError, atomic.Sequence, 'a')
+        self.assertRaises(RuntimeError, s.__init__, 3)
+
+    def test_uninitialized(self):
+        s = atomic.Sequence.__new__(atomic.Sequence)
+        self.assertRaises(RuntimeError, s.next)
+        self.assertRaises(RuntimeError, s.next_n, 2)
+
+    def test_next(self):
+        # A single thread sees no contention and gets every ID in order.
+        s = atomic.Sequence(10)
+        self.assertEqual([s.next() for _ in range(100)],
+                         list(range(10, 110)))
+        self.assertEqual(s.get(), 110)
+
+    def test_next_n(self):
+        s = atomic.Sequence()
+        self.assertEqual(s.next_n(3), range(0, 3))
+        self.assertEqual(s.next(), 3)
+        self.assertEqual(s.next_n(0), range(4, 4))
+        self.assertEqual(s.next_n(5000), range(4, 5004))
+        self.assertEqual(s.next(), 5004)
+        self.assertRaises(ValueError, s.next_n, -1)
+        self.assertRaises(TypeError, s.next_n, 'a')
+
+    def test_negative_start(self):
+        s = atomic.Sequence(-5)
+        self.assertEqual(s.next(), -5)
+        self.assertEqual(s.next_n(3), range(-4, -1))
+        self.assertEqual(s.next(), -1)
+
+    def test_iter(self):
+        s = atomic.Sequence(3)
+        self.assertIs(iter(s), s)
+        self.assertEqual(list(itertools.islice(s, 4)), [3, 4, 5, 6])
+
+    def test_exhausted(self):
+        # The largest C long is the last ID handed out.
+        s = atomic.Sequence(sys.maxsize - 2)
+        self.assertEqual(s.next(), sys.maxsize - 2)
+        self.assertEqual(s.next(), sys.maxsize - 1)
+        self.assertEqual(s.next(), sys.maxsize)
+        self.assertRaises(OverflowError, s.next)
+        self.assertRaises(OverflowError, s.next)
+
+        s = atomic.Sequence(sys.maxsize)
+        self.assertEqual(s.next(), sys.maxsize)
+        self.assertRaises(OverflowError, s.next)
+
+        s = atomic.Sequence(1)
+        self.assertEqual(s.next_n(sys.maxsize), range(1, sys.maxsize + 1))
+        self.assertRaises(OverflowError, s.next_n, 1)
+        self.assertRaises(OverflowError, atomic.Sequence(2).next_n,
+                          sys.maxsize)
+
+        # IDs left when a batch does not fit are still handed out.
+        s = atomic.Sequence(sys.maxsize - 3)
+        self.assertRaises(OverflowError, s.next_n, 10)
+        self.assertEqual(s.next_n(2), range(sys.maxsize - 3, sys.maxsize - 1))
+        self.assertEqual([s.next(), s.next()], [sys.maxsize - 1, sys.maxsize])
+        self.assertRaises(OverflowError, s.next)
+
+    def test_many_sequences(self):
+        # More sequences than cache slots, used alternately by one thread.
+        seqs = [atomic.Sequence(i * 1000) for i in range(40)]
+        seen = [[] for _ in seqs]
+        for _ in range(20):
+            for i, s in enumerate(seqs):
+                seen[i].append(s.next())
+        for i, ids in enumerate(seen):
+            self.assertEqual(len(set(ids)), len(ids))
+            self.assertEqual(ids, sorted(ids))
+            self.assertGreaterEqual(ids[0], i * 1000)
+
+    def test_threads(self):
+        s = atomic.Sequence(max_block=64)
+        results = []
+
+        def worker():
+            ids = []
+            for i in range(2000):
+                if i % 10 == 0:
+                    ids.extend(s.next_n(3))
+                else:
+                    ids.append(s.next())
+            results.append(ids)
+
+        threads = [threading.Thread(target=worker) for _ in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+
+        all_ids = [i for ids in results for i in ids]
+        self.assertEqual(len(all_ids), len(set(all_ids)))
+        for ids in results:
+            self.assertEqual(ids, sorted(ids))
+        self.assertGreater(s.get(), max(all_ids))
+
+
+if __name__ == '__main__':
+    unittest.main()
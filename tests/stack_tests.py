@@ -0,0 +1,187 @@
+import gc
+import importlib.util
+import sys
+import threading
+import unittest
+import weakref
+
+import atomic
+
+
+class TestAtomicStack(unittest.TestCase):
+    def test_init(self):
+        s = atomic.Stack()
+        self.assertEqual(len(s), 0)
+        self.assertRaises(IndexError, s.pop)
+        s = atomic.Stack([1, 2, 3])
+        self.assertEqual(len(s), 3)
+        self.assertEqual(s.pop(), 3)
+        self.assertRaises(TypeError, atomic.Stack, 5)
+
+    def test_push_pop(self):
+        s = atomic.Stack()
+        a, b = object(), object()
+        s.push(a)
+        s.push(b)
+        self.assertIs(s.pop(), b)
+        self.assertIs(s.pop(), a)
+        self.assertIsNone(s.pop(None))
+        self.assertEqual(s.pop('empty'), 'empty')
+        self.assertRaises(TypeError, s.pop, 1, 2)
+
+    def test_pop_all(self):
+        s = atomic.Stack(range(5))
+        self.assertEqual(s.pop_all(), [4, 3, 2, 1, 0])
+        self.assertEqual(len(s), 0)
+        self.assertEqual(s.pop_all(), [])
+
+    def test_refcount(self):
+        obj = object()
+        refcount = sys.getrefcount(obj)
+        s = atomic.Stack()
+        s.push(obj)
+        s.push(obj)
+        self.assertEqual(sys.getrefcount(obj), refcount + 2)
+        s.pop()
+        self.assertEqual(sys.getrefcount(obj), refcount + 1)
+        del s
+        self.assertEqual(sys.getrefcount(obj), refcount)
+
+    def test_reference_cycle_collected(self):
+        class Node:
+            pass
+
+        n = Node()
+        n.stack = atomic.Stack([n])
+        wr = weakref.ref(n)
+        del n
+        gc.collect()
+        self.assertIsNone(wr())
+
+    def test_threads(self):
+        s = atomic.Stack()
+        popped = [[] for _ in range(4)]
+
+        def worker(i):
+            for j in range(2000):
+                s.push((i, j))
+                if j % 3 == 0:
+                    popped[i].append(s.pop())
+                if j % 500 == 0:
+                    popped[i].extend(s.pop_all())
+
+        threads = [threading.Thread(target=worker, args=(i,))
+                   for i in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+
+        items = [x for p in popped for x in p] + s.pop_all()
+        self.assertEqual(sorted(items),
+                         [(i, j) for i in range(4) for j in range(2000)])
+        self.assertEqual(len(s), 0)
+
+
+class TestAtomicObjectPool(unittest.TestCase):
+    def test_init(self):
+        pool = atomic.ObjectPool(list, 2)
+        self.assertEqual(len(pool), 0)
+        self.assertRaises(TypeError, atomic.ObjectPool, 1, 2)
+        self.assertRaises(ValueError, atomic.ObjectPool, list, -1)
+        self.assertRaises(TypeError, atomic.ObjectPool, list)
+        self.assertRaises(RuntimeError, pool.__init__, list, 2)
+        pool = atomic.ObjectPool.__new__(atomic.ObjectPool)
+        self.assertRaises(RuntimeError, pool.acquire)
+
+    def test_acquire_release(self):
+        created = []
+
+        def factory():
+            created.append(bytearray(16))
+            return created[-1]
+
+        pool = atomic.ObjectPool(factory, max_size=2)
+        a = pool.acquire()
+        b = pool.acquire()
+        c = pool.acquire()
+        self.assertEqual(len(created), 3)
+        pool.release(a)
+        pool.release(b)
+        pool.release(c)
+        self.assertEqual(len(pool), 2)
+        self.assertIs(pool.acquire(), b)
+        self.assertIs(pool.acquire(), a)
+        pool.acquire()
+        self.assertEqual(len(created), 4)
+        pool.release(a)
+        pool.clear()
+        self.assertEqual(len(pool), 0)
+
+    def test_factory_error(self):
+        pool = atomic.ObjectPool(lambda: 1 / 0, 4)
+        self.assertRaises(ZeroDivisionError, pool.acquire)
+        pool.release('x')
+        self.assertEqual(pool.acquire(), 'x')
+
+    def test_borrow(self):
+        pool = atomic.ObjectPool(dict, 4)
+        with pool.borrow() as d:
+            d['x'] = 1
+            self.assertEqual(len(pool), 0)
+        self.assertEqual(len(pool), 1)
+        with pool.borrow() as d2:
+            self.assertIs(d2, d)
+
+        lease = pool.borrow()
+        self.assertRaises(RuntimeError, lease.__exit__, None, None, None)
+        with self.assertRaises(KeyError):
+            with lease as d3:
+                raise KeyError
+        self.assertEqual(len(pool), 1)
+        with lease:
+            self.assertRaises(RuntimeError, lease.__enter__)
+        self.assertRaises(TypeError, type(lease))
+
+    def test_module_instances(self):
+        # Each module instance owns its lease type, which lives as long as
+        # the pools created from it.
+        spec = importlib.util.find_spec('atomic')
+        module = importlib.util.module_from_spec(spec)
+        spec.loader.exec_module(module)
+        pool = module.ObjectPool(list, 1)
+        wr = weakref.ref(module)
+        del module
+        gc.collect()
+        with pool.borrow() as obj:
+            self.assertEqual(obj, [])
+        with atomic.ObjectPool(list, 1).borrow() as obj:
+            self.assertEqual(obj, [])
+        self.assertIsNotNone(wr())
+        del pool
+        gc.collect()
+        self.assertIsNone(wr())
+
+    def test_threads(self):
+        pool = atomic.ObjectPool(list, 4)
+        errors = []
+
+        def worker():
+            for _ in range(2000):
+                with pool.borrow() as buf:
+                    if buf:
+                        errors.append(buf)
+                    buf.append(1)
+                    buf.clear()
+
+        threads = [threading.Thread(target=worker) for _ in range(4)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(errors, [])
+        self.assertLessEqual(len(pool), 4)
+
+
+if __name__ == '__main__':
+    unittest.main()
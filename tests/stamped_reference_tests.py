@@ -0,0 +1,119 @@
+import gc
+import sys
+import threading
+import unittest
+import weakref
+
+import atomic
+
+
+class TestAtomicStampedReference(unittest.TestCase):
+    def test_init(self):
+        o = atomic.StampedReference()
+        self.assertEqual(o.get(), (None, 0))
+
+        d = {}
+        o = atomic.StampedReference(d, 5)
+        self.assertEqual(o.get(), (d, 5))
+        self.assertIs(o.get_reference(), d)
+        self.assertEqual(o.get_stamp(), 5)
+
+        o = atomic.StampedReference(stamp=(1 << 64) - 1)
+        self.assertEqual(o.get_stamp(), (1 << 64) - 1)
+        self.assertRaises(OverflowError, atomic.StampedReference, None, -1)
+        self.assertRaises(OverflowError, atomic.StampedReference, None,
+                          1 << 64)
+        self.assertEqual(atomic.StampedReference.__new__(
+            atomic.StampedReference).get(), (None, 0))
+
+    def test_set(self):
+        d = {}
+        o = atomic.StampedReference()
+        o.set(d, 3)
+        self.assertEqual(o.get(), (d, 3))
+        self.assertRaises(TypeError, o.set, d)
+        self.assertRaises(TypeError, o.set, d, 'a')
+
+    def test_compare_and_set(self):
+        d1 = {}
+        d2 = {}
+        o = atomic.StampedReference(d1, 0)
+
+        self.assertTrue(o.compare_and_set(d1, d2, 0, 1))
+        self.assertEqual(o.get(), (d2, 1))
+        self.assertFalse(o.compare_and_set(d1, d2, 1, 2))
+        self.assertFalse(o.compare_and_set(d2, d1, 0, 2))
+        self.assertEqual(o.get(), (d2, 1))
+
+        # ABA: the reference is back but the stamp moved on.
+        self.assertTrue(o.compare_and_set(d2, d1, 1, 2))
+        self.assertTrue(o.compare_and_set(d1, d2, 2, 3))
+        self.assertFalse(o.compare_and_set(d2, d1, 1, 4))
+        self.assertTrue(o.weak_compare_and_set(d2, d1, 3, 4,
+                                               order=atomic.ACQ_REL))
+        self.assertEqual(o.get(), (d1, 4))
+
+    def test_compare_and_set_refcount(self):
+        d1 = {}
+        d2 = {}
+        o = atomic.StampedReference(d1, 0)
+        refcounts = sys.getrefcount(d1), sys.getrefcount(d2)
+
+        self.assertFalse(o.compare_and_set(d1, d2, 1, 1))
+        self.assertEqual((sys.getrefcount(d1), sys.getrefcount(d2)), refcounts)
+
+        self.assertTrue(o.compare_and_set(d1, d2, 0, 1))
+        self.assertEqual(sys.getrefcount(d1), refcounts[0] - 1)
+        self.assertEqual(sys.getrefcount(d2), refcounts[1] + 1)
+
+    def test_attempt_stamp(self):
+        d = {}
+        o = atomic.StampedReference(d, 1)
+        self.assertTrue(o.attempt_stamp(d, 7))
+        self.assertEqual(o.get(), (d, 7))
+        self.assertFalse(o.attempt_stamp({}, 8))
+        self.assertEqual(o.get(), (d, 7))
+
+    def test_order(self):
+        o = atomic.StampedReference()
+        self.assertEqual(o.get(order=atomic.ACQUIRE), (None, 0))
+        self.assertRaises(ValueError, o.get, order=atomic.RELEASE)
+        self.assertRaises(ValueError, o.set, None, 1, order=atomic.ACQUIRE)
+
+    def test_repr(self):
+        o = atomic.StampedReference(None, 3)
+        self.assertEqual(repr(o), 'atomic.StampedReference(None, 3)')
+
+    def test_reference_cycle_collected(self):
+        class Node:
+            pass
+
+        n = Node()
+        n.ref = atomic.StampedReference(n, 1)
+        r = weakref.ref(n)
+        del n
+        gc.collect()
+        self.assertIsNone(r())
+
+    def test_concurrent_increment(self):
+        # Every increment is a compare_and_set on (object, stamp).
+        o = atomic.StampedReference(0, 0)
+        n, nthreads = 2000, 4
+
+        def worker():
+            for _ in range(n):
+                while True:
+                    value, stamp = o.get()
+                    if o.compare_and_set(value, value + 1, stamp, stamp + 1):
+                        break
+
+        threads = [threading.Thread(target=worker) for _ in range(nthreads)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(o.get_stamp(), n * nthreads)
+
+
+if __name__ == '__main__':
+    unittest.main()